@@ -0,0 +1,112 @@
+#include "bench-common.h"
+#include "importer-prometheus-client.h"
+
+// ---------------------------------------------------------------------------
+// allocation counting
+
+bool bench_count_allocations = true;
+__thread bool bench_ignore_allocations = false;
+
+static size_t allocations = 0;
+static size_t allocated_bytes = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static inline void record_allocation(size_t size)
+{
+    if (bench_count_allocations && !bench_ignore_allocations) {
+        __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&allocated_bytes, size, __ATOMIC_RELAXED);
+    }
+}
+
+void *malloc(size_t size)
+{
+    record_allocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    record_allocation(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    record_allocation(size);
+    return __libc_realloc(p, size);
+}
+
+bool bench_allocations_supported()
+{
+    return bench_count_allocations;
+}
+#else
+bool bench_allocations_supported()
+{
+    return false;
+}
+#endif
+
+void bench_allocations_snapshot(bench_allocations_t *snapshot)
+{
+    snapshot->count = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    snapshot->bytes = __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED);
+}
+
+// ---------------------------------------------------------------------------
+// null prometheus backend
+
+bench_stage_counters_t bench_stage_counters;
+
+#define ADD_COUNTER(name, value) __atomic_add_fetch(&bench_stage_counters.name, (size_t)(value), __ATOMIC_RELAXED)
+
+static void add_seconds(double *p, double value)
+{
+    double old, new;
+    __atomic_load(p, &old, __ATOMIC_RELAXED);
+    do {
+        new = old + value;
+    } while (!__atomic_compare_exchange(p, &old, &new, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void importer_prometheus_client_init(const char* address, importer_prometheus_client_params_t params) {}
+void importer_prometheus_client_shutdown() {}
+
+void importer_prometheus_client_count_updates(double value) { ADD_COUNTER(updates, value); }
+void importer_prometheus_client_count_inserts(double value) { ADD_COUNTER(inserts, value); }
+void importer_prometheus_client_count_msgs_missed(double value) { ADD_COUNTER(msgs_missed, value); }
+void importer_prometheus_client_count_msgs_received(double value) { ADD_COUNTER(msgs_received, value); }
+void importer_prometheus_client_count_bytes_received(double value) { ADD_COUNTER(bytes_received, value); }
+void importer_prometheus_client_count_msgs_dropped(double value) { ADD_COUNTER(msgs_dropped, value); }
+void importer_prometheus_client_count_msgs_blocked(double value) { ADD_COUNTER(msgs_blocked, value); }
+void importer_prometheus_client_count_msgs_parsed(double value) { ADD_COUNTER(msgs_parsed, value); }
+void importer_prometheus_client_count_updates_blocked(double value) { ADD_COUNTER(updates_blocked, value); }
+void importer_prometheus_client_count_inserts_failed(double value) { ADD_COUNTER(inserts_failed, value); }
+void importer_prometheus_client_gauge_queued_inserts(double value) {}
+void importer_prometheus_client_gauge_queued_updates(double value) {}
+void importer_prometheus_client_gauge_queued_inserts_limit(double value) {}
+void importer_prometheus_client_record_insert_spool(double messages, double bytes, double age) {}
+void importer_prometheus_client_count_inserts_spooled(double value) {}
+void importer_prometheus_client_count_live_stream_msgs(const char *kind, double value) {}
+void importer_prometheus_client_record_index_jobs(const char *day, double pending, double running) {}
+void importer_prometheus_client_count_index_jobs(const char *result, double value) {}
+void importer_prometheus_client_record_mongo_pool(int db, double ops, double op_seconds, double wait_seconds, double in_flight, double waiting, double deferred) {}
+void importer_prometheus_client_count_inserts_dropped(double value) {}
+void importer_prometheus_client_time_inserts(double value) { add_seconds(&bench_stage_counters.insert_seconds, value); }
+void importer_prometheus_client_time_updates(double value) { add_seconds(&bench_stage_counters.update_seconds, value); }
+double importer_prometheus_client_record_rusage_subscriber(uint i) { return 0; }
+double importer_prometheus_client_record_rusage_parser(uint i) { return 0; }
+double importer_prometheus_client_record_rusage_writer(uint i) { return 0; }
+double importer_prometheus_client_record_rusage_updater(uint i) { return 0; }
+
+void importer_prometheus_client_create_stream_counters(stream_info_t *stream) {}
+void importer_prometheus_client_destroy_stream_counters(stream_info_t *stream) {}
+void importer_prometheus_client_count_inserts_for_stream(stream_info_t *stream, double value) {}
+void importer_prometheus_client_count_throttled_inserts_for_stream(stream_info_t *stream, double value) {}
+void importer_prometheus_client_record_device_sequence_number(uint32_t id, const char *device, uint64_t n) {}
+void importer_prometheus_client_count_clamped_keys(const char *stream, const char *kind, double value) {}
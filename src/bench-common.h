@@ -0,0 +1,48 @@
+#ifndef __LOGJAM_BENCH_COMMON_H_INCLUDED__
+#define __LOGJAM_BENCH_COMMON_H_INCLUDED__
+
+#include "importer-common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Support code shared by the benchmark programs: allocation counting and a prometheus
+// client which only accumulates the importer's stage counters in memory. The globals
+// normally defined by logjam-importer.c are in importer-stubs.c.
+
+// allocations are counted by interposing malloc, calloc and realloc (glibc only)
+typedef struct {
+    size_t count;
+    size_t bytes;
+} bench_allocations_t;
+
+extern bool bench_count_allocations;
+// allocations made by the current thread are not counted while this is set
+extern __thread bool bench_ignore_allocations;
+
+extern bool bench_allocations_supported();
+extern void bench_allocations_snapshot(bench_allocations_t *snapshot);
+
+typedef struct {
+    size_t msgs_received;
+    size_t bytes_received;
+    size_t msgs_missed;
+    size_t msgs_dropped;
+    size_t msgs_blocked;
+    size_t msgs_parsed;
+    size_t inserts;
+    size_t inserts_failed;
+    size_t updates;
+    size_t updates_blocked;
+    double insert_seconds;
+    double update_seconds;
+} bench_stage_counters_t;
+
+extern bench_stage_counters_t bench_stage_counters;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,651 @@
+#include "bench-common.h"
+#include "importer-controller.h"
+#include "importer-resources.h"
+#include "importer-mongoutils.h"
+#include "importer-prometheus-client.h"
+#include <getopt.h>
+#include <sys/resource.h>
+
+/*
+ * connections: "o" = bind, "[<>v^]" = connect
+ *
+ *  feeder  PUSH  >----------o  inproc://subscriber-pull  subscriber -> parsers -> writers/updaters
+ *
+ */
+
+// Runs the importer pipeline in process: all actors are started exactly as in
+// logjam-importer, but requests are taken from a dump file held in memory and pushed into
+// the subscriber over inproc. Mongo is never touched (dryrun) and the prometheus client
+// is replaced by the one in bench-common.c, which only accumulates the per stage counters
+// for the final report. The controller tick callback starts the feeder, collects tick
+// durations and stops the controller once the pipeline has been drained.
+
+static const char *config_file_name = "logjam.conf";
+static const char *corpus_file_name = "logjam-stream.dump";
+static const char *json_file_name = NULL;
+static char *streams_url = NULL;
+static char streams_file_name[] = "/tmp/bench-importer-streams-XXXXXX";
+static bool remove_streams_file = false;
+
+static size_t io_threads = 1;
+static size_t total_messages = 0;
+static size_t messages_per_second = 0;
+static int max_seconds = 300;
+
+static char* num_parsers_arg_value = NULL;
+static char* num_updaters_arg_value = NULL;
+static char* num_writers_arg_value = NULL;
+
+// ---------------------------------------------------------------------------
+// corpus
+
+typedef struct {
+    zframe_t *frames[3];
+    msg_meta_t meta;
+    size_t bytes;
+} corpus_msg_t;
+
+static corpus_msg_t *corpus = NULL;
+static size_t corpus_size = 0;
+static size_t corpus_bytes = 0;
+
+static void load_corpus()
+{
+    FILE *file = fopen(corpus_file_name, "r");
+    if (!file) {
+        fprintf(stderr, "[E] could not open corpus file %s: %s\n", corpus_file_name, strerror(errno));
+        exit(1);
+    }
+    size_t capacity = 1024;
+    corpus = zmalloc(capacity * sizeof(corpus_msg_t));
+    zmsg_t *msg;
+    size_t skipped = 0;
+    while ((msg = zmsg_loadx(NULL, file))) {
+        msg_meta_t meta;
+        if (zmsg_size(msg) != 4 || !msg_extract_meta_info(msg, &meta)) {
+            skipped++;
+            zmsg_destroy(&msg);
+            continue;
+        }
+        if (corpus_size == capacity) {
+            capacity *= 2;
+            corpus = realloc(corpus, capacity * sizeof(corpus_msg_t));
+            assert(corpus);
+        }
+        corpus_msg_t *m = &corpus[corpus_size++];
+        m->meta = meta;
+        m->bytes = 0;
+        for (int i = 0; i < 3; i++) {
+            m->frames[i] = zmsg_pop(msg);
+            m->bytes += zframe_size(m->frames[i]);
+        }
+        corpus_bytes += m->bytes;
+        zmsg_destroy(&msg);
+    }
+    fclose(file);
+    if (corpus_size == 0) {
+        fprintf(stderr, "[E] corpus file %s contains no logjam messages\n", corpus_file_name);
+        exit(1);
+    }
+    if (skipped && !quiet)
+        printf("[W] bench: skipped %zu malformed messages in %s\n", skipped, corpus_file_name);
+    if (!quiet)
+        printf("[I] bench: loaded %zu messages (%.2f MB) from %s\n", corpus_size, (double)corpus_bytes / 1048576, corpus_file_name);
+}
+
+static void destroy_corpus()
+{
+    for (size_t i = 0; i < corpus_size; i++)
+        for (int j = 0; j < 3; j++)
+            zframe_destroy(&corpus[i].frames[j]);
+    free(corpus);
+}
+
+// the importer only accepts messages for known streams, so we make every stream found in
+// the corpus known, unless a stream config has been given on the command line
+static void write_streams_file()
+{
+    zhash_t *app_envs = zhash_new();
+    for (size_t i = 0; i < corpus_size; i++) {
+        char *app_env = zframe_strdup(corpus[i].frames[0]);
+        zhash_insert(app_envs, app_env, (void*)1);
+        free(app_env);
+    }
+    json_object *streams = json_object_new_object();
+    zlist_t *keys = zhash_keys(app_envs);
+    for (const char *key = zlist_first(keys); key; key = zlist_next(keys))
+        json_object_object_add(streams, key, json_object_new_object());
+    zlist_destroy(&keys);
+    zhash_destroy(&app_envs);
+
+    int fd = mkstemp(streams_file_name);
+    if (fd == -1) {
+        fprintf(stderr, "[E] could not create stream config file: %s\n", strerror(errno));
+        exit(1);
+    }
+    close(fd);
+    int rc = json_object_to_file(streams_file_name, streams);
+    assert(rc == 0);
+    json_object_put(streams);
+    remove_streams_file = true;
+
+    rc = asprintf(&streams_url, "file://%s", streams_file_name);
+    assert(rc != -1);
+}
+
+// ---------------------------------------------------------------------------
+// feeder
+
+static zactor_t *feeder_actor = NULL;
+static bool feeding_done = false;
+static size_t messages_fed = 0;
+static int64_t feed_start_ms = 0;
+static int64_t feed_end_ms = 0;
+
+// returns false if the feeder has been asked to terminate
+static bool feeder_check_pipe(zpoller_t *poller, zsock_t *pipe)
+{
+    if (zpoller_wait(poller, 0) == pipe) {
+        char *cmd = zstr_recv(pipe);
+        bool terminate = !cmd || streq(cmd, "$TERM");
+        free(cmd);
+        return !terminate;
+    }
+    return !zsys_interrupted;
+}
+
+static
+void feeder(zsock_t *pipe, void *args)
+{
+    set_thread_name("feeder[0]");
+    // allocations made by the feeder are not part of the pipeline cost
+    bench_ignore_allocations = true;
+
+    zsock_t *socket = zsock_new(ZMQ_PUSH);
+    assert(socket);
+    zsock_set_sndhwm(socket, 100000);
+    zsock_set_sndtimeo(socket, 100);
+    int rc = zsock_connect(socket, "inproc://subscriber-pull");
+    assert(rc == 0);
+
+    zpoller_t *poller = zpoller_new(pipe, NULL);
+    assert(poller);
+
+    zsock_signal(pipe, 0);
+
+    __atomic_store_n(&feed_start_ms, zclock_mono(), __ATOMIC_SEQ_CST);
+    int64_t start_usecs = zclock_usecs();
+    bool running = true;
+    size_t n = 0;
+
+    while (running && n < total_messages) {
+        corpus_msg_t *m = &corpus[n % corpus_size];
+        zmq_msg_t parts[3];
+        for (int i = 0; i < 3; i++)
+            zmq_msg_init_data(&parts[i], zframe_data(m->frames[i]), zframe_size(m->frames[i]), NULL, NULL);
+        msg_meta_t meta = m->meta;
+        // device 0 is not tracked for gaps, so cycling the corpus doesn't produce noise
+        meta.device_number = 0;
+        meta.sequence_number = n + 1;
+
+        do {
+            rc = publish_on_zmq_transport(parts, zsock_resolve(socket), &meta, 0);
+        } while (rc == -1 && errno == EAGAIN && (running = feeder_check_pipe(poller, pipe)));
+
+        for (int i = 0; i < 3; i++)
+            zmq_msg_close(&parts[i]);
+        if (rc == -1)
+            break;
+        __atomic_store_n(&messages_fed, ++n, __ATOMIC_RELAXED);
+
+        if (messages_per_second) {
+            int64_t due = start_usecs + (int64_t)(n * 1000000.0 / messages_per_second);
+            int64_t now = zclock_usecs();
+            if (due - now > 50)
+                usleep(due - now);
+        }
+        if (n % 1000 == 0)
+            running = feeder_check_pipe(poller, pipe);
+    }
+
+    __atomic_store_n(&feed_end_ms, zclock_mono(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&feeding_done, true, __ATOMIC_SEQ_CST);
+    if (!quiet)
+        printf("[I] feeder: sent %zu messages\n", n);
+
+    // wait for the termination command
+    while (running && !zsys_interrupted) {
+        char *cmd = zstr_recv(pipe);
+        running = cmd && !streq(cmd, "$TERM");
+        free(cmd);
+    }
+
+    zpoller_destroy(&poller);
+    zsock_destroy(&socket);
+}
+
+// ---------------------------------------------------------------------------
+// controller tick callback
+
+static int *tick_durations = NULL;
+static size_t tick_count = 0;
+static size_t tick_capacity = 0;
+static size_t drained_ticks = 0;
+static bool completed = false;
+static int64_t drain_end_ms = 0;
+static bench_allocations_t allocations_at_start;
+static bench_allocations_t allocations_at_end;
+
+static void record_end_of_run(bool drained)
+{
+    completed = drained;
+    drain_end_ms = zclock_mono();
+    bench_allocations_snapshot(&allocations_at_end);
+    if (feed_end_ms == 0)
+        feed_end_ms = drain_end_ms;
+}
+
+static void stop_benchmark(bool drained)
+{
+    record_end_of_run(drained);
+    zactor_destroy(&feeder_actor);
+    // makes the controller loop terminate
+    zsys_interrupted = 1;
+}
+
+static void bench_tick(controller_tick_info_t *info)
+{
+    if (feeder_actor == NULL && drain_end_ms == 0) {
+        bench_allocations_snapshot(&allocations_at_start);
+        feeder_actor = zactor_new(feeder, NULL);
+        assert(feeder_actor);
+        return;
+    }
+
+    if (tick_count == tick_capacity) {
+        tick_capacity = tick_capacity ? 2 * tick_capacity : 256;
+        tick_durations = realloc(tick_durations, tick_capacity * sizeof(int));
+        assert(tick_durations);
+    }
+    tick_durations[tick_count++] = info->runtime_ms;
+
+    if (zclock_mono() - feed_start_ms > max_seconds * 1000) {
+        fprintf(stderr, "[W] bench: pipeline not drained after %d seconds, giving up\n", max_seconds);
+        stop_benchmark(false);
+        return;
+    }
+
+    // the pipeline is drained when every message sent has been parsed and all
+    // queues are empty. updaters only receive work every DATABASE_UPDATE_INTERVAL
+    // ticks, so we wait a little longer before declaring victory.
+    bool idle = __atomic_load_n(&feeding_done, __ATOMIC_SEQ_CST)
+        && __atomic_load_n(&bench_stage_counters.msgs_parsed, __ATOMIC_RELAXED) >= __atomic_load_n(&messages_fed, __ATOMIC_RELAXED)
+        && info->queued_inserts == 0 && info->queued_updates == 0;
+    drained_ticks = idle ? drained_ticks + 1 : 0;
+    if (drained_ticks > DATABASE_UPDATE_INTERVAL)
+        stop_benchmark(true);
+}
+
+// ---------------------------------------------------------------------------
+// report
+
+static int compare_ints(const void *a, const void *b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+static int tick_percentile(int *sorted, double p)
+{
+    if (tick_count == 0)
+        return 0;
+    size_t i = (size_t)(p * (tick_count - 1) + 0.5);
+    return sorted[i];
+}
+
+static json_object* stage_json(size_t count, double seconds)
+{
+    json_object *stage = json_object_new_object();
+    json_object_object_add(stage, "count", json_object_new_int64(count));
+    json_object_object_add(stage, "per_second", json_object_new_double(seconds > 0 ? count / seconds : 0));
+    return stage;
+}
+
+static json_object* build_report()
+{
+    double feed_seconds = (feed_end_ms - feed_start_ms) / 1000.0;
+    double total_seconds = (drain_end_ms - feed_start_ms) / 1000.0;
+    size_t n = messages_fed;
+
+    json_object *report = json_object_new_object();
+    json_object_object_add(report, "completed", json_object_new_boolean(completed));
+
+    json_object *setup = json_object_new_object();
+    json_object_object_add(setup, "corpus", json_object_new_string(corpus_file_name));
+    json_object_object_add(setup, "corpus_messages", json_object_new_int64(corpus_size));
+    json_object_object_add(setup, "corpus_bytes", json_object_new_int64(corpus_bytes));
+    json_object_object_add(setup, "messages", json_object_new_int64(n));
+    json_object_object_add(setup, "rate_limit", json_object_new_int64(messages_per_second));
+    json_object_object_add(setup, "parsers", json_object_new_int64(num_parsers));
+    json_object_object_add(setup, "writers", json_object_new_int64(num_writers));
+    json_object_object_add(setup, "updaters", json_object_new_int64(num_updaters));
+    json_object_object_add(report, "setup", setup);
+
+    json_object_object_add(report, "feed_seconds", json_object_new_double(feed_seconds));
+    json_object_object_add(report, "total_seconds", json_object_new_double(total_seconds));
+
+    json_object *stages = json_object_new_object();
+    json_object_object_add(stages, "fed", stage_json(n, total_seconds));
+    json_object_object_add(stages, "received", stage_json(bench_stage_counters.msgs_received, total_seconds));
+    json_object_object_add(stages, "parsed", stage_json(bench_stage_counters.msgs_parsed, total_seconds));
+    json_object_object_add(stages, "inserts", stage_json(bench_stage_counters.inserts, total_seconds));
+    json_object_object_add(stages, "updates", stage_json(bench_stage_counters.updates, total_seconds));
+    json_object_object_add(stages, "dropped", stage_json(bench_stage_counters.msgs_dropped, total_seconds));
+    json_object_object_add(stages, "blocked", stage_json(bench_stage_counters.msgs_blocked, total_seconds));
+    json_object_object_add(stages, "updates_blocked", stage_json(bench_stage_counters.updates_blocked, total_seconds));
+    json_object_object_add(stages, "mb_received", json_object_new_double((double)bench_stage_counters.bytes_received / 1048576));
+    json_object_object_add(stages, "insert_seconds", json_object_new_double(bench_stage_counters.insert_seconds));
+    json_object_object_add(stages, "update_seconds", json_object_new_double(bench_stage_counters.update_seconds));
+    json_object_object_add(report, "stages", stages);
+
+    int *sorted = zmalloc((tick_count + 1) * sizeof(int));
+    memcpy(sorted, tick_durations, tick_count * sizeof(int));
+    qsort(sorted, tick_count, sizeof(int), compare_ints);
+    long sum = 0;
+    for (size_t i = 0; i < tick_count; i++)
+        sum += sorted[i];
+    json_object *ticks = json_object_new_object();
+    json_object_object_add(ticks, "count", json_object_new_int64(tick_count));
+    json_object_object_add(ticks, "min_ms", json_object_new_int(tick_count ? sorted[0] : 0));
+    json_object_object_add(ticks, "avg_ms", json_object_new_double(tick_count ? (double)sum / tick_count : 0));
+    json_object_object_add(ticks, "p50_ms", json_object_new_int(tick_percentile(sorted, 0.5)));
+    json_object_object_add(ticks, "p99_ms", json_object_new_int(tick_percentile(sorted, 0.99)));
+    json_object_object_add(ticks, "max_ms", json_object_new_int(tick_count ? sorted[tick_count-1] : 0));
+    json_object_object_add(report, "ticks", ticks);
+    free(sorted);
+
+    json_object *allocs = json_object_new_object();
+    bool counted = bench_allocations_supported();
+    size_t allocs_total = allocations_at_end.count - allocations_at_start.count;
+    size_t bytes_total = allocations_at_end.bytes - allocations_at_start.bytes;
+    json_object_object_add(allocs, "counted", json_object_new_boolean(counted));
+    json_object_object_add(allocs, "total", json_object_new_int64(allocs_total));
+    json_object_object_add(allocs, "per_message", json_object_new_double(n ? (double)allocs_total / n : 0));
+    json_object_object_add(allocs, "bytes_per_message", json_object_new_double(n ? (double)bytes_total / n : 0));
+    json_object_object_add(report, "allocations", allocs);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    json_object_object_add(report, "peak_rss_kb", json_object_new_int64(usage.ru_maxrss));
+    json_object_object_add(report, "user_cpu_seconds", json_object_new_double(usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6));
+    json_object_object_add(report, "system_cpu_seconds", json_object_new_double(usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6));
+
+    return report;
+}
+
+static void print_report(json_object *report)
+{
+    json_object *o, *stages, *ticks, *allocs;
+    json_object_object_get_ex(report, "stages", &stages);
+    json_object_object_get_ex(report, "ticks", &ticks);
+    json_object_object_get_ex(report, "allocations", &allocs);
+
+#define GET_INT(obj, key) (json_object_object_get_ex(obj, key, &o) ? json_object_get_int64(o) : 0)
+#define GET_DOUBLE(obj, key) (json_object_object_get_ex(obj, key, &o) ? json_object_get_double(o) : 0)
+
+    printf("\n[I] bench: %s after %.2f seconds (feeding took %.2f seconds)\n",
+           completed ? "pipeline drained" : "INCOMPLETE RUN",
+           GET_DOUBLE(report, "total_seconds"), GET_DOUBLE(report, "feed_seconds"));
+    const char *stage_names[] = {"fed", "received", "parsed", "inserts", "updates", "dropped", "blocked", "updates_blocked"};
+    for (size_t i = 0; i < sizeof(stage_names)/sizeof(stage_names[0]); i++) {
+        json_object *stage;
+        json_object_object_get_ex(stages, stage_names[i], &stage);
+        printf("[I] bench: %-16s %10" PRId64 " (%10.1f/s)\n", stage_names[i], GET_INT(stage, "count"), GET_DOUBLE(stage, "per_second"));
+    }
+    printf("[I] bench: ticks: %" PRId64 ", min/avg/p50/p99/max: %" PRId64 "/%.1f/%" PRId64 "/%" PRId64 "/%" PRId64 " ms\n",
+           GET_INT(ticks, "count"), GET_INT(ticks, "min_ms"), GET_DOUBLE(ticks, "avg_ms"),
+           GET_INT(ticks, "p50_ms"), GET_INT(ticks, "p99_ms"), GET_INT(ticks, "max_ms"));
+    if (json_object_object_get_ex(allocs, "counted", &o) && json_object_get_boolean(o))
+        printf("[I] bench: allocations: %" PRId64 " (%.1f/msg, %.1f bytes/msg)\n",
+               GET_INT(allocs, "total"), GET_DOUBLE(allocs, "per_message"), GET_DOUBLE(allocs, "bytes_per_message"));
+    printf("[I] bench: peak rss: %.1f MB\n", GET_INT(report, "peak_rss_kb") / 1024.0);
+
+#undef GET_INT
+#undef GET_DOUBLE
+}
+
+static void write_report(json_object *report)
+{
+    const char *text = json_object_to_json_string_ext(report, JSON_C_TO_STRING_PRETTY);
+    if (streq(json_file_name, "-")) {
+        printf("%s\n", text);
+        return;
+    }
+    FILE *file = fopen(json_file_name, "w");
+    if (!file) {
+        fprintf(stderr, "[E] could not open report file %s: %s\n", json_file_name, strerror(errno));
+        return;
+    }
+    fprintf(file, "%s\n", text);
+    fclose(file);
+}
+
+// ---------------------------------------------------------------------------
+
+static void setup_thread_counts(zconfig_t* config)
+{
+    num_subscribers = 1;
+
+    if (!num_parsers_arg_value)
+        num_parsers_arg_value = zconfig_resolve(config, "frontend/threads/parsers", NULL);
+    if (num_parsers_arg_value)
+        num_parsers = strtoul(num_parsers_arg_value, NULL, 0);
+
+    if (!num_updaters_arg_value)
+        num_updaters_arg_value = zconfig_resolve(config, "frontend/threads/updaters", NULL);
+    if (num_updaters_arg_value)
+        num_updaters = strtoul(num_updaters_arg_value, NULL, 0);
+
+    if (!num_writers_arg_value)
+        num_writers_arg_value = zconfig_resolve(config, "frontend/threads/writers", NULL);
+    if (num_writers_arg_value)
+        num_writers = strtoul(num_writers_arg_value, NULL, 0);
+}
+
+void print_usage(char * const *argv)
+{
+    fprintf(stderr,
+            "usage: %s [options] [corpus-file]\n"
+            "\nOptions:\n"
+            "  -c, --config C             zeromq config file\n"
+            "  -i, --io-threads N         zeromq io threads\n"
+            "  -j, --json F               write report as JSON to file F (- means stdout)\n"
+            "  -n, --messages N           number of messages to feed (default: corpus size)\n"
+            "  -r, --rate N               feed at most N messages per second (default: unlimited)\n"
+            "  -t, --timeout N            give up after N seconds (default: 300)\n"
+            "  -p, --parsers N            number of parser threads\n"
+            "  -u, --updaters N           number of db stats updater threads\n"
+            "  -w, --writers N            number of db request writer threads\n"
+            "  -L, --streams-url U        stream config to use, e.g. file:///tmp/streams.json\n"
+            "  -A, --no-alloc-count       don't count allocations\n"
+            "  -q, --quiet                supress most output\n"
+            "  -v, --verbose              log more (use -vv for debug output)\n"
+            "      --help                 display this message\n"
+            "\nThe corpus file must be in logjam-dump format (default: %s).\n"
+            , argv[0], corpus_file_name);
+}
+
+void process_arguments(int argc, char * const *argv)
+{
+    char c;
+    int longindex = 0;
+    opterr = 0;
+
+    static struct option long_options[] = {
+        { "config",           required_argument, 0, 'c' },
+        { "help",             no_argument,       0,  0  },
+        { "io-threads",       required_argument, 0, 'i' },
+        { "json",             required_argument, 0, 'j' },
+        { "messages",         required_argument, 0, 'n' },
+        { "no-alloc-count",   no_argument,       0, 'A' },
+        { "parsers",          required_argument, 0, 'p' },
+        { "quiet",            no_argument,       0, 'q' },
+        { "rate",             required_argument, 0, 'r' },
+        { "streams-url",      required_argument, 0, 'L' },
+        { "timeout",          required_argument, 0, 't' },
+        { "updaters",         required_argument, 0, 'u' },
+        { "verbose",          no_argument,       0, 'v' },
+        { "writers",          required_argument, 0, 'w' },
+        { 0,                  0,                 0,  0  }
+    };
+
+    while ((c = getopt_long(argc, argv, "c:i:j:n:Ap:qr:L:t:u:vw:", long_options, &longindex)) != -1) {
+        switch (c) {
+        case 'v':
+            if (verbose)
+                debug = true;
+            else
+                verbose = true;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case 'c':
+            config_file_name = optarg;
+            break;
+        case 'i':
+            io_threads = atoi(optarg);
+            break;
+        case 'j':
+            json_file_name = optarg;
+            break;
+        case 'n':
+            total_messages = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            messages_per_second = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            max_seconds = atoi(optarg);
+            break;
+        case 'A':
+            bench_count_allocations = false;
+            break;
+        case 'L':
+            streams_url = optarg;
+            break;
+        case 'p': {
+            unsigned long n = strtoul(optarg, NULL, 0);
+            if (n <= MAX_PARSERS)
+                num_parsers_arg_value = strdup(optarg);
+            else {
+                fprintf(stderr, "[E] parameter value 'p' cannot be larger than %d\n", MAX_PARSERS);
+                exit(1);
+            }
+            break;
+        }
+        case 'u': {
+            unsigned long n = strtoul(optarg, NULL, 0);
+            if (n <= MAX_UPDATERS)
+                num_updaters_arg_value = strdup(optarg);
+            else {
+                fprintf(stderr, "[E] parameter value 'u' cannot be larger than %d\n", MAX_UPDATERS);
+                exit(1);
+            }
+            break;
+        }
+        case 'w': {
+            unsigned long n = strtoul(optarg, NULL, 0);
+            if (n <= MAX_WRITERS)
+                num_writers_arg_value = strdup(optarg);
+            else {
+                fprintf(stderr, "[E] parameter value 'w' cannot be larger than %d\n", MAX_WRITERS);
+                exit(1);
+            }
+            break;
+        }
+        case 0:
+            print_usage(argv);
+            exit(0);
+            break;
+        case '?':
+            if (strchr("cijnprLtuw", optopt))
+                fprintf(stderr, "[E] option -%c requires an argument.\n", optopt);
+            else if (isprint (optopt))
+                fprintf(stderr, "[E] unknown option `-%c'.\n", optopt);
+            else
+                fprintf(stderr, "[E] unknown option character `\\x%x'.\n", optopt);
+            print_usage(argv);
+            exit(1);
+        default:
+            fprintf(stderr, "BUG: can't process option -%c\n", optopt);
+            exit(1);
+        }
+    }
+
+    if (optind < argc)
+        corpus_file_name = argv[optind];
+
+    if (streams_url && strncmp(streams_url, "file://", 7)) {
+        fprintf(stderr, "[E] stream config must be given as a file:// url\n");
+        exit(1);
+    }
+}
+
+int main(int argc, char * const *argv)
+{
+    // don't buffer stdout and stderr
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    setvbuf(stderr, NULL, _IOLBF, 0);
+
+    process_arguments(argc, argv);
+
+    // the importer must never talk to a database
+    dryrun = true;
+
+    // verify config file exists
+    if (!zsys_file_exists(config_file_name)) {
+        fprintf(stderr, "[E] missing config file: %s\n", config_file_name);
+        exit(1);
+    }
+    config_file_init(config_file_name);
+    config_update_date_info();
+    zconfig_t* config = zconfig_load((char*)config_file_name);
+
+    load_corpus();
+    if (total_messages == 0)
+        total_messages = corpus_size;
+    if (streams_url == NULL)
+        write_streams_file();
+
+    hosts = zlist_new();
+    setup_thread_counts(config);
+    initialize_mongo_db_globals(config);
+    setup_resource_maps(config);
+
+    if (!quiet)
+        printf("[I] bench: feeding %zu messages to %lu parsers, %lu writers, %lu updaters\n",
+               total_messages, num_parsers, num_writers, num_updaters);
+
+    set_controller_tick_fn(bench_tick);
+    int rc = run_controller_loop(config, io_threads, streams_url, "", 0);
+
+    // interrupted, or the controller failed to start
+    if (drain_end_ms == 0)
+        record_end_of_run(false);
+
+    json_object *report = build_report();
+    print_report(report);
+    if (json_file_name)
+        write_report(report);
+    json_object_put(report);
+
+    if (remove_streams_file)
+        unlink(streams_file_name);
+    free(tick_durations);
+    destroy_corpus();
+    zconfig_destroy(&config);
+
+    if (rc == 0 && !completed)
+        rc = 1;
+    return rc;
+}
@@ -0,0 +1,602 @@
+#include "bench-common.h"
+#include "importer-increments.h"
+#include "importer-processor.h"
+#include "importer-resources.h"
+#include "zring.h"
+#include <getopt.h>
+
+// Microbenchmarks for the functions on the importer's hot path. Each benchmark is run
+// with an increasing number of iterations until a single run takes at least the
+// minimum benchmark time; the last run is reported as time, allocations and allocated
+// bytes per operation. Inputs are taken round robin from a corpus of request bodies
+// (one JSON object per line, e.g. requests extracted from a dump file).
+
+static const char *config_file_name = NULL;
+static const char *corpus_file_name = NULL;
+static const char *json_file_name = NULL;
+static const char *benchmark_filter = NULL;
+static int64_t min_time_ns = 500 * 1000 * 1000;
+static zlist_t *sensitive_cookies = NULL;
+static cookie_masker_t *cookie_masker = NULL;
+
+// used when no metrics are configured (no config file given)
+static const char *default_config =
+    "metrics\n"
+    "    time\n"
+    "        total_time\n"
+    "        gc_time\n"
+    "        other_time\n"
+    "        db_time\n"
+    "        view_time\n"
+    "        api_time\n"
+    "        search_time\n"
+    "        cache_time\n"
+    "    call\n"
+    "        db_calls\n"
+    "        api_calls\n"
+    "        search_calls\n"
+    "        cache_calls\n"
+    "    memory\n"
+    "        allocated_objects\n"
+    "        allocated_bytes\n"
+    "    heap\n"
+    "        heap_size\n"
+    "        live_data_set_size\n"
+    "    frontend\n"
+    "        page_time\n"
+    "        ajax_time\n"
+    "        navigation_time\n"
+    "        connect_time\n"
+    "        request_time\n"
+    "        response_time\n"
+    "        processing_time\n"
+    "        load_time\n"
+    "    dom\n"
+    "        html_nodes\n"
+    "        script_nodes\n"
+    "        style_nodes\n";
+
+// used when no corpus file is given
+static const char *default_corpus[] = {
+    "{\"action\":\"Shop::ProductsController#show\",\"request_id\":\"a0c4d8a5e5a94a6c9b35ad0b5e3c6f01\","
+    "\"started_at\":\"2024-01-01T12:00:00+01:00\",\"started_ms\":1704106800000,\"code\":200,\"severity\":1,"
+    "\"host\":\"app-1\",\"process_id\":4711,\"total_time\":84.5,\"db_time\":12.25,\"view_time\":33.1,"
+    "\"db_calls\":12,\"allocated_objects\":24012,\"allocated_bytes\":1843200,\"heap_size\":6543210,"
+    "\"lines\":[[1,\"2024-01-01T12:00:00.001\",\"Started GET /products/4711 for 10.0.0.1\"],"
+    "[1,\"2024-01-01T12:00:00.050\",\"Rendered products/show.html.erb (33.1ms)\"],"
+    "[1,\"2024-01-01T12:00:00.085\",\"Completed 200 OK in 84ms\"]],"
+    "\"request_info\":{\"method\":\"GET\",\"url\":\"/products/4711\",\"headers\":{\"Accept\":\"text/html\","
+    "\"Cookie\":\"_shop_session=5b7a0c2d9e1f4a8b; remember_token=abcdef0123456789; locale=de\"}}}",
+
+    "{\"action\":\"Api::V1::OrdersController#create\",\"request_id\":\"f1e2d3c4b5a697887766554433221100\","
+    "\"started_at\":\"2024-01-01T12:00:01+01:00\",\"started_ms\":1704106801000,\"code\":500,\"severity\":3,"
+    "\"host\":\"app-2\",\"process_id\":815,\"total_time\":1234.5,\"db_time\":800.0,\"api_time\":300.5,"
+    "\"db_calls\":134,\"api_calls\":3,\"allocated_objects\":310042,\"allocated_bytes\":24117248,"
+    "\"exceptions\":[\"ActiveRecord::StatementInvalid\"],"
+    "\"caller_id\":\"checkout-production-0123456789abcdef0123456789abcdef\",\"caller_action\":\"Checkout::PaymentsController#create\","
+    "\"lines\":[[1,\"2024-01-01T12:00:01.001\",\"Started POST /api/v1/orders for 10.0.0.2\"],"
+    "[3,\"2024-01-01T12:00:02.200\",\"ActiveRecord::StatementInvalid: Mysql2::Error: Lock wait timeout exceeded\"],"
+    "[1,\"2024-01-01T12:00:02.235\",\"Completed 500 Internal Server Error in 1234ms\"]],"
+    "\"request_info\":{\"method\":\"POST\",\"url\":\"/api/v1/orders\",\"headers\":{\"Content-Type\":\"application/json\"}}}",
+
+    "{\"action\":\"Search::ResultsController#index\",\"request_id\":\"0123456789abcdef0123456789abcdef\","
+    "\"started_at\":\"2024-01-01T12:00:02+01:00\",\"started_ms\":1704106802000,\"code\":200,\"severity\":1,"
+    "\"host\":\"app-3\",\"process_id\":1234,\"total_time\":312.0,\"search_time\":201.7,\"cache_time\":2.5,"
+    "\"search_calls\":2,\"cache_calls\":17,\"allocated_objects\":98002,\"allocated_bytes\":7340032,"
+    "\"request_info\":{\"method\":\"GET\",\"url\":\"/search?q=shoes&page=2\",\"headers\":{\"Accept\":\"text/html\","
+    "\"Cookie\":\"_ga=GA1.2.1234567890.1700000000; _shop_session=ffeeddccbbaa9988; cart=3$items; remember_token=0011223344556677\"}}}",
+    NULL
+};
+
+typedef struct {
+    char *json;
+    size_t json_len;
+    json_object *request;
+    const char *page;
+    char *cookie;
+    char *tracker_key;
+    increments_t *increments;
+    zframe_t *compressed[4];
+} corpus_entry_t;
+
+static corpus_entry_t *corpus = NULL;
+static size_t corpus_size = 0;
+static size_t corpus_bytes = 0;
+
+static json_object *results = NULL;
+
+// ---------------------------------------------------------------------------
+// corpus
+
+static void corpus_add(const char *line, size_t len)
+{
+    json_tokener *tokener = json_tokener_new();
+    json_object *request = parse_json_data(line, len, tokener);
+    json_tokener_free(tokener);
+    if (request == NULL || !json_object_is_type(request, json_type_object)) {
+        json_object_put(request);
+        return;
+    }
+    corpus = realloc(corpus, (corpus_size + 1) * sizeof(corpus_entry_t));
+    assert(corpus);
+    corpus_entry_t *e = &corpus[corpus_size++];
+    memset(e, 0, sizeof(*e));
+    e->json = strndup(line, len);
+    e->json_len = len;
+    e->request = request;
+    corpus_bytes += len;
+
+    json_object *obj;
+    e->page = json_object_object_get_ex(request, "action", &obj) ? json_object_get_string(obj) : "Unknown#unknown";
+
+    // requests without cookies get a typical session cookie, so the cookie filter has work to do
+    json_object *request_info, *headers;
+    if (json_object_object_get_ex(request, "request_info", &request_info)
+        && json_object_object_get_ex(request_info, "headers", &headers)
+        && (json_object_object_get_ex(headers, "Cookie", &obj) || json_object_object_get_ex(headers, "cookie", &obj)))
+        e->cookie = strdup(json_object_get_string(obj));
+    else
+        e->cookie = strdup("_ga=GA1.2.1234567890.1700000000; _session=0123456789abcdef; remember_token=fedcba9876543210");
+
+    const char *request_id = json_object_object_get_ex(request, "request_id", &obj) ? json_object_get_string(obj) : "none";
+    int rc = asprintf(&e->tracker_key, "bench-production-%s-%zu", request_id, corpus_size);
+    assert(rc != -1);
+}
+
+static void load_corpus()
+{
+    if (corpus_file_name == NULL) {
+        for (const char **p = default_corpus; *p; p++)
+            corpus_add(*p, strlen(*p));
+        return;
+    }
+    FILE *file = fopen(corpus_file_name, "r");
+    if (!file) {
+        fprintf(stderr, "[E] could not open corpus file %s: %s\n", corpus_file_name, strerror(errno));
+        exit(1);
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t n;
+    while ((n = getline(&line, &capacity, file)) != -1) {
+        while (n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+            line[--n] = '\0';
+        if (n > 0)
+            corpus_add(line, n);
+    }
+    free(line);
+    fclose(file);
+    if (corpus_size == 0) {
+        fprintf(stderr, "[E] corpus file %s contains no JSON objects\n", corpus_file_name);
+        exit(1);
+    }
+}
+
+static void prepare_corpus()
+{
+    zchunk_t *buffer = zchunk_new(NULL, INITIAL_COMPRESSION_BUFFER_SIZE);
+    for (size_t i = 0; i < corpus_size; i++) {
+        corpus_entry_t *e = &corpus[i];
+        e->increments = increments_new();
+        e->increments->backend_request_count = 1;
+        increments_fill_metrics(e->increments, e->request);
+        json_object *obj;
+        double total_time = json_object_object_get_ex(e->request, "total_time", &obj) ? json_object_get_double(obj) : 0;
+        increments_fill_apdex(e->increments, total_time);
+
+        for (int method = ZLIB_COMPRESSION; method <= LZ4_COMPRESSION; method++) {
+            zmq_msg_t msg;
+            compress_message_data(method, buffer, &msg, e->json, e->json_len);
+            e->compressed[method] = zframe_new(zmq_msg_data(&msg), zmq_msg_size(&msg));
+            zmq_msg_close(&msg);
+        }
+    }
+    zchunk_destroy(&buffer);
+}
+
+static void destroy_corpus()
+{
+    for (size_t i = 0; i < corpus_size; i++) {
+        corpus_entry_t *e = &corpus[i];
+        free(e->json);
+        free(e->cookie);
+        free(e->tracker_key);
+        json_object_put(e->request);
+        increments_destroy(e->increments);
+        for (int method = ZLIB_COMPRESSION; method <= LZ4_COMPRESSION; method++)
+            zframe_destroy(&e->compressed[method]);
+    }
+    free(corpus);
+}
+
+// ---------------------------------------------------------------------------
+// benchmarks. each one performs the given number of operations and returns the number of
+// input bytes processed (0 if that's not meaningful).
+
+typedef size_t (bench_fn) (size_t iterations, void *arg);
+
+static zchunk_t *buffer = NULL;
+
+static size_t bench_compress(size_t iterations, void *arg)
+{
+    int method = (int)(size_t)arg;
+    size_t bytes = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        corpus_entry_t *e = &corpus[i % corpus_size];
+        zmq_msg_t msg;
+        compress_message_data(method, buffer, &msg, e->json, e->json_len);
+        zmq_msg_close(&msg);
+        bytes += e->json_len;
+    }
+    return bytes;
+}
+
+static size_t bench_decompress(size_t iterations, void *arg)
+{
+    int method = (int)(size_t)arg;
+    size_t bytes = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        corpus_entry_t *e = &corpus[i % corpus_size];
+        char *body;
+        size_t body_len;
+        int rc = decompress_frame(e->compressed[method], method, buffer, &body, &body_len);
+        assert(rc);
+        bytes += body_len;
+    }
+    return bytes;
+}
+
+static size_t bench_parse_json_data(size_t iterations, void *arg)
+{
+    json_tokener *tokener = json_tokener_new();
+    size_t bytes = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        corpus_entry_t *e = &corpus[i % corpus_size];
+        json_object *request = parse_json_data(e->json, e->json_len, tokener);
+        assert(request);
+        json_object_put(request);
+        bytes += e->json_len;
+    }
+    json_tokener_free(tokener);
+    return bytes;
+}
+
+static size_t bench_increments_fill_metrics(size_t iterations, void *arg)
+{
+    increments_t *increments = increments_new();
+    for (size_t i = 0; i < iterations; i++)
+        increments_fill_metrics(increments, corpus[i % corpus_size].request);
+    increments_destroy(increments);
+    return 0;
+}
+
+static size_t bench_increments_add(size_t iterations, void *arg)
+{
+    increments_t *increments = increments_new();
+    for (size_t i = 0; i < iterations; i++)
+        increments_add(increments, corpus[i % corpus_size].increments);
+    increments_destroy(increments);
+    return 0;
+}
+
+static size_t bench_increments_to_bson(size_t iterations, void *arg)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        bson_t *document = increments_to_bson(corpus[i % corpus_size].page, corpus[i % corpus_size].increments);
+        bson_destroy(document);
+    }
+    return 0;
+}
+
+static size_t bench_processor_add_quants(size_t iterations, void *arg)
+{
+    processor_state_t processor;
+    memset(&processor, 0, sizeof(processor));
+    processor.quants = zhash_new();
+    processor.sketches = zhash_new();
+    for (size_t i = 0; i < iterations; i++)
+        processor_add_quants(&processor, corpus[i % corpus_size].page, corpus[i % corpus_size].increments);
+    zhash_destroy(&processor.quants);
+    zhash_destroy(&processor.sketches);
+    return 0;
+}
+
+static size_t bench_replace_keywords(size_t iterations, void *arg)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        const char *cookie = corpus[i % corpus_size].cookie;
+        replace_keywords(cookie, sensitive_cookies, buffer);
+        bytes += strlen(cookie);
+    }
+    return bytes;
+}
+
+static size_t bench_cookie_masker_apply(size_t iterations, void *arg)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        const char *cookie = corpus[i % corpus_size].cookie;
+        size_t len = strlen(cookie);
+        cookie_masker_apply(cookie_masker, cookie, len, buffer, NULL);
+        bytes += len;
+    }
+    return bytes;
+}
+
+static size_t bench_filter_sensitive_cookies(size_t iterations, void *arg)
+{
+    for (size_t i = 0; i < iterations; i++)
+        filter_sensitive_cookies(corpus[i % corpus_size].request, cookie_masker, buffer);
+    return 0;
+}
+
+static size_t bench_copy_replace_dots_and_dollars(size_t iterations, void *arg)
+{
+    char safe_key[4096];
+    size_t bytes = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        const char *page = corpus[i % corpus_size].page;
+        size_t n = strlen(page);
+        if (3 * n < sizeof(safe_key))
+            copy_replace_dots_and_dollars(safe_key, page);
+        bytes += n;
+    }
+    return bytes;
+}
+
+// steady state of the request tracker: every operation inserts a key, looks up an older
+// one and expires the oldest entry
+#define ZRING_SIZE 10000
+
+static size_t bench_zring(size_t iterations, void *arg)
+{
+    zring_t *ring = zring_new();
+    char key[256];
+    for (size_t i = 0; i < iterations; i++) {
+        snprintf(key, sizeof(key), "%s-%zu", corpus[i % corpus_size].tracker_key, i);
+        zring_insert(ring, key, (void*)1);
+        if (i >= ZRING_SIZE / 2) {
+            snprintf(key, sizeof(key), "%s-%zu", corpus[(i - ZRING_SIZE / 2) % corpus_size].tracker_key, i - ZRING_SIZE / 2);
+            zring_lookup(ring, key);
+        }
+        if (zring_size(ring) > ZRING_SIZE)
+            zring_shift(ring);
+    }
+    zring_destroy(&ring);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// runner
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void run_benchmark(const char *name, bench_fn *fn, void *arg)
+{
+    if (benchmark_filter && !strstr(name, benchmark_filter))
+        return;
+
+    // warm up caches and lazily allocated buffers
+    fn(corpus_size, arg);
+
+    size_t iterations = 1;
+    int64_t elapsed;
+    size_t bytes;
+    bench_allocations_t before, after;
+    while (true) {
+        bench_allocations_snapshot(&before);
+        int64_t start = now_ns();
+        bytes = fn(iterations, arg);
+        elapsed = now_ns() - start;
+        bench_allocations_snapshot(&after);
+        if (elapsed >= min_time_ns || iterations >= (1UL << 32) || zsys_interrupted)
+            break;
+        // aim slightly above the minimum time, but never grow more than 100 fold
+        size_t next = elapsed > 0 ? (size_t)(1.2 * iterations * min_time_ns / elapsed) : 100 * iterations;
+        if (next > 100 * iterations)
+            next = 100 * iterations;
+        iterations = next > iterations ? next : iterations + 1;
+    }
+
+    double ns_per_op = (double)elapsed / iterations;
+    double allocs_per_op = (double)(after.count - before.count) / iterations;
+    double bytes_per_op = (double)(after.bytes - before.bytes) / iterations;
+    double mb_per_sec = bytes ? (bytes / 1048576.0) / (elapsed / 1e9) : 0;
+
+    printf("%-36s %12zu %12.1f ns/op", name, iterations, ns_per_op);
+    if (bench_allocations_supported())
+        printf(" %10.1f B/op %8.2f allocs/op", bytes_per_op, allocs_per_op);
+    if (mb_per_sec > 0)
+        printf(" %10.1f MB/s", mb_per_sec);
+    printf("\n");
+
+    json_object *result = json_object_new_object();
+    json_object_object_add(result, "name", json_object_new_string(name));
+    json_object_object_add(result, "iterations", json_object_new_int64(iterations));
+    json_object_object_add(result, "ns_per_op", json_object_new_double(ns_per_op));
+    if (bench_allocations_supported()) {
+        json_object_object_add(result, "bytes_per_op", json_object_new_double(bytes_per_op));
+        json_object_object_add(result, "allocs_per_op", json_object_new_double(allocs_per_op));
+    }
+    if (mb_per_sec > 0)
+        json_object_object_add(result, "mb_per_sec", json_object_new_double(mb_per_sec));
+    json_object_array_add(results, result);
+}
+
+static void run_benchmarks()
+{
+    buffer = zchunk_new(NULL, INITIAL_DECOMPRESSION_BUFFER_SIZE);
+    results = json_object_new_array();
+
+    for (int method = ZLIB_COMPRESSION; method <= LZ4_COMPRESSION; method++) {
+        char name[64];
+        snprintf(name, sizeof(name), "compress_message_data/%s", compression_method_to_string(method));
+        run_benchmark(name, bench_compress, (void*)(size_t)method);
+        snprintf(name, sizeof(name), "decompress_frame/%s", compression_method_to_string(method));
+        run_benchmark(name, bench_decompress, (void*)(size_t)method);
+    }
+    run_benchmark("parse_json_data", bench_parse_json_data, NULL);
+    run_benchmark("increments_fill_metrics", bench_increments_fill_metrics, NULL);
+    run_benchmark("increments_add", bench_increments_add, NULL);
+    run_benchmark("increments_to_bson", bench_increments_to_bson, NULL);
+    run_benchmark("processor_add_quants", bench_processor_add_quants, NULL);
+    run_benchmark("replace_keywords", bench_replace_keywords, NULL);
+    run_benchmark("cookie_masker_apply", bench_cookie_masker_apply, NULL);
+    run_benchmark("filter_sensitive_cookies", bench_filter_sensitive_cookies, NULL);
+    run_benchmark("copy_replace_dots_and_dollars", bench_copy_replace_dots_and_dollars, NULL);
+    run_benchmark("zring/insert+lookup+shift", bench_zring, NULL);
+
+    zchunk_destroy(&buffer);
+}
+
+static void write_results()
+{
+    json_object *report = json_object_new_object();
+    json_object_object_add(report, "corpus", json_object_new_string(corpus_file_name ? corpus_file_name : "built-in"));
+    json_object_object_add(report, "corpus_requests", json_object_new_int64(corpus_size));
+    json_object_object_add(report, "corpus_bytes", json_object_new_int64(corpus_bytes));
+    json_object_object_add(report, "benchmarks", results);
+
+    const char *text = json_object_to_json_string_ext(report, JSON_C_TO_STRING_PRETTY);
+    if (streq(json_file_name, "-")) {
+        printf("%s\n", text);
+    } else {
+        FILE *file = fopen(json_file_name, "w");
+        if (file) {
+            fprintf(file, "%s\n", text);
+            fclose(file);
+        } else
+            fprintf(stderr, "[E] could not open report file %s: %s\n", json_file_name, strerror(errno));
+    }
+    json_object_put(report);
+}
+
+// ---------------------------------------------------------------------------
+
+static void print_usage(char * const *argv)
+{
+    fprintf(stderr,
+            "usage: %s [options] [corpus-file]\n"
+            "\nOptions:\n"
+            "  -b, --benchmark S          only run benchmarks with S as substring\n"
+            "  -c, --config C             config file defining metrics (default: built-in)\n"
+            "  -j, --json F               write results as JSON to file F (- means stdout)\n"
+            "  -k, --cookies K,L          sensitive cookie names (default: _session,_shop_session,remember_token)\n"
+            "  -t, --time N               minimum run time per benchmark in milliseconds (default: 500)\n"
+            "  -A, --no-alloc-count       don't count allocations\n"
+            "  -v, --verbose              log more\n"
+            "      --help                 display this message\n"
+            "\nThe corpus file contains one request body (JSON) per line.\n"
+            , argv[0]);
+}
+
+static void process_arguments(int argc, char * const *argv)
+{
+    char c;
+    int longindex = 0;
+    opterr = 0;
+
+    static struct option long_options[] = {
+        { "benchmark",      required_argument, 0, 'b' },
+        { "config",         required_argument, 0, 'c' },
+        { "cookies",        required_argument, 0, 'k' },
+        { "help",           no_argument,       0,  0  },
+        { "json",           required_argument, 0, 'j' },
+        { "no-alloc-count", no_argument,       0, 'A' },
+        { "time",           required_argument, 0, 't' },
+        { "verbose",        no_argument,       0, 'v' },
+        { 0,                0,                 0,  0  }
+    };
+
+    while ((c = getopt_long(argc, argv, "b:c:j:k:t:Av", long_options, &longindex)) != -1) {
+        switch (c) {
+        case 'b':
+            benchmark_filter = optarg;
+            break;
+        case 'c':
+            config_file_name = optarg;
+            break;
+        case 'j':
+            json_file_name = optarg;
+            break;
+        case 'k':
+            sensitive_cookies = split_delimited_string(optarg);
+            break;
+        case 't':
+            min_time_ns = atol(optarg) * 1000 * 1000;
+            break;
+        case 'A':
+            bench_count_allocations = false;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 0:
+            print_usage(argv);
+            exit(0);
+            break;
+        case '?':
+            if (strchr("bcjkt", optopt))
+                fprintf(stderr, "[E] option -%c requires an argument.\n", optopt);
+            else if (isprint (optopt))
+                fprintf(stderr, "[E] unknown option `-%c'.\n", optopt);
+            else
+                fprintf(stderr, "[E] unknown option character `\\x%x'.\n", optopt);
+            print_usage(argv);
+            exit(1);
+        default:
+            fprintf(stderr, "BUG: can't process option -%c\n", optopt);
+            exit(1);
+        }
+    }
+
+    if (optind < argc)
+        corpus_file_name = argv[optind];
+
+    if (sensitive_cookies == NULL)
+        sensitive_cookies = split_delimited_string("_session,_shop_session,remember_token");
+    cookie_masker = cookie_masker_new(sensitive_cookies);
+}
+
+int main(int argc, char * const *argv)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    setvbuf(stderr, NULL, _IOLBF, 0);
+
+    process_arguments(argc, argv);
+
+    zconfig_t *config;
+    if (config_file_name) {
+        if (!zsys_file_exists(config_file_name)) {
+            fprintf(stderr, "[E] missing config file: %s\n", config_file_name);
+            exit(1);
+        }
+        config = zconfig_load((char*)config_file_name);
+    } else
+        config = zconfig_str_load(default_config);
+    assert(config);
+    setup_resource_maps(config);
+
+    load_corpus();
+    prepare_corpus();
+    printf("[I] bench: %zu requests (%.1f KB) from %s\n",
+           corpus_size, corpus_bytes / 1024.0, corpus_file_name ? corpus_file_name : "built-in corpus");
+
+    run_benchmarks();
+    if (json_file_name)
+        write_results();
+    else
+        json_object_put(results);
+
+    destroy_corpus();
+    cookie_masker_destroy(&cookie_masker);
+    zlist_destroy(&sensitive_cookies);
+    zconfig_destroy(&config);
+    return 0;
+}
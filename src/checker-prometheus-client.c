@@ -0,0 +1,39 @@
+#include "importer-prometheus-client.h"
+
+// prometheus client used by the checker: the importer modules under test report
+// metrics, but nobody scrapes them.
+
+void importer_prometheus_client_init(const char* address, importer_prometheus_client_params_t params) {}
+void importer_prometheus_client_shutdown() {}
+void importer_prometheus_client_count_updates(double value) {}
+void importer_prometheus_client_count_inserts(double value) {}
+void importer_prometheus_client_count_msgs_missed(double value) {}
+void importer_prometheus_client_count_msgs_received(double value) {}
+void importer_prometheus_client_count_bytes_received(double value) {}
+void importer_prometheus_client_count_msgs_dropped(double value) {}
+void importer_prometheus_client_count_msgs_blocked(double value) {}
+void importer_prometheus_client_count_msgs_parsed(double value) {}
+void importer_prometheus_client_count_updates_blocked(double value) {}
+void importer_prometheus_client_count_inserts_failed(double value) {}
+void importer_prometheus_client_gauge_queued_inserts(double value) {}
+void importer_prometheus_client_gauge_queued_updates(double value) {}
+void importer_prometheus_client_gauge_queued_inserts_limit(double value) {}
+void importer_prometheus_client_record_insert_spool(double messages, double bytes, double age) {}
+void importer_prometheus_client_count_inserts_spooled(double value) {}
+void importer_prometheus_client_count_inserts_dropped(double value) {}
+void importer_prometheus_client_count_live_stream_msgs(const char *kind, double value) {}
+void importer_prometheus_client_record_index_jobs(const char *day, double pending, double running) {}
+void importer_prometheus_client_count_index_jobs(const char *result, double value) {}
+void importer_prometheus_client_record_mongo_pool(int db, double ops, double op_seconds, double wait_seconds, double in_flight, double waiting, double deferred) {}
+void importer_prometheus_client_time_inserts(double value) {}
+void importer_prometheus_client_time_updates(double value) {}
+double importer_prometheus_client_record_rusage_subscriber(uint i) { return 0; }
+double importer_prometheus_client_record_rusage_parser(uint i) { return 0; }
+double importer_prometheus_client_record_rusage_writer(uint i) { return 0; }
+double importer_prometheus_client_record_rusage_updater(uint i) { return 0; }
+void importer_prometheus_client_create_stream_counters(stream_info_t *stream) {}
+void importer_prometheus_client_destroy_stream_counters(stream_info_t *stream) {}
+void importer_prometheus_client_count_inserts_for_stream(stream_info_t *stream, double value) {}
+void importer_prometheus_client_count_throttled_inserts_for_stream(stream_info_t *stream, double value) {}
+void importer_prometheus_client_record_device_sequence_number(uint32_t id, const char *device, uint64_t n) {}
+void importer_prometheus_client_count_clamped_keys(const char *stream, const char *kind, double value) {}
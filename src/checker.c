@@ -9,8 +9,26 @@
 #include <getopt.h>
 #include "logjam-util.h"
 #include "zring.h"
+#include "logjam-spool.h"
+#include "graylog-forwarder-gelf-output.h"
+#include "graylog-forwarder-sampler.h"
+#include "header-matcher.h"
+#include "device-admission.h"
+#include "device-heavy-hitters.h"
+#include "importer-quantiles.h"
+#include "importer-cardinality.h"
+#include "importer-checkpoint.h"
+#include "importer-scaler.h"
+#include "importer-conflator.h"
+#include "importer-indexscheduler.h"
+#include "importer-increments.h"
+#include "importer-processor.h"
+#include "device-tracker.h"
+#include "importer-insertspool.h"
+#include "logjam-message.h"
 
-bool verbose = false;
+// normally set by logjam-graylog-forwarder.c
+const char* default_datacenter = "unknown";
 
 static void print_usage(char * const *argv)
 {
@@ -62,7 +80,24 @@ static void process_arguments(int argc, char * const *argv)
 int main(int argc, char * const *argv)
 {
     process_arguments(argc, argv);
+    quiet = !verbose;
     zring_test(verbose);
     logjam_util_test(verbose);
+    spool_test(verbose);
+    gelf_output_test(verbose);
+    gelf_sampler_test(verbose);
+    header_matcher_test(verbose);
+    device_admission_test(verbose);
+    heavy_hitters_test(verbose);
+    quantile_sketch_test(verbose);
+    cardinality_guard_test(verbose);
+    checkpoint_test(verbose);
+    pool_scaler_test(verbose);
+    live_stream_conflator_test(verbose);
+    index_scheduler_test(verbose);
+    device_tracker_test(verbose);
+    processor_hash_test(verbose);
+    insert_spool_test(verbose);
+    logjam_message_test(verbose);
     return 0;
 }
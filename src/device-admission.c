@@ -0,0 +1,258 @@
+#include "device-admission.h"
+
+typedef struct {
+    double tokens;
+    int64_t last_refill_ms;
+    int64_t last_seen_ms;
+    size_t shed[MAX_PRIORITY_CLASSES];
+} app_env_bucket_t;
+
+typedef struct {
+    char *prefix;
+    size_t len;
+} priority_class_t;
+
+struct _device_admission_t {
+    double rate;
+    double burst;
+    size_t num_classes;                        // including the class for unmatched topics
+    priority_class_t classes[MAX_PRIORITY_CLASSES];
+    double reserves[MAX_PRIORITY_CLASSES];     // tokens a class has to leave in the bucket
+    shed_recorder_fn *record_shed;
+    zhashx_t *buckets;                         // app-env -> app_env_bucket_t
+    size_t shed_count;
+};
+
+static void free_bucket(void **item)
+{
+    free(*item);
+    *item = NULL;
+}
+
+device_admission_t* device_admission_new(double rate, double burst, const char* priority_classes, shed_recorder_fn *record_shed)
+{
+    device_admission_t *admission = zmalloc(sizeof(*admission));
+    admission->rate = rate;
+    admission->burst = burst >= 1 ? burst : 1;
+    admission->record_shed = record_shed;
+    admission->buckets = zhashx_new();
+    zhashx_set_destructor(admission->buckets, free_bucket);
+
+    char *list = strdup(priority_classes ? priority_classes : "");
+    char *saveptr = NULL;
+    char *prefix = strtok_r(list, ", ", &saveptr);
+    while (prefix) {
+        if (admission->num_classes == MAX_PRIORITY_CLASSES - 1) {
+            fprintf(stderr, "[E] too many priority classes (max %d)\n", MAX_PRIORITY_CLASSES - 1);
+            free(list);
+            device_admission_destroy(&admission);
+            return NULL;
+        }
+        priority_class_t *class = &admission->classes[admission->num_classes++];
+        class->prefix = strdup(prefix);
+        class->len = strlen(prefix);
+        prefix = strtok_r(NULL, ", ", &saveptr);
+    }
+    free(list);
+
+    // all other topics
+    priority_class_t *other = &admission->classes[admission->num_classes++];
+    other->prefix = strdup("other");
+    other->len = 0;
+
+    // a full bucket must accept messages of all classes, even if the burst is smaller
+    // than the number of classes
+    for (size_t i = 0; i < admission->num_classes; i++) {
+        admission->reserves[i] = admission->burst * i / admission->num_classes;
+        if (admission->reserves[i] > admission->burst - 1)
+            admission->reserves[i] = admission->burst - 1;
+    }
+
+    return admission;
+}
+
+void device_admission_destroy(device_admission_t **admission_p)
+{
+    device_admission_t *admission = *admission_p;
+    if (admission == NULL)
+        return;
+    for (size_t i = 0; i < admission->num_classes; i++)
+        free(admission->classes[i].prefix);
+    zhashx_destroy(&admission->buckets);
+    free(admission);
+    *admission_p = NULL;
+}
+
+// topics match a prefix if they're equal to it or continue with a dot
+static size_t priority_class(device_admission_t *admission, const char *topic, size_t topic_len)
+{
+    size_t last = admission->num_classes - 1;
+    for (size_t i = 0; i < last; i++) {
+        priority_class_t *class = &admission->classes[i];
+        if (topic_len >= class->len
+            && memcmp(topic, class->prefix, class->len) == 0
+            && (topic_len == class->len || topic[class->len] == '.'))
+            return i;
+    }
+    return last;
+}
+
+bool device_admission_check(device_admission_t *admission, const char *app_env, size_t app_env_len,
+                            const char *topic, size_t topic_len, int64_t now_ms)
+{
+    char key[app_env_len+1];
+    memcpy(key, app_env, app_env_len);
+    key[app_env_len] = '\0';
+
+    app_env_bucket_t *bucket = zhashx_lookup(admission->buckets, key);
+    if (bucket == NULL) {
+        bucket = zmalloc(sizeof(*bucket));
+        bucket->tokens = admission->burst;
+        bucket->last_refill_ms = now_ms;
+        zhashx_insert(admission->buckets, key, bucket);
+    } else if (now_ms > bucket->last_refill_ms) {
+        bucket->tokens += admission->rate * (now_ms - bucket->last_refill_ms) / 1000.0;
+        if (bucket->tokens > admission->burst)
+            bucket->tokens = admission->burst;
+        bucket->last_refill_ms = now_ms;
+    }
+    bucket->last_seen_ms = now_ms;
+
+    size_t class = priority_class(admission, topic, topic_len);
+    if (bucket->tokens - admission->reserves[class] < 1) {
+        bucket->shed[class]++;
+        admission->shed_count++;
+        return false;
+    }
+    bucket->tokens -= 1;
+    return true;
+}
+
+size_t device_admission_flush(device_admission_t *admission, int64_t now_ms, int64_t max_age)
+{
+    zlist_t *deletions = zlist_new();
+    int64_t threshold = now_ms - max_age;
+    app_env_bucket_t *bucket = zhashx_first(admission->buckets);
+    while (bucket) {
+        const char *app_env = zhashx_cursor(admission->buckets);
+        for (size_t i = 0; i < admission->num_classes; i++) {
+            if (bucket->shed[i] == 0)
+                continue;
+            if (admission->record_shed)
+                admission->record_shed(app_env, admission->classes[i].prefix, bucket->shed[i]);
+            bucket->shed[i] = 0;
+        }
+        if (bucket->last_seen_ms < threshold)
+            zlist_append(deletions, (void*)app_env);
+        bucket = zhashx_next(admission->buckets);
+    }
+    const char *app_env = zlist_first(deletions);
+    while (app_env) {
+        zhashx_delete(admission->buckets, app_env);
+        app_env = zlist_next(deletions);
+    }
+    zlist_destroy(&deletions);
+
+    size_t shed_count = admission->shed_count;
+    admission->shed_count = 0;
+    return shed_count;
+}
+
+static size_t test_shed[MAX_PRIORITY_CLASSES];
+
+static void test_record_shed(const char *app_env, const char *priority_class, size_t count)
+{
+    if (streq(priority_class, "logs"))
+        test_shed[0] += count;
+    else if (streq(priority_class, "frontend"))
+        test_shed[1] += count;
+    else if (streq(priority_class, "other"))
+        test_shed[2] += count;
+}
+
+#define CHECK(app_env, topic, now) \
+    device_admission_check(admission, app_env, strlen(app_env), topic, strlen(topic), now)
+
+void device_admission_test(int verbose)
+{
+    printf(" * device-admission: ");
+    if (verbose)
+        printf("\n");
+
+    assert(device_admission_new(100, 100, "a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p", NULL) == NULL);
+
+    // 100 messages per second, three classes: logs, frontend, other
+    device_admission_t *admission = device_admission_new(100, 90, "logs,frontend", test_record_shed);
+    assert(admission);
+    assert(priority_class(admission, "logs", 4) == 0);
+    assert(priority_class(admission, "logs.app", 8) == 0);
+    assert(priority_class(admission, "logsx", 5) == 2);
+    assert(priority_class(admission, "frontend.page", 13) == 1);
+    assert(priority_class(admission, "events", 6) == 2);
+
+    // a full bucket accepts messages of all classes
+    int64_t now = 1000;
+    assert(CHECK("a-b", "frontend.page", now));
+    assert(CHECK("a-b", "events", now));
+    assert(CHECK("a-b", "logs", now));
+
+    // the least important class leaves 60 tokens, frontend 30 and logs none
+    size_t accepted = 0;
+    for (int i = 0; i < 100; i++)
+        accepted += CHECK("a-b", "events", now);
+    assert(accepted == 27);
+    accepted = 0;
+    for (int i = 0; i < 100; i++)
+        accepted += CHECK("a-b", "frontend.ajax", now);
+    assert(accepted == 30);
+    accepted = 0;
+    for (int i = 0; i < 100; i++)
+        accepted += CHECK("a-b", "logs", now);
+    assert(accepted == 30);
+
+    // other app-envs are not affected
+    assert(CHECK("c-d", "events", now));
+
+    // 100ms later 10 tokens are available for logs
+    now += 100;
+    assert(!CHECK("a-b", "frontend.page", now));
+    accepted = 0;
+    for (int i = 0; i < 100; i++)
+        accepted += CHECK("a-b", "logs", now);
+    assert(accepted == 10);
+
+    size_t shed = device_admission_flush(admission, now, 60000);
+    if (verbose)
+        printf("[D] shed logs: %zu, frontend: %zu, other: %zu\n", test_shed[0], test_shed[1], test_shed[2]);
+    assert(shed == 73 + 70 + 70 + 1 + 90);
+    assert(test_shed[0] == 70 + 90);
+    assert(test_shed[1] == 70 + 1);
+    assert(test_shed[2] == 73);
+    assert(device_admission_flush(admission, now, 60000) == 0);
+
+    // idle app-envs are forgotten
+    assert(zhashx_size(admission->buckets) == 2);
+    device_admission_flush(admission, now + 60001, 60000);
+    assert(zhashx_size(admission->buckets) == 0);
+
+    device_admission_destroy(&admission);
+    assert(admission == NULL);
+
+    // a burst smaller than the number of classes still admits all classes on a full bucket
+    admission = device_admission_new(1, 2, "logs,frontend", NULL);
+    assert(CHECK("a-b", "events", now));
+    assert(!CHECK("a-b", "events", now));
+    assert(!CHECK("a-b", "frontend.page", now));
+    assert(CHECK("a-b", "logs", now));
+    assert(!CHECK("a-b", "logs", now));
+    device_admission_destroy(&admission);
+
+    admission = device_admission_new(1, 1, "logs,frontend", NULL);
+    assert(CHECK("a-b", "events", now));
+    assert(!CHECK("a-b", "logs", now));
+    now += 1000;
+    assert(CHECK("a-b", "frontend.page", now));
+    device_admission_destroy(&admission);
+
+    printf("OK\n");
+}
@@ -0,0 +1,52 @@
+#ifndef __LOGJAM_DEVICE_ADMISSION_H_INCLUDED__
+#define __LOGJAM_DEVICE_ADMISSION_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Limits the number of messages a device accepts per app-env, so that a single flooding
+// application can't fill the publisher's send queue and cause messages of all other
+// streams to be dropped. Every app-env has its own token bucket, filled at a fixed rate and
+// holding at most `burst` tokens.
+//
+// Topics are assigned to priority classes by prefix, given as a comma separated list
+// ordered from most to least important (e.g. "logs,javascript,events,mobile,frontend").
+// Topics not matching any prefix belong to an additional, least important class. The
+// most important class may use all tokens of a bucket, less important classes only the
+// tokens above a reserve which grows with decreasing importance, but always leaves room
+// for one message in a full bucket. When an app-env exceeds its rate, its least important
+// messages are shed first.
+//
+// Shed messages are counted per app-env and priority class and reported by
+// device_admission_flush. Each intake thread has its own admission state.
+
+#define MAX_PRIORITY_CLASSES 16
+#define DEFAULT_PRIORITY_CLASSES "logs,javascript,events,mobile,frontend"
+
+typedef void (shed_recorder_fn)(const char* app_env, const char* priority_class, size_t count);
+
+typedef struct _device_admission_t device_admission_t;
+
+// returns NULL if the priority class list is invalid
+extern device_admission_t* device_admission_new(double rate, double burst, const char* priority_classes, shed_recorder_fn *record_shed);
+extern void device_admission_destroy(device_admission_t **admission_p);
+
+// consumes a token from the bucket of the given app-env, if the topic's priority class
+// is allowed to use it. app_env and topic need not be null terminated.
+extern bool device_admission_check(device_admission_t *admission, const char *app_env, size_t app_env_len,
+                                   const char *topic, size_t topic_len, int64_t now_ms);
+
+// reports and resets shed counts, forgets buckets of app-envs not seen for max_age
+// milliseconds and returns the number of messages shed since the last flush
+extern size_t device_admission_flush(device_admission_t *admission, int64_t now_ms, int64_t max_age);
+
+extern void device_admission_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
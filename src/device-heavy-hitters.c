@@ -0,0 +1,358 @@
+#include "device-heavy-hitters.h"
+
+typedef struct hh_bucket hh_bucket_t;
+typedef struct hh_entry hh_entry_t;
+
+struct hh_bucket {
+    size_t count;
+    hh_bucket_t *prev;                  // bucket with the next smaller count
+    hh_bucket_t *next;                  // bucket with the next larger count
+    hh_entry_t *entries;
+};
+
+struct hh_entry {
+    char key[HEAVY_HITTER_KEY_SIZE];
+    uint32_t hash;
+    size_t error;
+    size_t bytes;
+    hh_bucket_t *bucket;
+    hh_entry_t *prev;                   // entries of the same bucket
+    hh_entry_t *next;
+    hh_entry_t *chain;                  // hash table collision chain
+};
+
+struct _heavy_hitters_t {
+    size_t capacity;
+    size_t used;
+    hh_entry_t *entries;
+    hh_bucket_t *buckets;
+    hh_bucket_t *free_buckets;
+    hh_bucket_t *min;
+    hh_bucket_t *max;
+    hh_entry_t **table;
+    size_t table_mask;
+    size_t total_count;
+    size_t total_bytes;
+};
+
+heavy_hitters_t* heavy_hitters_new(size_t capacity)
+{
+    assert(capacity > 0);
+    heavy_hitters_t *hh = zmalloc(sizeof(*hh));
+    hh->capacity = capacity;
+    hh->entries = zmalloc(capacity * sizeof(hh_entry_t));
+    // an emptied bucket is released after the entry has been moved to a new one
+    hh->buckets = zmalloc((capacity + 1) * sizeof(hh_bucket_t));
+    size_t table_size = 1;
+    while (table_size < 2 * capacity)
+        table_size <<= 1;
+    hh->table = zmalloc(table_size * sizeof(hh_entry_t*));
+    hh->table_mask = table_size - 1;
+    heavy_hitters_reset(hh);
+    return hh;
+}
+
+void heavy_hitters_destroy(heavy_hitters_t **hh_p)
+{
+    heavy_hitters_t *hh = *hh_p;
+    if (hh == NULL)
+        return;
+    free(hh->entries);
+    free(hh->buckets);
+    free(hh->table);
+    free(hh);
+    *hh_p = NULL;
+}
+
+void heavy_hitters_reset(heavy_hitters_t *hh)
+{
+    hh->used = 0;
+    hh->min = hh->max = NULL;
+    hh->free_buckets = NULL;
+    for (size_t i = 0; i <= hh->capacity; i++) {
+        hh->buckets[i].next = hh->free_buckets;
+        hh->free_buckets = &hh->buckets[i];
+    }
+    memset(hh->table, 0, (hh->table_mask + 1) * sizeof(hh_entry_t*));
+    hh->total_count = 0;
+    hh->total_bytes = 0;
+}
+
+size_t heavy_hitters_capacity(heavy_hitters_t *hh)
+{
+    return hh->capacity;
+}
+
+size_t heavy_hitters_total_count(heavy_hitters_t *hh)
+{
+    return hh->total_count;
+}
+
+size_t heavy_hitters_total_bytes(heavy_hitters_t *hh)
+{
+    return hh->total_bytes;
+}
+
+// FNV-1a
+static uint32_t hash_key(const char *key, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static hh_entry_t* lookup_entry(heavy_hitters_t *hh, const char *key, size_t len, uint32_t hash)
+{
+    hh_entry_t *e = hh->table[hash & hh->table_mask];
+    while (e) {
+        if (e->hash == hash && strncmp(e->key, key, len) == 0 && e->key[len] == '\0')
+            return e;
+        e = e->chain;
+    }
+    return NULL;
+}
+
+static void insert_entry(heavy_hitters_t *hh, hh_entry_t *e)
+{
+    hh_entry_t **head = &hh->table[e->hash & hh->table_mask];
+    e->chain = *head;
+    *head = e;
+}
+
+static void remove_entry(heavy_hitters_t *hh, hh_entry_t *e)
+{
+    hh_entry_t **p = &hh->table[e->hash & hh->table_mask];
+    while (*p != e)
+        p = &(*p)->chain;
+    *p = e->chain;
+}
+
+static void unlink_from_bucket(hh_entry_t *e)
+{
+    hh_bucket_t *b = e->bucket;
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        b->entries = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    e->bucket = NULL;
+}
+
+static void release_bucket(heavy_hitters_t *hh, hh_bucket_t *b)
+{
+    if (b->prev)
+        b->prev->next = b->next;
+    else
+        hh->min = b->next;
+    if (b->next)
+        b->next->prev = b->prev;
+    else
+        hh->max = b->prev;
+    b->next = hh->free_buckets;
+    hh->free_buckets = b;
+}
+
+// links an unlinked entry into the bucket for count, searching upwards from start (or the
+// smallest bucket if start is NULL). takes constant time if count is the count of start
+// or its successor plus one.
+static void place_entry(heavy_hitters_t *hh, hh_entry_t *e, hh_bucket_t *start, size_t count)
+{
+    hh_bucket_t *b = start ? start : hh->min;
+    hh_bucket_t *prev = b ? b->prev : NULL;
+    while (b && b->count < count) {
+        prev = b;
+        b = b->next;
+    }
+    if (b == NULL || b->count != count) {
+        hh_bucket_t *n = hh->free_buckets;
+        assert(n);
+        hh->free_buckets = n->next;
+        n->count = count;
+        n->entries = NULL;
+        n->prev = prev;
+        n->next = b;
+        if (prev)
+            prev->next = n;
+        else
+            hh->min = n;
+        if (b)
+            b->prev = n;
+        else
+            hh->max = n;
+        b = n;
+    }
+    e->bucket = b;
+    e->prev = NULL;
+    e->next = b->entries;
+    if (b->entries)
+        b->entries->prev = e;
+    b->entries = e;
+}
+
+static void increment_entry(heavy_hitters_t *hh, hh_entry_t *e, size_t n)
+{
+    hh_bucket_t *old = e->bucket;
+    unlink_from_bucket(e);
+    place_entry(hh, e, old, old->count + n);
+    if (old->entries == NULL)
+        release_bucket(hh, old);
+}
+
+static void add_counts(heavy_hitters_t *hh, const char *key, size_t len, size_t count, size_t error, size_t bytes)
+{
+    if (len >= HEAVY_HITTER_KEY_SIZE)
+        len = HEAVY_HITTER_KEY_SIZE - 1;
+    uint32_t hash = hash_key(key, len);
+    hh->total_count += count;
+    hh->total_bytes += bytes;
+
+    hh_entry_t *e = lookup_entry(hh, key, len, hash);
+    if (e) {
+        e->error += error;
+        e->bytes += bytes;
+        increment_entry(hh, e, count);
+        return;
+    }
+
+    if (hh->used < hh->capacity) {
+        e = &hh->entries[hh->used++];
+        e->error = error;
+        e->bytes = bytes;
+        place_entry(hh, e, NULL, count);
+    } else {
+        // take over a counter with the smallest count
+        e = hh->min->entries;
+        remove_entry(hh, e);
+        e->error = hh->min->count + error;
+        e->bytes = bytes;
+        increment_entry(hh, e, count);
+    }
+    memcpy(e->key, key, len);
+    e->key[len] = '\0';
+    e->hash = hash;
+    insert_entry(hh, e);
+}
+
+void heavy_hitters_add(heavy_hitters_t *hh, const char *key, size_t key_len, size_t bytes)
+{
+    add_counts(hh, key, key_len, 1, 0, bytes);
+}
+
+void heavy_hitters_merge(heavy_hitters_t *dst, heavy_hitters_t *src)
+{
+    size_t total_count = dst->total_count + src->total_count;
+    size_t total_bytes = dst->total_bytes + src->total_bytes;
+    for (hh_bucket_t *b = src->min; b; b = b->next)
+        for (hh_entry_t *e = b->entries; e; e = e->next)
+            add_counts(dst, e->key, strlen(e->key), b->count, e->error, e->bytes);
+    // messages of evicted keys are included in the totals of src
+    dst->total_count = total_count;
+    dst->total_bytes = total_bytes;
+}
+
+size_t heavy_hitters_top(heavy_hitters_t *hh, heavy_hitter_t *result, size_t n)
+{
+    size_t i = 0;
+    for (hh_bucket_t *b = hh->max; b && i < n; b = b->prev) {
+        for (hh_entry_t *e = b->entries; e && i < n; e = e->next) {
+            result[i].key = e->key;
+            result[i].count = b->count;
+            result[i].error = e->error;
+            result[i].bytes = e->bytes;
+            i++;
+        }
+    }
+    return i;
+}
+
+static void check_invariants(heavy_hitters_t *hh)
+{
+    size_t entries = 0;
+    hh_bucket_t *prev = NULL;
+    for (hh_bucket_t *b = hh->min; b; b = b->next) {
+        assert(b->prev == prev);
+        assert(b->entries);
+        assert(prev == NULL || prev->count < b->count);
+        for (hh_entry_t *e = b->entries; e; e = e->next) {
+            assert(e->bucket == b);
+            assert(lookup_entry(hh, e->key, strlen(e->key), e->hash) == e);
+            entries++;
+        }
+        prev = b;
+    }
+    assert(hh->max == prev);
+    assert(entries == hh->used);
+}
+
+void heavy_hitters_test(int verbose)
+{
+    printf(" * heavy-hitters: ");
+    if (verbose)
+        printf("\n");
+
+    heavy_hitters_t *hh = heavy_hitters_new(20);
+    heavy_hitter_t top[10];
+    char key[32];
+
+    assert(heavy_hitters_top(hh, top, 10) == 0);
+
+    // 5 heavy keys among 1000 rare ones
+    for (int i = 0; i < 1000; i++) {
+        for (int k = 0; k < 5; k++) {
+            if (i % (k + 1) == 0) {
+                snprintf(key, sizeof(key), "heavy-%d logs", k);
+                heavy_hitters_add(hh, key, strlen(key), 100);
+            }
+        }
+        snprintf(key, sizeof(key), "rare-%d logs", i);
+        heavy_hitters_add(hh, key, strlen(key), 10);
+        check_invariants(hh);
+    }
+    assert(heavy_hitters_total_count(hh) == 1000 + 500 + 334 + 250 + 200 + 1000);
+
+    size_t n = heavy_hitters_top(hh, top, 5);
+    assert(n == 5);
+    for (int k = 0; k < 5; k++) {
+        if (verbose)
+            printf("[D] %s: count=%zu error=%zu bytes=%zu\n", top[k].key, top[k].count, top[k].error, top[k].bytes);
+        snprintf(key, sizeof(key), "heavy-%d logs", k);
+        assert(streq(top[k].key, key));
+        assert(top[k].count - top[k].error <= (size_t)(1000 + k) / (k + 1));
+        assert(top[k].count >= (size_t)(1000 + k) / (k + 1));
+    }
+    assert(top[0].error == 0 && top[0].count == 1000 && top[0].bytes == 100000);
+
+    // merging two sketches adds their counts
+    heavy_hitters_t *other = heavy_hitters_new(10);
+    for (int i = 0; i < 2000; i++)
+        heavy_hitters_add(other, "heavy-4 logs", 12, 1);
+    heavy_hitters_merge(hh, other);
+    check_invariants(hh);
+    n = heavy_hitters_top(hh, top, 1);
+    assert(n == 1);
+    assert(streq(top[0].key, "heavy-4 logs"));
+    assert(top[0].count >= 2200);
+    assert(heavy_hitters_total_count(hh) == 5284);
+    heavy_hitters_destroy(&other);
+
+    // long keys are truncated
+    char long_key[2*HEAVY_HITTER_KEY_SIZE];
+    memset(long_key, 'x', sizeof(long_key));
+    heavy_hitters_reset(hh);
+    heavy_hitters_add(hh, long_key, sizeof(long_key), 1);
+    heavy_hitters_add(hh, long_key, sizeof(long_key) - 1, 1);
+    check_invariants(hh);
+    n = heavy_hitters_top(hh, top, 10);
+    assert(n == 1);
+    assert(top[0].count == 2);
+    assert(strlen(top[0].key) == HEAVY_HITTER_KEY_SIZE - 1);
+
+    heavy_hitters_destroy(&hh);
+    assert(hh == NULL);
+
+    printf("OK\n");
+}
@@ -0,0 +1,55 @@
+#ifndef __LOGJAM_DEVICE_HEAVY_HITTERS_H_INCLUDED__
+#define __LOGJAM_DEVICE_HEAVY_HITTERS_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Finds the keys (e.g. app-env and topic) with the most messages in a stream of unknown
+// size, using the space saving algorithm with a fixed number of counters. Counters are
+// kept in buckets of equal count, linked in ascending order (the "stream summary"), so
+// counting a message takes constant time. When all counters are in use, the counter of a
+// key with the smallest count is taken over by the new key, which inherits its count as
+// possible overestimation (error). Every key occurring more than total/capacity times is
+// guaranteed to be in the sketch. Keys longer than HEAVY_HITTER_KEY_SIZE-1 are truncated.
+//
+// Sketches are not thread safe. Sketches of different threads can be merged.
+
+#define HEAVY_HITTER_KEY_SIZE 192
+
+typedef struct {
+    const char *key;
+    size_t count;
+    size_t error;
+    size_t bytes;
+} heavy_hitter_t;
+
+typedef struct _heavy_hitters_t heavy_hitters_t;
+
+extern heavy_hitters_t* heavy_hitters_new(size_t capacity);
+extern void heavy_hitters_destroy(heavy_hitters_t **hh_p);
+
+// counts a message of the given size
+extern void heavy_hitters_add(heavy_hitters_t *hh, const char *key, size_t key_len, size_t bytes);
+
+// adds all counters of src to dst
+extern void heavy_hitters_merge(heavy_hitters_t *dst, heavy_hitters_t *src);
+
+// stores at most n entries with the highest counts in result, in descending order, and
+// returns the number of entries stored. keys are valid until the sketch is modified.
+extern size_t heavy_hitters_top(heavy_hitters_t *hh, heavy_hitter_t *result, size_t n);
+
+extern void heavy_hitters_reset(heavy_hitters_t *hh);
+extern size_t heavy_hitters_capacity(heavy_hitters_t *hh);
+extern size_t heavy_hitters_total_count(heavy_hitters_t *hh);
+extern size_t heavy_hitters_total_bytes(heavy_hitters_t *hh);
+
+extern void heavy_hitters_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
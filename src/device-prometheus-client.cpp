@@ -10,6 +10,11 @@ typedef struct {
     int64_t last_seen;
 } stream_counter_t;
 
+// per stream counters are updated by intake threads and the main thread
+static std::mutex mutex;
+
+typedef std::unordered_map<std::string, prometheus::Gauge*> gauge_map_t;
+
 static struct prometheus_client_t {
     prometheus::Exposer *exposer;
     std::shared_ptr<prometheus::Registry> registry;
@@ -26,6 +31,7 @@ static struct prometheus_client_t {
     prometheus::Family<prometheus::Counter> *cpu_usage_total_family;
     prometheus::Counter *cpu_usage_total;
     std::vector<prometheus::Counter*> cpu_usage_total_compressors;
+    std::vector<prometheus::Counter*> cpu_usage_total_intake_threads;
     prometheus::Family<prometheus::Counter> *ping_count_total_family;
     prometheus::Counter *ping_count_total;
     prometheus::Family<prometheus::Counter> *ping_count_by_stream_total_family;
@@ -34,15 +40,23 @@ static struct prometheus_client_t {
     prometheus::Counter *broken_meta_count_total;
     prometheus::Family<prometheus::Counter> *broken_meta_count_by_stream_total_family;
     std::unordered_map<std::string, stream_counter_t*> broken_meta_count_by_stream_total_map;
+    prometheus::Family<prometheus::Counter> *shed_msgs_total_family;
+    prometheus::Counter *shed_msgs_total;
+    prometheus::Family<prometheus::Counter> *shed_msgs_by_stream_total_family;
+    std::unordered_map<std::string, stream_counter_t*> shed_msgs_by_stream_total_map;
     prometheus::Family<prometheus::Gauge> *app_start_time_family;
     prometheus::Gauge *app_start_time;
     prometheus::Family<prometheus::Gauge> *sequence_number_family;
     prometheus::Gauge *sequence_number;
     prometheus::Family<prometheus::Gauge> *received_messages_max_bytes_family;
     prometheus::Gauge *received_messages_max_bytes;
+    prometheus::Family<prometheus::Gauge> *top_streams_family;
+    gauge_map_t top_streams_map;
+    prometheus::Family<prometheus::Gauge> *top_producers_family;
+    gauge_map_t top_producers_map;
 } client;
 
-void device_prometheus_client_init(const char* address, const char* device, int num_compressors)
+void device_prometheus_client_init(const char* address, const char* device, int num_compressors, int num_intake_threads)
 {
     // create a http server running on the given address
     client.exposer = new prometheus::Exposer{address};
@@ -102,6 +116,12 @@ void device_prometheus_client_init(const char* address, const char* device, int
         snprintf(name, sizeof(name), "compressor%d", i);
         client.cpu_usage_total_compressors.push_back(&client.cpu_usage_total_family->Add({{"thread", name}}));
     }
+    client.cpu_usage_total_intake_threads = {};
+    for (int i=0; i<num_intake_threads; i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "intake%d", i);
+        client.cpu_usage_total_intake_threads.push_back(&client.cpu_usage_total_family->Add({{"thread", name}}));
+    }
 
     client.ping_count_total_family = &prometheus::BuildCounter()
         .Name("logjam:device:ping_count_total")
@@ -131,6 +151,20 @@ void device_prometheus_client_init(const char* address, const char* device, int
         .Labels({{"device", device}})
         .Register(*client.registry);
 
+    client.shed_msgs_total_family = &prometheus::BuildCounter()
+        .Name("logjam:device:msgs_shed_total")
+        .Help("How many messages this device has shed because their app-env exceeded its rate")
+        .Labels({{"device", device}})
+        .Register(*client.registry);
+
+    client.shed_msgs_total = &client.shed_msgs_total_family->Add({});
+
+    client.shed_msgs_by_stream_total_family = &prometheus::BuildCounter()
+        .Name("logjam:device:msgs_shed_by_stream_total")
+        .Help("How many messages this device has shed for a given stream and priority class")
+        .Labels({{"device", device}})
+        .Register(*client.registry);
+
     client.app_start_time_family = &prometheus::BuildGauge()
         .Name("logjam:device:app_start_time")
         .Help("Timestamp when the device started")
@@ -155,6 +189,18 @@ void device_prometheus_client_init(const char* address, const char* device, int
 
     client.received_messages_max_bytes = &client.received_messages_max_bytes_family->Add({});
 
+    client.top_streams_family = &prometheus::BuildGauge()
+        .Name("logjam:device:top_stream_msgs")
+        .Help("Messages received during the last second for the streams and topics sending the most messages")
+        .Labels({{"device", device}})
+        .Register(*client.registry);
+
+    client.top_producers_family = &prometheus::BuildGauge()
+        .Name("logjam:device:top_producer_msgs")
+        .Help("Messages received during the last second from the producers sending the most messages")
+        .Labels({{"device", device}})
+        .Register(*client.registry);
+
     // ask the exposer to scrape the registry on incoming scrapes
     client.exposer->RegisterCollectable(client.registry);
 }
@@ -197,6 +243,7 @@ void device_prometheus_client_count_pings(double value)
 
 void device_prometheus_client_count_ping(const char* app_env)
 {
+    std::lock_guard<std::mutex> lock(mutex);
     std::string stream(app_env);
     std::unordered_map<std::string,stream_counter_t*>::const_iterator got = client.ping_count_by_stream_total_map.find(stream);
     stream_counter_t *counter;
@@ -212,6 +259,7 @@ void device_prometheus_client_count_ping(const char* app_env)
 
 void device_prometheus_client_delete_old_ping_counters(int64_t max_age)
 {
+    std::lock_guard<std::mutex> lock(mutex);
     int64_t threshold = zclock_time() - max_age;
     std::unordered_map<std::string,stream_counter_t*>::iterator it = client.ping_count_by_stream_total_map.begin();
     while (it != client.ping_count_by_stream_total_map.end()) {
@@ -233,6 +281,7 @@ void device_prometheus_client_count_broken_metas(double value)
 
 void device_prometheus_client_count_broken_meta(const char* app_env)
 {
+    std::lock_guard<std::mutex> lock(mutex);
     std::string stream(app_env);
     std::unordered_map<std::string,stream_counter_t*>::const_iterator got = client.broken_meta_count_by_stream_total_map.find(stream);
     stream_counter_t *counter;
@@ -248,6 +297,7 @@ void device_prometheus_client_count_broken_meta(const char* app_env)
 
 void device_prometheus_client_delete_old_broken_meta_counters(int64_t max_age)
 {
+    std::lock_guard<std::mutex> lock(mutex);
     int64_t threshold = zclock_time() - max_age;
     std::unordered_map<std::string,stream_counter_t*>::iterator it = client.broken_meta_count_by_stream_total_map.begin();
     while (it != client.broken_meta_count_by_stream_total_map.end()) {
@@ -262,6 +312,46 @@ void device_prometheus_client_delete_old_broken_meta_counters(int64_t max_age)
     }
 }
 
+void device_prometheus_client_count_shed_msgs(double value)
+{
+    client.shed_msgs_total->Increment(value);
+}
+
+void device_prometheus_client_count_shed_msgs_for_stream(const char* app_env, const char* priority_class, size_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string key(app_env);
+    key += '\t';
+    key += priority_class;
+    std::unordered_map<std::string,stream_counter_t*>::const_iterator got = client.shed_msgs_by_stream_total_map.find(key);
+    stream_counter_t *counter;
+    if (got == client.shed_msgs_by_stream_total_map.end()) {
+        counter = new(stream_counter_t);
+        counter->counter = &client.shed_msgs_by_stream_total_family->Add({{"stream", app_env}, {"priority", priority_class}});
+        client.shed_msgs_by_stream_total_map[key] = counter;
+    } else
+        counter = got->second;
+    counter->counter->Increment(count);
+    counter->last_seen = zclock_time();
+}
+
+void device_prometheus_client_delete_old_shed_counters(int64_t max_age)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t threshold = zclock_time() - max_age;
+    std::unordered_map<std::string,stream_counter_t*>::iterator it = client.shed_msgs_by_stream_total_map.begin();
+    while (it != client.shed_msgs_by_stream_total_map.end()) {
+        if (it->second->last_seen < threshold) {
+            stream_counter_t *counter = it->second;
+            client.shed_msgs_by_stream_total_family->Remove(counter->counter);
+            delete counter;
+            it = client.shed_msgs_by_stream_total_map.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
 static
 double get_combined_cpu_usage()
 {
@@ -293,6 +383,13 @@ void device_prometheus_client_record_rusage_compressor(int i)
     client.cpu_usage_total_compressors[i]->Increment(value - oldvalue);
 }
 
+void device_prometheus_client_record_rusage_intake(int i)
+{
+    double value = get_combined_cpu_usage();
+    double oldvalue = client.cpu_usage_total_intake_threads[i]->Value();
+    client.cpu_usage_total_intake_threads[i]->Increment(value - oldvalue);
+}
+
 void device_prometheus_client_set_start_time()
 {
     client.app_start_time->SetToCurrentTime();
@@ -308,3 +405,39 @@ void device_prometheus_client_set_msg_max_bytes(uint64_t received_messages_max_b
 {
     client.received_messages_max_bytes->Set(received_messages_max_bytes);
 }
+
+// keys of heavy hitters are "app-env topic" or "app-env routing-id"
+static void set_top_gauges(prometheus::Family<prometheus::Gauge> *family, gauge_map_t &gauges, const char* label, heavy_hitter_t *top, size_t n)
+{
+    gauge_map_t current;
+    for (size_t i = 0; i < n; i++) {
+        std::string key(top[i].key);
+        prometheus::Gauge *gauge;
+        gauge_map_t::iterator got = gauges.find(key);
+        if (got == gauges.end()) {
+            size_t space = key.find(' ');
+            std::string stream = key.substr(0, space);
+            std::string rest = space == std::string::npos ? "" : key.substr(space + 1);
+            gauge = &family->Add({{"stream", stream}, {label, rest}});
+        } else {
+            gauge = got->second;
+            gauges.erase(got);
+        }
+        gauge->Set(top[i].count);
+        current[key] = gauge;
+    }
+    // remove gauges of keys no longer among the top ones
+    for (gauge_map_t::iterator it = gauges.begin(); it != gauges.end(); it++)
+        family->Remove(it->second);
+    gauges.swap(current);
+}
+
+void device_prometheus_client_set_top_streams(heavy_hitter_t *top, size_t n)
+{
+    set_top_gauges(client.top_streams_family, client.top_streams_map, "topic", top, n);
+}
+
+void device_prometheus_client_set_top_producers(heavy_hitter_t *top, size_t n)
+{
+    set_top_gauges(client.top_producers_family, client.top_producers_map, "routing_id", top, n);
+}
@@ -2,12 +2,13 @@
 #define __LOGJAM_DEVICE_PROMETHEUS_CLIENT_H_INCLUDED__
 
 #include "logjam-util.h"
+#include "device-heavy-hitters.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern void device_prometheus_client_init(const char* address, const char* device, int num_compressors);
+extern void device_prometheus_client_init(const char* address, const char* device, int num_compressors, int num_intake_threads);
 extern void device_prometheus_client_shutdown();
 
 extern void device_prometheus_client_count_msgs_received(double value);
@@ -21,8 +22,14 @@ extern void device_prometheus_client_count_broken_metas(double value);
 extern void device_prometheus_client_count_broken_meta(const char* app_env);
 extern void device_prometheus_client_delete_old_ping_counters(int64_t max_age);
 extern void device_prometheus_client_delete_old_broken_meta_counters(int64_t max_age);
+extern void device_prometheus_client_count_shed_msgs(double value);
+extern void device_prometheus_client_count_shed_msgs_for_stream(const char* app_env, const char* priority_class, size_t count);
+extern void device_prometheus_client_delete_old_shed_counters(int64_t max_age);
+extern void device_prometheus_client_set_top_streams(heavy_hitter_t *top, size_t n);
+extern void device_prometheus_client_set_top_producers(heavy_hitter_t *top, size_t n);
 extern void device_prometheus_client_record_rusage();
 extern void device_prometheus_client_record_rusage_compressor(int i);
+extern void device_prometheus_client_record_rusage_intake(int i);
 extern void device_prometheus_client_set_start_time();
 extern void device_prometheus_client_set_sequence_number(uint64_t n);
 extern void device_prometheus_client_set_msg_max_bytes(uint64_t received_messages_max_bytes);
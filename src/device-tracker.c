@@ -9,11 +9,19 @@ typedef struct {
     uint32_t device_number;
     uint64_t sequence_number;
     uint64_t lost;
+    uint64_t lost_recorded;
     int credit;
+    uint64_t resumed_sequence_number;     // 0 unless resumed after a restart
+    int64_t resume_deadline;
     const char* pub_spec;
     char device_num_str[11]; // at most 4294967295
 } device_info_t;
 
+// messages older than the saved sequence number are only dropped shortly after a restart
+// and if they are not too far behind (the device might have been restarted, too)
+#define RESUME_SECONDS 10
+#define RESUME_WINDOW 100000
+
 struct _device_tracker_t {
     zhashx_t *seen_devices;
     zhash_t *known_devices;
@@ -39,19 +47,30 @@ static void device_info_destroy(void **item)
     *item = NULL;
 }
 
-device_tracker_t* device_tracker_new(zlist_t* known_devices, zsock_t* sub_socket)
+void device_tracker_set_known_devices(device_tracker_t* tracker, zlist_t* known_devices)
 {
-    device_tracker_t *tracker = zmalloc(sizeof(*tracker));
-    tracker->sub_socket = sub_socket;
+    zhash_destroy(&tracker->known_devices);
+    free(tracker->localhost_spec);
+    tracker->localhost_spec = NULL;
 
     tracker->known_devices = zhash_new();
     char *spec = zlist_first(known_devices);
     while (spec) {
         zhash_insert(tracker->known_devices, spec, (void*)1);
-        if (strstr(spec, "localhost") || strstr(spec, "127.0.0.1") || strstr(spec, "::1"))
-            tracker->localhost_spec = spec;
+        if (strstr(spec, "localhost") || strstr(spec, "127.0.0.1") || strstr(spec, "::1")) {
+            free(tracker->localhost_spec);
+            tracker->localhost_spec = strdup(spec);
+        }
         spec = zlist_next(known_devices);
     }
+}
+
+device_tracker_t* device_tracker_new(zlist_t* known_devices, zsock_t* sub_socket)
+{
+    device_tracker_t *tracker = zmalloc(sizeof(*tracker));
+    tracker->sub_socket = sub_socket;
+
+    device_tracker_set_known_devices(tracker, known_devices);
 
     tracker->seen_devices = zhashx_new();
     zhashx_set_key_hasher(tracker->seen_devices, uint64_hash);
@@ -67,6 +86,7 @@ void device_tracker_destroy(device_tracker_t** tracker)
 {
     zhashx_destroy(&(*tracker)->seen_devices);
     zhash_destroy(&(*tracker)->known_devices);
+    free((*tracker)->localhost_spec);
     *tracker = NULL;
 }
 
@@ -88,6 +108,7 @@ size_t device_tracker_calculate_gap(device_tracker_t* tracker, msg_meta_t* meta,
         info->sequence_number = sequence_number;
         info->credit = INITIAL_HEARTBEAT_CREDIT;
         info->lost = 0;
+        info->lost_recorded = 0;
         info->pub_spec = pub_spec;
         sprintf(info->device_num_str, "%" PRIu32, (uint32_t)device_number);
         int rc = zhashx_insert(tracker->seen_devices, (const void*) device_number, info);
@@ -171,3 +192,150 @@ void device_tracker_record_sequence_numbers(device_tracker_t* tracker, device_nu
         info = zhashx_next(tracker->seen_devices);
     }
 }
+
+void device_tracker_record_lost_messages(device_tracker_t* tracker, device_lost_recorder_fn f)
+{
+    device_info_t *info = zhashx_first(tracker->seen_devices);
+    while (info) {
+        if (info->lost > info->lost_recorded) {
+            f(info->device_number, info->device_num_str, info->lost - info->lost_recorded);
+            info->lost_recorded = info->lost;
+        }
+        info = zhashx_next(tracker->seen_devices);
+    }
+}
+
+size_t device_tracker_get_sequence_numbers(device_tracker_t* tracker, device_sequence_t *result, size_t max)
+{
+    size_t n = 0;
+    device_info_t *info = zhashx_first(tracker->seen_devices);
+    while (info && n < max) {
+        result[n].device_number = info->device_number;
+        result[n].sequence_number = info->sequence_number;
+        n++;
+        info = zhashx_next(tracker->seen_devices);
+    }
+    return n;
+}
+
+void device_tracker_resume(device_tracker_t* tracker, device_sequence_t *sequences, size_t n)
+{
+    int64_t deadline = zclock_mono() + RESUME_SECONDS * 1000;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t device_number = sequences[i].device_number;
+        if (device_number == 0 || zhashx_lookup(tracker->seen_devices, (const void*) device_number))
+            continue;
+        device_info_t *info = zmalloc(sizeof(*info));
+        assert(info);
+        info->device_number = device_number;
+        info->sequence_number = sequences[i].sequence_number;
+        info->resumed_sequence_number = sequences[i].sequence_number;
+        info->resume_deadline = deadline;
+        info->credit = INITIAL_HEARTBEAT_CREDIT;
+        sprintf(info->device_num_str, "%" PRIu32, (uint32_t)device_number);
+        int rc = zhashx_insert(tracker->seen_devices, (const void*) device_number, info);
+        assert(rc == 0);
+        if (!quiet)
+            printf("[I] resuming device %" PRIu64 " at sequence number %" PRIu64 "\n", device_number, info->sequence_number);
+    }
+}
+
+bool device_tracker_message_already_counted(device_tracker_t* tracker, msg_meta_t* meta)
+{
+    uint64_t device_number = meta->device_number;
+    if (device_number == 0)
+        return false;
+    device_info_t *info = zhashx_lookup(tracker->seen_devices, (const void*) device_number);
+    if (info == NULL || info->resumed_sequence_number == 0)
+        return false;
+
+    uint64_t sequence_number = meta->sequence_number;
+    uint64_t resumed = info->resumed_sequence_number;
+    if (sequence_number <= resumed && resumed - sequence_number < RESUME_WINDOW && zclock_mono() < info->resume_deadline)
+        return true;
+
+    // the device has moved on (or has been restarted)
+    info->resumed_sequence_number = 0;
+    if (sequence_number <= resumed) {
+        if (sequence_number > 0)
+            info->sequence_number = sequence_number - 1;
+        else
+            // nothing has been counted since resuming, start counting gaps afresh
+            zhashx_delete(tracker->seen_devices, (const void*) device_number);
+    }
+    return false;
+}
+
+static bool test_already_counted(device_tracker_t* tracker, uint32_t device_number, uint64_t sequence_number)
+{
+    msg_meta_t meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.device_number = device_number;
+    meta.sequence_number = sequence_number;
+    if (device_tracker_message_already_counted(tracker, &meta))
+        return true;
+    // gaps are only counted for messages which aren't dropped
+    size_t gap = device_tracker_calculate_gap(tracker, &meta, NULL);
+    assert(gap == 0);
+    return false;
+}
+
+static void test_expire_resume_deadline(device_tracker_t* tracker, uint64_t device_number)
+{
+    device_info_t *info = zhashx_lookup(tracker->seen_devices, (const void*) device_number);
+    assert(info);
+    info->resume_deadline = 0;
+}
+
+void device_tracker_test(int verbose)
+{
+    printf(" * device-tracker: ");
+    if (verbose)
+        printf("\n");
+
+    zlist_t *devices = zlist_new();
+    device_tracker_t *tracker = device_tracker_new(devices, NULL);
+
+    device_sequence_t sequences[] = {{1, 100}, {2, 50}, {0, 7}, {4, 200000}, {5, 10}, {6, 100}};
+    device_tracker_resume(tracker, sequences, sizeof(sequences) / sizeof(sequences[0]));
+    assert(device_tracker_get_sequence_numbers(tracker, sequences, 6) == 5);
+
+    // messages up to the saved sequence number have been counted before the restart
+    assert(test_already_counted(tracker, 1, 99));
+    assert(test_already_counted(tracker, 1, 100));
+    assert(!test_already_counted(tracker, 1, 101));
+    // once the device has moved on, older messages are counted again
+    msg_meta_t old_meta = { .device_number = 1, .sequence_number = 100 };
+    assert(!device_tracker_message_already_counted(tracker, &old_meta));
+
+    // messages lost while we were down are counted as lost
+    msg_meta_t meta = { .device_number = 2, .sequence_number = 60 };
+    assert(!device_tracker_message_already_counted(tracker, &meta));
+    assert(device_tracker_calculate_gap(tracker, &meta, NULL) == 9);
+
+    // devices which have not been resumed
+    assert(!test_already_counted(tracker, 3, 1));
+    assert(!test_already_counted(tracker, 0, 1));
+
+    // sequence numbers far behind the saved one belong to a restarted device
+    assert(!test_already_counted(tracker, 4, 200000 - RESUME_WINDOW));
+    assert(!test_already_counted(tracker, 4, 200000 - RESUME_WINDOW + 1));
+
+    // after the resume window, messages are counted, even if a restarted device starts at 0
+    test_expire_resume_deadline(tracker, 5);
+    assert(!test_already_counted(tracker, 5, 0));
+    assert(!test_already_counted(tracker, 5, 1));
+    test_expire_resume_deadline(tracker, 6);
+    assert(!test_already_counted(tracker, 6, 90));
+    assert(!test_already_counted(tracker, 6, 91));
+
+    // devices seen before resuming keep their sequence numbers
+    device_sequence_t stale = {1, 5};
+    device_tracker_resume(tracker, &stale, 1);
+    assert(!test_already_counted(tracker, 1, 102));
+
+    device_tracker_destroy(&tracker);
+    zlist_destroy(&devices);
+
+    printf("OK\n");
+}
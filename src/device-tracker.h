@@ -18,16 +18,35 @@ extern "C" {
 
 typedef struct _device_tracker_t device_tracker_t;
 
+typedef struct {
+    uint32_t device_number;
+    uint64_t sequence_number;
+} device_sequence_t;
+
 typedef void (device_number_recorder_fn)(uint32_t device_number, const char* device, int signum);
+typedef void (device_lost_recorder_fn)(uint32_t device_number, const char* device, uint64_t lost);
 
 extern device_tracker_t* device_tracker_new(zlist_t* known_devices, zsock_t* sub_socket);
 extern void device_tracker_destroy(device_tracker_t** tracker);
+// replaces the devices we reconnect to when they go stale
+extern void device_tracker_set_known_devices(device_tracker_t* tracker, zlist_t* known_devices);
 extern size_t device_tracker_calculate_gap(device_tracker_t* tracker, msg_meta_t* meta, const char* pub_spec);
 extern void device_tracker_reconnect_stale_devices(device_tracker_t* tracker);
 extern void device_tracker_record_sequence_numbers(device_tracker_t* tracker, device_number_recorder_fn f);
+// calls f with the number of messages lost since the last call, for devices which lost messages
+extern void device_tracker_record_lost_messages(device_tracker_t* tracker, device_lost_recorder_fn f);
+
+// stores the last sequence number of at most max devices in result and returns their number
+extern size_t device_tracker_get_sequence_numbers(device_tracker_t* tracker, device_sequence_t *result, size_t max);
+// continues counting from sequence numbers saved before a restart. for a few seconds, messages
+// with sequence numbers up to the saved ones are considered to be counted already.
+extern void device_tracker_resume(device_tracker_t* tracker, device_sequence_t *sequences, size_t n);
+extern bool device_tracker_message_already_counted(device_tracker_t* tracker, msg_meta_t* meta);
 
 extern bool log_gaps;
 
+extern void device_tracker_test(int verbose);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,51 +1,168 @@
+#include "logjam-util.h"
+#include "str-builder.h"
 #include "gelf-message.h"
 
-gelf_message* gelf_message_new(const char *host, const char *short_message)
+struct _gelf_message {
+    str_builder *sb;
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+gelf_message* gelf_message_new()
+{
+    gelf_message *msg = zmalloc(sizeof(gelf_message));
+    assert(msg);
+    msg->sb = sb_new(16 * 1024);
+    return msg;
+}
+
+void gelf_message_begin(gelf_message *msg)
+{
+    sb_reset(msg->sb);
+    sb_append(msg->sb, "{\"version\":\"1.1\"", 16);
+}
+
+void gelf_message_end(gelf_message *msg)
+{
+    sb_append(msg->sb, "}", 1);
+}
+
+static inline void append_key(gelf_message *msg, const char *key)
+{
+    sb_append(msg->sb, ",\"", 2);
+    sb_append(msg->sb, key, strlen(key));
+    sb_append(msg->sb, "\":", 2);
+}
+
+void gelf_message_start_string(gelf_message *msg, const char *key)
 {
-    json_object *json = json_object_new_object();
-    json_object_object_add(json, "version", json_object_new_string("1.1"));
-    json_object_object_add(json, "host", json_object_new_string(host));
-    json_object_object_add(json, "short_message", json_object_new_string(short_message));
+    append_key(msg, key);
+    sb_append(msg->sb, "\"", 1);
+}
+
+void gelf_message_finish_string(gelf_message *msg)
+{
+    sb_append(msg->sb, "\"", 1);
+}
+
+void gelf_message_append_string(gelf_message *msg, const char *str, size_t len)
+{
+    const char *end = str + len;
+    const char *run = str;
+    for (const char *p = str; p < end; p++) {
+        unsigned char c = *p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        sb_append(msg->sb, run, p - run);
+        run = p + 1;
+        switch (c) {
+        case '"':  sb_append(msg->sb, "\\\"", 2); break;
+        case '\\': sb_append(msg->sb, "\\\\", 2); break;
+        case '\n': sb_append(msg->sb, "\\n", 2); break;
+        case '\r': sb_append(msg->sb, "\\r", 2); break;
+        case '\t': sb_append(msg->sb, "\\t", 2); break;
+        case '\b': sb_append(msg->sb, "\\b", 2); break;
+        case '\f': sb_append(msg->sb, "\\f", 2); break;
+        default: {
+            char u[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf]};
+            sb_append(msg->sb, u, 6);
+        }
+        }
+    }
+    sb_append(msg->sb, run, end - run);
+}
 
-    return (gelf_message *) json;
+size_t gelf_message_json_escape_length(const char *p, const char *end)
+{
+    if (end - p < 2 || p[0] != '\\')
+        return 0;
+    switch (p[1]) {
+    case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+        return 2;
+    case 'u':
+        if (end - p < 6)
+            return 0;
+        for (int i = 2; i < 6; i++)
+            if (!isxdigit((unsigned char)p[i]))
+                return 0;
+        return 6;
+    }
+    return 0;
+}
+
+void gelf_message_append_json_string(gelf_message *msg, const char *str, size_t len)
+{
+    // valid escape sequences are copied verbatim, only raw control characters (which
+    // lenient JSON producers leave in strings) and backslashes which don't start a
+    // valid escape sequence need to be escaped
+    const char *end = str + len;
+    const char *run = str;
+    for (const char *p = str; p < end; p++) {
+        unsigned char c = *p;
+        if (c == '\\') {
+            size_t n = gelf_message_json_escape_length(p, end);
+            if (n > 0) {
+                p += n - 1;
+                continue;
+            }
+            sb_append(msg->sb, run, p - run);
+            run = p + 1;
+            sb_append(msg->sb, "\\\\", 2);
+            continue;
+        }
+        if (c >= 0x20)
+            continue;
+        sb_append(msg->sb, run, p - run);
+        run = p + 1;
+        char u[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf]};
+        sb_append(msg->sb, u, 6);
+    }
+    sb_append(msg->sb, run, end - run);
 }
 
 void gelf_message_add_string(gelf_message *msg, const char *key, const char *value)
 {
-    json_object *json = (json_object *) msg;
-    json_object_object_add(json, key, json_object_new_string(value));
+    gelf_message_start_string(msg, key);
+    gelf_message_append_string(msg, value, strlen(value));
+    gelf_message_finish_string(msg);
+}
+
+void gelf_message_add_int(gelf_message *msg, const char *key, int64_t value)
+{
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%" PRId64, value);
+    append_key(msg, key);
+    sb_append(msg->sb, buf, n);
 }
 
-void gelf_message_add_double(gelf_message *msg, const char *key, double value)
+void gelf_message_add_timestamp(gelf_message *msg, int64_t ms)
 {
-    json_object *json = (json_object *) msg;
-    json_object_object_add(json, key, json_object_new_double(value));
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%" PRId64 ".%03d", ms / 1000, (int)(ms % 1000));
+    append_key(msg, "timestamp");
+    sb_append(msg->sb, buf, n);
 }
 
-void gelf_message_add_int(gelf_message *msg, const char *key, int value)
+void gelf_message_add_json(gelf_message *msg, const char *key, const char *json, size_t len)
 {
-    json_object *json = (json_object *) msg;
-    json_object_object_add(json, key, json_object_new_int(value));
+    append_key(msg, key);
+    sb_append(msg->sb, json, len);
 }
 
-void gelf_message_add_json_object(gelf_message *msg, const char *key, json_object *obj)
+const char* gelf_message_to_string(gelf_message *msg)
 {
-    json_object *json = (json_object *) msg;
-    // obj is now part of two container objects, so: increment reference count
-    json_object_get(obj);
-    json_object_object_add(json, key, obj);
+    return sb_string(msg->sb);
 }
 
-const char* gelf_message_to_string(const gelf_message *msg)
+size_t gelf_message_size(gelf_message *msg)
 {
-    json_object *json = (json_object *) msg;
-    return json_object_to_json_string_ext(json, JSON_C_TO_STRING_PLAIN);
+    return sb_length(msg->sb);
 }
 
 void gelf_message_destroy(gelf_message **msg)
 {
     if (*msg == NULL) return;
-    json_object *json = (json_object *) *msg;
-    json_object_put(json);
+    sb_destroy(&(*msg)->sb);
+    free(*msg);
     *msg = NULL;
 }
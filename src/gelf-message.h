@@ -1,25 +1,51 @@
 #ifndef __GELF_MESSAGE_H_INCLUDED__
 #define __GELF_MESSAGE_H_INCLUDED__
 
-#include <json-c/json.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 
-#define gelf_message_add_full_message(m,v) gelf_message_add_string(m, "full_message", v)
-#define gelf_message_add_timestamp(m,v) gelf_message_add_double(m, "timestamp", v)
-#define gelf_message_add_level(m,v) gelf_message_add_int(m, "level", v)
+// A GELF message is written as JSON text directly into a reusable buffer. Fields are
+// appended in the order of the calls, callers must make sure no field is added twice.
 
-typedef json_object gelf_message;
+typedef struct _gelf_message gelf_message;
 
-gelf_message* gelf_message_new(const char *host, const char *short_message);
+gelf_message* gelf_message_new();
+
+// discards the current contents and opens a new message (writes the version field)
+void gelf_message_begin(gelf_message *msg);
+
+// closes the message
+void gelf_message_end(gelf_message *msg);
 
 void gelf_message_add_string(gelf_message *msg, const char *key, const char *value);
 
-void gelf_message_add_double(gelf_message *msg, const char *key, double value);
+void gelf_message_add_int(gelf_message *msg, const char *key, int64_t value);
+
+// adds a timestamp field (seconds since the epoch, millisecond precision)
+void gelf_message_add_timestamp(gelf_message *msg, int64_t ms);
+
+// adds a field with a value which is already valid JSON text
+void gelf_message_add_json(gelf_message *msg, const char *key, const char *json, size_t len);
+
+// string values can be assembled piecewise: start, append any number of parts, finish
+void gelf_message_start_string(gelf_message *msg, const char *key);
+
+// appends a part which needs escaping
+void gelf_message_append_string(gelf_message *msg, const char *str, size_t len);
+
+// appends a part taken from a JSON string literal (already escaped, without quotes).
+// invalid escape sequences are kept as text, with the backslash escaped.
+void gelf_message_append_json_string(gelf_message *msg, const char *str, size_t len);
+
+// returns the length of the valid JSON escape sequence starting at p, 0 if there is none
+size_t gelf_message_json_escape_length(const char *p, const char *end);
 
-void gelf_message_add_int(gelf_message *msg, const char *key, int value);
+void gelf_message_finish_string(gelf_message *msg);
 
-void gelf_message_add_json_object(gelf_message *msg, const char *key, json_object *obj);
+const char* gelf_message_to_string(gelf_message *msg);
 
-const char* gelf_message_to_string(const gelf_message *msg);
+size_t gelf_message_size(gelf_message *msg);
 
 void gelf_message_destroy(gelf_message **msg);
 
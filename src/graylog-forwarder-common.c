@@ -1,33 +1,16 @@
 #include "graylog-forwarder-common.h"
 
 bool compress_gelf = false;
+int gelf_compression_level = Z_DEFAULT_COMPRESSION;
 
 zlist_t *hosts = NULL;
 char *interface = NULL;
+zlist_t *gelf_endpoints = NULL;
 zlist_t *subscriptions = NULL;
 
 int rcv_hwm = -1;
 int snd_hwm = -1;
 
-
-compressed_gelf_t *
-compressed_gelf_new(Bytef *data, uLongf len)
-{
-    compressed_gelf_t *self = zmalloc(sizeof(*self));
-    if (self) {
-        self->data = data;
-        self->len = len;
-    }
-    return self;
-}
-
-void compressed_gelf_destroy(compressed_gelf_t **self_p)
-{
-    assert (self_p);
-    if (*self_p) {
-        compressed_gelf_t *self = *self_p;
-        free (self->data);
-        free (self);
-        *self_p = NULL;
-    }
-}
+char *spool_directory = NULL;
+size_t spool_max_size = 0;
+unsigned int spool_drain_rate = 0;
@@ -10,6 +10,7 @@ extern "C" {
 #endif
 
 extern bool compress_gelf;
+extern int gelf_compression_level;
 
 #define DEFAULT_RCV_HWM       10000
 #define DEFAULT_RCV_HWM_STR  "10000"
@@ -23,22 +24,26 @@ extern char* headers_file_name;
 
 extern zlist_t *hosts;
 extern char *interface;
+extern zlist_t *gelf_endpoints;
 extern zlist_t *subscriptions;
 
 extern int rcv_hwm;
 extern int snd_hwm;
 
+#define SPOOL_SEGMENT_SIZE (64 * 1024 * 1024)
+#define DEFAULT_SPOOL_MAX_SIZE 1024
+#define DEFAULT_SPOOL_DRAIN_RATE 10000
+
+extern char *spool_directory;
+extern size_t spool_max_size;           // MB
+extern unsigned int spool_drain_rate;   // messages per second
+
 extern const char* default_datacenter;
 
 #define MAX_PARSERS 20
 extern unsigned int num_parsers;
 
-typedef struct {
-    Bytef *data;
-    uLongf len;
-} compressed_gelf_t;
-
-extern compressed_gelf_t* compressed_gelf_new(Bytef *data, uLongf len);
-extern void compressed_gelf_destroy(compressed_gelf_t **self_p);
+#define MAX_SUBSCRIBERS 10
+extern unsigned int num_subscribers;
 
 #endif
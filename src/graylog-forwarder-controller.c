@@ -7,7 +7,7 @@
 #include "importer-watchdog.h"
 
 /*
- *                 --- PIPE ---  subscriber
+ *                 --- PIPE ---  subscribers(NUM_SUBSCRIBERS)
  *  controller:    --- PIPE ---  parsers(NUM_PARSERS)
  *                 --- PIPE ---  writer
  *                 --- PIPE ---  watchdog
@@ -16,10 +16,11 @@
 // The controller creates all other threads/actors.
 
 unsigned int num_parsers = 8;
+unsigned int num_subscribers = 1;
 
 typedef struct {
     zconfig_t *config;
-    zactor_t *subscriber;
+    zactor_t *subscribers[MAX_SUBSCRIBERS];
     zactor_t *parsers[MAX_PARSERS];
     zactor_t *writer;
     zactor_t *stream_config_updater;
@@ -34,8 +35,10 @@ bool controller_create_actors(controller_state_t *state, zlist_t* devices, int r
     // start the stream config updater
     state->stream_config_updater = stream_config_updater_new(NULL);
 
-    // create subscriber
-    state->subscriber = graylog_forwarder_subscriber_new(state->config, devices, rcv_hwm, send_hwm);
+    // create subscribers, each connecting to a subset of the devices
+    for (size_t i=0; i<num_subscribers; i++) {
+        state->subscribers[i] = graylog_forwarder_subscriber_new(state->config, devices, rcv_hwm, send_hwm, i);
+    }
 
     // create the parsers
     for (size_t i=0; i<num_parsers; i++) {
@@ -54,7 +57,9 @@ bool controller_create_actors(controller_state_t *state, zlist_t* devices, int r
 static
 void controller_destroy_actors(controller_state_t *state)
 {
-    zactor_destroy(&state->subscriber);
+    for (size_t i=0; i<num_subscribers; i++) {
+        zactor_destroy(&state->subscribers[i]);
+    }
     zactor_destroy(&state->writer);
     for (size_t i=0; i<num_parsers; i++) {
         graylog_forwarder_parser_destroy(&state->parsers[i]);
@@ -73,18 +78,22 @@ int send_tick_commands(zloop_t *loop, int timer_id, void *arg)
 
     // send tick commands to actors to let them print out their stats
     zstr_send(state->writer, "tick");
-    zstr_send(state->subscriber, "tick");
+    for (size_t i=0; i<num_subscribers; i++) {
+        zstr_send(state->subscribers[i], "tick");
+    }
     for (size_t i=0; i<num_parsers; i++) {
         zstr_send(state->parsers[i], "tick");
     }
 
-    // get number of messages received by subscriber
+    // get number of messages received by subscribers
     size_t messages_received = 0;
-    zmsg_t *response = zmsg_recv(state->subscriber);
-    if (response) {
-        zframe_t *frame = zmsg_first(response);
-        messages_received = zframe_getsize(frame);
-        zmsg_destroy(&response);
+    for (size_t i=0; i<num_subscribers; i++) {
+        zmsg_t *response = zmsg_recv(state->subscribers[i]);
+        if (response) {
+            zframe_t *frame = zmsg_first(response);
+            messages_received += zframe_getsize(frame);
+            zmsg_destroy(&response);
+        }
     }
     if (messages_received > 0)
         zstr_send(state->watchdog, "tick");
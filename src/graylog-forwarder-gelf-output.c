@@ -0,0 +1,499 @@
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "graylog-forwarder-gelf-output.h"
+
+#define GELF_BATCH_MESSAGES 64
+#define GELF_BATCH_BYTES (1024 * 1024)
+#define GELF_CHUNK_HEADER_SIZE 12
+#define GELF_MAX_DATAGRAMS 256
+#define GELF_MIN_BACKOFF 100
+#define GELF_MAX_BACKOFF 30000
+#define GELF_SEND_TIMEOUT 1000
+
+typedef enum { GELF_UDP, GELF_TCP } gelf_transport_t;
+
+typedef struct {
+    size_t offset;
+    size_t len;
+} gelf_pending_t;
+
+typedef struct {
+    gelf_transport_t transport;
+    const char *spec;
+    char *host;
+    char port[16];
+    int fd;                                     // -1 if not connected
+    int64_t retry_at;                           // when to try to reconnect
+    int backoff;                                // current reconnect delay (msecs)
+    int64_t last_error_logged;
+    char *data;                                 // queued messages
+    size_t data_len;
+    size_t data_size;
+    gelf_pending_t pending[GELF_BATCH_MESSAGES];
+    size_t num_pending;
+} gelf_endpoint_t;
+
+struct _gelf_output_t {
+    size_t num_endpoints;
+    gelf_endpoint_t *endpoints;
+    size_t next;                                // round robin position
+    uint64_t message_id;                        // id of the last chunked message
+};
+
+static bool parse_endpoint(const char *spec, gelf_endpoint_t *endpoint)
+{
+    // the endpoint gets destroyed even if parsing fails
+    endpoint->spec = spec;
+    endpoint->host = NULL;
+    endpoint->fd = -1;
+
+    if (!strncmp(spec, "udp://", 6))
+        endpoint->transport = GELF_UDP;
+    else if (!strncmp(spec, "tcp://", 6))
+        endpoint->transport = GELF_TCP;
+    else
+        return false;
+
+    const char *host = spec + 6;
+    const char *colon = strrchr(host, ':');
+    if (colon) {
+        char *end;
+        unsigned long port = strtoul(colon + 1, &end, 10);
+        if (*end || port == 0 || port > 65535)
+            return false;
+        snprintf(endpoint->port, sizeof(endpoint->port), "%lu", port);
+        endpoint->host = strndup(host, colon - host);
+    } else {
+        snprintf(endpoint->port, sizeof(endpoint->port), "%d", DEFAULT_GELF_PORT);
+        endpoint->host = strdup(host);
+    }
+    return *endpoint->host != '\0';
+}
+
+static void schedule_reconnect(gelf_endpoint_t *endpoint)
+{
+    if (endpoint->backoff == 0)
+        endpoint->backoff = GELF_MIN_BACKOFF;
+    else if ((endpoint->backoff *= 2) > GELF_MAX_BACKOFF)
+        endpoint->backoff = GELF_MAX_BACKOFF;
+    endpoint->retry_at = zclock_mono() + endpoint->backoff;
+}
+
+static void log_endpoint_error(gelf_endpoint_t *endpoint, const char *what, const char *error)
+{
+    // at most one message per second and endpoint
+    int64_t now = zclock_mono();
+    if (now - endpoint->last_error_logged < 1000)
+        return;
+    endpoint->last_error_logged = now;
+    fprintf(stderr, "[W] gelf-output: %s %s failed: %s\n", what, endpoint->spec, error);
+}
+
+static bool connect_endpoint(gelf_endpoint_t *endpoint)
+{
+    struct addrinfo hints = {0}, *addresses;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = endpoint->transport == GELF_UDP ? SOCK_DGRAM : SOCK_STREAM;
+    int rc = getaddrinfo(endpoint->host, endpoint->port, &hints, &addresses);
+    if (rc) {
+        log_endpoint_error(endpoint, "resolving", gai_strerror(rc));
+        schedule_reconnect(endpoint);
+        return false;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *a = addresses; a; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0)
+            continue;
+        // also limits the time connect blocks
+        struct timeval timeout = { GELF_SEND_TIMEOUT / 1000, (GELF_SEND_TIMEOUT % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+
+    if (fd < 0) {
+        log_endpoint_error(endpoint, "connecting to", strerror(errno));
+        schedule_reconnect(endpoint);
+        return false;
+    }
+    printf("[I] gelf-output: connected to %s\n", endpoint->spec);
+    endpoint->fd = fd;
+    endpoint->backoff = 0;
+    return true;
+}
+
+static void disconnect_endpoint(gelf_endpoint_t *endpoint, int error)
+{
+    log_endpoint_error(endpoint, "sending to", strerror(error));
+    close(endpoint->fd);
+    endpoint->fd = -1;
+    schedule_reconnect(endpoint);
+}
+
+static bool ensure_connected(gelf_endpoint_t *endpoint)
+{
+    if (endpoint->fd >= 0)
+        return true;
+    if (zclock_mono() < endpoint->retry_at)
+        return false;
+    return connect_endpoint(endpoint);
+}
+
+gelf_output_t* gelf_output_new(zlist_t *endpoints)
+{
+    gelf_output_t *output = zmalloc(sizeof(*output));
+    output->num_endpoints = zlist_size(endpoints);
+    output->endpoints = zmalloc(output->num_endpoints * sizeof(gelf_endpoint_t));
+    // chunked message ids must be unique per graylog input, not only per process
+    output->message_id = ((uint64_t)getpid() << 40) ^ (uint64_t)zclock_usecs();
+
+    size_t i = 0;
+    for (const char *spec = zlist_first(endpoints); spec; spec = zlist_next(endpoints), i++) {
+        if (!parse_endpoint(spec, &output->endpoints[i])) {
+            fprintf(stderr, "[E] gelf-output: invalid endpoint spec: %s\n", spec);
+            output->num_endpoints = i + 1;
+            gelf_output_destroy(&output);
+            return NULL;
+        }
+    }
+    if (output->num_endpoints == 0)
+        gelf_output_destroy(&output);
+    return output;
+}
+
+void gelf_output_destroy(gelf_output_t **output_p)
+{
+    gelf_output_t *output = *output_p;
+    if (output == NULL)
+        return;
+    gelf_output_flush(output);
+    for (size_t i = 0; i < output->num_endpoints; i++) {
+        gelf_endpoint_t *endpoint = &output->endpoints[i];
+        if (endpoint->fd >= 0)
+            close(endpoint->fd);
+        free(endpoint->host);
+        free(endpoint->data);
+    }
+    free(output->endpoints);
+    free(output);
+    *output_p = NULL;
+}
+
+bool gelf_output_ready(gelf_output_t *output)
+{
+    bool ready = false;
+    for (size_t i = 0; i < output->num_endpoints; i++)
+        ready |= ensure_connected(&output->endpoints[i]);
+    return ready;
+}
+
+static void clear_pending(gelf_endpoint_t *endpoint)
+{
+    endpoint->num_pending = 0;
+    endpoint->data_len = 0;
+}
+
+// removes the first n pending messages
+static void remove_pending(gelf_endpoint_t *endpoint, size_t n)
+{
+    if (n == 0)
+        return;
+    size_t remaining = endpoint->num_pending - n;
+    size_t base = endpoint->pending[n].offset;
+    memmove(endpoint->data, endpoint->data + base, endpoint->data_len - base);
+    memmove(endpoint->pending, endpoint->pending + n, remaining * sizeof(gelf_pending_t));
+    for (size_t i = 0; i < remaining; i++)
+        endpoint->pending[i].offset -= base;
+    endpoint->data_len -= base;
+    endpoint->num_pending = remaining;
+}
+
+static void send_datagrams(gelf_endpoint_t *endpoint, struct mmsghdr *datagrams, size_t n)
+{
+    size_t sent = 0;
+    while (sent < n) {
+        int rc = sendmmsg(endpoint->fd, datagrams + sent, n - sent, 0);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            // graylog not listening (ECONNREFUSED) or send buffer full: UDP is lossy anyway
+            log_endpoint_error(endpoint, "sending to", strerror(errno));
+            return;
+        }
+        sent += rc;
+    }
+}
+
+static void flush_udp(gelf_output_t *output, gelf_endpoint_t *endpoint)
+{
+    struct mmsghdr datagrams[GELF_MAX_DATAGRAMS];
+    struct iovec iovs[GELF_MAX_DATAGRAMS][2];
+    unsigned char headers[GELF_MAX_DATAGRAMS][GELF_CHUNK_HEADER_SIZE];
+    size_t n = 0;
+
+    memset(datagrams, 0, sizeof(datagrams));
+    for (size_t i = 0; i < endpoint->num_pending; i++) {
+        char *data = endpoint->data + endpoint->pending[i].offset;
+        size_t len = endpoint->pending[i].len;
+        size_t count = (len + GELF_UDP_CHUNK_SIZE - 1) / GELF_UDP_CHUNK_SIZE;
+        if (count > GELF_MAX_CHUNKS) {
+            log_endpoint_error(endpoint, "chunking message for", "message too large");
+            continue;
+        }
+        uint64_t id = count > 1 ? ++output->message_id : 0;
+        for (size_t seq = 0; seq < count; seq++) {
+            if (n == GELF_MAX_DATAGRAMS) {
+                send_datagrams(endpoint, datagrams, n);
+                n = 0;
+            }
+            struct msghdr *hdr = &datagrams[n].msg_hdr;
+            hdr->msg_iov = iovs[n];
+            if (count == 1) {
+                iovs[n][0] = (struct iovec){ data, len };
+                hdr->msg_iovlen = 1;
+            } else {
+                unsigned char *header = headers[n];
+                header[0] = 0x1e;
+                header[1] = 0x0f;
+                memcpy(header + 2, &id, 8);
+                header[10] = seq;
+                header[11] = count;
+                size_t offset = seq * GELF_UDP_CHUNK_SIZE;
+                size_t chunk_len = len - offset < GELF_UDP_CHUNK_SIZE ? len - offset : GELF_UDP_CHUNK_SIZE;
+                iovs[n][0] = (struct iovec){ header, GELF_CHUNK_HEADER_SIZE };
+                iovs[n][1] = (struct iovec){ data + offset, chunk_len };
+                hdr->msg_iovlen = 2;
+            }
+            n++;
+        }
+    }
+    if (n > 0)
+        send_datagrams(endpoint, datagrams, n);
+    clear_pending(endpoint);
+}
+
+static void flush_tcp(gelf_endpoint_t *endpoint)
+{
+    static char terminator = '\0';
+    struct iovec iov[2 * GELF_BATCH_MESSAGES];
+    size_t n = 0;
+    for (size_t i = 0; i < endpoint->num_pending; i++) {
+        iov[n++] = (struct iovec){ endpoint->data + endpoint->pending[i].offset, endpoint->pending[i].len };
+        iov[n++] = (struct iovec){ &terminator, 1 };
+    }
+
+    size_t first = 0;
+    while (first < n) {
+        struct msghdr hdr = { .msg_iov = iov + first, .msg_iovlen = n - first };
+        ssize_t rc = sendmsg(endpoint->fd, &hdr, MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            disconnect_endpoint(endpoint, errno);
+            // partially sent messages are sent again after reconnecting
+            remove_pending(endpoint, first / 2);
+            return;
+        }
+        while (rc > 0) {
+            if ((size_t)rc >= iov[first].iov_len) {
+                rc -= iov[first].iov_len;
+                first++;
+            } else {
+                iov[first].iov_base = (char*)iov[first].iov_base + rc;
+                iov[first].iov_len -= rc;
+                rc = 0;
+            }
+        }
+    }
+    clear_pending(endpoint);
+}
+
+static void flush_endpoint(gelf_output_t *output, gelf_endpoint_t *endpoint)
+{
+    if (endpoint->num_pending == 0 || !ensure_connected(endpoint))
+        return;
+    if (endpoint->transport == GELF_UDP)
+        flush_udp(output, endpoint);
+    else
+        flush_tcp(endpoint);
+}
+
+static bool queue_message(gelf_output_t *output, gelf_endpoint_t *endpoint, const void *data, size_t len)
+{
+    if (endpoint->num_pending == GELF_BATCH_MESSAGES
+        || (endpoint->num_pending > 0 && endpoint->data_len + len > GELF_BATCH_BYTES))
+        flush_endpoint(output, endpoint);
+    // flushing fails if the connection broke
+    if (endpoint->num_pending == GELF_BATCH_MESSAGES)
+        return false;
+
+    if (endpoint->data_len + len > endpoint->data_size) {
+        size_t size = 2 * endpoint->data_size;
+        if (size < endpoint->data_len + len)
+            size = endpoint->data_len + len;
+        endpoint->data = realloc(endpoint->data, size);
+        assert(endpoint->data);
+        endpoint->data_size = size;
+    }
+    memcpy(endpoint->data + endpoint->data_len, data, len);
+    endpoint->pending[endpoint->num_pending++] = (gelf_pending_t){ endpoint->data_len, len };
+    endpoint->data_len += len;
+
+    if (endpoint->num_pending == GELF_BATCH_MESSAGES)
+        flush_endpoint(output, endpoint);
+    return true;
+}
+
+bool gelf_output_send(gelf_output_t *output, const void *data, size_t len)
+{
+    size_t n = output->num_endpoints;
+    for (size_t i = 0; i < n; i++) {
+        size_t j = (output->next + i) % n;
+        gelf_endpoint_t *endpoint = &output->endpoints[j];
+        if (ensure_connected(endpoint) && queue_message(output, endpoint, data, len)) {
+            output->next = (j + 1) % n;
+            return true;
+        }
+    }
+    return false;
+}
+
+void gelf_output_flush(gelf_output_t *output)
+{
+    for (size_t i = 0; i < output->num_endpoints; i++)
+        flush_endpoint(output, &output->endpoints[i]);
+}
+
+static int test_listener_new(int type, char *spec, size_t n)
+{
+    int fd = socket(AF_INET, type, 0);
+    assert(fd >= 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    assert(rc == 0);
+    socklen_t addr_len = sizeof(addr);
+    rc = getsockname(fd, (struct sockaddr*)&addr, &addr_len);
+    assert(rc == 0);
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    snprintf(spec, n, "%s://127.0.0.1:%d", type == SOCK_DGRAM ? "udp" : "tcp", ntohs(addr.sin_port));
+    return fd;
+}
+
+void gelf_output_test(int verbose)
+{
+    printf(" * gelf-output: ");
+    if (verbose)
+        printf("\n");
+
+    size_t large_len = 3 * GELF_UDP_CHUNK_SIZE + 100;
+    char *large = zmalloc(large_len);
+    for (size_t i = 0; i < large_len; i++)
+        large[i] = 'a' + i % 26;
+    const char *small = "{\"version\":\"1.1\"}";
+    size_t small_len = strlen(small);
+
+    char spec[64];
+    zlist_t *endpoints = zlist_new();
+    assert(gelf_output_new(endpoints) == NULL);
+    zlist_append(endpoints, "http://127.0.0.1:12201");
+    assert(gelf_output_new(endpoints) == NULL);
+    zlist_purge(endpoints);
+
+    // UDP: a large message is sent in chunks which can be reassembled
+    int udp = test_listener_new(SOCK_DGRAM, spec, sizeof(spec));
+    zlist_append(endpoints, spec);
+    gelf_output_t *output = gelf_output_new(endpoints);
+    assert(output);
+    assert(gelf_output_ready(output));
+    assert(gelf_output_send(output, large, large_len));
+    assert(gelf_output_send(output, small, small_len));
+    gelf_output_flush(output);
+
+    char *reassembled = zmalloc(large_len);
+    size_t reassembled_len = 0;
+    int chunks = 0;
+    uint64_t message_id = 0;
+    bool small_received = false;
+    char datagram[GELF_UDP_CHUNK_SIZE + GELF_CHUNK_HEADER_SIZE];
+    while (chunks < 4 || !small_received) {
+        ssize_t n = recv(udp, datagram, sizeof(datagram), 0);
+        assert(n > 0);
+        if ((unsigned char)datagram[0] == 0x1e && (unsigned char)datagram[1] == 0x0f) {
+            uint64_t id;
+            memcpy(&id, datagram + 2, 8);
+            if (chunks++ == 0)
+                message_id = id;
+            assert(id == message_id);
+            assert(datagram[11] == 4);
+            int seq = datagram[10];
+            assert(seq >= 0 && seq < 4);
+            memcpy(reassembled + seq * GELF_UDP_CHUNK_SIZE, datagram + GELF_CHUNK_HEADER_SIZE, n - GELF_CHUNK_HEADER_SIZE);
+            reassembled_len += n - GELF_CHUNK_HEADER_SIZE;
+        } else {
+            assert((size_t)n == small_len);
+            assert(memcmp(datagram, small, n) == 0);
+            small_received = true;
+        }
+    }
+    assert(reassembled_len == large_len);
+    assert(memcmp(reassembled, large, large_len) == 0);
+    free(reassembled);
+    gelf_output_destroy(&output);
+    close(udp);
+    zlist_purge(endpoints);
+
+    // TCP: messages are null terminated
+    int listener = test_listener_new(SOCK_STREAM, spec, sizeof(spec));
+    int rc = listen(listener, 1);
+    assert(rc == 0);
+    zlist_append(endpoints, spec);
+    output = gelf_output_new(endpoints);
+    assert(output);
+    assert(gelf_output_ready(output));
+    int connection = accept(listener, NULL, NULL);
+    assert(connection >= 0);
+    struct timeval timeout = { 1, 0 };
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    assert(gelf_output_send(output, small, small_len));
+    assert(gelf_output_send(output, large, large_len));
+    gelf_output_flush(output);
+
+    size_t expected_len = small_len + 1 + large_len + 1;
+    char *stream = zmalloc(expected_len);
+    size_t stream_len = 0;
+    while (stream_len < expected_len) {
+        ssize_t n = recv(connection, stream + stream_len, expected_len - stream_len, 0);
+        assert(n > 0);
+        stream_len += n;
+    }
+    assert(memcmp(stream, small, small_len) == 0);
+    assert(stream[small_len] == '\0');
+    assert(memcmp(stream + small_len + 1, large, large_len) == 0);
+    assert(stream[expected_len - 1] == '\0');
+    free(stream);
+    gelf_output_destroy(&output);
+    close(connection);
+    close(listener);
+
+    // no endpoint available
+    zlist_purge(endpoints);
+    zlist_append(endpoints, spec);
+    output = gelf_output_new(endpoints);
+    assert(!gelf_output_ready(output));
+    assert(!gelf_output_send(output, small, small_len));
+    gelf_output_destroy(&output);
+
+    zlist_destroy(&endpoints);
+    free(large);
+
+    printf("OK\n");
+}
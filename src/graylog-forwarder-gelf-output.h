@@ -0,0 +1,44 @@
+#ifndef __LOGJAM_GRAYLOG_FORWARDER_GELF_OUTPUT_H_INCLUDED__
+#define __LOGJAM_GRAYLOG_FORWARDER_GELF_OUTPUT_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sends GELF messages directly to graylog GELF UDP or TCP inputs. Endpoints are given as
+// udp://host:port or tcp://host:port (port defaults to 12201). Messages are distributed
+// round robin over all connected endpoints and queued per endpoint; queued messages are
+// sent with a single sendmmsg (UDP) or writev (TCP) call when the batch is full or the
+// output is flushed. UDP messages larger than a datagram are split into GELF chunks, TCP
+// messages are terminated by a null byte. Broken TCP connections are reestablished with
+// exponential backoff.
+
+#define DEFAULT_GELF_PORT 12201
+#define GELF_UDP_CHUNK_SIZE 8154
+#define GELF_MAX_CHUNKS 128
+
+typedef struct _gelf_output_t gelf_output_t;
+
+// returns NULL if one of the endpoint specs is invalid
+extern gelf_output_t* gelf_output_new(zlist_t *endpoints);
+extern void gelf_output_destroy(gelf_output_t **output_p);
+
+// true if at least one endpoint is connected. tries to reconnect endpoints whose backoff
+// period has passed.
+extern bool gelf_output_ready(gelf_output_t *output);
+
+// queues a message for sending; returns false if no endpoint is connected
+extern bool gelf_output_send(gelf_output_t *output, const void *data, size_t len);
+
+// sends all queued messages
+extern void gelf_output_flush(gelf_output_t *output);
+
+extern void gelf_output_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,18 +8,21 @@ typedef struct {
     char me[16];
     zconfig_t *config;
     zsock_t *pipe;                          // actor commands
-    zsock_t *pull_socket;                   // incoming messages from subscriber
+    zsock_t *pull_socket;                   // incoming messages from subscribers
     zsock_t *push_socket;                   // outgoing messages to writer
     zchunk_t *decompression_buffer;         // grows dynamically on demand
     zchunk_t *scratch_buffer;               // scratch buffer for string operations
-    json_tokener *tokener;                  // json tokener instance
+    z_stream deflate_stream;                // reused for all messages (reset after each)
+    zchunk_t *compression_buffer;           // output buffer for compressed GELF messages
+    gelf_message *gelf_msg;                 // reusable GELF output buffer
     zhash_t *stream_info_cache;             // thread local stream info cache
-    zhash_t *headers;                       // whitelisted HTTP headers
+    header_matcher_t *headers;              // whitelisted HTTP headers and sensitive cookies
     size_t gelf_bytes;                      // size of uncompressed GELF messages
     size_t ticks;
     bool received_term_cmd;
     zlist_t* sensitive_cookies;
-    zchunk_t *obfuscation_buffer;
+    zchunk_t *obfuscation_buffer;           // output buffer for the cookie masker
+    gelf_sampler_t *sampler;                // per stream sampling and rate limits
 } parser_state_t;
 
 
@@ -38,17 +41,26 @@ static char *default_headers[] = {
     NULL
 };
 
-static zhash_t* default_headers_hash() {
-    zhash_t *headers = zhash_new();
+static zlist_t* default_headers_list() {
+    zlist_t *headers = zlist_new();
+    zlist_autofree(headers);
 
     for (char **p = &default_headers[0]; *p; p++) {
         // printf("[D] adding default header: %s\n", *p);
-        zhash_insert(headers, *p, (void*)1);
+        zlist_append(headers, *p);
     }
 
     return headers;
 }
 
+static header_matcher_t* default_headers_matcher(parser_state_t *state) {
+    zlist_t *headers = default_headers_list();
+    header_matcher_t *matcher = header_matcher_new(headers, state->sensitive_cookies);
+    zlist_destroy(&headers);
+    return matcher;
+}
+
+// recompiles the header matcher from the default headers and the headers file
 static void load_headers(parser_state_t *state) {
     if (headers_file_name == NULL)
         return;
@@ -57,8 +69,7 @@ static void load_headers(parser_state_t *state) {
     if (!file)
         return;
 
-    zhash_destroy(&state->headers);
-    state->headers = default_headers_hash();
+    zlist_t *headers = default_headers_list();
 
     char line[256] = {0};
     while (fgets(line, 256, file)) {
@@ -68,10 +79,37 @@ static void load_headers(parser_state_t *state) {
         }
         if (n > 0) {
             // printf("[D] adding whitelisted header: %s\n", line);
-            zhash_insert(state->headers, line, (void*)1);
+            zlist_append(headers, line);
         }
     }
     fclose(file);
+
+    header_matcher_destroy(&state->headers);
+    state->headers = header_matcher_new(headers, state->sensitive_cookies);
+    zlist_destroy(&headers);
+}
+
+// compresses data into the parser's compression buffer, returns the compressed size.
+// avoids the allocation and initialization of a deflate state for every message.
+static
+size_t compress_gelf_data(parser_state_t *state, const char *data, size_t len)
+{
+    z_stream *zs = &state->deflate_stream;
+    uLong bound = deflateBound(zs, len);
+    zchunk_ensure_size(state->compression_buffer, bound);
+
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = len;
+    zs->next_out = zchunk_data(state->compression_buffer);
+    zs->avail_out = bound;
+    int rc = deflate(zs, Z_FINISH);
+    assert(rc == Z_STREAM_END);
+
+    size_t compressed_len = zs->total_out;
+    rc = deflateReset(zs);
+    assert(rc == Z_OK);
+
+    return compressed_len;
 }
 
 static
@@ -80,16 +118,15 @@ int process_message(zloop_t *loop, zsock_t *socket, void *arg)
     // printf("[I] graylog-forwarder-parser [%zu]: process_logjam_message\n", state->id);
     parser_state_t *state = arg;
     logjam_message *logjam_msg = logjam_message_read(socket);
-    gelf_message *gelf_msg = NULL;
+    gelf_message *gelf_msg = state->gelf_msg;
 
     if (logjam_msg && !zsys_interrupted) {
-        gelf_msg = logjam_message_to_gelf (logjam_msg, state->tokener, state->stream_info_cache, state->decompression_buffer, state->scratch_buffer, state->headers, state->sensitive_cookies, state->obfuscation_buffer);
-        // gelf message can be null for unknown streams or unparseable json
-        if (gelf_msg == NULL) {
+        // conversion fails for unknown streams, unparseable json, or sampled requests
+        if (!logjam_message_to_gelf (logjam_msg, gelf_msg, state->stream_info_cache, state->decompression_buffer, state->scratch_buffer, state->headers, state->obfuscation_buffer, state->sampler)) {
             goto cleanup;
         }
         const char *gelf_data = gelf_message_to_string (gelf_msg);
-        size_t gelf_source_bytes = strlen(gelf_data);
+        size_t gelf_source_bytes = gelf_message_size (gelf_msg);
         state->gelf_bytes += gelf_source_bytes;
 
         graylog_forwarder_prometheus_client_count_msg_for_stream(logjam_msg->stream);
@@ -103,19 +140,11 @@ int process_message(zloop_t *loop, zsock_t *socket, void *arg)
         zmsg_addstr(msg, logjam_msg->stream);
 
         if (compress_gelf) {
-            const Bytef *raw_data = (Bytef *)gelf_data;
-            uLong raw_len = strlen(gelf_data);
-            uLongf compressed_len = compressBound(raw_len);
-            Bytef *compressed_data = zmalloc(compressed_len);
-            int rc = compress(compressed_data, &compressed_len, raw_data, raw_len);
-            assert(rc == Z_OK);
-
-            // printf("[D] GELF bytes uncompressed/compressed: %ld/%ld\n", raw_len, compressed_len);
-
-            compressed_gelf_t *compressed_gelf = compressed_gelf_new(compressed_data, compressed_len);
-            zmsg_addptr(msg, compressed_gelf);
+            size_t compressed_len = compress_gelf_data(state, gelf_data, gelf_source_bytes);
+            // printf("[D] GELF bytes uncompressed/compressed: %zu/%zu\n", gelf_source_bytes, compressed_len);
+            zmsg_addmem(msg, zchunk_data(state->compression_buffer), compressed_len);
         } else {
-            zmsg_addstr(msg, gelf_data);
+            zmsg_addmem(msg, gelf_data, gelf_source_bytes);
         }
 
         while (!zsys_interrupted && !output_socket_ready(state->push_socket, 1000)) {
@@ -127,11 +156,9 @@ int process_message(zloop_t *loop, zsock_t *socket, void *arg)
         } else {
             zmsg_destroy(&msg);
         }
-        // we don't free gelf_data because it's owned by the json library
     }
 
  cleanup:
-    gelf_message_destroy(&gelf_msg);
     logjam_message_destroy(&logjam_msg);
     return 0;
 }
@@ -142,15 +169,17 @@ zsock_t* parser_pull_socket_new()
     int rc;
     zsock_t *socket = zsock_new(ZMQ_PULL);
     assert(socket);
-    // connect socket, taking thread startup time into account
+    // connect socket to all subscribers, taking thread startup time into account
     // TODO: this is a hack. better let controller coordinate this
-    for (int i=0; i<10; i++) {
-        rc = zsock_connect(socket, "inproc://graylog-forwarder-subscriber");
-        if (rc == 0) break;
-        zclock_sleep(100);
+    for (size_t j=0; j<num_subscribers; j++) {
+        for (int i=0; i<10; i++) {
+            rc = zsock_connect(socket, "inproc://graylog-forwarder-subscriber-%zu", j);
+            if (rc == 0) break;
+            zclock_sleep(100);
+        }
+        log_zmq_error(rc, __FILE__, __LINE__);
+        assert(rc == 0);
     }
-    log_zmq_error(rc, __FILE__, __LINE__);
-    assert(rc == 0);
     return socket;
 }
 
@@ -181,12 +210,18 @@ parser_state_t* parser_state_new(zconfig_t* config, size_t id)
     state->push_socket = parser_push_socket_new();
     state->decompression_buffer = zchunk_new(NULL, INITIAL_DECOMPRESSION_BUFFER_SIZE);
     state->scratch_buffer = zchunk_new(NULL, 4096);
-    state->tokener = json_tokener_new();
+    if (compress_gelf) {
+        int rc = deflateInit(&state->deflate_stream, gelf_compression_level);
+        assert(rc == Z_OK);
+        state->compression_buffer = zchunk_new(NULL, 16 * 1024);
+    }
+    state->gelf_msg = gelf_message_new();
     state->stream_info_cache = zhash_new();
-    state->headers = default_headers_hash();
     const char* cookies = zconfig_resolve(config, "/frontend/sensitive_cookies", NULL);
     state->sensitive_cookies = split_delimited_string(cookies);
     state->obfuscation_buffer = zchunk_new(NULL, 1024);
+    state->headers = default_headers_matcher(state);
+    state->sampler = gelf_sampler_new(num_parsers, graylog_forwarder_prometheus_client_count_dropped_msg_for_stream);
     load_headers(state);
     return state;
 }
@@ -200,11 +235,16 @@ void parser_state_destroy(parser_state_t **state_p)
     zsock_destroy(&state->push_socket);
     zchunk_destroy(&state->decompression_buffer);
     zchunk_destroy(&state->scratch_buffer);
-    zhash_destroy(&state->headers);
-    json_tokener_free(state->tokener);
+    if (compress_gelf) {
+        deflateEnd(&state->deflate_stream);
+        zchunk_destroy(&state->compression_buffer);
+    }
+    header_matcher_destroy(&state->headers);
+    gelf_message_destroy(&state->gelf_msg);
     zhash_destroy(&state->stream_info_cache);
     zlist_destroy(&state->sensitive_cookies);
     zchunk_destroy(&state->obfuscation_buffer);
+    gelf_sampler_destroy(&state->sampler);
     free(state);
     *state_p = NULL;
 }
@@ -2,12 +2,15 @@
 #include <prometheus/exposer.h>
 #include <prometheus/registry.h>
 #include "graylog-forwarder-prometheus-client.h"
+#include "graylog-forwarder-sampler.h"
 #include <sys/resource.h>
 
 typedef struct {
     prometheus::Counter *forwarded_msgs_total;
     prometheus::Counter *forwarded_bytes_total;
     prometheus::Counter *gelf_source_bytes_total;
+    prometheus::Counter *sampled_msgs_total;
+    prometheus::Counter *rate_limited_msgs_total;
     int64_t last_seen;
 } stream_counters_t;
 
@@ -20,6 +23,10 @@ static struct prometheus_client_t {
     prometheus::Counter *received_msgs_total;
     prometheus::Family<prometheus::Counter> *received_bytes_total_family;
     prometheus::Counter *received_bytes_total;
+    prometheus::Family<prometheus::Counter> *missed_msgs_total_family;
+    prometheus::Counter *missed_msgs_total;
+    prometheus::Family<prometheus::Counter> *missed_msgs_by_device_total_family;
+    std::unordered_map<uint32_t, prometheus::Counter*> missed_msgs_by_device;
     prometheus::Family<prometheus::Counter> *forwarded_msgs_total_family;
     prometheus::Family<prometheus::Counter> *forwarded_msgs_by_stream_total_family;
     prometheus::Counter *forwarded_msgs_total;
@@ -29,16 +36,25 @@ static struct prometheus_client_t {
     prometheus::Family<prometheus::Counter> *gelf_source_bytes_total_family;
     prometheus::Family<prometheus::Counter> *gelf_source_bytes_by_stream_total_family;
     prometheus::Counter *gelf_source_bytes_total;
+    prometheus::Family<prometheus::Counter> *dropped_msgs_by_stream_total_family;
     prometheus::Family<prometheus::Counter> *cpu_usage_total_family;
-    prometheus::Counter *cpu_usage_total_subscriber;
+    std::vector<prometheus::Counter*> cpu_usage_total_subscribers;
     prometheus::Counter *cpu_usage_total_writer;
     std::vector<prometheus::Counter*> cpu_usage_total_parsers;
     std::unordered_map<std::string, stream_counters_t*> counters_by_stream_total_map;
     prometheus::Family<prometheus::Gauge> *sequence_number_family;
     std::unordered_map<uint32_t, prometheus::Gauge*> sequence_numbers;
+    prometheus::Family<prometheus::Gauge> *spool_msgs_family;
+    prometheus::Gauge *spool_msgs;
+    prometheus::Family<prometheus::Gauge> *spool_bytes_family;
+    prometheus::Gauge *spool_bytes;
+    prometheus::Family<prometheus::Gauge> *spool_age_family;
+    prometheus::Gauge *spool_age;
+    prometheus::Family<prometheus::Counter> *spool_dropped_msgs_total_family;
+    prometheus::Counter *spool_dropped_msgs_total;
 } client;
 
-void graylog_forwarder_prometheus_client_init(const char* address, int num_parsers)
+void graylog_forwarder_prometheus_client_init(const char* address, int num_subscribers, int num_parsers)
 {
     // create a http server running on the given address
     client.exposer = new prometheus::Exposer{address};
@@ -59,6 +75,18 @@ void graylog_forwarder_prometheus_client_init(const char* address, int num_parse
 
     client.received_bytes_total = &client.received_bytes_total_family->Add({});
 
+    client.missed_msgs_total_family = &prometheus::BuildCounter()
+        .Name("logjam:graylog_forwarder:msgs_missed_total")
+        .Help("How many logjam messages were missed by this graylog_forwarder")
+        .Register(*client.registry);
+
+    client.missed_msgs_total = &client.missed_msgs_total_family->Add({});
+
+    client.missed_msgs_by_device_total_family = &prometheus::BuildCounter()
+        .Name("logjam:graylog_forwarder:msgs_missed_by_device_total")
+        .Help("How many logjam messages from a specific device were missed by this graylog_forwarder")
+        .Register(*client.registry);
+
     client.forwarded_msgs_total_family = &prometheus::BuildCounter()
         .Name("logjam:graylog_forwarder:msgs_forwarded_total")
         .Help("How many graylog messages has this graylog_forwarder forwarded")
@@ -95,12 +123,22 @@ void graylog_forwarder_prometheus_client_init(const char* address, int num_parse
 
     client.gelf_source_bytes_total = &client.gelf_source_bytes_total_family->Add({});
 
+    client.dropped_msgs_by_stream_total_family = &prometheus::BuildCounter()
+        .Name("logjam:graylog_forwarder:msgs_dropped_by_stream_total")
+        .Help("How many messages has this graylog_forwarder dropped for a specific stream because of sampling or rate limits")
+        .Register(*client.registry);
+
     client.cpu_usage_total_family = &prometheus::BuildCounter()
         .Name("logjam:graylog_forwarder:cpu_seconds_total")
         .Help("Sum of user and system CPU usage per thread")
         .Register(*client.registry);
 
-    client.cpu_usage_total_subscriber = &client.cpu_usage_total_family->Add({{"thread", "subscriber"}});
+    client.cpu_usage_total_subscribers = {};
+    for (int i=0; i<num_subscribers; i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "subscriber%d", i);
+        client.cpu_usage_total_subscribers.push_back(&client.cpu_usage_total_family->Add({{"thread", name}}));
+    }
     client.cpu_usage_total_writer = &client.cpu_usage_total_family->Add({{"thread", "writer"}});
     client.cpu_usage_total_parsers = {};
     for (int i=0; i<num_parsers; i++) {
@@ -114,6 +152,34 @@ void graylog_forwarder_prometheus_client_init(const char* address, int num_parse
         .Help("Current sequence number for the given logjam device")
         .Register(*client.registry);
 
+    client.spool_msgs_family = &prometheus::BuildGauge()
+        .Name("logjam:graylog_forwarder:spool_msgs")
+        .Help("How many graylog messages are currently waiting in the spool")
+        .Register(*client.registry);
+
+    client.spool_msgs = &client.spool_msgs_family->Add({});
+
+    client.spool_bytes_family = &prometheus::BuildGauge()
+        .Name("logjam:graylog_forwarder:spool_bytes")
+        .Help("How many bytes of graylog messages are currently waiting in the spool")
+        .Register(*client.registry);
+
+    client.spool_bytes = &client.spool_bytes_family->Add({});
+
+    client.spool_age_family = &prometheus::BuildGauge()
+        .Name("logjam:graylog_forwarder:spool_age_seconds")
+        .Help("Age of the oldest graylog message waiting in the spool")
+        .Register(*client.registry);
+
+    client.spool_age = &client.spool_age_family->Add({});
+
+    client.spool_dropped_msgs_total_family = &prometheus::BuildCounter()
+        .Name("logjam:graylog_forwarder:spool_dropped_msgs_total")
+        .Help("How many spooled graylog messages were dropped because the spool was full")
+        .Register(*client.registry);
+
+    client.spool_dropped_msgs_total = &client.spool_dropped_msgs_total_family->Add({});
+
     // ask the exposer to scrape the registry on incoming scrapes
     client.exposer->RegisterCollectable(client.registry);
 }
@@ -134,6 +200,11 @@ void graylog_forwarder_prometheus_client_count_bytes_received(double value)
     client.received_bytes_total->Increment(value);
 }
 
+void graylog_forwarder_prometheus_client_count_msgs_missed(double value)
+{
+    client.missed_msgs_total->Increment(value);
+}
+
 void graylog_forwarder_prometheus_client_count_msgs_forwarded(double value)
 {
     client.forwarded_msgs_total->Increment(value);
@@ -160,6 +231,8 @@ stream_counters_t * get_counter(const char* app_env)
         counter->forwarded_msgs_total = &client.forwarded_msgs_by_stream_total_family->Add({{"stream", app_env}});
         counter->forwarded_bytes_total = &client.forwarded_bytes_by_stream_total_family->Add({{"stream", app_env}});
         counter->gelf_source_bytes_total = &client.gelf_source_bytes_by_stream_total_family->Add({{"stream", app_env}});
+        counter->sampled_msgs_total = &client.dropped_msgs_by_stream_total_family->Add({{"stream", app_env}, {"reason", gelf_drop_reason_str(GELF_DROP_SAMPLED)}});
+        counter->rate_limited_msgs_total = &client.dropped_msgs_by_stream_total_family->Add({{"stream", app_env}, {"reason", gelf_drop_reason_str(GELF_DROP_RATE_LIMITED)}});
         client.counters_by_stream_total_map[stream] = counter;
     } else
         counter = got->second;
@@ -181,6 +254,15 @@ void graylog_forwarder_prometheus_client_count_gelf_source_bytes_for_stream(cons
     get_counter(app_env)->gelf_source_bytes_total->Increment(value);
 }
 
+void graylog_forwarder_prometheus_client_count_dropped_msg_for_stream(const char* app_env, int reason)
+{
+    stream_counters_t *counter = get_counter(app_env);
+    if (reason == GELF_DROP_SAMPLED)
+        counter->sampled_msgs_total->Increment(1);
+    else if (reason == GELF_DROP_RATE_LIMITED)
+        counter->rate_limited_msgs_total->Increment(1);
+}
+
 void graylog_forwarder_prometheus_client_delete_old_stream_counters(int64_t max_age)
 {
     std::lock_guard<std::mutex> lock(mutex);
@@ -192,6 +274,8 @@ void graylog_forwarder_prometheus_client_delete_old_stream_counters(int64_t max_
             client.forwarded_msgs_total_family->Remove(counter->forwarded_msgs_total);
             client.forwarded_bytes_total_family->Remove(counter->forwarded_bytes_total);
             client.gelf_source_bytes_total_family->Remove(counter->gelf_source_bytes_total);
+            client.dropped_msgs_by_stream_total_family->Remove(counter->sampled_msgs_total);
+            client.dropped_msgs_by_stream_total_family->Remove(counter->rate_limited_msgs_total);
             delete counter;
             it = client.counters_by_stream_total_map.erase(it);
         } else {
@@ -217,11 +301,11 @@ double get_combined_cpu_usage()
     return total.tv_sec + (double)total.tv_usec/1000000;
 }
 
-void graylog_forwarder_prometheus_client_record_rusage_subscriber()
+void graylog_forwarder_prometheus_client_record_rusage_subscriber(int i)
 {
     double value = get_combined_cpu_usage();
-    double oldvalue = client.cpu_usage_total_subscriber->Value();
-    client.cpu_usage_total_subscriber->Increment(value - oldvalue);
+    double oldvalue = client.cpu_usage_total_subscribers[i]->Value();
+    client.cpu_usage_total_subscribers[i]->Increment(value - oldvalue);
 }
 
 void graylog_forwarder_prometheus_client_record_rusage_parser(int i)
@@ -254,3 +338,29 @@ void graylog_forwarder_prometheus_client_record_device_sequence_number(uint32_t
     }
 
 }
+
+void graylog_forwarder_prometheus_client_count_msgs_missed_for_device(uint32_t id, const char* device, uint64_t n)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unordered_map<uint32_t,prometheus::Counter*>::const_iterator got = client.missed_msgs_by_device.find(id);
+    prometheus::Counter* missed;
+    if (got == client.missed_msgs_by_device.end()) {
+        missed = &client.missed_msgs_by_device_total_family->Add({{"device", device}});
+        client.missed_msgs_by_device[id] = missed;
+    } else {
+        missed = got->second;
+    }
+    missed->Increment(n);
+}
+
+void graylog_forwarder_prometheus_client_record_spool(double messages, double bytes, double age)
+{
+    client.spool_msgs->Set(messages);
+    client.spool_bytes->Set(bytes);
+    client.spool_age->Set(age);
+}
+
+void graylog_forwarder_prometheus_client_count_spool_dropped(double value)
+{
+    client.spool_dropped_msgs_total->Increment(value);
+}
@@ -0,0 +1,181 @@
+#include "graylog-forwarder-sampler.h"
+#include "logjam-streaminfo.h"
+
+typedef struct {
+    double tokens;
+    int64_t last_refill_ms;
+} token_bucket_t;
+
+struct _gelf_sampler_t {
+    size_t num_parsers;
+    gelf_drop_recorder_fn *record_drop;
+    zhash_t *buckets;                   // stream name -> token_bucket_t
+};
+
+gelf_sampler_t* gelf_sampler_new(size_t num_parsers, gelf_drop_recorder_fn *record_drop)
+{
+    gelf_sampler_t *sampler = zmalloc(sizeof(*sampler));
+    sampler->num_parsers = num_parsers > 0 ? num_parsers : 1;
+    sampler->record_drop = record_drop;
+    sampler->buckets = zhash_new();
+    return sampler;
+}
+
+void gelf_sampler_destroy(gelf_sampler_t **sampler_p)
+{
+    gelf_sampler_t *sampler = *sampler_p;
+    if (sampler == NULL)
+        return;
+    token_bucket_t *bucket = zhash_first(sampler->buckets);
+    while (bucket) {
+        free(bucket);
+        bucket = zhash_next(sampler->buckets);
+    }
+    zhash_destroy(&sampler->buckets);
+    free(sampler);
+    *sampler_p = NULL;
+}
+
+const char* gelf_drop_reason_str(int reason)
+{
+    switch (reason) {
+    case GELF_FORWARD:
+        return "forwarded";
+    case GELF_DROP_SAMPLED:
+        return "sampled";
+    case GELF_DROP_RATE_LIMITED:
+        return "rate_limited";
+    default:
+        return "unknown";
+    }
+}
+
+static bool take_token(gelf_sampler_t *sampler, stream_info_t *stream, int64_t now_ms)
+{
+    double rate = (double)stream->max_gelf_messages_per_second / sampler->num_parsers;
+    // with fewer messages per second than parsers, buckets must still be able to hold a
+    // whole token, they just take more than a second to fill
+    double capacity = rate < 1 ? 1 : rate;
+    token_bucket_t *bucket = zhash_lookup(sampler->buckets, stream->key);
+    if (bucket == NULL) {
+        bucket = zmalloc(sizeof(*bucket));
+        bucket->tokens = capacity;
+        bucket->last_refill_ms = now_ms;
+        zhash_insert(sampler->buckets, stream->key, bucket);
+    } else if (now_ms > bucket->last_refill_ms) {
+        bucket->tokens += rate * (now_ms - bucket->last_refill_ms) / 1000.0;
+        if (bucket->tokens > capacity)
+            bucket->tokens = capacity;
+        bucket->last_refill_ms = now_ms;
+    }
+    if (bucket->tokens < 1)
+        return false;
+    bucket->tokens -= 1;
+    return true;
+}
+
+int gelf_sampler_check(gelf_sampler_t *sampler, stream_info_t *stream, int severity, int64_t now_ms)
+{
+    int reason = GELF_FORWARD;
+    if (stream->gelf_sampling) {
+        if (severity < 0 || severity >= NUM_LOG_SEVERITIES)
+            severity = NUM_LOG_SEVERITIES - 1;
+        long threshold = stream->gelf_sampling_thresholds[severity];
+        if (threshold == 0 || random() > threshold)
+            reason = GELF_DROP_SAMPLED;
+    }
+    if (reason == GELF_FORWARD && stream->max_gelf_messages_per_second > 0) {
+        if (!take_token(sampler, stream, now_ms))
+            reason = GELF_DROP_RATE_LIMITED;
+    }
+    if (reason != GELF_FORWARD && sampler->record_drop)
+        sampler->record_drop(stream->key, reason);
+    return reason;
+}
+
+static size_t test_drops[3];
+
+static void test_record_drop(const char *stream, int reason)
+{
+    test_drops[reason]++;
+}
+
+void gelf_sampler_test(int verbose)
+{
+    printf(" * gelf-sampler: ");
+    if (verbose)
+        printf("\n");
+
+    stream_info_t stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.key = "app-env";
+    for (int i = 0; i < NUM_LOG_SEVERITIES; i++)
+        stream.gelf_sampling_thresholds[i] = MAX_RANDOM_VALUE;
+
+    gelf_sampler_t *sampler = gelf_sampler_new(2, test_record_drop);
+
+    // no limits
+    for (int i = 0; i < 1000; i++)
+        assert(gelf_sampler_check(sampler, &stream, 1, 0) == GELF_FORWARD);
+
+    // 100 messages per second over two parsers allow for 50 per second per parser
+    stream.max_gelf_messages_per_second = 100;
+    int64_t now = 1000;
+    size_t forwarded = 0;
+    for (int i = 0; i < 100; i++)
+        forwarded += gelf_sampler_check(sampler, &stream, 3, now) == GELF_FORWARD;
+    assert(forwarded == 50);
+    assert(test_drops[GELF_DROP_RATE_LIMITED] == 50);
+
+    // 100ms later 5 more tokens are available
+    now += 100;
+    forwarded = 0;
+    for (int i = 0; i < 100; i++)
+        forwarded += gelf_sampler_check(sampler, &stream, 3, now) == GELF_FORWARD;
+    assert(forwarded == 5);
+
+    // buckets don't hold more than one second worth of tokens
+    now += 10000;
+    forwarded = 0;
+    for (int i = 0; i < 100; i++)
+        forwarded += gelf_sampler_check(sampler, &stream, 3, now) == GELF_FORWARD;
+    assert(forwarded == 50);
+
+    // one message per second over four parsers: each parser may send one message
+    // every four seconds
+    gelf_sampler_t *slow_sampler = gelf_sampler_new(4, test_record_drop);
+    stream.max_gelf_messages_per_second = 1;
+    assert(gelf_sampler_check(slow_sampler, &stream, 3, now) == GELF_FORWARD);
+    assert(gelf_sampler_check(slow_sampler, &stream, 3, now) == GELF_DROP_RATE_LIMITED);
+    assert(gelf_sampler_check(slow_sampler, &stream, 3, now + 3000) == GELF_DROP_RATE_LIMITED);
+    assert(gelf_sampler_check(slow_sampler, &stream, 3, now + 4000) == GELF_FORWARD);
+    assert(gelf_sampler_check(slow_sampler, &stream, 3, now + 4000) == GELF_DROP_RATE_LIMITED);
+    // at most one token is kept
+    assert(gelf_sampler_check(slow_sampler, &stream, 3, now + 100000) == GELF_FORWARD);
+    assert(gelf_sampler_check(slow_sampler, &stream, 3, now + 100000) == GELF_DROP_RATE_LIMITED);
+    gelf_sampler_destroy(&slow_sampler);
+
+    // drop all debug and half of the info requests, keep errors
+    stream.max_gelf_messages_per_second = 0;
+    stream.gelf_sampling = true;
+    stream.gelf_sampling_thresholds[0] = 0;
+    stream.gelf_sampling_thresholds[1] = MAX_RANDOM_VALUE / 2;
+    memset(test_drops, 0, sizeof(test_drops));
+    size_t forwarded_by_severity[NUM_LOG_SEVERITIES] = {0};
+    for (int i = 0; i < 10000; i++)
+        for (int severity = 0; severity < NUM_LOG_SEVERITIES; severity++)
+            forwarded_by_severity[severity] += gelf_sampler_check(sampler, &stream, severity, now) == GELF_FORWARD;
+    if (verbose)
+        printf("[D] forwarded debug: %zu, info: %zu, error: %zu\n",
+               forwarded_by_severity[0], forwarded_by_severity[1], forwarded_by_severity[3]);
+    assert(forwarded_by_severity[0] == 0);
+    assert(forwarded_by_severity[1] > 4000 && forwarded_by_severity[1] < 6000);
+    assert(forwarded_by_severity[3] == 10000);
+    assert(test_drops[GELF_DROP_SAMPLED] == 20000 - forwarded_by_severity[1]);
+    assert(test_drops[GELF_DROP_RATE_LIMITED] == 0);
+
+    gelf_sampler_destroy(&sampler);
+    assert(sampler == NULL);
+
+    printf("OK\n");
+}
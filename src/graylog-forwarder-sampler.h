@@ -0,0 +1,48 @@
+#ifndef __LOGJAM_GRAYLOG_FORWARDER_SAMPLER_H_INCLUDED__
+#define __LOGJAM_GRAYLOG_FORWARDER_SAMPLER_H_INCLUDED__
+
+#include "logjam-util.h"
+#include "logjam-streaminfo-types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decides which requests of a stream get forwarded to graylog, before they are converted
+// to GELF. Requests are first sampled according to the stream's gelf_sampling_rates for
+// their severity (for example, keep all errors but only 10% of info requests). Requests
+// which survive sampling are subject to a per stream token bucket, filled at the stream's
+// max_gelf_messages_per_second rate and holding at most one second worth of tokens, but
+// at least one token.
+// Each parser has its own sampler. As messages are distributed evenly over all parsers,
+// each bucket is filled at the configured rate divided by the number of parsers.
+
+#define GELF_FORWARD 0
+#define GELF_DROP_SAMPLED 1
+#define GELF_DROP_RATE_LIMITED 2
+
+typedef void (gelf_drop_recorder_fn)(const char* stream, int reason);
+
+typedef struct _gelf_sampler_t gelf_sampler_t;
+
+extern gelf_sampler_t* gelf_sampler_new(size_t num_parsers, gelf_drop_recorder_fn *record_drop);
+extern void gelf_sampler_destroy(gelf_sampler_t **sampler_p);
+
+// true if the stream has sampling or rate limiting configured
+static inline bool gelf_sampler_applies_to(stream_info_t *stream)
+{
+    return stream->gelf_sampling || stream->max_gelf_messages_per_second > 0;
+}
+
+// returns GELF_FORWARD or the reason for dropping the request (which is recorded)
+extern int gelf_sampler_check(gelf_sampler_t *sampler, stream_info_t *stream, int severity, int64_t now_ms);
+
+extern const char* gelf_drop_reason_str(int reason);
+
+extern void gelf_sampler_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
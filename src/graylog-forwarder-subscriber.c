@@ -6,9 +6,11 @@
 
 // actor state
 typedef struct {
+    size_t id;                  // subscriber number
+    char me[16];                // thread name
     zconfig_t *config;          // config
     zsock_t *pipe;              // actor commands
-    zlist_t *devices;           // list of devices to connect to (overrides config)
+    zlist_t *devices;           // devices this subscriber connects to (owned)
     device_tracker_t *tracker;  // tracks gaps and heartbeats
     zsock_t *sub_socket;        // incoming data from logjam devices
     zsock_t *push_socket;       // outgoing data for parsers
@@ -19,6 +21,7 @@ typedef struct {
     size_t message_gap_size;    // messages missed due to gaps in the stream (since last tick)
     size_t message_drops;       // messages dropped because push_socket wasn't ready (since last tick)
     size_t message_blocks;      // how often the subscriber blocked on the push_socket (since last tick)
+    size_t ticks;
     zlist_t *subscriptions;     // streams to subscribe to
     int rcv_hwm;
     int snd_hwm;
@@ -29,19 +32,33 @@ typedef struct {
     zlist_t *devices;
     int rcv_hwm;
     int snd_hwm;
+    size_t id;
 } subscriber_args_t;
 
 
-static subscriber_args_t* subscriber_args_new(zconfig_t *config, zlist_t *devices, int rcv_hwm, int snd_hwm)
+static subscriber_args_t* subscriber_args_new(zconfig_t *config, zlist_t *devices, int rcv_hwm, int snd_hwm, size_t id)
 {
     subscriber_args_t *args = zmalloc(sizeof(*args));
     args->config = config;
     args->devices = devices;
     args->rcv_hwm = rcv_hwm;
     args->snd_hwm = snd_hwm;
+    args->id = id;
     return args;
 }
 
+// the subset of devices a subscriber connects to
+static zlist_t* subscriber_devices(zlist_t *devices, size_t id)
+{
+    zlist_t *subset = zlist_new();
+    size_t pos = 0;
+    for (char *spec = zlist_first(devices); spec; spec = zlist_next(devices)) {
+        if (pos++ % num_subscribers == id)
+            zlist_append(subset, spec);
+    }
+    return subset;
+}
+
 static
 void update_subscriptions(subscriber_state_t *state, zlist_t *subscriptions)
 {
@@ -49,7 +66,7 @@ void update_subscriptions(subscriber_state_t *state, zlist_t *subscriptions)
     if (streq(pattern, "")) {
         // no pattern set, we only need to subscribe once at startup
         if (state->subscriptions == NULL) {
-            printf("[I] subscriber: subscribing to all streams\n");
+            printf("[I] %s: subscribing to all streams\n", state->me);
             zsock_set_subscribe(state->sub_socket, "");
             state->subscriptions = zlist_new();
         }
@@ -66,7 +83,7 @@ void update_subscriptions(subscriber_state_t *state, zlist_t *subscriptions)
     zlist_t *added = zlist_added(state->subscriptions, subscriptions);
     char *new_stream = zlist_first(added);
     while (new_stream) {
-        printf("[I] subscriber: subscribing to stream: %s\n", new_stream);
+        printf("[I] %s: subscribing to stream: %s\n", state->me, new_stream);
         zsock_set_subscribe(state->sub_socket, new_stream);
         new_stream = zlist_next(added);
     }
@@ -75,7 +92,7 @@ void update_subscriptions(subscriber_state_t *state, zlist_t *subscriptions)
     zlist_t *deleted = zlist_deleted(state->subscriptions, subscriptions);
     char *old_stream = zlist_first(deleted);
     while (old_stream) {
-        printf("[I] subscriber: unsubscribing from stream: %s\n", old_stream);
+        printf("[I] %s: unsubscribing from stream: %s\n", state->me, old_stream);
         zsock_set_unsubscribe(state->sub_socket, old_stream);
         old_stream = zlist_next(deleted);
     }
@@ -96,9 +113,9 @@ static
 int timer_function(zloop_t *loop, int timer_id, void* arg)
 {
     subscriber_state_t *state = arg;
-    printf("[I] subscriber: updating subscriptions\n");
+    printf("[I] %s: updating subscriptions\n", state->me);
     setup_subscriptions(state);
-    printf("[I] subscriber: subscriptions updated\n");
+    printf("[I] %s: subscriptions updated\n", state->me);
     return 0;
 }
 
@@ -111,7 +128,7 @@ zsock_t* subscriber_sub_socket_new(subscriber_state_t *state)
 
     char* device = zlist_first(state->devices);
     while (device) {
-        printf("[I] subscriber: connecting SUB socket to logjam-device via %s\n", device);
+        printf("[I] %s: connecting SUB socket to logjam-device via %s\n", state->me, device);
         int rc = zsock_connect(socket, "%s", device);
         log_zmq_error(rc, __FILE__, __LINE__);
         assert(rc == 0);
@@ -122,12 +139,12 @@ zsock_t* subscriber_sub_socket_new(subscriber_state_t *state)
 }
 
 static
-zsock_t* subscriber_push_socket_new()
+zsock_t* subscriber_push_socket_new(size_t id)
 {
     zsock_t *socket = zsock_new(ZMQ_PUSH);
     assert(socket);
     zsock_set_sndtimeo(socket, 10);
-    int rc = zsock_bind(socket, "inproc://graylog-forwarder-subscriber");
+    int rc = zsock_bind(socket, "inproc://graylog-forwarder-subscriber-%zu", id);
     assert(rc == 0);
     return socket;
 }
@@ -136,13 +153,15 @@ static
 subscriber_state_t* subscriber_state_new(zsock_t* pipe, subscriber_args_t* args)
 {
     subscriber_state_t *state = zmalloc(sizeof(*state));
+    state->id = args->id;
+    snprintf(state->me, sizeof(state->me), "subscriber[%zu]", state->id);
     state->pipe = pipe;
     state->config = args->config;
     state->devices = args->devices;
     state->rcv_hwm = args->rcv_hwm;
     state->snd_hwm = args->snd_hwm;
     state->sub_socket = subscriber_sub_socket_new(state);
-    state->push_socket = subscriber_push_socket_new();
+    state->push_socket = subscriber_push_socket_new(state->id);
     state->tracker = device_tracker_new(state->devices, state->sub_socket);
     free(args);
     return state;
@@ -155,6 +174,9 @@ void subscriber_state_destroy(subscriber_state_t **state_p)
     zsock_destroy(&state->sub_socket);
     zsock_destroy(&state->push_socket);
     device_tracker_destroy(&state->tracker);
+    zlist_destroy(&state->devices);
+    zlist_destroy(&state->subscriptions);
+    free(state);
     *state_p = NULL;
 }
 
@@ -170,7 +192,7 @@ int process_meta_information_and_handle_heartbeat(subscriber_state_t *state, zms
     if (!rc) {
         // dump_meta_info(&meta);
         if (!state->meta_info_failures++)
-            fprintf(stderr, "[E] subscriber: received invalid meta info\n");
+            fprintf(stderr, "[E] %s: received invalid meta info\n", state->me);
         return is_heartbeat;
     }
     if (meta.device_number == 0) {
@@ -203,7 +225,7 @@ int read_request_and_forward(zloop_t *loop, zsock_t *socket, void *callback_data
         state->message_bytes += zmsg_content_size(msg);
         int n = zmsg_size(msg);
         if (n < 3 || n > 4) {
-            fprintf(stderr, "[E] subscriber: dropped invalid message\n");
+            fprintf(stderr, "[E] %s: dropped invalid message\n", state->me);
             my_zmsg_fprint(msg, "[E] MSG", stderr);
             zmsg_destroy(&msg);
             return 0;
@@ -217,12 +239,12 @@ int read_request_and_forward(zloop_t *loop, zsock_t *socket, void *callback_data
         }
 
         if (!output_socket_ready(state->push_socket, 0) && !state->message_blocks++)
-            fprintf(stderr, "[W] subscriber: push socket not ready. blocking!\n");
+            fprintf(stderr, "[W] %s: push socket not ready. blocking!\n", state->me);
 
         int rc = zmsg_send_and_destroy(&msg, state->push_socket);
         if (rc) {
             if (!state->message_drops++)
-                fprintf(stderr, "[E] subscriber: dropped message on push socket (%d: %s)\n", errno, zmq_strerror(errno));
+                fprintf(stderr, "[E] %s: dropped message on push socket (%d: %s)\n", state->me, errno, zmq_strerror(errno));
         }
     }
     return 0;
@@ -231,23 +253,23 @@ int read_request_and_forward(zloop_t *loop, zsock_t *socket, void *callback_data
 static
 int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
 {
-    static size_t ticks = 0;
     int rc = 0;
     subscriber_state_t *state = callback_data;
     zmsg_t *msg = zmsg_recv(socket);
     if (msg) {
         char *cmd = zmsg_popstr(msg);
         if (streq(cmd, "$TERM")) {
-            fprintf(stderr, "[D] subscriber: received $TERM command\n");
+            fprintf(stderr, "[D] %s: received $TERM command\n", state->me);
             rc = -1;
         } else if (streq(cmd, "tick")) {
-            printf("[I] subscriber: %5zu messages "
+            printf("[I] %s: %5zu messages "
                    "(gap_size: %zu, no_info: %zu, dev_zero: %zu, blocks: %zu, drops: %zu)\n",
-                   state->message_count, state->message_gap_size, state->meta_info_failures,
+                   state->me, state->message_count, state->message_gap_size, state->meta_info_failures,
                    state->messages_dev_zero, state->message_blocks, state->message_drops);
-            graylog_forwarder_prometheus_client_record_rusage_subscriber();
+            graylog_forwarder_prometheus_client_record_rusage_subscriber(state->id);
             graylog_forwarder_prometheus_client_count_msgs_received(state->message_count);
             graylog_forwarder_prometheus_client_count_bytes_received(state->message_bytes);
+            graylog_forwarder_prometheus_client_count_msgs_missed(state->message_gap_size);
             zmsg_t* response = zmsg_new();
             zmsg_addmem(response, &state->message_count, sizeof(state->message_count));
             zmsg_send(&response, socket);
@@ -259,10 +281,11 @@ int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
             state->message_drops = 0;
             device_number_recorder_fn *f = (device_number_recorder_fn*)graylog_forwarder_prometheus_client_record_device_sequence_number;
             device_tracker_record_sequence_numbers(state->tracker, f);
-            if (++ticks % HEART_BEAT_INTERVAL == 0)
+            device_tracker_record_lost_messages(state->tracker, graylog_forwarder_prometheus_client_count_msgs_missed_for_device);
+            if (++state->ticks % HEART_BEAT_INTERVAL == 0)
                 device_tracker_reconnect_stale_devices(state->tracker);
         } else {
-            fprintf(stderr, "[E] subscriber: received unknown actor command: %s\n", cmd);
+            fprintf(stderr, "[E] %s: received unknown actor command: %s\n", state->me, cmd);
         }
         free(cmd);
         zmsg_destroy(&msg);
@@ -273,10 +296,9 @@ int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
 static
 void graylog_forwarder_subscriber(zsock_t *pipe, void *args)
 {
-    set_thread_name("graylog-forwarder-subscriber");
-
     int rc;
     subscriber_state_t *state = subscriber_state_new(pipe, args);
+    set_thread_name(state->me);
 
     // subscribe to either all messages, or a subset
     setup_subscriptions(state);
@@ -304,7 +326,7 @@ void graylog_forwarder_subscriber(zsock_t *pipe, void *args)
         zloop_timer(loop, 60000, 0, timer_function, state);
 
     // run the loop
-    fprintf(stdout, "[I] subscriber: listening\n");
+    fprintf(stdout, "[I] %s: listening\n", state->me);
 
     bool should_continue_to_run = getenv("CPUPROFILE") != NULL;
     do {
@@ -314,18 +336,20 @@ void graylog_forwarder_subscriber(zsock_t *pipe, void *args)
             log_zmq_error(rc, __FILE__, __LINE__);
     } while (should_continue_to_run);
 
-    fprintf(stdout, "[I] subscriber: shutting down\n");
+    fprintf(stdout, "[I] %s: shutting down\n", state->me);
 
     // shutdown
+    size_t id = state->id;
     subscriber_state_destroy(&state);
     zloop_destroy(&loop);
     assert(loop == NULL);
 
-    fprintf(stdout, "[I] subscriber: terminated\n");
+    fprintf(stdout, "[I] subscriber[%zu]: terminated\n", id);
 }
 
-zactor_t* graylog_forwarder_subscriber_new(zconfig_t *config, zlist_t *devices, int rcv_hwm, int snd_hwm)
+zactor_t* graylog_forwarder_subscriber_new(zconfig_t *config, zlist_t *devices, int rcv_hwm, int snd_hwm, size_t id)
 {
-    subscriber_args_t *args = subscriber_args_new(config, devices, rcv_hwm, snd_hwm);
+    // the device list is shared by all subscribers, so don't iterate it in the actor thread
+    subscriber_args_t *args = subscriber_args_new(config, subscriber_devices(devices, id), rcv_hwm, snd_hwm, id);
     return zactor_new(graylog_forwarder_subscriber, args);
 }
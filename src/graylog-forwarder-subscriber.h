@@ -7,7 +7,7 @@
 extern "C" {
 #endif
 
-extern zactor_t* graylog_forwarder_subscriber_new(zconfig_t *config, zlist_t *devices, int rcv_hwm, int send_hwm);
+extern zactor_t* graylog_forwarder_subscriber_new(zconfig_t *config, zlist_t *devices, int rcv_hwm, int send_hwm, size_t id);
 
 #ifdef __cplusplus
 }
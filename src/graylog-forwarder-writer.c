@@ -1,49 +1,60 @@
 #include "graylog-forwarder-common.h"
 #include "graylog-forwarder-prometheus-client.h"
 #include "graylog-forwarder-writer.h"
+#include "logjam-spool.h"
+#include "graylog-forwarder-gelf-output.h"
 #include "gelf-message.h"
 
 typedef struct {
     zsock_t *pipe;          // actor commands
     zsock_t *pull_socket;   // incoming messages from parsers
     zsock_t *push_socket;   // outgoing GELF messages to graylog; the GELF ZeroMQ PULL device should connect to this (not bind)
+    gelf_output_t *gelf_output; // replaces the push socket if GELF UDP/TCP endpoints have been configured
     size_t message_count;   // how many messages we have sent since last tick
     size_t message_bytes;   // how many bytes we have sent since last tick
+    spool_t *spool;         // messages which could not be sent immediately; NULL if spooling is disabled
+    spool_drain_t drain;    // limits the rate at which spooled messages are replayed
 } writer_state_t;
 
-static void send_graylog_message(zmsg_t* msg, writer_state_t* state)
-{
-    zmsg_t *out_msg = zmsg_new();
-    assert(out_msg);
-
-    char *stream = zmsg_popstr(msg);
-    size_t sent_bytes = 0;
+// max number of messages processed before queued GELF messages are sent
+#define WRITER_BATCH_SIZE 256
 
-    if (compress_gelf) {
-        compressed_gelf_t *compressed_gelf = zmsg_popptr(msg);
-        assert(compressed_gelf);
-
-        sent_bytes = compressed_gelf->len;
-        int rc = zmsg_addmem(out_msg, compressed_gelf->data, compressed_gelf->len);
-        assert(rc == 0);
-        compressed_gelf_destroy(&compressed_gelf);
-    } else {
-        zframe_t *gelf_data = zmsg_pop(msg);
-        assert(gelf_data);
-
-        sent_bytes = zframe_size(gelf_data);
-        int rc = zmsg_append(out_msg, &gelf_data);
-        assert(rc == 0);
-    }
+static bool output_ready(writer_state_t* state)
+{
+    if (state->gelf_output)
+        return gelf_output_ready(state->gelf_output);
+    else
+        return output_socket_ready(state->push_socket, 0);
+}
 
+static void forward_graylog_message(const char *stream, zframe_t **gelf_data, writer_state_t* state)
+{
+    size_t sent_bytes = zframe_size(*gelf_data);
     graylog_forwarder_prometheus_client_count_forwarded_bytes_for_stream(stream, sent_bytes);
-    free(stream);
 
     if (dryrun) {
-        zmsg_destroy(&out_msg);
+        zframe_destroy(gelf_data);
+        return;
+    }
+
+    if (state->gelf_output) {
+        while (!zsys_interrupted && !gelf_output_send(state->gelf_output, zframe_data(*gelf_data), sent_bytes)) {
+            fprintf(stderr, "[W] writer: no graylog endpoint available. blocking!\n");
+            zclock_sleep(1000);
+        }
+        if (!zsys_interrupted) {
+            state->message_count++;
+            state->message_bytes += sent_bytes;
+        }
+        zframe_destroy(gelf_data);
         return;
     }
 
+    zmsg_t *out_msg = zmsg_new();
+    assert(out_msg);
+    int rc = zmsg_append(out_msg, gelf_data);
+    assert(rc == 0);
+
     while (!zsys_interrupted && !output_socket_ready(state->push_socket, 1000)) {
         fprintf(stderr, "[W] writer: push socket not ready (graylog not connected?). blocking!\n");
     }
@@ -57,6 +68,48 @@ static void send_graylog_message(zmsg_t* msg, writer_state_t* state)
     }
 }
 
+static void send_graylog_message(zmsg_t* msg, writer_state_t* state)
+{
+    char *stream = zmsg_popstr(msg);
+
+    // GELF data, compressed by the parser if requested
+    zframe_t *gelf_data = zmsg_pop(msg);
+    assert(gelf_data);
+
+    // spool the message if graylog doesn't accept messages. live messages are sent
+    // directly even while older ones are spooled, otherwise a backlog could only shrink
+    // at the drain rate. fall back to blocking if the spool can't take it.
+    if (state->spool && !dryrun && !output_ready(state)
+        && spool_append(state->spool, stream, zframe_data(gelf_data), zframe_size(gelf_data))) {
+        zframe_destroy(&gelf_data);
+    } else {
+        forward_graylog_message(stream, &gelf_data, state);
+    }
+    free(stream);
+}
+
+// sends spooled messages with the capacity left over by live traffic, limited by the drain rate
+static void drain_spool(writer_state_t* state)
+{
+    if (state->spool == NULL || spool_size(state->spool) == 0)
+        return;
+
+    size_t available = spool_drain_available(&state->drain, zclock_mono());
+    while (available-- > 0 && !zsys_interrupted && output_ready(state)) {
+        zmsg_t *msg = spool_shift(state->spool);
+        if (msg == NULL)
+            break;
+        char *stream = zmsg_popstr(msg);
+        zframe_t *gelf_data = zmsg_pop(msg);
+        forward_graylog_message(stream, &gelf_data, state);
+        free(stream);
+        zmsg_destroy(&msg);
+        state->drain.tokens -= 1;
+    }
+    if (state->gelf_output)
+        gelf_output_flush(state->gelf_output);
+}
+
 static
 zsock_t* writer_pull_socket_new()
 {
@@ -87,7 +140,17 @@ writer_state_t* writer_state_new(zsock_t *pipe, zconfig_t* config)
     writer_state_t *state = zmalloc(sizeof(writer_state_t));
     state->pipe = pipe;
     state->pull_socket = writer_pull_socket_new();
-    state->push_socket = writer_push_socket_new(config);
+    if (gelf_endpoints) {
+        state->gelf_output = gelf_output_new(gelf_endpoints);
+        assert(state->gelf_output);
+    } else {
+        state->push_socket = writer_push_socket_new(config);
+    }
+    if (spool_directory) {
+        printf("[I] writer: spooling to %s (max %zu MB)\n", spool_directory, spool_max_size);
+        state->spool = spool_new(spool_directory, SPOOL_SEGMENT_SIZE, spool_max_size * 1024 * 1024);
+    }
+    spool_drain_init(&state->drain, spool_drain_rate, zclock_mono());
     return state;
 }
 
@@ -98,6 +161,8 @@ void writer_state_destroy(writer_state_t **state_p)
     // must not destroy the pipe, as it's owned by the actor
     zsock_destroy(&state->pull_socket);
     zsock_destroy(&state->push_socket);
+    gelf_output_destroy(&state->gelf_output);
+    spool_destroy(&state->spool);
     free(state);
     *state_p = NULL;
 }
@@ -116,8 +181,10 @@ void graylog_forwarder_writer(zsock_t *pipe, void *args)
 
     while (!zsys_interrupted) {
         // printf("[D] writer [%zu]: polling\n", id);
-        // -1 == block until something is readable
-        void *socket = zpoller_wait(poller, -1);
+        // -1 == block until something is readable, but wake up regularly while
+        // messages wait in the spool
+        bool spooling = state->spool && spool_size(state->spool) > 0;
+        void *socket = zpoller_wait(poller, spooling ? 10 : -1);
         zmsg_t *msg = NULL;
         if (socket == state->pipe) {
             msg = zmsg_recv(state->pipe);
@@ -136,21 +203,36 @@ void graylog_forwarder_writer(zsock_t *pipe, void *args)
                 graylog_forwarder_prometheus_client_count_bytes_forwarded(state->message_bytes);
                 state->message_count = 0;
                 state->message_bytes = 0;
+                if (state->spool) {
+                    spool_flush(state->spool);
+                    size_t spooled = spool_size(state->spool);
+                    if (spooled > 0)
+                        printf("[I] writer: %zu messages spooled\n", spooled);
+                    graylog_forwarder_prometheus_client_record_spool(spooled, spool_bytes(state->spool), spool_age(state->spool) / 1000.0);
+                    graylog_forwarder_prometheus_client_count_spool_dropped(spool_dropped(state->spool));
+                }
             } else {
                 fprintf(stderr, "[E] writer: received unknown command: %s\n", cmd);
                 assert(false);
             }
             free(cmd);
         } else if (socket == state->pull_socket) {
-            msg = zmsg_recv(state->pull_socket);
-            if (msg != NULL) {
+            // process all available messages (up to a limit) before sending queued GELF output
+            int n = 0;
+            do {
+                msg = zmsg_recv(state->pull_socket);
+                if (msg == NULL)
+                    break;
                 send_graylog_message(msg, state);
                 zmsg_destroy(&msg);
-            }
-        } else {
+            } while (++n < WRITER_BATCH_SIZE && (zsock_events(state->pull_socket) & ZMQ_POLLIN));
+            if (state->gelf_output)
+                gelf_output_flush(state->gelf_output);
+        } else if (!zpoller_expired(poller)) {
             // msg == NULL, probably interrupted by signal handler
             break;
         }
+        drain_spool(state);
     }
 
     fprintf(stdout, "[I] writer: shutting down\n");
@@ -0,0 +1,185 @@
+#include "header-matcher.h"
+
+#define GELF_HEADER_FIELD_PREFIX "_http_header_"
+#define MAX_HEADER_NAME_LENGTH 1000
+#define MAX_SEED_ATTEMPTS 1000
+
+typedef struct {
+    char *name;                 // lower case header name
+    size_t len;
+    char *field;                // GELF field name
+} header_entry_t;
+
+struct _header_matcher_t {
+    uint32_t seed;
+    uint32_t mask;              // table size - 1
+    header_entry_t *table;      // NULL name for empty slots
+    cookie_masker_t *cookie_masker;
+};
+
+// FNV-1a over the lower cased name
+static inline uint32_t header_hash(const char *name, size_t len, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t) tolower(name[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool try_seed(header_matcher_t *matcher, header_entry_t *entries, size_t n, uint32_t seed)
+{
+    memset(matcher->table, 0, (matcher->mask + 1) * sizeof(header_entry_t));
+    for (size_t i = 0; i < n; i++) {
+        header_entry_t *slot = &matcher->table[header_hash(entries[i].name, entries[i].len, seed) & matcher->mask];
+        if (slot->name)
+            return false;
+        *slot = entries[i];
+    }
+    matcher->seed = seed;
+    return true;
+}
+
+header_matcher_t* header_matcher_new(zlist_t *header_names, zlist_t *sensitive_cookies)
+{
+    header_matcher_t *matcher = zmalloc(sizeof(*matcher));
+    matcher->cookie_masker = cookie_masker_new(sensitive_cookies);
+
+    // collect distinct, lower cased names
+    size_t max_entries = zlist_size(header_names);
+    header_entry_t *entries = zmalloc((max_entries + 1) * sizeof(header_entry_t));
+    size_t n = 0;
+    const char *name = zlist_first(header_names);
+    while (name) {
+        size_t len = strlen(name);
+        bool duplicate = len == 0 || len > MAX_HEADER_NAME_LENGTH;
+        for (size_t i = 0; i < n && !duplicate; i++)
+            duplicate = entries[i].len == len && !strncasecmp(entries[i].name, name, len);
+        if (!duplicate) {
+            header_entry_t *e = &entries[n++];
+            e->len = len;
+            e->name = strdup(name);
+            e->field = zmalloc(sizeof(GELF_HEADER_FIELD_PREFIX) + len);
+            char *p = stpcpy(e->field, GELF_HEADER_FIELD_PREFIX);
+            for (size_t i = 0; i < len; i++) {
+                e->name[i] = tolower(name[i]);
+                p[i] = e->name[i] == '-' ? '_' : e->name[i];
+            }
+        }
+        name = zlist_next(header_names);
+    }
+
+    // find a seed which doesn't produce collisions, doubling the table size when no
+    // seed can be found. the table is at least twice as big as the number of entries
+    size_t size = 2;
+    while (size < 2 * n)
+        size *= 2;
+    for (;;) {
+        matcher->mask = size - 1;
+        matcher->table = zmalloc(size * sizeof(header_entry_t));
+        uint32_t seed;
+        for (seed = 0; seed < MAX_SEED_ATTEMPTS; seed++)
+            if (try_seed(matcher, entries, n, seed))
+                break;
+        if (seed < MAX_SEED_ATTEMPTS)
+            break;
+        free(matcher->table);
+        size *= 2;
+    }
+    free(entries);
+
+    return matcher;
+}
+
+void header_matcher_destroy(header_matcher_t **matcher_p)
+{
+    header_matcher_t *matcher = *matcher_p;
+    if (matcher == NULL)
+        return;
+    for (size_t i = 0; i <= matcher->mask; i++) {
+        free(matcher->table[i].name);
+        free(matcher->table[i].field);
+    }
+    free(matcher->table);
+    cookie_masker_destroy(&matcher->cookie_masker);
+    free(matcher);
+    *matcher_p = NULL;
+}
+
+const char* header_matcher_field(header_matcher_t *matcher, const char *name, size_t len)
+{
+    header_entry_t *e = &matcher->table[header_hash(name, len, matcher->seed) & matcher->mask];
+    if (e->name == NULL || e->len != len || strncasecmp(e->name, name, len))
+        return NULL;
+    return e->field;
+}
+
+cookie_masker_t* header_matcher_cookie_masker(header_matcher_t *matcher)
+{
+    return matcher->cookie_masker;
+}
+
+void header_matcher_test(int verbose)
+{
+    printf(" * header-matcher: ");
+    if (verbose)
+        printf("\n");
+
+    zlist_t *names = zlist_new();
+    zlist_t *cookies = zlist_new();
+
+    // empty whitelist
+    header_matcher_t *matcher = header_matcher_new(names, cookies);
+    assert(header_matcher_field(matcher, "host", 4) == NULL);
+    assert(header_matcher_field(matcher, "", 0) == NULL);
+    assert(cookie_masker_empty(header_matcher_cookie_masker(matcher)));
+    header_matcher_destroy(&matcher);
+    assert(matcher == NULL);
+
+    char *headers[] = {
+        "content-type", "cookie", "forwarded-user-agent", "host", "origin", "referer",
+        "true-client-ip", "user-agent", "x-forwarded-for", "x-original-forwarded-for",
+        "x-real-ip", "X-Request-Id", "host", NULL
+    };
+    for (char **p = headers; *p; p++)
+        zlist_append(names, *p);
+    zlist_append(cookies, "_session");
+    matcher = header_matcher_new(names, cookies);
+
+    const char *field = header_matcher_field(matcher, "User-Agent", 10);
+    assert(field && streq(field, "_http_header_user_agent"));
+    field = header_matcher_field(matcher, "HOST", 4);
+    assert(field && streq(field, "_http_header_host"));
+    field = header_matcher_field(matcher, "x-request-id", 12);
+    assert(field && streq(field, "_http_header_x_request_id"));
+    for (char **p = headers; *p; p++)
+        assert(header_matcher_field(matcher, *p, strlen(*p)));
+
+    // names don't need to be null terminated
+    assert(header_matcher_field(matcher, "hostname", 4));
+    assert(header_matcher_field(matcher, "hostname", 8) == NULL);
+    assert(header_matcher_field(matcher, "accept", 6) == NULL);
+    assert(header_matcher_field(matcher, "user_agent", 10) == NULL);
+
+    assert(!cookie_masker_empty(header_matcher_cookie_masker(matcher)));
+    header_matcher_destroy(&matcher);
+
+    // larger whitelists need bigger tables
+    zlist_purge(names);
+    char generated[200][32];
+    for (int i = 0; i < 200; i++) {
+        snprintf(generated[i], 32, "x-header-%d", i);
+        zlist_append(names, generated[i]);
+    }
+    matcher = header_matcher_new(names, cookies);
+    for (int i = 0; i < 200; i++)
+        assert(header_matcher_field(matcher, generated[i], strlen(generated[i])));
+    assert(header_matcher_field(matcher, "x-header-200", 12) == NULL);
+    header_matcher_destroy(&matcher);
+
+    zlist_destroy(&names);
+    zlist_destroy(&cookies);
+
+    printf("OK\n");
+}
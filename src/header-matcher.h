@@ -0,0 +1,34 @@
+#ifndef __LOGJAM_HEADER_MATCHER_H_INCLUDED__
+#define __LOGJAM_HEADER_MATCHER_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compiled form of the HTTP header whitelist used when converting requests to GELF. The
+// whitelist is stored in a collision free hash table, which is built by searching for a
+// hash seed which maps all header names to different slots, so that a lookup needs a
+// single hash computation and a single comparison. The GELF field names of whitelisted
+// headers are computed once when the matcher is built. The matcher also owns the cookie
+// masker for the configured sensitive cookies.
+
+typedef struct _header_matcher_t header_matcher_t;
+
+extern header_matcher_t* header_matcher_new(zlist_t *header_names, zlist_t *sensitive_cookies);
+extern void header_matcher_destroy(header_matcher_t **matcher_p);
+
+// returns the GELF field name for a whitelisted header, NULL if the header isn't
+// whitelisted. header names are compared case insensitively.
+extern const char* header_matcher_field(header_matcher_t *matcher, const char *name, size_t len);
+
+extern cookie_masker_t* header_matcher_cookie_masker(header_matcher_t *matcher);
+
+extern void header_matcher_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #include "importer-adder.h"
 #include "importer-processor.h"
 #include "importer-resources.h"
+#include "importer-quantiles.h"
 
 /*
  * connections: n_w = num_writers, n_p = num_parsers, "o" = bind, "[<>v^]" = connect
@@ -78,6 +79,26 @@ void merge_histograms(zhash_t *target, zhash_t *source)
     }
 }
 
+static
+void merge_sketches(zhash_t *target, zhash_t *source)
+{
+    quantile_sketch_t *source_sketch = NULL;
+
+    while ( (source_sketch = zhash_first(source)) ) {
+        const char* key = zhash_cursor(source);
+        assert(key);
+        quantile_sketch_t *dest = zhash_lookup(target, key);
+        if (dest) {
+            quantile_sketch_merge(dest, source_sketch);
+        } else {
+            zhash_insert(target, key, source_sketch);
+            zhash_freefn(target, key, quantile_sketch_destroy);
+            zhash_freefn(source, key, NULL);
+        }
+        zhash_delete(source, key);
+    }
+}
+
 static
 void merge_modules(zhash_t* target, zhash_t *source)
 {
@@ -159,6 +180,8 @@ void merge_processors(zhash_t *target, zhash_t *source)
             merge_increments(dest_processor->minutes, source_processor->minutes);
             merge_quants(dest_processor->quants, source_processor->quants);
             merge_histograms(dest_processor->histograms, source_processor->histograms);
+            merge_sketches(dest_processor->sketches, source_processor->sketches);
+            merge_sketches(dest_processor->minute_sketches, source_processor->minute_sketches);
             merge_agents(dest_processor->agents, source_processor->agents);
         } else {
             zhash_insert(target, db_name, source_processor);
@@ -0,0 +1,354 @@
+#include "importer-cardinality.h"
+#include <math.h>
+
+const char* cardinality_kind_names[CARDINALITY_KINDS] = {
+    "pages", "exceptions", "callers", "js_exceptions"
+};
+
+// callers have the form app@action
+const char* cardinality_overflow_keys[CARDINALITY_KINDS] = {
+    "Others#overflow", "Others#overflow", "Others@overflow", "Others#overflow"
+};
+
+// HyperLogLog with 2^10 registers, standard error 1.04/sqrt(1024) = 3.25%
+#define HLL_BITS 10
+#define HLL_REGISTERS (1 << HLL_BITS)
+
+#define INITIAL_TABLE_SIZE 64
+
+struct _cardinality_guard_t {
+    size_t budget;
+    size_t admitted;
+    size_t clamped;
+    size_t table_size;          // power of two, at most twice the budget (rounded up)
+    uint64_t *table;            // open addressing, 0 marks a free slot
+    uint8_t registers[HLL_REGISTERS];
+};
+
+cardinality_guard_t* cardinality_guard_new(size_t budget)
+{
+    cardinality_guard_t *guard = zmalloc(sizeof(*guard));
+    guard->budget = budget;
+    if (budget > 0) {
+        guard->table_size = INITIAL_TABLE_SIZE;
+        guard->table = zmalloc(guard->table_size * sizeof(uint64_t));
+    }
+    return guard;
+}
+
+void cardinality_guard_destroy(cardinality_guard_t **guard_p)
+{
+    cardinality_guard_t *guard = *guard_p;
+    if (guard == NULL)
+        return;
+    free(guard->table);
+    free(guard);
+    *guard_p = NULL;
+}
+
+// FNV-1a, followed by the splitmix64 finalizer to spread the bits for the HLL
+static uint64_t hash_key(const char *key)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (const unsigned char *p = (const unsigned char*)key; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h ? h : 1;
+}
+
+static void hll_add(cardinality_guard_t *guard, uint64_t hash)
+{
+    size_t index = hash >> (64 - HLL_BITS);
+    // the sentinel bit limits the rank to 64 - HLL_BITS + 1
+    uint64_t rest = (hash << HLL_BITS) | (1ull << (HLL_BITS - 1));
+    uint8_t rank = __builtin_clzll(rest) + 1;
+    if (rank > guard->registers[index])
+        guard->registers[index] = rank;
+}
+
+double cardinality_guard_estimate(cardinality_guard_t *guard)
+{
+    const double m = HLL_REGISTERS;
+    double sum = 0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -guard->registers[i]);
+        zeros += guard->registers[i] == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    // linear counting for small cardinalities
+    if (estimate <= 2.5 * m && zeros > 0)
+        estimate = m * log(m / zeros);
+    return estimate;
+}
+
+static uint64_t* lookup_slot(uint64_t *table, size_t table_size, uint64_t hash)
+{
+    size_t mask = table_size - 1;
+    size_t i = hash & mask;
+    while (table[i] != 0 && table[i] != hash)
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+static void grow_table(cardinality_guard_t *guard)
+{
+    size_t new_size = guard->table_size << 1;
+    uint64_t *table = zmalloc(new_size * sizeof(uint64_t));
+    for (size_t i = 0; i < guard->table_size; i++)
+        if (guard->table[i])
+            *lookup_slot(table, new_size, guard->table[i]) = guard->table[i];
+    free(guard->table);
+    guard->table = table;
+    guard->table_size = new_size;
+}
+
+bool cardinality_guard_admit(cardinality_guard_t *guard, const char *key)
+{
+    uint64_t hash = hash_key(key);
+    hll_add(guard, hash);
+    if (guard->budget == 0)
+        return true;
+
+    uint64_t *slot = lookup_slot(guard->table, guard->table_size, hash);
+    if (*slot == hash)
+        return true;
+    if (guard->admitted >= guard->budget) {
+        guard->clamped++;
+        return false;
+    }
+    // keep the load factor below 1/2
+    if (2 * (guard->admitted + 1) > guard->table_size) {
+        grow_table(guard);
+        slot = lookup_slot(guard->table, guard->table_size, hash);
+    }
+    *slot = hash;
+    guard->admitted++;
+    return true;
+}
+
+size_t cardinality_guard_admitted(cardinality_guard_t *guard)
+{
+    return guard->admitted;
+}
+
+size_t cardinality_guard_take_clamped(cardinality_guard_t *guard)
+{
+    size_t clamped = guard->clamped;
+    guard->clamped = 0;
+    return clamped;
+}
+
+stream_cardinality_t* stream_cardinality_new(const char *stream, const size_t budgets[CARDINALITY_KINDS])
+{
+    stream_cardinality_t *cardinality = zmalloc(sizeof(*cardinality));
+    cardinality->stream = strdup(stream);
+    pthread_mutex_init(&cardinality->lock, NULL);
+    for (int i = 0; i < CARDINALITY_KINDS; i++)
+        if (budgets[i] > 0)
+            cardinality->guards[i] = cardinality_guard_new(budgets[i]);
+    return cardinality;
+}
+
+void stream_cardinality_destroy(void *item)
+{
+    stream_cardinality_t *cardinality = item;
+    for (int i = 0; i < CARDINALITY_KINDS; i++)
+        cardinality_guard_destroy(&cardinality->guards[i]);
+    pthread_mutex_destroy(&cardinality->lock);
+    free(cardinality->stream);
+    free(cardinality);
+}
+
+const char* stream_cardinality_clamp(stream_cardinality_t *cardinality, cardinality_kind_t kind, const char *key)
+{
+    if (cardinality == NULL)
+        return key;
+    cardinality_guard_t *guard = cardinality->guards[kind];
+    if (guard == NULL)
+        return key;
+    pthread_mutex_lock(&cardinality->lock);
+    bool admitted = cardinality_guard_admit(guard, key);
+    pthread_mutex_unlock(&cardinality->lock);
+    return admitted ? key : cardinality_overflow_keys[kind];
+}
+
+// guards live as long as a database receives requests
+#define CARDINALITY_MAX_IDLE_SECONDS 3600
+
+static zhash_t *registry = NULL;    // db name -> stream_cardinality_t
+static size_t registry_budgets[CARDINALITY_KINDS];
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void cardinality_registry_init(zconfig_t *config)
+{
+    // 0 disables the limit
+    static const char* defaults[CARDINALITY_KINDS] = {"10000", "2000", "2000", "2000"};
+    pthread_mutex_lock(&registry_lock);
+    for (int i = 0; i < CARDINALITY_KINDS; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "frontend/cardinality/%s", cardinality_kind_names[i]);
+        const char *value = config ? zconfig_resolve(config, path, defaults[i]) : defaults[i];
+        registry_budgets[i] = strtoul(value, NULL, 0);
+    }
+    if (registry == NULL)
+        registry = zhash_new();
+    pthread_mutex_unlock(&registry_lock);
+}
+
+void cardinality_registry_destroy()
+{
+    pthread_mutex_lock(&registry_lock);
+    zhash_destroy(&registry);
+    pthread_mutex_unlock(&registry_lock);
+}
+
+stream_cardinality_t* cardinality_registry_lookup(const char *db_name, const char *stream)
+{
+    pthread_mutex_lock(&registry_lock);
+    stream_cardinality_t *cardinality = NULL;
+    if (registry) {
+        cardinality = zhash_lookup(registry, db_name);
+        if (cardinality == NULL) {
+            cardinality = stream_cardinality_new(stream, registry_budgets);
+            zhash_insert(registry, db_name, cardinality);
+            zhash_freefn(registry, db_name, stream_cardinality_destroy);
+        }
+        cardinality->last_used = time(NULL);
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return cardinality;
+}
+
+static void flush_stream_cardinality(const char *db_name, stream_cardinality_t *cardinality, clamped_keys_recorder_fn *record_clamped)
+{
+    pthread_mutex_lock(&cardinality->lock);
+    for (int i = 0; i < CARDINALITY_KINDS; i++) {
+        cardinality_guard_t *guard = cardinality->guards[i];
+        if (guard == NULL)
+            continue;
+        size_t clamped = cardinality_guard_take_clamped(guard);
+        if (clamped > 0 && record_clamped)
+            record_clamped(db_name, cardinality->stream, i, clamped,
+                           cardinality_guard_admitted(guard), cardinality_guard_estimate(guard));
+    }
+    pthread_mutex_unlock(&cardinality->lock);
+}
+
+void cardinality_registry_flush(clamped_keys_recorder_fn *record_clamped)
+{
+    pthread_mutex_lock(&registry_lock);
+    if (registry == NULL) {
+        pthread_mutex_unlock(&registry_lock);
+        return;
+    }
+    time_t threshold = time(NULL) - CARDINALITY_MAX_IDLE_SECONDS;
+    zlist_t *deletions = zlist_new();
+    stream_cardinality_t *cardinality = zhash_first(registry);
+    while (cardinality) {
+        const char *db_name = zhash_cursor(registry);
+        flush_stream_cardinality(db_name, cardinality, record_clamped);
+        if (cardinality->last_used < threshold)
+            zlist_append(deletions, (void*)db_name);
+        cardinality = zhash_next(registry);
+    }
+    const char *db_name = zlist_first(deletions);
+    while (db_name) {
+        zhash_delete(registry, db_name);
+        db_name = zlist_next(deletions);
+    }
+    zlist_destroy(&deletions);
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static size_t test_clamped[CARDINALITY_KINDS];
+
+static void test_record_clamped(const char *db_name, const char *stream, cardinality_kind_t kind,
+                                size_t clamped, size_t admitted, double estimate)
+{
+    assert(streq(db_name, "logjam-a-b-2026-10-19"));
+    assert(streq(stream, "a-b"));
+    test_clamped[kind] += clamped;
+}
+
+void cardinality_guard_test(int verbose)
+{
+    printf(" * cardinality-guard: ");
+    if (verbose)
+        printf("\n");
+
+    char key[64];
+    cardinality_guard_t *guard = cardinality_guard_new(1000);
+
+    // keys seen before stay admitted after the budget has been used up
+    for (int i = 0; i < 100000; i++) {
+        snprintf(key, sizeof(key), "Users#show_%d", i);
+        bool admitted = cardinality_guard_admit(guard, key);
+        assert(admitted == (i < 1000));
+    }
+    assert(cardinality_guard_admitted(guard) == 1000);
+    assert(cardinality_guard_take_clamped(guard) == 99000);
+    assert(cardinality_guard_take_clamped(guard) == 0);
+    assert(cardinality_guard_admit(guard, "Users#show_999"));
+    assert(!cardinality_guard_admit(guard, "Users#show_1000"));
+    // table is bounded by the budget
+    assert(guard->table_size <= 2048);
+
+    double estimate = cardinality_guard_estimate(guard);
+    if (verbose)
+        printf("[D] estimated %.0f distinct keys (100000 sent)\n", estimate);
+    assert(fabs(estimate - 100000) < 100000 * 0.1);
+    cardinality_guard_destroy(&guard);
+    assert(guard == NULL);
+
+    // small cardinalities are estimated almost exactly
+    guard = cardinality_guard_new(0);
+    for (int i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "exceptions.Error%d", i % 100);
+        assert(cardinality_guard_admit(guard, key));
+    }
+    assert(fabs(cardinality_guard_estimate(guard) - 100) < 5);
+    cardinality_guard_destroy(&guard);
+
+    // per stream guards fold rejected keys into overflow keys
+    size_t budgets[CARDINALITY_KINDS] = {2, 1, 0, 1};
+    stream_cardinality_t *cardinality = stream_cardinality_new("a-b", budgets);
+    assert(streq(stream_cardinality_clamp(cardinality, CARDINALITY_PAGES, "A#a"), "A#a"));
+    assert(streq(stream_cardinality_clamp(cardinality, CARDINALITY_PAGES, "A#b"), "A#b"));
+    assert(streq(stream_cardinality_clamp(cardinality, CARDINALITY_PAGES, "A#c"), "Others#overflow"));
+    assert(streq(stream_cardinality_clamp(cardinality, CARDINALITY_PAGES, "A#a"), "A#a"));
+    assert(streq(stream_cardinality_clamp(cardinality, CARDINALITY_CALLERS, "x@y"), "x@y"));
+    assert(streq(stream_cardinality_clamp(cardinality, CARDINALITY_EXCEPTIONS, "E1"), "E1"));
+    assert(streq(stream_cardinality_clamp(cardinality, CARDINALITY_EXCEPTIONS, "E2"), "Others#overflow"));
+    assert(streq(stream_cardinality_clamp(NULL, CARDINALITY_PAGES, "A#c"), "A#c"));
+    stream_cardinality_destroy(cardinality);
+
+    // parsers share the guards of a database, so the budget is not multiplied by the
+    // number of parsers
+    zconfig_t *config = zconfig_new("root", NULL);
+    zconfig_put(config, "frontend/cardinality/pages", "2");
+    cardinality_registry_init(config);
+    stream_cardinality_t *parser1 = cardinality_registry_lookup("logjam-a-b-2026-10-19", "a-b");
+    stream_cardinality_t *parser2 = cardinality_registry_lookup("logjam-a-b-2026-10-19", "a-b");
+    assert(parser1 == parser2);
+    assert(cardinality_registry_lookup("logjam-c-d-2026-10-19", "c-d") != parser1);
+    assert(streq(stream_cardinality_clamp(parser1, CARDINALITY_PAGES, "A#a"), "A#a"));
+    assert(streq(stream_cardinality_clamp(parser2, CARDINALITY_PAGES, "A#b"), "A#b"));
+    assert(streq(stream_cardinality_clamp(parser1, CARDINALITY_PAGES, "A#c"), "Others#overflow"));
+    assert(streq(stream_cardinality_clamp(parser2, CARDINALITY_PAGES, "A#c"), "Others#overflow"));
+    assert(streq(stream_cardinality_clamp(parser2, CARDINALITY_PAGES, "A#a"), "A#a"));
+    cardinality_registry_flush(test_record_clamped);
+    assert(test_clamped[CARDINALITY_PAGES] == 2);
+    cardinality_registry_flush(test_record_clamped);
+    assert(test_clamped[CARDINALITY_PAGES] == 2);
+    cardinality_registry_destroy();
+    zconfig_destroy(&config);
+
+    printf("OK\n");
+}
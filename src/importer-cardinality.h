@@ -0,0 +1,79 @@
+#ifndef __LOGJAM_IMPORTER_CARDINALITY_H_INCLUDED__
+#define __LOGJAM_IMPORTER_CARDINALITY_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Limits the number of distinct keys (pages, exceptions, callers, js exceptions) a stream
+// can create per day. The first `budget` keys seen are admitted, all other keys have to
+// be folded into an overflow key by the caller. Admitted keys are remembered as 64 bit
+// hashes, so memory use depends on the budget only. A HyperLogLog sketch estimates how
+// many distinct keys the stream actually sent.
+//
+// Guards are not thread safe. The guards of a stream and day are shared by all parsers,
+// as requests are distributed round robin over them, so stream_cardinality_clamp takes
+// a lock. The registry of all stream guards is owned by this module.
+
+typedef enum {
+    CARDINALITY_PAGES,
+    CARDINALITY_EXCEPTIONS,
+    CARDINALITY_CALLERS,
+    CARDINALITY_JS_EXCEPTIONS,
+    CARDINALITY_KINDS
+} cardinality_kind_t;
+
+extern const char* cardinality_kind_names[CARDINALITY_KINDS];
+extern const char* cardinality_overflow_keys[CARDINALITY_KINDS];
+
+typedef struct _cardinality_guard_t cardinality_guard_t;
+
+// a budget of 0 admits all keys
+extern cardinality_guard_t* cardinality_guard_new(size_t budget);
+extern void cardinality_guard_destroy(cardinality_guard_t **guard_p);
+
+extern bool cardinality_guard_admit(cardinality_guard_t *guard, const char *key);
+
+extern size_t cardinality_guard_admitted(cardinality_guard_t *guard);
+extern double cardinality_guard_estimate(cardinality_guard_t *guard);
+
+// returns the number of rejected keys since the last call
+extern size_t cardinality_guard_take_clamped(cardinality_guard_t *guard);
+
+// guards for all kinds of keys of one stream and day
+typedef struct {
+    char *stream;
+    time_t last_used;
+    pthread_mutex_t lock;
+    cardinality_guard_t *guards[CARDINALITY_KINDS];
+} stream_cardinality_t;
+
+extern stream_cardinality_t* stream_cardinality_new(const char *stream, const size_t budgets[CARDINALITY_KINDS]);
+extern void stream_cardinality_destroy(void *cardinality);
+
+// returns key if admitted, the overflow key for the given kind otherwise. thread safe.
+extern const char* stream_cardinality_clamp(stream_cardinality_t *cardinality, cardinality_kind_t kind, const char *key);
+
+// reads budgets from frontend/cardinality/* (config may be NULL)
+extern void cardinality_registry_init(zconfig_t *config);
+extern void cardinality_registry_destroy();
+
+// returns the guards for the given database, creating them if necessary. guards stay
+// valid until they have been idle for an hour.
+extern stream_cardinality_t* cardinality_registry_lookup(const char *db_name, const char *stream);
+
+typedef void (clamped_keys_recorder_fn)(const char *db_name, const char *stream, cardinality_kind_t kind,
+                                        size_t clamped, size_t admitted, double estimate);
+
+// reports keys rejected since the last call and forgets idle guards
+extern void cardinality_registry_flush(clamped_keys_recorder_fn *record_clamped);
+
+extern void cardinality_guard_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
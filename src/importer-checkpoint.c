@@ -0,0 +1,252 @@
+#include "importer-checkpoint.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#define CHECKPOINT_MAGIC "LJCHKPT1"
+
+typedef struct {
+    char magic[8];
+    uint64_t generation;
+    uint64_t size;
+    uint64_t checksum;
+    int64_t created_ms;
+} checkpoint_header_t;
+
+typedef struct {
+    int fd;
+    size_t mapped_size;
+    size_t reserved_size;       // bytes of the file known to have disk blocks allocated
+    byte *map;
+} checkpoint_slot_t;
+
+struct _checkpoint_t {
+    char *path;
+    uint64_t generation;        // of the last checkpoint read or written
+    checkpoint_slot_t slots[2];
+};
+
+// files grow in steps of 1MB
+#define CHECKPOINT_FILE_INCREMENT (1024 * 1024)
+
+static uint64_t checksum(const byte *data, size_t size)
+{
+    // FNV-1a on 64 bit words, bytewise for the tail
+    uint64_t h = 14695981039346656037ull;
+    size_t words = size / sizeof(uint64_t);
+    for (size_t i = 0; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, data + i * sizeof(uint64_t), sizeof(w));
+        h ^= w;
+        h *= 1099511628211ull;
+    }
+    for (size_t i = words * sizeof(uint64_t); i < size; i++) {
+        h ^= data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+checkpoint_t* checkpoint_new(const char *path)
+{
+    checkpoint_t *checkpoint = zmalloc(sizeof(*checkpoint));
+    checkpoint->path = strdup(path);
+    checkpoint->slots[0].fd = checkpoint->slots[1].fd = -1;
+    for (int i = 0; i < 2; i++) {
+        char file_name[strlen(path) + 3];
+        sprintf(file_name, "%s.%d", path, i);
+        checkpoint_slot_t *slot = &checkpoint->slots[i];
+        slot->fd = open(file_name, O_RDWR | O_CREAT, 0644);
+        if (slot->fd < 0) {
+            fprintf(stderr, "[E] checkpoint: could not open %s: %s\n", file_name, strerror(errno));
+            checkpoint_destroy(&checkpoint);
+            return NULL;
+        }
+    }
+    return checkpoint;
+}
+
+void checkpoint_destroy(checkpoint_t **checkpoint_p)
+{
+    checkpoint_t *checkpoint = *checkpoint_p;
+    if (checkpoint == NULL)
+        return;
+    for (int i = 0; i < 2; i++) {
+        checkpoint_slot_t *slot = &checkpoint->slots[i];
+        if (slot->map)
+            munmap(slot->map, slot->mapped_size);
+        if (slot->fd >= 0)
+            close(slot->fd);
+    }
+    free(checkpoint->path);
+    free(checkpoint);
+    *checkpoint_p = NULL;
+}
+
+static bool map_slot(checkpoint_slot_t *slot, size_t size)
+{
+    if (slot->map && slot->mapped_size >= size)
+        return true;
+    struct stat st;
+    if (fstat(slot->fd, &st))
+        return false;
+    if ((size_t)st.st_size < size) {
+        size = (size + CHECKPOINT_FILE_INCREMENT - 1) / CHECKPOINT_FILE_INCREMENT * CHECKPOINT_FILE_INCREMENT;
+        if (ftruncate(slot->fd, size))
+            return false;
+    } else
+        size = st.st_size;
+    if (slot->map)
+        munmap(slot->map, slot->mapped_size);
+    slot->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, slot->fd, 0);
+    if (slot->map == MAP_FAILED) {
+        slot->map = NULL;
+        slot->mapped_size = 0;
+        return false;
+    }
+    slot->mapped_size = size;
+    return true;
+}
+
+// writing to a page of a shared mapping which has no disk block raises SIGBUS if the file
+// system is full, so the blocks of the mapped file are allocated before writing
+static bool reserve_slot(checkpoint_slot_t *slot)
+{
+    if (slot->reserved_size >= slot->mapped_size)
+        return true;
+    int rc = posix_fallocate(slot->fd, 0, slot->mapped_size);
+    if (rc) {
+        errno = rc;
+        return false;
+    }
+    slot->reserved_size = slot->mapped_size;
+    return true;
+}
+
+bool checkpoint_write(checkpoint_t *checkpoint, const void *data, size_t size)
+{
+    uint64_t generation = checkpoint->generation + 1;
+    checkpoint_slot_t *slot = &checkpoint->slots[generation % 2];
+    if (!map_slot(slot, sizeof(checkpoint_header_t) + size)) {
+        fprintf(stderr, "[E] checkpoint: could not map %s.%d: %s\n", checkpoint->path, (int)(generation % 2), strerror(errno));
+        return false;
+    }
+    if (!reserve_slot(slot)) {
+        fprintf(stderr, "[E] checkpoint: could not reserve space for %s.%d: %s\n", checkpoint->path, (int)(generation % 2), strerror(errno));
+        return false;
+    }
+    checkpoint_header_t *header = (checkpoint_header_t*) slot->map;
+    // invalidate the slot while it's being written
+    header->generation = 0;
+    if (size > 0)
+        memcpy(slot->map + sizeof(checkpoint_header_t), data, size);
+    header->size = size;
+    header->checksum = checksum(data, size);
+    header->created_ms = zclock_time();
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    __atomic_store_n(&header->generation, generation, __ATOMIC_RELEASE);
+    // schedule write back, but don't wait for it
+    msync(slot->map, sizeof(checkpoint_header_t) + size, MS_ASYNC);
+    checkpoint->generation = generation;
+    return true;
+}
+
+zchunk_t* checkpoint_read(checkpoint_t *checkpoint, int64_t *created_ms)
+{
+    zchunk_t *result = NULL;
+    uint64_t best = 0;
+    for (int i = 0; i < 2; i++) {
+        checkpoint_slot_t *slot = &checkpoint->slots[i];
+        struct stat st;
+        if (fstat(slot->fd, &st) || (size_t)st.st_size < sizeof(checkpoint_header_t))
+            continue;
+        if (!map_slot(slot, st.st_size))
+            continue;
+        checkpoint_header_t *header = (checkpoint_header_t*) slot->map;
+        if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic))
+            || header->generation <= best
+            || header->size > slot->mapped_size - sizeof(checkpoint_header_t))
+            continue;
+        const byte *data = slot->map + sizeof(checkpoint_header_t);
+        if (checksum(data, header->size) != header->checksum) {
+            fprintf(stderr, "[W] checkpoint: ignored corrupt checkpoint %s.%d\n", checkpoint->path, i);
+            continue;
+        }
+        zchunk_destroy(&result);
+        result = zchunk_new(data, header->size);
+        best = header->generation;
+        if (created_ms)
+            *created_ms = header->created_ms;
+    }
+    // continue with the next generation
+    if (best > checkpoint->generation)
+        checkpoint->generation = best;
+    return result;
+}
+
+void checkpoint_test(int verbose)
+{
+    printf(" * checkpoint: ");
+    if (verbose)
+        printf("\n");
+
+    char path[] = "/tmp/logjam-checkpoint-test-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    checkpoint_t *checkpoint = checkpoint_new(path);
+    assert(checkpoint);
+    assert(checkpoint_read(checkpoint, NULL) == NULL);
+
+    // later checkpoints win, also when they grow the file
+    assert(checkpoint_write(checkpoint, "first", 5));
+    size_t big_size = 3 * CHECKPOINT_FILE_INCREMENT + 17;
+    byte *big = zmalloc(big_size);
+    for (size_t i = 0; i < big_size; i++)
+        big[i] = i % 251;
+    assert(checkpoint_write(checkpoint, big, big_size));
+    // all blocks written through the mapping have been allocated
+    for (int i = 0; i < 2; i++) {
+        struct stat st;
+        assert(fstat(checkpoint->slots[i].fd, &st) == 0);
+        assert((size_t)st.st_blocks * 512 >= checkpoint->slots[i].mapped_size);
+    }
+    checkpoint_destroy(&checkpoint);
+
+    checkpoint = checkpoint_new(path);
+    int64_t created = 0;
+    zchunk_t *chunk = checkpoint_read(checkpoint, &created);
+    assert(chunk);
+    assert(zchunk_size(chunk) == big_size);
+    assert(memcmp(zchunk_data(chunk), big, big_size) == 0);
+    assert(created > 0 && created <= zclock_time());
+    zchunk_destroy(&chunk);
+
+    // a torn checkpoint is ignored in favour of the previous one
+    assert(checkpoint_write(checkpoint, "third", 5));
+    checkpoint_slot_t *slot = &checkpoint->slots[checkpoint->generation % 2];
+    slot->map[sizeof(checkpoint_header_t) + 2] ^= 1;
+    chunk = checkpoint_read(checkpoint, NULL);
+    assert(chunk);
+    assert(zchunk_size(chunk) == big_size);
+    zchunk_destroy(&chunk);
+
+    // an empty checkpoint is valid
+    assert(checkpoint_write(checkpoint, NULL, 0));
+    chunk = checkpoint_read(checkpoint, NULL);
+    assert(chunk && zchunk_size(chunk) == 0);
+    zchunk_destroy(&chunk);
+
+    checkpoint_destroy(&checkpoint);
+    assert(checkpoint == NULL);
+    free(big);
+    for (int i = 0; i < 2; i++) {
+        char file_name[sizeof(path) + 2];
+        sprintf(file_name, "%s.%d", path, i);
+        unlink(file_name);
+    }
+    unlink(path);
+
+    printf("OK\n");
+}
@@ -0,0 +1,35 @@
+#ifndef __LOGJAM_IMPORTER_CHECKPOINT_H_INCLUDED__
+#define __LOGJAM_IMPORTER_CHECKPOINT_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Persists a binary blob (the controller's merged processor state) in memory mapped files,
+// so that it survives a restart or crash of the importer. Checkpoints alternate between two
+// files (<path>.0 and <path>.1), each starting with a header containing a generation number
+// and a checksum, so a checkpoint torn by a crash is detected and the previous one is used.
+// Data written to the mapping is in the page cache as soon as it has been copied, so only
+// an OS crash can lose it. Disk blocks for the files are allocated before writing to them,
+// so a full file system makes checkpoint_write fail instead of crashing the importer.
+
+typedef struct _checkpoint_t checkpoint_t;
+
+extern checkpoint_t* checkpoint_new(const char *path);
+extern void checkpoint_destroy(checkpoint_t **checkpoint_p);
+
+// returns false if the data could not be written
+extern bool checkpoint_write(checkpoint_t *checkpoint, const void *data, size_t size);
+
+// returns a copy of the most recent valid checkpoint (or NULL) and its creation time (ms)
+extern zchunk_t* checkpoint_read(checkpoint_t *checkpoint, int64_t *created_ms);
+
+extern void checkpoint_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
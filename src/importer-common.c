@@ -6,6 +6,14 @@ bool debug = false;
 bool quiet = false;
 bool initialize_dbs = false;
 
+// keep updating the quants and heatmaps collections next to the quantile sketches
+bool legacy_quants = true;
+
+// request databases above the soft limit get 10% of their requests inserted, above the
+// hard limit none at all. the sizes include indexes, 20 GB and 40 GB by default.
+int64_t soft_limit_storage_size = 20LL << 30;
+int64_t hard_limit_storage_size = 40LL << 30;
+
 int queued_updates = 0;
 int queued_inserts = 0;
 
@@ -278,6 +286,43 @@ bool config_file_has_changed()
     return changed;
 }
 
+zconfig_t* config_file_reload()
+{
+    zconfig_t *config = zconfig_load((char*)config_file_name);
+    if (config) {
+        config_file_last_modified = zfile_modified(config_file);
+        free(config_file_digest);
+        config_file_digest = strdup(zfile_digest(config_file));
+    }
+    return config;
+}
+
+zlist_t* extract_devices_from_config(zconfig_t* config)
+{
+    zlist_t *devices = zlist_new();
+    zconfig_t *bindings = zconfig_locate(config, "frontend/endpoints/bindings");
+    zconfig_t *binding = bindings ? zconfig_child(bindings) : NULL;
+    while (binding) {
+        char *spec = zconfig_value(binding);
+        if (streq(spec, "")) {
+            if (verbose)
+                printf("[I] ignoring empty SUB socket binding in config\n");
+        } else {
+            zlist_append(devices, spec);
+        }
+        binding = zconfig_next(binding);
+    }
+    return devices;
+}
+
+void config_update_storage_limits(zconfig_t* config)
+{
+    int64_t soft_limit = atof(zconfig_resolve(config, "frontend/storage/soft_limit", "20")) * (1 << 30);
+    int64_t hard_limit = atof(zconfig_resolve(config, "frontend/storage/hard_limit", "40")) * (1 << 30);
+    __atomic_store_n(&soft_limit_storage_size, soft_limit, __ATOMIC_RELAXED);
+    __atomic_store_n(&hard_limit_storage_size, hard_limit, __ATOMIC_RELAXED);
+}
+
 bool config_update_date_info()
 {
     char old_date[ISO_DATE_STR_LEN];
@@ -14,6 +14,8 @@ extern "C" {
 #define MAX_ADDERS 16
 #define MAX_WRITERS 20
 #define MAX_UPDATERS 20
+// sequence numbers of at most this many devices are kept in checkpoints
+#define MAX_DEVICES 4096
 
 extern unsigned long num_subscribers;
 extern unsigned long num_parsers;
@@ -71,6 +73,9 @@ extern bool verbose;
 extern bool debug;
 extern bool quiet;
 extern bool initialize_dbs;
+extern bool legacy_quants;
+extern int64_t soft_limit_storage_size;
+extern int64_t hard_limit_storage_size;
 
 extern char iso_date_today[ISO_DATE_STR_LEN];
 extern char iso_date_tomorrow[ISO_DATE_STR_LEN];
@@ -83,6 +88,12 @@ extern int convert_to_win1252(const char *str, size_t n, char *utf8);
 
 extern void config_file_init(const char* file_name);
 extern bool config_file_has_changed();
+// loads the changed config file, after which config_file_has_changed returns false again
+extern zconfig_t* config_file_reload();
+// returns the SUB socket bindings from the config. the list doesn't own its items.
+extern zlist_t* extract_devices_from_config(zconfig_t* config);
+// reads frontend/storage/{soft,hard}_limit (GB per app, env and day, including indexes)
+extern void config_update_storage_limits(zconfig_t* config);
 extern bool config_update_date_info();
 extern int set_thread_name(const char* name);
 
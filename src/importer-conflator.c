@@ -0,0 +1,229 @@
+#include "importer-conflator.h"
+
+typedef struct {
+    char *totals;           // latest totals
+    json_object *errors;    // array of distinct errors
+} pending_t;
+
+struct _live_stream_conflator_t {
+    size_t max_errors;
+    zhash_t *pending;       // key -> pending_t
+    live_stream_conflation_stats_t stats;
+};
+
+static
+void pending_destroy(void *item)
+{
+    pending_t *pending = item;
+    free(pending->totals);
+    if (pending->errors)
+        json_object_put(pending->errors);
+    free(pending);
+}
+
+static
+pending_t* pending_lookup(live_stream_conflator_t *conflator, const char *key)
+{
+    pending_t *pending = zhash_lookup(conflator->pending, key);
+    if (pending == NULL) {
+        pending = zmalloc(sizeof(*pending));
+        zhash_insert(conflator->pending, key, pending);
+        zhash_freefn(conflator->pending, key, pending_destroy);
+    }
+    return pending;
+}
+
+live_stream_conflator_t* live_stream_conflator_new(size_t max_errors)
+{
+    live_stream_conflator_t *conflator = zmalloc(sizeof(*conflator));
+    conflator->max_errors = max_errors > 0 ? max_errors : 1;
+    conflator->pending = zhash_new();
+    return conflator;
+}
+
+void live_stream_conflator_destroy(live_stream_conflator_t **conflator_p)
+{
+    live_stream_conflator_t *conflator = *conflator_p;
+    if (conflator == NULL)
+        return;
+    zhash_destroy(&conflator->pending);
+    free(conflator);
+    *conflator_p = NULL;
+}
+
+void live_stream_conflator_add_totals(live_stream_conflator_t *conflator, const char *key, const char *json_str)
+{
+    conflator->stats.received++;
+    pending_t *pending = pending_lookup(conflator, key);
+    if (pending->totals) {
+        conflator->stats.conflated++;
+        free(pending->totals);
+    }
+    pending->totals = strdup(json_str);
+}
+
+static
+bool same_field(json_object *a, json_object *b, const char *field)
+{
+    json_object *x, *y;
+    bool has_x = json_object_object_get_ex(a, field, &x);
+    bool has_y = json_object_object_get_ex(b, field, &y);
+    if (!has_x || !has_y)
+        return has_x == has_y;
+    return streq(json_object_get_string(x), json_object_get_string(y));
+}
+
+static
+bool same_error(json_object *a, json_object *b)
+{
+    return same_field(a, b, "action") && same_field(a, b, "response_code") && same_field(a, b, "description");
+}
+
+static
+void add_error(live_stream_conflator_t *conflator, pending_t *pending, json_object *error)
+{
+    size_t n = json_object_array_length(pending->errors);
+    for (size_t i = 0; i < n; i++) {
+        json_object *known = json_object_array_get_idx(pending->errors, i);
+        if (same_error(known, error)) {
+            json_object *count_obj;
+            int count = 1;
+            if (json_object_object_get_ex(known, "count", &count_obj))
+                count = json_object_get_int(count_obj);
+            json_object_object_add(known, "count", json_object_new_int(count + 1));
+            conflator->stats.conflated++;
+            return;
+        }
+    }
+    if (n >= conflator->max_errors) {
+        conflator->stats.suppressed++;
+        return;
+    }
+    json_object_get(error);
+    json_object_array_add(pending->errors, error);
+}
+
+void live_stream_conflator_add_errors(live_stream_conflator_t *conflator, const char *key, const char *json_str)
+{
+    json_object *errors = json_tokener_parse(json_str);
+    if (errors == NULL || !json_object_is_type(errors, json_type_array)) {
+        fprintf(stderr, "[E] live_stream: ignored invalid error message for %s: %s\n", key, json_str);
+        if (errors)
+            json_object_put(errors);
+        return;
+    }
+    pending_t *pending = pending_lookup(conflator, key);
+    if (pending->errors == NULL)
+        pending->errors = json_object_new_array();
+    size_t n = json_object_array_length(errors);
+    for (size_t i = 0; i < n; i++) {
+        conflator->stats.received++;
+        json_object *error = json_object_array_get_idx(errors, i);
+        if (json_object_is_type(error, json_type_object))
+            add_error(conflator, pending, error);
+    }
+    json_object_put(errors);
+}
+
+void live_stream_conflator_flush(live_stream_conflator_t *conflator, live_stream_publish_fn *publish, void *arg)
+{
+    pending_t *pending = zhash_first(conflator->pending);
+    while (pending) {
+        const char *key = zhash_cursor(conflator->pending);
+        if (pending->totals) {
+            publish(key, pending->totals, arg);
+            conflator->stats.published++;
+        }
+        if (pending->errors && json_object_array_length(pending->errors) > 0) {
+            publish(key, json_object_to_json_string_ext(pending->errors, JSON_C_TO_STRING_PLAIN), arg);
+            conflator->stats.published++;
+        }
+        pending = zhash_next(conflator->pending);
+    }
+    zhash_destroy(&conflator->pending);
+    conflator->pending = zhash_new();
+}
+
+void live_stream_conflator_take_stats(live_stream_conflator_t *conflator, live_stream_conflation_stats_t *stats)
+{
+    *stats = conflator->stats;
+    memset(&conflator->stats, 0, sizeof(conflator->stats));
+}
+
+static zhash_t *test_published = NULL;
+
+static
+void test_publish(const char *key, const char *json_str, void *arg)
+{
+    size_t *count = arg;
+    (*count)++;
+    char *copy = strdup(json_str);
+    char test_key[256];
+    snprintf(test_key, sizeof(test_key), "%s:%c", key, *json_str);
+    zhash_update(test_published, test_key, copy);
+    zhash_freefn(test_published, test_key, free);
+}
+
+void live_stream_conflator_test(int verbose)
+{
+    printf(" * live-stream-conflator: ");
+    if (verbose)
+        printf("\n");
+
+    test_published = zhash_new();
+    live_stream_conflator_t *conflator = live_stream_conflator_new(2);
+    live_stream_conflation_stats_t stats;
+    size_t published = 0;
+
+    // only the latest totals per key are published
+    for (int i = 0; i < 10; i++) {
+        char json[64];
+        snprintf(json, sizeof(json), "{\"count\":%d}", i);
+        live_stream_conflator_add_totals(conflator, "a-b,all_pages", json);
+    }
+    live_stream_conflator_add_totals(conflator, "a-b,foo", "{\"count\":1}");
+    live_stream_conflator_flush(conflator, test_publish, &published);
+    assert(published == 2);
+    assert(streq(zhash_lookup(test_published, "a-b,all_pages:{"), "{\"count\":9}"));
+    live_stream_conflator_take_stats(conflator, &stats);
+    assert(stats.received == 11);
+    assert(stats.published == 2);
+    assert(stats.conflated == 9);
+
+    // nothing left after a flush
+    published = 0;
+    live_stream_conflator_flush(conflator, test_publish, &published);
+    assert(published == 0);
+
+    // identical errors are merged, distinct errors beyond the limit are suppressed
+    const char *error = "[{\"request_id\":\"1\",\"action\":\"A#b\",\"response_code\":500,\"description\":\"boom\"}]";
+    for (int i = 0; i < 5; i++)
+        live_stream_conflator_add_errors(conflator, "a-b,all_pages", error);
+    live_stream_conflator_add_errors(conflator, "a-b,all_pages",
+                                     "[{\"action\":\"A#c\",\"response_code\":500,\"description\":\"boom\"},"
+                                     "{\"action\":\"A#d\",\"response_code\":500,\"description\":\"boom\"}]");
+    live_stream_conflator_add_totals(conflator, "a-b,all_pages", "{\"count\":1}");
+    live_stream_conflator_flush(conflator, test_publish, &published);
+    assert(published == 2);
+    const char *errors_str = zhash_lookup(test_published, "a-b,all_pages:[");
+    if (verbose)
+        printf("[D] published errors: %s\n", errors_str);
+    json_object *errors = json_tokener_parse(errors_str);
+    assert(json_object_array_length(errors) == 2);
+    json_object *count;
+    assert(json_object_object_get_ex(json_object_array_get_idx(errors, 0), "count", &count));
+    assert(json_object_get_int(count) == 5);
+    assert(!json_object_object_get_ex(json_object_array_get_idx(errors, 1), "count", &count));
+    json_object_put(errors);
+    live_stream_conflator_take_stats(conflator, &stats);
+    assert(stats.received == 8);
+    assert(stats.published == 2);
+    assert(stats.conflated == 4);
+    assert(stats.suppressed == 1);
+
+    live_stream_conflator_destroy(&conflator);
+    assert(conflator == NULL);
+    zhash_destroy(&test_published);
+
+    printf("OK\n");
+}
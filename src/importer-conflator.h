@@ -0,0 +1,46 @@
+#ifndef __LOGJAM_IMPORTER_CONFLATOR_H_INCLUDED__
+#define __LOGJAM_IMPORTER_CONFLATOR_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Coalesces live stream messages by key between two flushes of the live stream publisher.
+// For totals only the latest message per key is kept. Errors are kept as a JSON array per
+// key, where errors with the same action, response code and description are merged into
+// one entry with a "count" field. At most max_errors distinct errors are kept per key, the
+// rest is suppressed. A flush publishes at most one totals and one errors message per key,
+// which bounds the output rate of the live stream no matter how many errors occur.
+
+typedef struct {
+    size_t received;
+    size_t published;
+    size_t conflated;       // totals replaced or errors merged before publication
+    size_t suppressed;      // errors exceeding max_errors per key
+} live_stream_conflation_stats_t;
+
+typedef struct _live_stream_conflator_t live_stream_conflator_t;
+
+typedef void (live_stream_publish_fn)(const char *key, const char *json_str, void *arg);
+
+extern live_stream_conflator_t* live_stream_conflator_new(size_t max_errors);
+extern void live_stream_conflator_destroy(live_stream_conflator_t **conflator_p);
+
+extern void live_stream_conflator_add_totals(live_stream_conflator_t *conflator, const char *key, const char *json_str);
+extern void live_stream_conflator_add_errors(live_stream_conflator_t *conflator, const char *key, const char *json_str);
+
+// publishes all pending messages and forgets them
+extern void live_stream_conflator_flush(live_stream_conflator_t *conflator, live_stream_publish_fn *publish, void *arg);
+
+// copies the stats collected since the last call and resets them
+extern void live_stream_conflator_take_stats(live_stream_conflator_t *conflator, live_stream_conflation_stats_t *stats);
+
+extern void live_stream_conflator_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
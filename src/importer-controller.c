@@ -11,6 +11,11 @@
 #include "importer-watchdog.h"
 #include "unknown-streams-collector.h"
 #include "importer-prometheus-client.h"
+#include "importer-checkpoint.h"
+#include "importer-insertspool.h"
+#include "importer-mongopool.h"
+#include "importer-scaler.h"
+#include "device-tracker.h"
 
 /*
  * connections: n_s = num_subscribers, n_w = num_writers, n_p = num_parsers, n_u= num_updaters, n_a = num_adders "[<>^v]" = connect, "o" = bind
@@ -40,6 +45,13 @@
 // The data from the parsers is collected using the pipes, but maybe we should have an
 // independent socket for this. The controller send ticks to the watchdog, which aborts
 // the whole process if it doesn't receive ticks for ten consecutive seconds.
+//
+// The number of parsers, writers and updaters adapts to the load: the configured thread
+// counts are the minimum, frontend/threads/max_{parsers,writers,updaters} the maximum. When
+// the config file changes, the controller reloads it. Changes to thread limits, scaling
+// thresholds, device bindings, live stream settings, frontend/writers/max_queued and
+// frontend/quants/legacy are applied on the fly. Other changes still make the controller
+// terminate, so that it gets restarted with the new config.
 
 unsigned long num_subscribers = 1;
 unsigned long num_parsers = 8;
@@ -47,6 +59,17 @@ unsigned long num_writers = 10;
 unsigned long num_updaters = 10;
 unsigned long num_adders = 4;
 
+// initial size of the buffer used for serializing checkpoints, grows as needed
+#define CHECKPOINT_BUFFER_SIZE (1024 * 1024)
+
+// called at the end of every tick
+static controller_tick_fn *tick_callback = NULL;
+
+void set_controller_tick_fn(controller_tick_fn *f)
+{
+    tick_callback = f;
+}
+
 typedef struct {
     zconfig_t *config;
     zactor_t *stream_config_updater;
@@ -65,63 +88,96 @@ typedef struct {
     size_t updates_blocked;
     zsock_t *adder_socket;
     zsock_t *live_stream_socket;
+    size_t live_stream_snapshot_interval;   // publish all known modules every n ticks
+    bool live_stream_batched;               // publish one message per stream instead of per module
     size_t ticks;
     zlist_t *collected_processors;
+    checkpoint_t *checkpoint;
+    zchunk_t *checkpoint_buffer;
+    size_t num_device_sequences;
+    device_sequence_t device_sequences[MAX_DEVICES];
+    zlist_t *loaded_configs;            // configs loaded on changes, actors might still refer to them
+    zlist_t *devices;                   // devices from the config, NULL if not given by the config
+    pool_scaler_t parser_scaler;
+    pool_scaler_t writer_scaler;
+    pool_scaler_t updater_scaler;
+    bool retiring_parser;               // last parser gets destroyed after the next tick
+    bool retiring_updater;              // last updater gets destroyed once no updates are queued
+    zactor_t *retiring_writer;          // gets destroyed once it has drained its queue
 } controller_state_t;
 
 
 static
-void extract_parser_state(controller_state_t *state, zmsg_t* msg, zhash_t **processors, size_t *parsed_msgs_count, frontend_stats_t *fe_stats)
+void extract_parser_state(controller_state_t *state, zmsg_t* msg, zhash_t **processors, size_t *parsed_msgs_count, frontend_stats_t *fe_stats, double *cpu_seconds)
 {
     zframe_t *first = zmsg_first(msg);
     zframe_t *second = zmsg_next(msg);
     zframe_t *third = zmsg_next(msg);
+    zframe_t *fourth = zmsg_next(msg);
     assert(zframe_size(first) == sizeof(zhash_t*));
     memcpy(&*processors, zframe_data(first), sizeof(zhash_t*));
     assert(zframe_size(second) == sizeof(size_t));
     memcpy(parsed_msgs_count, zframe_data(second), sizeof(size_t));
     assert(zframe_size(third) == sizeof(frontend_stats_t));
     memcpy(fe_stats, zframe_data(third), sizeof(frontend_stats_t));
+    assert(zframe_size(fourth) == sizeof(double));
+    memcpy(cpu_seconds, zframe_data(fourth), sizeof(double));
 }
 
 
 static
-void publish_totals(stream_info_t *stream_info, zhash_t *totals, zsock_t *live_stream_socket)
+json_object* module_totals_to_json(increments_t *incs)
+{
+    json_object *json = json_object_new_object();
+    if (incs) {
+        json_object_object_add(json, "count", json_object_new_int(incs->backend_request_count));
+        json_object_object_add(json, "page_count", json_object_new_int(incs->page_request_count));
+        json_object_object_add(json, "ajax_count", json_object_new_int(incs->ajax_request_count));
+        increments_add_metrics_to_json(incs, json);
+    } else {
+        json_object_object_add(json, "count", json_object_new_int(0));
+        json_object_object_add(json, "page_count", json_object_new_int(0));
+        json_object_object_add(json, "ajax_count", json_object_new_int(0));
+    }
+    return json;
+}
+
+// Only modules which received requests during the last tick are published, plus those
+// which just became idle, so that their graphs drop to zero. Every
+// live_stream_snapshot_interval ticks all known modules are published, so that clients
+// joining late get a complete picture.
+static
+void publish_totals(controller_state_t *state, stream_info_t *stream_info, zhash_t *totals, bool snapshot)
 {
-    size_t n = stream_info->app_len + 1 + stream_info->env_len;
+    json_object *batch = NULL;
     zhash_t *known_modules = stream_info->known_modules;
-    void *value = zhash_first(known_modules);
-    while (value) {
+    known_module_t *known = zhash_first(known_modules);
+    while (known) {
         const char *module = zhash_cursor(known_modules);
-        const char *namespace = module;
-        // skip :: at the beginning of module
-        while (*module == ':') module++;
-        size_t m = strlen(module);
-        char key[n + m + 3];
-        sprintf(key, "%s-%s,%s", stream_info->app, stream_info->env, module);
-        // TODO: change this crap in the live stream publisher
-        // tolower is unsafe and not really necessary
-        for (char *p = key; *p; ++p) *p = tolower(*p);
-
-        // printf("[D] publishing totals for module: %s, key: %s\n", module, key);
-        json_object *json = json_object_new_object();
-        increments_t *incs = totals ? zhash_lookup(totals, namespace) : NULL;
-        if (incs) {
-            json_object_object_add(json, "count", json_object_new_int(incs->backend_request_count));
-            json_object_object_add(json, "page_count", json_object_new_int(incs->page_request_count));
-            json_object_object_add(json, "ajax_count", json_object_new_int(incs->ajax_request_count));
-            increments_add_metrics_to_json(incs, json);
-
-        } else {
-            json_object_object_add(json, "count", json_object_new_int(0));
-            json_object_object_add(json, "page_count", json_object_new_int(0));
-            json_object_object_add(json, "ajax_count", json_object_new_int(0));
+        increments_t *incs = totals ? zhash_lookup(totals, module) : NULL;
+        if (incs || known->active || snapshot) {
+            known->active = incs != NULL;
+            // printf("[D] publishing totals for module: %s, key: %s\n", module, known->live_stream_key);
+            json_object *json = module_totals_to_json(incs);
+            if (state->live_stream_batched) {
+                if (batch == NULL)
+                    batch = json_object_new_object();
+                json_object_object_add(batch, known->live_stream_module, json);
+            } else {
+                const char* json_str = json_object_to_json_string_ext(json, JSON_C_TO_STRING_PLAIN);
+                live_stream_publish(state->live_stream_socket, known->live_stream_key, json_str);
+                json_object_put(json);
+            }
         }
+        known = zhash_next(known_modules);
+    }
+    if (batch) {
+        json_object *json = json_object_new_object();
+        json_object_object_add(json, "snapshot", json_object_new_boolean(snapshot));
+        json_object_object_add(json, "modules", batch);
         const char* json_str = json_object_to_json_string_ext(json, JSON_C_TO_STRING_PLAIN);
-        live_stream_publish(live_stream_socket, key, json_str);
+        live_stream_publish(state->live_stream_socket, stream_info->live_stream_key, json_str);
         json_object_put(json);
-
-        value = zhash_next(known_modules);
     }
 }
 
@@ -129,6 +185,7 @@ static
 void publish_totals_for_every_known_stream(controller_state_t *state, zhash_t *processors)
 {
     zhash_t *published_streams= zhash_new();
+    bool snapshot = state->ticks % state->live_stream_snapshot_interval == 0;
 
     // publish updates for all streams where we received some data
     processor_state_t* processor = zhash_first(processors);
@@ -136,7 +193,7 @@ void publish_totals_for_every_known_stream(controller_state_t *state, zhash_t *p
         stream_info_t *stream_info = processor->stream_info;
         update_known_modules(stream_info, processor->modules);
         zhash_insert(published_streams, stream_info->key, (void*)1);
-        publish_totals(stream_info, processor->totals, state->live_stream_socket);
+        publish_totals(state, stream_info, processor->totals, snapshot);
         processor = zhash_next(processors);
     }
 
@@ -147,7 +204,7 @@ void publish_totals_for_every_known_stream(controller_state_t *state, zhash_t *p
         stream_info_t *stream_info = get_stream_info(stream, NULL);
         if (stream_info) {
             if (!zhash_lookup(published_streams, stream)) {
-                publish_totals(stream_info, NULL, state->live_stream_socket);
+                publish_totals(state, stream_info, NULL, snapshot);
             }
             release_stream_info(stream_info);
         }
@@ -274,6 +331,40 @@ void forward_updates(controller_state_t *state, zhash_t *processor)
         else
             __atomic_add_fetch(&queued_updates, 1, __ATOMIC_SEQ_CST);
 
+        // send quantile sketch updates
+        stats_msg = zmsg_new();
+        zmsg_addstr(stats_msg, "s");
+        zmsg_addstr(stats_msg, proc->db_name);
+        zmsg_addptr(stats_msg, proc->stream_info);
+        reference_stream_info(proc->stream_info);
+        zmsg_addptr(stats_msg, proc->sketches);
+        proc->sketches = NULL;
+        if (!output_socket_ready(state->updates_socket, 0)) {
+            if (!state->updates_blocked++)
+                fprintf(stderr, "[W] controller: updates push socket not ready. blocking!\n");
+        }
+        if (zmsg_send_and_destroy(&stats_msg, state->updates_socket))
+            release_stream_info(proc->stream_info);
+        else
+            __atomic_add_fetch(&queued_updates, 1, __ATOMIC_SEQ_CST);
+
+        // send minute quantile sketch updates
+        stats_msg = zmsg_new();
+        zmsg_addstr(stats_msg, "S");
+        zmsg_addstr(stats_msg, proc->db_name);
+        zmsg_addptr(stats_msg, proc->stream_info);
+        reference_stream_info(proc->stream_info);
+        zmsg_addptr(stats_msg, proc->minute_sketches);
+        proc->minute_sketches = NULL;
+        if (!output_socket_ready(state->updates_socket, 0)) {
+            if (!state->updates_blocked++)
+                fprintf(stderr, "[W] controller: updates push socket not ready. blocking!\n");
+        }
+        if (zmsg_send_and_destroy(&stats_msg, state->updates_socket))
+            release_stream_info(proc->stream_info);
+        else
+            __atomic_add_fetch(&queued_updates, 1, __ATOMIC_SEQ_CST);
+
         // send agents updates
         stats_msg = zmsg_new();
         zmsg_addstr(stats_msg, "a");
@@ -296,6 +387,416 @@ void forward_updates(controller_state_t *state, zhash_t *processor)
     zlist_destroy(&db_names);
 }
 
+// subscribers connected to the same device report the sequence number they have seen last
+static
+void record_clamped_keys(const char *db_name, const char *stream, cardinality_kind_t kind,
+                         size_t clamped, size_t admitted, double estimate)
+{
+    importer_prometheus_client_count_clamped_keys(stream, cardinality_kind_names[kind], clamped);
+    if (verbose)
+        printf("[W] controller: %s: folded %zu %s into overflow (%zu admitted, ~%.0f distinct)\n",
+               db_name, clamped, cardinality_kind_names[kind], admitted, estimate);
+}
+
+static
+void add_device_sequences(controller_state_t *state, device_sequence_t *sequences, size_t n)
+{
+    for (size_t i=0; i<n; i++) {
+        device_sequence_t *known = NULL;
+        for (size_t j=0; j<state->num_device_sequences; j++) {
+            if (state->device_sequences[j].device_number == sequences[i].device_number) {
+                known = &state->device_sequences[j];
+                break;
+            }
+        }
+        if (known == NULL) {
+            if (state->num_device_sequences == MAX_DEVICES)
+                continue;
+            known = &state->device_sequences[state->num_device_sequences++];
+            *known = sequences[i];
+        } else if (known->sequence_number < sequences[i].sequence_number)
+            known->sequence_number = sequences[i].sequence_number;
+    }
+}
+
+// a checkpoint contains the device sequence numbers seen by the subscribers, followed by
+// the processor state collected since the last time updates have been forwarded. it is
+// written right after forwarding, so that the state sent to the stats updaters is only
+// counted twice if we crash before the next checkpoint has been written.
+static
+void write_checkpoint(controller_state_t *state)
+{
+    int64_t start_time_ms = zclock_mono();
+    zchunk_t *buffer = state->checkpoint_buffer;
+    zchunk_set(buffer, NULL, 0);
+    uint32_t n = state->num_device_sequences;
+    zchunk_extend(buffer, &n, sizeof(n));
+    zchunk_extend(buffer, state->device_sequences, n * sizeof(device_sequence_t));
+    processor_hash_dump(zlist_first(state->collected_processors), buffer);
+    checkpoint_write(state->checkpoint, zchunk_data(buffer), zchunk_size(buffer));
+    if (verbose)
+        printf("[D] controller: checkpoint: %zu bytes (%d ms)\n", zchunk_size(buffer), (int)(zclock_mono() - start_time_ms));
+}
+
+static
+void restore_checkpoint(controller_state_t *state)
+{
+    int64_t created_ms = 0;
+    zchunk_t *chunk = checkpoint_read(state->checkpoint, &created_ms);
+    if (chunk == NULL) {
+        printf("[I] controller: no checkpoint found\n");
+        return;
+    }
+    const byte *data = zchunk_data(chunk);
+    size_t size = zchunk_size(chunk);
+    uint32_t n = 0;
+    if (size >= sizeof(n))
+        memcpy(&n, data, sizeof(n));
+    size_t sequences_size = n * sizeof(device_sequence_t);
+    if (size < sizeof(n) || n > MAX_DEVICES || size - sizeof(n) < sequences_size) {
+        fprintf(stderr, "[E] controller: ignored corrupt checkpoint\n");
+        zchunk_destroy(&chunk);
+        return;
+    }
+    data += sizeof(n);
+    memcpy(state->device_sequences, data, sequences_size);
+    data += sequences_size;
+    size -= sizeof(n) + sequences_size;
+
+    zhash_t *processors = processor_hash_load(data, size);
+    if (processors) {
+        state->num_device_sequences = n;
+        printf("[I] controller: restored checkpoint from %.1f seconds ago: %zu databases, %u devices\n",
+               (zclock_time() - created_ms) / 1000.0, zhash_size(processors), n);
+        zlist_append(state->collected_processors, processors);
+    }
+    zchunk_destroy(&chunk);
+}
+
+static
+void add_parser(controller_state_t *state)
+{
+    size_t i = num_parsers;
+    state->parsers[i] = parser_new(state->config, i);
+    num_parsers++;
+    // adders only work while processors get merged, so we never retire them
+    while (num_adders < (num_parsers + 1) / 2 && num_adders < MAX_ADDERS) {
+        state->adders[num_adders] = zactor_new(adder, (void*)num_adders);
+        num_adders++;
+    }
+    printf("[I] controller: added parser[%zu]\n", i);
+}
+
+// Parsers pull messages from the subscribers. Disconnecting a pull socket drops the
+// messages waiting in it, so we pause the subscribers while the parser drains its queue
+// and disconnects.
+static
+void retire_parser(controller_state_t *state)
+{
+    size_t i = num_parsers - 1;
+    for (size_t j=0; j<num_subscribers; j++) {
+        zstr_send(state->subscribers[j], "pause");
+        zsock_wait(state->subscribers[j]);
+    }
+    zstr_send(state->parsers[i], "retire");
+    zsock_wait(state->parsers[i]);
+    for (size_t j=0; j<num_subscribers; j++) {
+        zstr_send(state->subscribers[j], "continue");
+    }
+    state->retiring_parser = true;
+    printf("[I] controller: retiring parser[%zu]\n", i);
+}
+
+static
+void change_parser_writers(controller_state_t *state, const char *cmd, size_t writer)
+{
+    char id[32];
+    snprintf(id, sizeof(id), "%zu", writer);
+    for (size_t i=0; i<num_parsers; i++) {
+        zstr_sendx(state->parsers[i], cmd, id, NULL);
+        zsock_wait(state->parsers[i]);
+    }
+}
+
+static
+void add_writer(controller_state_t *state)
+{
+    size_t i = num_writers;
+    // the writer binds its pull socket before the parsers connect to it
+    state->writers[i] = request_writer_new(state->config, i);
+    change_parser_writers(state, "add-writer", i);
+    num_writers++;
+    printf("[I] controller: added writer[%zu]\n", i);
+}
+
+// Once all parsers have disconnected from a writer, it works off the requests already
+// queued for it and tells us when it is done.
+static
+void retire_writer(controller_state_t *state)
+{
+    size_t i = --num_writers;
+    change_parser_writers(state, "remove-writer", i);
+    zstr_send(state->writers[i], "retire");
+    state->retiring_writer = state->writers[i];
+    state->writers[i] = NULL;
+    printf("[I] controller: retiring writer[%zu]\n", i);
+}
+
+static
+void add_updater(controller_state_t *state)
+{
+    size_t i = num_updaters;
+    state->updaters[i] = stats_updater_new(state->config, i);
+    num_updaters++;
+    printf("[I] controller: added updater[%zu]\n", i);
+}
+
+// Only the controller sends updates. So an updater can be destroyed safely as soon as
+// no updates are queued, as it can't receive any until the controller forwards again.
+static
+void retire_updater(controller_state_t *state)
+{
+    int updates;
+    __atomic_load(&queued_updates, &updates, __ATOMIC_SEQ_CST);
+    if (updates != 0)
+        return;
+    size_t i = --num_updaters;
+    zactor_destroy(&state->updaters[i]);
+    state->retiring_updater = false;
+    printf("[I] controller: retired updater[%zu]\n", i);
+}
+
+// At most one actor of each pool gets added or retired at a time. A pool isn't scaled in
+// the tick in which a retirement finishes.
+static
+void scale_pools(controller_state_t *state, double parser_cpu_seconds, int updates, int inserts)
+{
+    if (state->retiring_parser) {
+        // the retiring parser has been ticked for the last time
+        size_t i = --num_parsers;
+        parser_destroy(&state->parsers[i]);
+        state->retiring_parser = false;
+        printf("[I] controller: retired parser[%zu]\n", i);
+    } else {
+        int change = pool_scaler_update(&state->parser_scaler, num_parsers, parser_cpu_seconds / num_parsers);
+        if (change > 0)
+            add_parser(state);
+        else if (change < 0)
+            retire_parser(state);
+    }
+
+    if (state->retiring_writer) {
+        if (zsock_events(zactor_sock(state->retiring_writer)) & ZMQ_POLLIN) {
+            zactor_destroy(&state->retiring_writer);
+            printf("[I] controller: retired writer[%zu]\n", num_writers);
+        }
+    } else {
+        // spooled inserts are waiting for idle writers
+        double queued = inserts + insert_spool_size();
+        int change = pool_scaler_update(&state->writer_scaler, num_writers, queued / num_writers);
+        if (change > 0)
+            add_writer(state);
+        else if (change < 0)
+            retire_writer(state);
+    }
+
+    if (state->retiring_updater) {
+        retire_updater(state);
+    } else {
+        int change = pool_scaler_update(&state->updater_scaler, num_updaters, (double)updates / num_updaters);
+        if (change > 0)
+            add_updater(state);
+        else if (change < 0) {
+            state->retiring_updater = true;
+            retire_updater(state);
+        }
+    }
+}
+
+static
+void configure_pool_scaler(pool_scaler_t *scaler, zconfig_t *config, const char *pool, size_t min, size_t limit,
+                           const char *high, const char *low, size_t interval, size_t cooldown)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "frontend/threads/max_%s", pool);
+    size_t max = atol(zconfig_resolve(config, path, "0"));
+    if (max > limit) {
+        fprintf(stderr, "[W] controller: %s: limiting max_%s to %zu\n", path, pool, limit);
+        max = limit;
+    }
+    snprintf(path, sizeof(path), "frontend/scaling/%s/high", pool);
+    double high_load = atof(zconfig_resolve(config, path, high));
+    snprintf(path, sizeof(path), "frontend/scaling/%s/low", pool);
+    double low_load = atof(zconfig_resolve(config, path, low));
+    pool_scaler_init(scaler, min, max, high_load, low_load, interval, cooldown);
+    if (scaler->max > scaler->min)
+        printf("[I] controller: scaling %s between %zu and %zu (load: %.2f-%.2f)\n",
+               pool, scaler->min, scaler->max, scaler->low, scaler->high);
+}
+
+// the configured thread counts are kept as the minimum pool sizes
+static
+void configure_pool_scalers(controller_state_t *state, bool startup)
+{
+    zconfig_t *config = state->config;
+    size_t interval = atol(zconfig_resolve(config, "frontend/scaling/interval", "10"));
+    size_t cooldown = atol(zconfig_resolve(config, "frontend/scaling/cooldown", "60"));
+    // parser load is cpu seconds per second, writer and updater load are queued messages
+    configure_pool_scaler(&state->parser_scaler, config, "parsers",
+                          startup ? num_parsers : state->parser_scaler.min, MAX_PARSERS, "0.8", "0.3", interval, cooldown);
+    configure_pool_scaler(&state->writer_scaler, config, "writers",
+                          startup ? num_writers : state->writer_scaler.min, MAX_WRITERS, "1000", "10", interval, cooldown);
+    configure_pool_scaler(&state->updater_scaler, config, "updaters",
+                          startup ? num_updaters : state->updater_scaler.min, MAX_UPDATERS, "100", "1", interval, cooldown);
+}
+
+static
+void configure_live_stream(controller_state_t *state)
+{
+    zconfig_t *config = state->config;
+    state->live_stream_snapshot_interval = atol(zconfig_resolve(config, "frontend/livestream/snapshot_interval", "10"));
+    if (state->live_stream_snapshot_interval == 0)
+        state->live_stream_snapshot_interval = 1;
+    const char *format = zconfig_resolve(config, "frontend/livestream/format", "modules");
+    if (strcmp(format, "modules") && strcmp(format, "streams"))
+        fprintf(stderr, "[W] controller: unknown live stream format: %s, using modules\n", format);
+    state->live_stream_batched = streq(format, "streams");
+}
+
+static
+bool same_strings(zlist_t *a, zlist_t *b)
+{
+    if (zlist_size(a) != zlist_size(b))
+        return false;
+    const char *x = zlist_first(a);
+    const char *y = zlist_first(b);
+    while (x && y) {
+        if (strcmp(x, y))
+            return false;
+        x = zlist_next(a);
+        y = zlist_next(b);
+    }
+    return true;
+}
+
+static
+void reconfigure_devices(controller_state_t *state)
+{
+    zlist_t *devices = extract_devices_from_config(state->config);
+    if (zlist_size(devices) == 0) {
+        fprintf(stderr, "[W] controller: ignoring empty device list in changed config\n");
+        zlist_destroy(&devices);
+        return;
+    }
+    if (same_strings(devices, state->devices)) {
+        zlist_destroy(&devices);
+        return;
+    }
+    printf("[I] controller: device list changed (%zu devices)\n", zlist_size(devices));
+    for (size_t i=0; i<num_subscribers; i++) {
+        zmsg_t *msg = zmsg_new();
+        zmsg_addstr(msg, "devices");
+        const char *spec = zlist_first(devices);
+        while (spec) {
+            zmsg_addstr(msg, spec);
+            spec = zlist_next(devices);
+        }
+        zmsg_send(&msg, state->subscribers[i]);
+    }
+    zlist_destroy(&state->devices);
+    state->devices = devices;
+}
+
+static
+bool config_path_reloadable(controller_state_t *state, const char *path)
+{
+    static const char* reloadable[] = {
+        "frontend/threads/max_parsers",
+        "frontend/threads/max_writers",
+        "frontend/threads/max_updaters",
+        "frontend/scaling",
+        "frontend/writers/max_queued",
+        "frontend/quants/legacy",
+        "frontend/storage",
+        "frontend/endpoints/bindings",
+        "frontend/livestream/snapshot_interval",
+        "frontend/livestream/format",
+        NULL
+    };
+    for (const char **prefix = reloadable; *prefix; prefix++) {
+        size_t n = strlen(*prefix);
+        if (strncmp(path, *prefix, n) == 0 && (path[n] == '\0' || path[n] == '/')) {
+            // subscribers only follow the device list from the config if they were started with it
+            return state->devices != NULL || strcmp(*prefix, "frontend/endpoints/bindings");
+        }
+    }
+    return false;
+}
+
+// appends path=value for all settings which can't be changed without a restart
+static
+void config_fixed_settings(controller_state_t *state, zconfig_t *config, const char *prefix, zlist_t *settings)
+{
+    zconfig_t *child = zconfig_child(config);
+    while (child) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s%s%s", prefix, *prefix ? "/" : "", zconfig_name(child));
+        if (!config_path_reloadable(state, path)) {
+            const char *value = zconfig_value(child);
+            char *setting;
+            int n = asprintf(&setting, "%s=%s", path, value ? value : "");
+            assert(n > 0);
+            zlist_append(settings, setting);
+            free(setting);
+            config_fixed_settings(state, child, path, settings);
+        }
+        child = zconfig_next(child);
+    }
+}
+
+static
+bool config_change_requires_restart(controller_state_t *state, zconfig_t *old_config, zconfig_t *new_config)
+{
+    zlist_t *old_settings = zlist_new();
+    zlist_autofree(old_settings);
+    zlist_t *new_settings = zlist_new();
+    zlist_autofree(new_settings);
+    config_fixed_settings(state, old_config, "", old_settings);
+    config_fixed_settings(state, new_config, "", new_settings);
+    bool changed = !same_strings(old_settings, new_settings);
+    zlist_destroy(&old_settings);
+    zlist_destroy(&new_settings);
+    return changed;
+}
+
+// returns true if the controller should terminate
+static
+bool reload_config(controller_state_t *state)
+{
+    zconfig_t *config = config_file_reload();
+    if (config == NULL) {
+        fprintf(stderr, "[E] controller: could not load changed config file, keeping current config\n");
+        return false;
+    }
+    if (config_change_requires_restart(state, state->config, config)) {
+        printf("[I] controller: detected config change. terminating.\n");
+        zconfig_destroy(&config);
+        return true;
+    }
+    printf("[I] controller: detected config change. reloading.\n");
+    zlist_append(state->loaded_configs, config);
+    state->config = config;
+
+    __atomic_store_n(&legacy_quants, strcmp(zconfig_resolve(config, "frontend/quants/legacy", "true"), "false") != 0, __ATOMIC_RELAXED);
+    insert_spool_update_limit(config);
+    config_update_storage_limits(config);
+    configure_pool_scalers(state, false);
+    configure_live_stream(state);
+    if (state->devices)
+        reconfigure_devices(state);
+    return false;
+}
+
 static
 int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
 {
@@ -304,6 +805,7 @@ int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
     zhash_t *processors[num_parsers];
     size_t parsed_msgs_counts[num_parsers];
     frontend_stats_t fe_stats[num_parsers];
+    double cpu_seconds[num_parsers];
 
     state->ticks++;
 
@@ -311,12 +813,16 @@ int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
     zstr_send(state->stream_config_updater, "tick");
 
     size_t messages_received = 0;
+    state->num_device_sequences = 0;
     for (size_t i=0; i<num_subscribers; i++) {
         zstr_send(state->subscribers[i], "tick");
         zmsg_t *response = zmsg_recv(state->subscribers[i]);
         if (response) {
             zframe_t *frame = zmsg_first(response);
             messages_received += zframe_getsize(frame);
+            frame = zmsg_next(response);
+            if (frame)
+                add_device_sequences(state, (device_sequence_t*) zframe_data(frame), zframe_size(frame) / sizeof(device_sequence_t));
             zmsg_destroy(&response);
         }
     }
@@ -332,7 +838,7 @@ int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
         zstr_send(parser, "tick");
         zmsg_t *response = zmsg_recv(parser);
         if (response) {
-            extract_parser_state(state, response, &processors[i], &parsed_msgs_counts[i], &fe_stats[i]);
+            extract_parser_state(state, response, &processors[i], &parsed_msgs_counts[i], &fe_stats[i], &cpu_seconds[i]);
             zmsg_destroy(&response);
         }
     }
@@ -343,8 +849,10 @@ int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
     // printf("[D] controller: combining processors states\n");
     size_t parsed_msgs_count = parsed_msgs_counts[0];
     frontend_stats_t front_stats = fe_stats[0];
+    double parser_cpu_seconds = cpu_seconds[0];
     for (int i=1; i<num_parsers; i++) {
         parsed_msgs_count += parsed_msgs_counts[i];
+        parser_cpu_seconds += cpu_seconds[i];
         front_stats.received += fe_stats[i].received;
         front_stats.dropped += fe_stats[i].dropped;
         for (int j=0; j<FE_MSG_NUM_REASONS; j++)
@@ -385,13 +893,19 @@ int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
         zhash_destroy(&processors);
     }
 
+    if (state->checkpoint)
+        write_checkpoint(state);
+
+    // report database connection usage
+    mongo_pools_tick();
+
     // tell request writers to tick
     // printf("[D] controller: ticking writers\n");
     for (int i=0; i<num_writers; i++) {
         zstr_send(state->writers[i], "tick");
     }
 
-    bool terminate = (state->ticks % CONFIG_FILE_CHECK_INTERVAL == 0) && config_file_has_changed();
+    bool terminate = (state->ticks % CONFIG_FILE_CHECK_INTERVAL == 0) && config_file_has_changed() && reload_config(state);
     int64_t end_time_ms = zclock_mono();
     int runtime = end_time_ms - start_time_ms;
     int next_tick = runtime > 999 ? 1 : 1000 - runtime;
@@ -416,6 +930,25 @@ int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
     }
     importer_prometheus_client_gauge_queued_updates(updates);
     importer_prometheus_client_gauge_queued_inserts(inserts);
+    insert_spool_tick();
+    cardinality_registry_flush(record_clamped_keys);
+
+    if (!terminate)
+        scale_pools(state, parser_cpu_seconds, updates, inserts);
+
+    if (tick_callback) {
+        controller_tick_info_t info = {
+            .ticks = state->ticks,
+            .runtime_ms = runtime,
+            .messages_received = messages_received,
+            .messages_parsed = parsed_msgs_count,
+            .frontend_received = front_stats.received,
+            .frontend_dropped = front_stats.dropped,
+            .queued_updates = updates,
+            .queued_inserts = inserts,
+        };
+        tick_callback(&info);
+    }
 
     importer_prometheus_client_count_updates_blocked(state->updates_blocked);
 
@@ -433,7 +966,6 @@ int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
     }
 
     if (terminate) {
-        printf("[I] controller: detected config change. terminating.\n");
         zsys_interrupted = 1;
     } else {
         int rc = zloop_timer(loop, next_tick, 1, collect_stats_and_forward, state);
@@ -454,14 +986,16 @@ int collect_stats_and_forward(zloop_t *loop, int timer_id, void *arg)
 static
 bool controller_create_actors(controller_state_t *state, uint64_t indexer_opts)
 {
-    // initialize mongo client
-    if (!dryrun)
+    // initialize mongo client and the shared connection pools
+    if (!dryrun) {
         mongoc_init();
+        mongo_pools_init(state->config);
+    }
 
     // start the stream config updater (pass something not null to make it send indexer messages)
     state->stream_config_updater = stream_config_updater_new((void*)1);
     // start the indexer
-    state->indexer = zactor_new(indexer, (void*)indexer_opts);
+    state->indexer = indexer_new(state->config, indexer_opts);
     if (initialize_dbs) return !zsys_interrupted;
 
     // start the live stream publisher
@@ -469,9 +1003,10 @@ bool controller_create_actors(controller_state_t *state, uint64_t indexer_opts)
     // start the unknown streams collector
     state->unknown_streams_collector = zactor_new(unknown_streams_collector_actor_fn, NULL);
 
-    // create subscribers
+    // create subscribers. they must not count messages twice which are already contained
+    // in a restored checkpoint.
     for (size_t i=0; i<num_subscribers; i++) {
-        state->subscribers[i] = subscriber_new(state->config, i);
+        state->subscribers[i] = subscriber_new(state->config, i, state->device_sequences, state->num_device_sequences);
     }
     //start the tracker
     state->tracker = zactor_new(tracker, NULL);
@@ -555,6 +1090,11 @@ void controller_destroy_actors(controller_state_t *state)
         }
     }
 
+    if (state->retiring_writer) {
+        if (verbose) printf("[D] controller: destroying retiring writer\n");
+        zactor_destroy(&state->retiring_writer);
+    }
+
     for (size_t i=0; i<num_updaters; i++) {
         if (state->updaters[i]) {
             if (verbose) printf("[D] controller: destroying updater[%zu]\n", i);
@@ -604,9 +1144,11 @@ void controller_destroy_actors(controller_state_t *state)
         zsock_destroy(&state->adder_socket);
     }
 
-    // shut down mongo client
-    if (!dryrun)
+    // shut down connection pools and mongo client
+    if (!dryrun) {
+        mongo_pools_destroy();
         mongoc_cleanup();
+    }
 }
 
 
@@ -681,6 +1223,31 @@ int run_controller_loop(zconfig_t* config, size_t io_threads, const char *logjam
     state.config = config,
     state.collected_processors = zlist_new();
     assert(state.collected_processors);
+    state.loaded_configs = zlist_new();
+    configure_pool_scalers(&state, true);
+    configure_live_stream(&state);
+
+    // only apply device list changes if the subscribers have been started with the list from the config
+    state.devices = extract_devices_from_config(config);
+    if (hosts == NULL || zlist_size(hosts) == 0 || !same_strings(hosts, state.devices))
+        zlist_destroy(&state.devices);
+
+    // bound the number of inserts kept in memory
+    insert_spool_init(config);
+
+    // bound the number of distinct keys per stream and day, shared by all parsers
+    cardinality_registry_init(config);
+
+    // restore state saved before the last shutdown or crash
+    const char *checkpoint_path = zconfig_resolve(config, "frontend/checkpoint/path", NULL);
+    if (checkpoint_path && !initialize_dbs) {
+        state.checkpoint = checkpoint_new(checkpoint_path);
+        if (state.checkpoint) {
+            state.checkpoint_buffer = zchunk_new(NULL, CHECKPOINT_BUFFER_SIZE);
+            restore_checkpoint(&state);
+        }
+    }
+
     bool start_up_complete = controller_create_actors(&state, indexer_opts);
 
     if (!start_up_complete) {
@@ -721,6 +1288,8 @@ int run_controller_loop(zconfig_t* config, size_t io_threads, const char *logjam
         zhash_destroy(&p);
     }
     zlist_destroy(&state.collected_processors);
+    checkpoint_destroy(&state.checkpoint);
+    zchunk_destroy(&state.checkpoint_buffer);
     // create apocalypse timer
     if (start_shutdown_timer() == -1)
         printf("[W] controller: could not start shutdown timer\n");
@@ -729,6 +1298,16 @@ int run_controller_loop(zconfig_t* config, size_t io_threads, const char *logjam
 
     // destroy actors
     controller_destroy_actors(&state);
+    insert_spool_destroy();
+    cardinality_registry_destroy();
+
+    // configs loaded after changes can be freed once all actors are gone
+    zlist_destroy(&state.devices);
+    zconfig_t *loaded_config;
+    while ( (loaded_config = zlist_pop(state.loaded_configs)) ) {
+        zconfig_destroy(&loaded_config);
+    }
+    zlist_destroy(&state.loaded_configs);
 
  shutdown:
     // wait for actors to finish
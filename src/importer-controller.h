@@ -7,6 +7,23 @@
 extern "C" {
 #endif
 
+// summary of a controller tick, passed to the tick callback (if any)
+typedef struct {
+    size_t ticks;                 // number of ticks since start
+    int runtime_ms;               // time spent in this tick
+    size_t messages_received;     // messages received by all subscribers
+    size_t messages_parsed;       // messages parsed by all parsers
+    size_t frontend_received;     // frontend messages received by all parsers
+    size_t frontend_dropped;      // frontend messages dropped by all parsers
+    int queued_updates;           // stats updates not yet processed by updaters
+    int queued_inserts;           // requests not yet processed by writers
+} controller_tick_info_t;
+
+typedef void (controller_tick_fn) (controller_tick_info_t *info);
+
+// register a function to be called at the end of every controller tick (used by benchmarks)
+extern void set_controller_tick_fn(controller_tick_fn *f);
+
 extern int run_controller_loop(zconfig_t* config, size_t io_threads, const char *logjam_url, const char* subscription_pattern, uint64_t indexer_opts);
 
 #ifdef __cplusplus
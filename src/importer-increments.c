@@ -173,7 +173,22 @@ void increments_fill_severity(increments_t *increments, request_data_t *request_
     json_object_object_add(increments->others, sev, NEW_INT1);
 }
 
-void increments_fill_exceptions(increments_t *increments, json_object *exceptions)
+// counts key, or the overflow key with the same prefix if the stream has too many distinct names
+static
+void increments_add_clamped(increments_t *increments, stream_cardinality_t *cardinality, cardinality_kind_t kind, char *key, size_t prefix_len)
+{
+    const char *name = stream_cardinality_clamp(cardinality, kind, key + prefix_len);
+    if (name == key + prefix_len) {
+        json_object_object_add(increments->others, key, NEW_INT1);
+        return;
+    }
+    char clamped_key[prefix_len + strlen(name) + 1];
+    memcpy(clamped_key, key, prefix_len);
+    strcpy(clamped_key + prefix_len, name);
+    json_object_object_add(increments->others, clamped_key, NEW_INT1);
+}
+
+void increments_fill_exceptions(increments_t *increments, json_object *exceptions, stream_cardinality_t *cardinality)
 {
     if (exceptions == NULL)
         return;
@@ -194,7 +209,7 @@ void increments_fill_exceptions(increments_t *increments, json_object *exception
             json_object* new_ex = json_object_new_string(ex_str_dup+11);
             json_object_array_put_idx(exceptions, i, new_ex);
         }
-        json_object_object_add(increments->others, ex_str_dup, NEW_INT1);
+        increments_add_clamped(increments, cardinality, CARDINALITY_EXCEPTIONS, ex_str_dup, 11);
     }
 }
 
@@ -223,7 +238,7 @@ void increments_fill_soft_exceptions(increments_t *increments, json_object *soft
   }
 }
 
-void increments_fill_js_exception(increments_t *increments, const char *js_exception)
+void increments_fill_js_exception(increments_t *increments, const char *js_exception, stream_cardinality_t *cardinality)
 {
     size_t n = strlen(js_exception);
     int l = 14;
@@ -231,10 +246,10 @@ void increments_fill_js_exception(increments_t *increments, const char *js_excep
     strcpy(xbuffer, "js_exceptions.");
     uri_replace_dots_and_dollars(xbuffer+l, js_exception);
     // printf("[D] JS EXCEPTION: %s\n", xbuffer);
-    json_object_object_add(increments->others, xbuffer, NEW_INT1);
+    increments_add_clamped(increments, cardinality, CARDINALITY_JS_EXCEPTIONS, xbuffer, l);
 }
 
-void increments_fill_caller_info(increments_t *increments, json_object *request)
+void increments_fill_caller_info(increments_t *increments, json_object *request, stream_cardinality_t *cardinality)
 {
     json_object *caller_action_obj;
     if (json_object_object_get_ex(request, "caller_action", &caller_action_obj)) {
@@ -255,7 +270,7 @@ void increments_fill_caller_info(increments_t *increments, json_object *request)
                 caller_name[real_app_len + 8] = '@';
                 copy_replace_dots_and_dollars(caller_name + 8 + real_app_len + 1, caller_action);
                 // printf("[D] CALLER: %s\n", caller_name);
-                json_object_object_add(increments->others, caller_name, NEW_INT1);
+                increments_add_clamped(increments, cardinality, CARDINALITY_CALLERS, caller_name, 8);
             }
         }
     }
@@ -336,3 +351,71 @@ void increments_add(increments_t *stored_increments, increments_t* increments)
         }
     }
 }
+
+bson_t* increments_to_bson(const char* namespace, increments_t* increments)
+{
+    // dump_increments(namespace, increments);
+
+    bson_t *incs = bson_new();
+    bson_t *maxs = bson_new();
+
+    if (increments->backend_request_count)
+        bson_append_int32(incs, "count", 5, increments->backend_request_count);
+    size_t frontend_request_count = 0;
+    if (increments->page_request_count) {
+        frontend_request_count += increments->page_request_count;
+        bson_append_int32(incs, "page_count", 10, increments->page_request_count);
+    }
+    if (increments->ajax_request_count) {
+        frontend_request_count += increments->ajax_request_count;
+        bson_append_int32(incs, "ajax_count", 10, increments->ajax_request_count);
+    }
+    // store frontend_count for easier retrieval of frontend totals/minutes
+    if (frontend_request_count) {
+        bson_append_int32(incs, "frontend_count", 14, frontend_request_count);
+    }
+
+    bool have_maxs = false;
+    for (size_t i=0; i<=last_resource_offset; i++) {
+        double val = increments->metrics[i].val;
+        if (val > 0) {
+            const char *name = int_to_resource[i];
+            bson_append_double(incs, name, strlen(name), val);
+            const char *name_sq = int_to_resource_sq[i];
+            bson_append_double(incs, name_sq, strlen(name_sq), increments->metrics[i].val_squared);
+            have_maxs = true;
+            const char *name_max = int_to_resource_max[i];
+            bson_append_double(maxs, name_max, strlen(name_max), increments->metrics[i].val_max);
+        }
+    }
+
+    json_object_object_foreach(increments->others, key, value_obj) {
+        size_t n = strlen(key);
+        enum json_type type = json_object_get_type(value_obj);
+        switch (type) {
+        case json_type_int:
+            bson_append_int32(incs, key, n, json_object_get_int(value_obj));
+            break;
+        case json_type_double:
+            bson_append_double(incs, key, n, json_object_get_double(value_obj));
+            break;
+        default:
+            fprintf(stderr, "[E] unsupported json type in json to bson conversion: %s, key: %s\n", json_type_to_name(type), key);
+        }
+    }
+
+    bson_t *document = bson_new();
+    bson_append_document(document, "$inc", 4, incs);
+    if (have_maxs)
+        bson_append_document(document, "$max", 4, maxs);
+
+    // size_t n;
+    // char* bs = bson_as_json(document, &n);
+    // printf("[D] document. size: %zu; value:%s\n", n, bs);
+    // bson_free(bs);
+
+    bson_destroy(incs);
+    bson_destroy(maxs);
+
+    return document;
+}
@@ -2,6 +2,7 @@
 #define __LOGJAM_IMPORTER_INCREMENTS_H_INCLUDED__
 
 #include "importer-common.h"
+#include "importer-cardinality.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,11 +49,12 @@ extern void increments_fill_page_apdex(increments_t *increments, double total_ti
 extern void increments_fill_ajax_apdex(increments_t *increments, double total_time);
 extern void increments_fill_response_code(increments_t *increments, request_data_t *request_data);
 extern void increments_fill_severity(increments_t *increments, request_data_t *request_data);
-extern void increments_fill_exceptions(increments_t *increments, json_object *exceptions);
+extern void increments_fill_exceptions(increments_t *increments, json_object *exceptions, stream_cardinality_t *cardinality);
 extern void increments_fill_soft_exceptions(increments_t *increments, json_object *soft_exceptions);
-extern void increments_fill_js_exception(increments_t *increments, const char *js_exception);
-extern void increments_fill_caller_info(increments_t *increments, json_object *request);
+extern void increments_fill_js_exception(increments_t *increments, const char *js_exception, stream_cardinality_t *cardinality);
+extern void increments_fill_caller_info(increments_t *increments, json_object *request, stream_cardinality_t *cardinality);
 extern void increments_fill_sender_info(increments_t *increments, json_object *request);
+extern bson_t* increments_to_bson(const char* namespace, increments_t* increments);
 
 extern void dump_metrics(metric_pair_t *metrics);
 extern void dump_increments(const char *action, increments_t *increments);
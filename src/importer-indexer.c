@@ -1,16 +1,19 @@
 #include "importer-indexer.h"
 #include "logjam-streaminfo.h"
 #include "importer-mongoutils.h"
+#include "importer-indexscheduler.h"
+#include "importer-mongopool.h"
+#include "importer-prometheus-client.h"
 
 
 /*
- * connections: n_w = num_writers, n_p = num_parsers, "o" = bind, "[<>v^]" = connect
+ * connections: n_w = num_writers, n_p = num_parsers, n_i = num index workers, "o" = bind, "[<>v^]" = connect
  *
  *                            controller
  *                                |
  *                               PIPE
  *               PUSH    PULL     |
- *  parser(n_p)  >----------o  indexer
+ *  parser(n_p)  >----------o  indexer  --- PIPE ---  index workers(n_i)
  *
  */
 
@@ -18,31 +21,37 @@
 // The indexer keeps track of indexes it has already created to avoid repeated mongodb calls.
 // Creating an index on a collection while it is being written to, slows down the writers considerably.
 // The indexer therefore creates databases along with all their indexes one day in advance.
-// On startup, databases and indexes for the current day are created synchronously. The completion
-// of this is signalled to the controller by sending a started message to the controller.
-// Databases and indexes for dates in the future are always created via a fresh background
-// thread, spawned from the indexer.
+// On startup, databases and indexes for the current day are created before the controller
+// gets signalled that the indexer has started.
+//
+// Databases and indexes are created by a fixed pool of index workers
+// (frontend/indexer/workers, default 2). The indexer hands out jobs in the order decided by
+// the index scheduler: databases for today before databases for tomorrow, bigger streams
+// first. Tomorrow's databases are scheduled when the quiet hours
+// (frontend/indexer/quiet_hours, for example "2-5") start, or right after the date change
+// if none are configured. During the quiet hours all workers may work on them, otherwise
+// only one, so that requests for today's databases always find an idle worker.
+
+#define MAX_INDEX_WORKERS 16
 
 typedef struct {
     size_t id;
-    mongoc_client_t *mongo_clients[MAX_DATABASES];
     zsock_t *controller_socket;
     zsock_t *pull_socket;
-    zhash_t *databases;
     uint64_t opts;
+    index_scheduler_t *scheduler;
+    size_t num_workers;
+    zactor_t *workers[MAX_INDEX_WORKERS];
+    bool worker_busy[MAX_INDEX_WORKERS];
+    int quiet_hours_start;                  // -1 if no quiet hours are configured
+    int quiet_hours_end;
+    char scheduled_date[ISO_DATE_STR_LEN];  // last date for which all databases were scheduled
 } indexer_state_t;
 
 typedef struct {
-    size_t id;
-    char iso_date[ISO_DATE_STR_LEN];
-    bool ensure_known;
-} bg_indexer_args_t;
-
-enum future_t {tomorrow = 1, today = 0};
-
-// sleep 5 seconds in between each step when iterating over all
-// databases to create tomorrow's indexes
-#define INDEXER_DELAY 5
+    zconfig_t *config;
+    uint64_t opts;
+} indexer_args_t;
 
 static
 zsock_t *indexer_pull_socket_new()
@@ -190,11 +199,11 @@ bool add_metrics_collection_indexes(indexer_state_t *state, mongoc_database_t *d
 }
 
 static
-int64_t extract_storage_size(bson_t *doc)
+int64_t extract_size_on_disk(const bson_iter_t *db_iter)
 {
     bson_iter_t iter;
-    if (bson_iter_init_find (&iter, doc, "storageSize")) {
-        bson_type_t bit = bson_iter_type (&iter);
+    if (bson_iter_recurse(db_iter, &iter) && bson_iter_find(&iter, "sizeOnDisk")) {
+        bson_type_t bit = bson_iter_type(&iter);
         switch (bit) {
         case BSON_TYPE_DOUBLE:
             return bson_iter_double(&iter);
@@ -203,47 +212,43 @@ int64_t extract_storage_size(bson_t *doc)
         case BSON_TYPE_INT32:
             return bson_iter_int32(&iter);
         default:
-            fprintf(stderr, "unexpected bson type when reading databse stats: %d\n", bit);
+            fprintf(stderr, "unexpected bson type when reading database sizes: %d\n", bit);
         }
     }
     return 0;
 }
 
+// fills the given hash with the sizes of all databases for the given date, using a
+// single listDatabases command instead of one dbStats command per stream
 static
-void indexer_check_disk_usage(indexer_state_t *state, const char *db_name, stream_info_t *stream_info)
+bool indexer_list_database_sizes(indexer_state_t *state, int db, const char *iso_date, zhash_t *sizes)
 {
-    if (dryrun) return;
-
-    bson_t *cmd = bson_new();
-    bson_append_int32(cmd, "dbStats", 7, 1);
-    bson_append_int32(cmd, "scale", 5, 1);
-
-    mongoc_client_t *client = state->mongo_clients[stream_info->db];
-    mongoc_database_t *database = mongoc_client_get_database(client, db_name);
+    char pattern[ISO_DATE_STR_LEN + 2];
+    snprintf(pattern, sizeof(pattern), "-%s$", iso_date);
+    bson_t *cmd = BCON_NEW("listDatabases", BCON_INT32(1),
+                           "filter", "{", "name", "{", "$regex", BCON_UTF8(pattern), "}", "}");
     bson_t reply;
-    bson_init(&reply);
     bson_error_t error;
-
-    bool ok = mongoc_database_command_simple(database, cmd, NULL, &reply, &error);
+    mongo_connection_t *connection = mongo_connection_acquire(db);
+    bool ok = mongoc_client_command_simple(connection->client, "admin", cmd, NULL, &reply, &error);
+    mongo_connection_release(&connection);
     if (!ok) {
-        fprintf(stderr, "[E] could not retrieve database statistics: (%d) %s\n", error.code, error.message);
+        fprintf(stderr, "[E] indexer[%zu]: could not list databases: (%d) %s\n", state->id, error.code, error.message);
     } else {
-        // size_t n;
-        // char* bjs = bson_as_json(reply, &n);
-        // printf("[D] database stats for (%s): %s\n", db_name, bjs);
-        // bson_free(bjs);
-        stream_info->storage_size = extract_storage_size(&reply);
-        if (stream_info->storage_size > HARD_LIMIT_STORAGE_SIZE)
-            fprintf(stderr, "[E] indexer[%zu]: hard limiting %s at %"PRId64"\n", state->id, db_name, stream_info->storage_size);
-        else if (stream_info->storage_size > SOFT_LIMIT_STORAGE_SIZE)
-            fprintf(stderr, "[W] indexer[%zu]: soft limiting %s at %"PRId64"\n", state->id, db_name, stream_info->storage_size);
-        else if (verbose)
-            fprintf(stdout, "[I] indexer[%zu]: not limiting %s at %"PRId64"\n", state->id, db_name, stream_info->storage_size);
+        bson_iter_t iter, databases;
+        if (bson_iter_init_find(&iter, &reply, "databases") && bson_iter_recurse(&iter, &databases)) {
+            while (bson_iter_next(&databases)) {
+                bson_iter_t name;
+                if (bson_iter_recurse(&databases, &name) && bson_iter_find(&name, "name") && bson_iter_type(&name) == BSON_TYPE_UTF8) {
+                    int64_t size = extract_size_on_disk(&databases);
+                    zhash_update(sizes, bson_iter_utf8(&name, NULL), (void*)size);
+                }
+            }
+        }
     }
-
     bson_destroy(cmd);
     bson_destroy(&reply);
-    mongoc_database_destroy(database);
+    return ok;
 }
 
 static
@@ -251,29 +256,47 @@ void indexer_refresh_storage_sizes(indexer_state_t *self)
 {
     if (dryrun) return;
 
+    zhash_t *sizes[num_databases];
+    bool ok[num_databases];
+    for (int i = 0; i < num_databases; i++) {
+        sizes[i] = zhash_new();
+        ok[i] = indexer_list_database_sizes(self, i, iso_date_today, sizes[i]);
+    }
+
     zlist_t *streams = get_active_stream_names();
     char *stream = zlist_first(streams);
     while (stream && !zsys_interrupted) {
         stream_info_t *info = get_stream_info(stream, NULL);
         if (info) {
-            char db_name[1000];
-            sprintf(db_name, "logjam-%s-%s-%s", info->app, info->env, iso_date_today);
-            indexer_check_disk_usage(self, db_name, info);
+            if (ok[info->db]) {
+                char db_name[1000];
+                sprintf(db_name, "logjam-%s-%s-%s", info->app, info->env, iso_date_today);
+                info->storage_size = (int64_t)zhash_lookup(sizes[info->db], db_name);
+                if (info->storage_size > __atomic_load_n(&hard_limit_storage_size, __ATOMIC_RELAXED))
+                    fprintf(stderr, "[E] indexer[%zu]: hard limiting %s at %"PRId64"\n", self->id, db_name, info->storage_size);
+                else if (info->storage_size > __atomic_load_n(&soft_limit_storage_size, __ATOMIC_RELAXED))
+                    fprintf(stderr, "[W] indexer[%zu]: soft limiting %s at %"PRId64"\n", self->id, db_name, info->storage_size);
+                else if (verbose)
+                    fprintf(stdout, "[I] indexer[%zu]: not limiting %s at %"PRId64"\n", self->id, db_name, info->storage_size);
+            }
             release_stream_info(info);
         }
         stream = zlist_next(streams);
     }
     zlist_destroy(&streams);
+
+    for (int i = 0; i < num_databases; i++)
+        zhash_destroy(&sizes[i]);
 }
 
 static
-bool indexer_create_indexes(indexer_state_t *state, const char *db_name, stream_info_t *stream_info)
+bool indexer_create_indexes(indexer_state_t *state, const char *db_name, int db_index)
 {
     bool ok = true;
     if (dryrun) return ok;
 
-    mongoc_client_t *client = state->mongo_clients[stream_info->db];
-    mongoc_database_t *db = mongoc_client_get_database(client, db_name);
+    mongo_connection_t *connection = mongo_connection_acquire(db_index);
+    mongoc_database_t *db = mongoc_client_get_database(connection->client, db_name);
     bson_t *keys;
     size_t id = state->id;
 
@@ -303,6 +326,17 @@ bool indexer_create_indexes(indexer_state_t *state, const char *db_name, stream_
     ok &= create_index(state, db, "heatmaps", keys, NON_UNIQUE);
     bson_destroy(keys);
 
+    keys = bson_new();
+    assert(bson_append_int32(keys, "page", 4, 1));
+    ok &= create_index(state, db, "sketches", keys, NON_UNIQUE);
+    bson_destroy(keys);
+
+    keys = bson_new();
+    assert(bson_append_int32(keys, "page", 4, 1));
+    assert(bson_append_int32(keys, "minute", 6, 1));
+    ok &= create_index(state, db, "sketch_minutes", keys, NON_UNIQUE);
+    bson_destroy(keys);
+
     keys = bson_new();
     assert(bson_append_int32(keys, "agent", 5, 1));
     ok &= create_index(state, db, "agents", keys, NON_UNIQUE);
@@ -313,32 +347,33 @@ bool indexer_create_indexes(indexer_state_t *state, const char *db_name, stream_
     ok &= add_jse_collection_indexes(state, db);
 
     mongoc_database_destroy(db);
+    mongo_connection_release(&connection);
 
     return ok;
 }
 
+// schedules databases and indexes of all active streams for the given date
 static
-void indexer_create_all_indexes(indexer_state_t *self, const char *iso_date, int delay)
+void indexer_schedule_all_databases(indexer_state_t *self, const char *iso_date, int day)
 {
     if (dryrun) return;
 
+    size_t scheduled = 0;
     zlist_t *streams = get_active_stream_names();
     char *stream = zlist_first(streams);
-    while (stream && !zsys_interrupted) {
+    while (stream) {
         stream_info_t *info = get_stream_info(stream, NULL);
         if (info) {
             char db_name[1000];
             sprintf(db_name, "logjam-%s-%s-%s", info->app, info->env, iso_date);
-            indexer_create_indexes(self, db_name, info);
-            indexer_check_disk_usage(self, db_name, info);
+            scheduled += index_scheduler_add(self->scheduler, db_name, info->db, day, info->storage_size, false);
             release_stream_info(info);
-            if (delay) {
-                zclock_sleep(1000 * delay);
-            }
         }
         stream = zlist_next(streams);
     }
     zlist_destroy(&streams);
+    strcpy(self->scheduled_date, iso_date);
+    printf("[I] indexer[%zu]: scheduled %zu databases for %s\n", self->id, scheduled, iso_date);
 }
 
 static
@@ -350,8 +385,8 @@ bool indexer_create_global_indexes(indexer_state_t *self)
     bson_t *keys;
 
     for (int i = 0; i < num_databases; i++) {
-        mongoc_client_t *client = self->mongo_clients[i];
-        mongoc_database_t *db = mongoc_client_get_database(client, "logjam-global");
+        mongo_connection_t *connection = mongo_connection_acquire(i);
+        mongoc_database_t *db = mongoc_client_get_database(connection->client, "logjam-global");
 
         keys = bson_new();
         bson_append_int32(keys, "env", 3, -1);
@@ -370,6 +405,7 @@ bool indexer_create_global_indexes(indexer_state_t *self)
         bson_destroy(keys);
 
         mongoc_database_destroy(db);
+        mongo_connection_release(&connection);
     }
 
     return ok;
@@ -402,8 +438,11 @@ void ensure_databases_are_known(indexer_state_t *state, const char* iso_date)
     }
 
     for (int i = 0; i<num_databases; i++) {
-        if (!zsys_interrupted)
-            ensure_known_databases(state->mongo_clients[i], db_names[i]);
+        if (!zsys_interrupted) {
+            mongo_connection_t *connection = mongo_connection_acquire(i);
+            ensure_known_databases(connection->client, db_names[i]);
+            mongo_connection_release(&connection);
+        }
         zlist_destroy(&db_names[i]);
     }
 
@@ -411,54 +450,159 @@ void ensure_databases_are_known(indexer_state_t *state, const char* iso_date)
 }
 
 static
-void* bg_create_indexes_for_date(void* args)
+bool in_quiet_hours(indexer_state_t *state)
+{
+    if (state->quiet_hours_start < 0)
+        return false;
+    time_t now = time(NULL);
+    struct tm lt;
+    localtime_r(&now, &lt);
+    return lt.tm_hour >= state->quiet_hours_start && lt.tm_hour < state->quiet_hours_end;
+}
+
+// tomorrow's databases get scheduled once the quiet hours have started
+static
+bool tomorrow_is_due(indexer_state_t *state)
 {
-    bg_indexer_args_t *indexer_args = args;
-    if (dryrun) goto exit;
+    if (state->opts & INDEXER_DB_ON_DEMAND || streq(state->scheduled_date, iso_date_tomorrow))
+        return false;
+    if (state->quiet_hours_start < 0)
+        return true;
+    time_t now = time(NULL);
+    struct tm lt;
+    localtime_r(&now, &lt);
+    return lt.tm_hour >= state->quiet_hours_start;
+}
 
+static
+void index_worker(zsock_t *pipe, void *args)
+{
     indexer_state_t state;
     memset(&state, 0, sizeof(state));
-    state.id = indexer_args->id;;
+    state.id = (size_t)args;
 
     char thread_name[16];
     memset(thread_name, 0, 16);
     snprintf(thread_name, 16, "indexer[%zu]", state.id);
     set_thread_name(thread_name);
 
-    for (int i=0; i<num_databases; i++) {
-        state.mongo_clients[i] = mongoc_client_new(databases[i]);
-        assert(state.mongo_clients[i]);
-    }
-    state.databases = zhash_new();
+    zsock_signal(pipe, 0);
 
-    if (indexer_args->ensure_known)
-        ensure_databases_are_known(&state, indexer_args->iso_date);
+    while (!zsys_interrupted) {
+        zmsg_t *msg = zmsg_recv(pipe);
+        if (msg == NULL)
+            break;
+        char *cmd = zmsg_popstr(msg);
+        if (streq(cmd, "$TERM")) {
+            free(cmd);
+            zmsg_destroy(&msg);
+            break;
+        }
+        char *db_name = zmsg_popstr(msg);
+        char *db_str = zmsg_popstr(msg);
+        char *ensure_known_str = zmsg_popstr(msg);
+        int db = atoi(db_str);
+        bool ok = true;
+        if (streq(ensure_known_str, "1") && !dryrun) {
+            mongo_connection_t *connection = mongo_connection_acquire(db);
+            ok = ensure_known_database(connection->client, db_name);
+            mongo_connection_release(&connection);
+        }
+        // only record db as known if index creation and global db update went well
+        ok = ok && indexer_create_indexes(&state, db_name, db);
+        zstr_sendx(pipe, "done", db_name, ok ? "1" : "0", NULL);
+        free(cmd);
+        free(db_name);
+        free(db_str);
+        free(ensure_known_str);
+        zmsg_destroy(&msg);
+    }
+}
 
-    indexer_create_all_indexes(&state, indexer_args->iso_date, INDEXER_DELAY);
+static
+void indexer_dispatch_jobs(indexer_state_t *state)
+{
+    size_t max_future_running = in_quiet_hours(state) ? state->num_workers : 1;
+    for (size_t i = 0; i < state->num_workers; i++) {
+        if (state->worker_busy[i])
+            continue;
+        index_job_t *job = index_scheduler_next(state->scheduler, max_future_running);
+        if (job == NULL)
+            break;
+        char db_str[16];
+        snprintf(db_str, sizeof(db_str), "%d", job->db);
+        zstr_sendx(state->workers[i], "index", job->db_name, db_str, job->ensure_known ? "1" : "0", NULL);
+        state->worker_busy[i] = true;
+    }
+}
 
-    zhash_destroy(&state.databases);
-    for (int i=0; i<num_databases; i++) {
-        mongoc_client_destroy(state.mongo_clients[i]);
+static
+bool indexer_workers_busy(indexer_state_t *state)
+{
+    for (size_t i = 0; i < state->num_workers; i++) {
+        if (state->worker_busy[i])
+            return true;
     }
+    return false;
+}
 
- exit:
-    free(indexer_args);
-    return NULL;
+static
+void indexer_handle_worker_reply(indexer_state_t *state, size_t i)
+{
+    char *cmd, *db_name, *ok_str;
+    if (zstr_recvx(state->workers[i], &cmd, &db_name, &ok_str, NULL) == -1)
+        return;
+    bool ok = streq(ok_str, "1");
+    index_scheduler_done(state->scheduler, db_name, ok);
+    importer_prometheus_client_count_index_jobs(ok ? "ok" : "failed", 1);
+    state->worker_busy[i] = false;
+    zstr_free(&cmd);
+    zstr_free(&db_name);
+    zstr_free(&ok_str);
 }
 
 static
-void spawn_bg_indexer_for_date(size_t id, const char* iso_date, enum future_t future)
+void indexer_record_progress(indexer_state_t *state)
 {
-    bg_indexer_args_t *indexer_args = zmalloc(sizeof(bg_indexer_args_t));
-    assert(indexer_args != NULL);
-    indexer_args->id = id;
-    indexer_args->ensure_known = future == today;
-    strcpy(indexer_args->iso_date, iso_date);
-    pthread_t thread;
-    int rc = pthread_create (&thread, NULL, bg_create_indexes_for_date, indexer_args);
-    assert(rc == 0);
-    rc = pthread_detach (thread);
-    assert(rc == 0);
+    index_scheduler_stats_t stats;
+    index_scheduler_get_stats(state->scheduler, &stats);
+    importer_prometheus_client_record_index_jobs("today", stats.pending[0], stats.running[0]);
+    importer_prometheus_client_record_index_jobs("tomorrow", stats.pending[1], stats.running[1]);
+    if (verbose)
+        printf("[D] indexer[%zu]: jobs pending: %zu/%zu, running: %zu/%zu, done: %zu\n", state->id,
+               stats.pending[0], stats.pending[1], stats.running[0], stats.running[1], stats.done);
+}
+
+static
+int indexer_worker_index(indexer_state_t *state, void *socket)
+{
+    for (size_t i = 0; i < state->num_workers; i++) {
+        if (socket == state->workers[i])
+            return i;
+    }
+    return -1;
+}
+
+// processes scheduled jobs until all workers are idle
+static
+void indexer_run_jobs(indexer_state_t *state)
+{
+    zpoller_t *poller = zpoller_new(NULL);
+    assert(poller);
+    for (size_t i = 0; i < state->num_workers; i++)
+        zpoller_add(poller, state->workers[i]);
+
+    indexer_dispatch_jobs(state);
+    while (!zsys_interrupted && indexer_workers_busy(state)) {
+        void *socket = zpoller_wait(poller, 1000);
+        int i = indexer_worker_index(state, socket);
+        if (i >= 0) {
+            indexer_handle_worker_reply(state, i);
+            indexer_dispatch_jobs(state);
+        }
+        indexer_record_progress(state);
+    }
+    zpoller_destroy(&poller);
 }
 
 static
@@ -472,46 +616,56 @@ void handle_indexer_request(zmsg_t *msg, indexer_state_t *state)
     memcpy(db_name, zframe_data(db_frame), n);
     db_name[n] = '\0';
 
-    size_t m = zframe_size(stream_frame);
-    char stream_name[m+1];
-    memcpy(stream_name, zframe_data(stream_frame), m);
-    stream_name[m] = '\0';
-
     stream_info_t *stream_info = zframe_getptr(stream_frame);
 
     if (dryrun) goto cleanup;
 
-    const char *known_db = zhash_lookup(state->databases, db_name);
-    if (known_db == NULL) {
-        if (ensure_known_database(state->mongo_clients[stream_info->db], db_name)
-            && indexer_create_indexes(state, db_name, stream_info)) {
-            // only record db as known if index creation and global db update went well
-            zhash_insert(state->databases, db_name, strdup(db_name));
-            zhash_freefn(state->databases, db_name, free);
-        }
-    } else {
-        // printf("[D] indexer[%zu]: indexes already created: %s\n", state->id, db_name);
-    }
+    // databases requested by the parsers are needed right away, the scheduler ignores
+    // requests for databases it has already created
+    index_scheduler_add(state->scheduler, db_name, stream_info->db, 0, stream_info->storage_size, true);
 
  cleanup:
     release_stream_info(stream_info);
 }
 
 static
-indexer_state_t* indexer_state_new(zsock_t *pipe, size_t id, int opts)
+void indexer_configure(indexer_state_t *state, zconfig_t *config)
+{
+    state->num_workers = atol(zconfig_resolve(config, "frontend/indexer/workers", "2"));
+    if (state->num_workers < 1)
+        state->num_workers = 1;
+    if (state->num_workers > MAX_INDEX_WORKERS) {
+        fprintf(stderr, "[W] indexer[%zu]: limiting number of index workers to %d\n", state->id, MAX_INDEX_WORKERS);
+        state->num_workers = MAX_INDEX_WORKERS;
+    }
+
+    state->quiet_hours_start = -1;
+    const char *quiet_hours = zconfig_resolve(config, "frontend/indexer/quiet_hours", NULL);
+    if (quiet_hours) {
+        int start, end;
+        if (sscanf(quiet_hours, "%d-%d", &start, &end) == 2 && 0 <= start && start < end && end <= 24) {
+            state->quiet_hours_start = start;
+            state->quiet_hours_end = end;
+        } else {
+            fprintf(stderr, "[W] indexer[%zu]: ignoring invalid quiet hours: %s\n", state->id, quiet_hours);
+        }
+    }
+}
+
+static
+indexer_state_t* indexer_state_new(zsock_t *pipe, size_t id, indexer_args_t *args)
 {
     indexer_state_t *state = zmalloc(sizeof(*state));
     state->id = id;
     state->controller_socket = pipe;
     state->pull_socket = indexer_pull_socket_new();
-    if (!dryrun) {
-        for (int i=0; i<num_databases; i++) {
-            state->mongo_clients[i] = mongoc_client_new(databases[i]);
-            assert(state->mongo_clients[i]);
-        }
+    state->opts = args->opts;
+    state->scheduler = index_scheduler_new();
+    indexer_configure(state, args->config);
+    // workers are numbered after the indexer
+    for (size_t i=0; i<state->num_workers; i++) {
+        state->workers[i] = zactor_new(index_worker, (void*)(id + 1 + i));
     }
-    state->databases = zhash_new();
-    state->opts = opts;
     return state;
 }
 
@@ -519,17 +673,16 @@ static
 void indexer_state_destroy(indexer_state_t **state_p)
 {
     indexer_state_t *state = *state_p;
-    zsock_destroy(&state->pull_socket);
-    zhash_destroy(&state->databases);
-    if (!dryrun) {
-        for (int i=0; i<num_databases; i++) {
-            mongoc_client_destroy(state->mongo_clients[i]);
-        }
+    for (size_t i=0; i<state->num_workers; i++) {
+        zactor_destroy(&state->workers[i]);
     }
+    zsock_destroy(&state->pull_socket);
+    index_scheduler_destroy(&state->scheduler);
     free(state);
     *state_p = NULL;
 }
 
+static
 void indexer(zsock_t *pipe, void *args)
 {
     size_t id = 0;
@@ -542,36 +695,39 @@ void indexer(zsock_t *pipe, void *args)
         printf("[I] indexer[%zu]: starting\n", id);
 
     size_t ticks = 0;
-    size_t bg_indexer_runs = 0;
-    indexer_state_t *state = indexer_state_new(pipe, id, (uint64_t)args);
+    indexer_state_t *state = indexer_state_new(pipe, id, args);
+    free(args);
 
     // setup indexes on global databases
     indexer_create_global_indexes(state);
 
-    // setup indexes for today (synchronously)
+    // sizes are used to create databases of bigger streams first
     config_update_date_info();
+    indexer_refresh_storage_sizes(state);
+
+    // setup indexes for today (before signalling readiness, unless asked to start fast)
     ensure_databases_are_known(state, iso_date_today);
+    if (!(state->opts & INDEXER_DB_ON_DEMAND))
+        indexer_schedule_all_databases(state, iso_date_today, 0);
     if (!(state->opts & INDEXER_DB_FAST_START))
-        indexer_create_all_indexes(state, iso_date_today, 0);
+        indexer_run_jobs(state);
 
     // signal readyiness after index creation
     zsock_signal(pipe, 0);
 
-    // setup indexes for tomorrow (asynchronously)
-    if (!(state->opts & INDEXER_DB_ON_DEMAND)) {
-        if (state->opts & INDEXER_DB_FAST_START)
-            spawn_bg_indexer_for_date(++bg_indexer_runs, iso_date_today, today);
-        spawn_bg_indexer_for_date(++bg_indexer_runs, iso_date_tomorrow, tomorrow);
-    }
-
     zpoller_t *poller = zpoller_new(state->controller_socket, state->pull_socket, NULL);
     assert(poller);
+    for (size_t i=0; i<state->num_workers; i++) {
+        zpoller_add(poller, state->workers[i]);
+    }
 
     while (!zsys_interrupted) {
         // printf("indexer[%zu]: polling\n", id);
+        indexer_dispatch_jobs(state);
         // wait at most one second
         void *socket = zpoller_wait(poller, 1000);
         zmsg_t *msg = NULL;
+        int worker = indexer_worker_index(state, socket);
         if (socket == state->controller_socket) {
             msg = zmsg_recv(state->controller_socket);
             char *cmd = zmsg_popstr(msg);
@@ -581,33 +737,28 @@ void indexer(zsock_t *pipe, void *args)
                     printf("[D] indexer[%zu]: tick\n", id);
 
                 // if date has changed, make sure databases of today are added to the
-                // known datbases table and spawn a background thread to create databases
-                // for the next day, unless we're running in lazy mode
+                // known datbases table and that any pending jobs for them are done first
                 if (config_update_date_info()) {
                     printf("[I] indexer[%zu]: date change detected\n", id);
                     printf("[I] indexer[%zu]: making sure today's databases are known\n", id);
                     ensure_databases_are_known(state, iso_date_today);
-                    if (!(state->opts & INDEXER_DB_ON_DEMAND)) {
-                        printf("[I] indexer[%zu]: creating indexes for tomorrow\n", id);
-                        spawn_bg_indexer_for_date(++bg_indexer_runs, iso_date_tomorrow, tomorrow);
-                    }
+                    index_scheduler_advance_day(state->scheduler);
                 }
-                if (ticks++ % PING_INTERVAL == 0) {
-                    // ping mongodb to reestablish connection if it got lost
-                    for (int i=0; i<num_databases; i++) {
-                        mongo_client_ping(state->mongo_clients[i]);
-                    }
+                // schedule creation of tomorrow's databases, unless we're running in lazy mode
+                if (tomorrow_is_due(state)) {
+                    printf("[I] indexer[%zu]: scheduling indexes for tomorrow\n", id);
+                    indexer_schedule_all_databases(state, iso_date_tomorrow, 1);
                 }
-                if (ticks % DATABASE_INFO_REFRESH_INTERVAL == 0) {
-                    // retrieve current database storage sizew
+                if (++ticks % DATABASE_INFO_REFRESH_INTERVAL == 0) {
+                    // retrieve current database storage sizes
                     indexer_refresh_storage_sizes(state);
                 }
                 if (ticks % COLLECTION_REFRESH_INTERVAL == COLLECTION_REFRESH_INTERVAL - id - 1) {
                     // free known databases list
                     printf("[I] indexer[%zu]: freeing database info\n", id);
-                    zhash_destroy(&state->databases);
-                    state->databases = zhash_new();
+                    index_scheduler_forget_done(state->scheduler);
                 }
+                indexer_record_progress(state);
                 free(cmd);
             } else if (streq(cmd, "$TERM")) {
                 // printf("[D] indexer[%zu]: received $TERM command\n", id);
@@ -623,6 +774,8 @@ void indexer(zsock_t *pipe, void *args)
                 handle_indexer_request(msg, state);
                 zmsg_destroy(&msg);
             }
+        } else if (worker >= 0) {
+            indexer_handle_worker_reply(state, worker);
         } else if (socket) {
             // if socket is not null, something is horribly broken
             printf("[E] indexer[%zu]: broken poller. committing suicide.\n", id);
@@ -634,6 +787,8 @@ void indexer(zsock_t *pipe, void *args)
         }
     }
 
+    zpoller_destroy(&poller);
+
     if (!quiet)
         printf("[I] indexer[%zu]: shutting down\n", id);
 
@@ -642,3 +797,11 @@ void indexer(zsock_t *pipe, void *args)
     if (!quiet)
         printf("[I] indexer[%zu]: terminated\n", id);
 }
+
+zactor_t* indexer_new(zconfig_t *config, uint64_t opts)
+{
+    indexer_args_t *args = zmalloc(sizeof(*args));
+    args->config = config;
+    args->opts = opts;
+    return zactor_new(indexer, args);
+}
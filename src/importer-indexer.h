@@ -7,7 +7,7 @@
 extern "C" {
 #endif
 
-extern void indexer(zsock_t *pipe, void *args);
+extern zactor_t* indexer_new(zconfig_t *config, uint64_t opts);
 
 #ifdef __cplusplus
 }
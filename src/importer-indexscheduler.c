@@ -0,0 +1,206 @@
+#include "importer-indexscheduler.h"
+
+#define JOB_PENDING 0
+#define JOB_RUNNING 1
+#define JOB_DONE 2
+
+struct _index_scheduler_t {
+    zhash_t *jobs;          // db name -> index_job_t
+    zlist_t *pending;       // pending jobs, in insertion order
+};
+
+static
+void index_job_destroy(void *item)
+{
+    index_job_t *job = item;
+    free(job->db_name);
+    free(job);
+}
+
+index_scheduler_t* index_scheduler_new()
+{
+    index_scheduler_t *scheduler = zmalloc(sizeof(*scheduler));
+    scheduler->jobs = zhash_new();
+    scheduler->pending = zlist_new();
+    return scheduler;
+}
+
+void index_scheduler_destroy(index_scheduler_t **scheduler_p)
+{
+    index_scheduler_t *scheduler = *scheduler_p;
+    if (scheduler == NULL)
+        return;
+    zlist_destroy(&scheduler->pending);
+    zhash_destroy(&scheduler->jobs);
+    free(scheduler);
+    *scheduler_p = NULL;
+}
+
+bool index_scheduler_add(index_scheduler_t *scheduler, const char *db_name, int db, int day, int64_t volume, bool ensure_known)
+{
+    if (zhash_lookup(scheduler->jobs, db_name))
+        return false;
+    index_job_t *job = zmalloc(sizeof(*job));
+    job->db_name = strdup(db_name);
+    job->db = db;
+    job->day = day;
+    job->volume = volume;
+    job->ensure_known = ensure_known;
+    job->status = JOB_PENDING;
+    zhash_insert(scheduler->jobs, db_name, job);
+    zhash_freefn(scheduler->jobs, db_name, index_job_destroy);
+    zlist_append(scheduler->pending, job);
+    return true;
+}
+
+static
+size_t running_future_jobs(index_scheduler_t *scheduler)
+{
+    size_t n = 0;
+    index_job_t *job = zhash_first(scheduler->jobs);
+    while (job) {
+        n += job->status == JOB_RUNNING && job->day > 0;
+        job = zhash_next(scheduler->jobs);
+    }
+    return n;
+}
+
+index_job_t* index_scheduler_next(index_scheduler_t *scheduler, size_t max_future_running)
+{
+    bool future_allowed = running_future_jobs(scheduler) < max_future_running;
+    index_job_t *best = NULL;
+    index_job_t *job = zlist_first(scheduler->pending);
+    while (job) {
+        if (job->day == 0 || future_allowed) {
+            if (best == NULL || job->day < best->day || (job->day == best->day && job->volume > best->volume))
+                best = job;
+        }
+        job = zlist_next(scheduler->pending);
+    }
+    if (best) {
+        zlist_remove(scheduler->pending, best);
+        best->status = JOB_RUNNING;
+    }
+    return best;
+}
+
+void index_scheduler_done(index_scheduler_t *scheduler, const char *db_name, bool ok)
+{
+    index_job_t *job = zhash_lookup(scheduler->jobs, db_name);
+    if (job == NULL || job->status != JOB_RUNNING)
+        return;
+    if (ok)
+        job->status = JOB_DONE;
+    else
+        zhash_delete(scheduler->jobs, db_name);
+}
+
+void index_scheduler_advance_day(index_scheduler_t *scheduler)
+{
+    index_job_t *job = zhash_first(scheduler->jobs);
+    while (job) {
+        if (job->day > 0)
+            job->day--;
+        job = zhash_next(scheduler->jobs);
+    }
+}
+
+void index_scheduler_forget_done(index_scheduler_t *scheduler)
+{
+    zlist_t *db_names = zhash_keys(scheduler->jobs);
+    const char *db_name = zlist_first(db_names);
+    while (db_name) {
+        index_job_t *job = zhash_lookup(scheduler->jobs, db_name);
+        if (job->status == JOB_DONE)
+            zhash_delete(scheduler->jobs, db_name);
+        db_name = zlist_next(db_names);
+    }
+    zlist_destroy(&db_names);
+}
+
+void index_scheduler_get_stats(index_scheduler_t *scheduler, index_scheduler_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    index_job_t *job = zhash_first(scheduler->jobs);
+    while (job) {
+        int i = job->day > 0;
+        switch (job->status) {
+        case JOB_PENDING:
+            stats->pending[i]++;
+            break;
+        case JOB_RUNNING:
+            stats->running[i]++;
+            break;
+        default:
+            stats->done++;
+        }
+        job = zhash_next(scheduler->jobs);
+    }
+}
+
+void index_scheduler_test(int verbose)
+{
+    printf(" * index-scheduler: ");
+    if (verbose)
+        printf("\n");
+
+    index_scheduler_t *scheduler = index_scheduler_new();
+    index_scheduler_stats_t stats;
+
+    assert(index_scheduler_add(scheduler, "logjam-a-p-2024-01-02", 0, 1, 500, false));
+    assert(index_scheduler_add(scheduler, "logjam-a-p-2024-01-01", 0, 0, 10, false));
+    assert(index_scheduler_add(scheduler, "logjam-b-p-2024-01-01", 1, 0, 1000, false));
+    assert(index_scheduler_add(scheduler, "logjam-b-p-2024-01-02", 1, 1, 1000, false));
+    assert(!index_scheduler_add(scheduler, "logjam-b-p-2024-01-01", 1, 0, 1000, true));
+
+    index_scheduler_get_stats(scheduler, &stats);
+    assert(stats.pending[0] == 2 && stats.pending[1] == 2);
+
+    // today's databases go first, bigger streams first
+    index_job_t *job = index_scheduler_next(scheduler, 1);
+    assert(streq(job->db_name, "logjam-b-p-2024-01-01"));
+    assert(job->db == 1);
+    job = index_scheduler_next(scheduler, 1);
+    assert(streq(job->db_name, "logjam-a-p-2024-01-01"));
+
+    // only one job for tomorrow runs at a time
+    job = index_scheduler_next(scheduler, 1);
+    assert(streq(job->db_name, "logjam-b-p-2024-01-02"));
+    assert(index_scheduler_next(scheduler, 1) == NULL);
+
+    index_scheduler_get_stats(scheduler, &stats);
+    assert(stats.running[0] == 2 && stats.running[1] == 1 && stats.pending[1] == 1);
+
+    // failed jobs can be scheduled again, completed ones can't
+    index_scheduler_done(scheduler, "logjam-b-p-2024-01-01", true);
+    index_scheduler_done(scheduler, "logjam-a-p-2024-01-01", false);
+    assert(!index_scheduler_add(scheduler, "logjam-b-p-2024-01-01", 1, 0, 1000, true));
+    assert(index_scheduler_add(scheduler, "logjam-a-p-2024-01-01", 0, 0, 10, true));
+    job = index_scheduler_next(scheduler, 1);
+    assert(streq(job->db_name, "logjam-a-p-2024-01-01"));
+    assert(job->ensure_known);
+    index_scheduler_done(scheduler, job->db_name, true);
+
+    // after the date change, the remaining job for tomorrow isn't limited anymore
+    index_scheduler_advance_day(scheduler);
+    job = index_scheduler_next(scheduler, 0);
+    assert(streq(job->db_name, "logjam-a-p-2024-01-02"));
+    assert(job->day == 0);
+    index_scheduler_done(scheduler, job->db_name, true);
+    index_scheduler_done(scheduler, "logjam-b-p-2024-01-02", true);
+
+    index_scheduler_get_stats(scheduler, &stats);
+    assert(stats.done == 4);
+    assert(stats.pending[0] + stats.pending[1] + stats.running[0] + stats.running[1] == 0);
+
+    // forgotten databases can be scheduled again
+    index_scheduler_forget_done(scheduler);
+    index_scheduler_get_stats(scheduler, &stats);
+    assert(stats.done == 0);
+    assert(index_scheduler_add(scheduler, "logjam-b-p-2024-01-01", 1, 0, 1000, true));
+
+    index_scheduler_destroy(&scheduler);
+    assert(scheduler == NULL);
+
+    printf("OK\n");
+}
@@ -0,0 +1,60 @@
+#ifndef __LOGJAM_IMPORTER_INDEXSCHEDULER_H_INCLUDED__
+#define __LOGJAM_IMPORTER_INDEXSCHEDULER_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keeps track of the databases the indexer has to create (along with their indexes) and
+// decides in which order the indexer workers process them. Databases for today always go
+// before databases for future days, and within a day, databases of streams with more data
+// go first. Databases are identified by name, so a database is only scheduled once until
+// its creation failed or the scheduler is told to forget the completed ones.
+
+typedef struct {
+    char *db_name;
+    int db;                 // index of the mongo server holding the database
+    int day;                // days from today
+    int64_t volume;         // storage size of the stream's database for today
+    bool ensure_known;      // database needs to be added to the known databases first
+    int status;
+} index_job_t;
+
+typedef struct {
+    size_t pending[2];      // today, future days
+    size_t running[2];
+    size_t done;
+} index_scheduler_stats_t;
+
+typedef struct _index_scheduler_t index_scheduler_t;
+
+extern index_scheduler_t* index_scheduler_new();
+extern void index_scheduler_destroy(index_scheduler_t **scheduler_p);
+
+// returns false if the database has already been scheduled
+extern bool index_scheduler_add(index_scheduler_t *scheduler, const char *db_name, int db, int day, int64_t volume, bool ensure_known);
+
+// returns the most urgent pending job and marks it as running. at most max_future_running
+// jobs for future days run at the same time. returns NULL if no job is eligible.
+extern index_job_t* index_scheduler_next(index_scheduler_t *scheduler, size_t max_future_running);
+
+// failed jobs are forgotten, so that the database can be scheduled again
+extern void index_scheduler_done(index_scheduler_t *scheduler, const char *db_name, bool ok);
+
+// called on date changes: jobs for tomorrow become jobs for today
+extern void index_scheduler_advance_day(index_scheduler_t *scheduler);
+
+// forgets completed jobs, so that their databases get checked again when requested
+extern void index_scheduler_forget_done(index_scheduler_t *scheduler);
+
+extern void index_scheduler_get_stats(index_scheduler_t *scheduler, index_scheduler_stats_t *stats);
+
+extern void index_scheduler_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
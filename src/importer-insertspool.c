@@ -0,0 +1,354 @@
+#include "importer-insertspool.h"
+#include "importer-prometheus-client.h"
+#include "logjam-spool.h"
+
+// Spool records use the stream name as the message's stream. The data consists of the
+// task type, the sampling reason, the zero terminated database and module names and the
+// JSON representation of the request.
+
+#define INSERT_SPOOL_SEGMENT_SIZE (64 * 1024 * 1024)
+
+size_t max_queued_inserts = 0;
+
+static spool_t *spool = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// copy of spool_size(spool), so that parsers can check it without taking the lock
+static size_t spooled_inserts = 0;
+
+// since last tick
+static size_t inserts_spooled = 0;
+static size_t inserts_dropped = 0;
+
+void insert_spool_init(zconfig_t *config)
+{
+    max_queued_inserts = atol(zconfig_resolve(config, "frontend/writers/max_queued", "50000"));
+    const char *directory = zconfig_resolve(config, "frontend/writers/spool/directory", NULL);
+    size_t max_size = atol(zconfig_resolve(config, "frontend/writers/spool/max_size", "1024"));
+
+    if (max_queued_inserts > 0 && directory && !dryrun) {
+        printf("[I] insert spool: spooling to %s (max %zu MB)\n", directory, max_size);
+        spool = spool_new(directory, INSERT_SPOOL_SEGMENT_SIZE, max_size * 1024 * 1024);
+        if (spool)
+            spooled_inserts = spool_size(spool);
+    }
+    if (max_queued_inserts > 0 && spool == NULL)
+        printf("[I] insert spool: dropping inserts when more than %zu are queued\n", max_queued_inserts);
+
+    importer_prometheus_client_gauge_queued_inserts_limit(max_queued_inserts);
+}
+
+void insert_spool_update_limit(zconfig_t *config)
+{
+    size_t limit = atol(zconfig_resolve(config, "frontend/writers/max_queued", "50000"));
+    if (limit == max_queued_inserts)
+        return;
+    printf("[I] insert spool: changed limit of queued inserts from %zu to %zu\n", max_queued_inserts, limit);
+    __atomic_store_n(&max_queued_inserts, limit, __ATOMIC_RELAXED);
+    importer_prometheus_client_gauge_queued_inserts_limit(limit);
+}
+
+void insert_spool_destroy()
+{
+    pthread_mutex_lock(&lock);
+    spool_destroy(&spool);
+    spooled_inserts = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+bool insert_spool_active()
+{
+    size_t limit = __atomic_load_n(&max_queued_inserts, __ATOMIC_RELAXED);
+    if (limit == 0)
+        return false;
+    if (__atomic_load_n(&spooled_inserts, __ATOMIC_RELAXED) > 0)
+        return true;
+    int queued = __atomic_load_n(&queued_inserts, __ATOMIC_RELAXED);
+    return queued >= 0 && (size_t)queued >= limit;
+}
+
+size_t insert_spool_size()
+{
+    return __atomic_load_n(&spooled_inserts, __ATOMIC_RELAXED);
+}
+
+void insert_spool_append(const char *db_name, char task_type, const char *module, json_object *request,
+                         stream_info_t *stream_info, sampling_reason_t sampling_reason)
+{
+    if (spool == NULL) {
+        __atomic_add_fetch(&inserts_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    const char *json = json_object_to_json_string_ext(request, JSON_C_TO_STRING_PLAIN);
+    size_t db_name_len = strlen(db_name) + 1;
+    size_t module_len = strlen(module) + 1;
+    size_t json_len = strlen(json);
+    size_t n = 1 + sizeof(sampling_reason) + db_name_len + module_len + json_len;
+    char *data = malloc(n);
+    assert(data);
+    char *p = data;
+    *p++ = task_type;
+    memcpy(p, &sampling_reason, sizeof(sampling_reason));
+    p += sizeof(sampling_reason);
+    memcpy(p, db_name, db_name_len);
+    p += db_name_len;
+    memcpy(p, module, module_len);
+    p += module_len;
+    memcpy(p, json, json_len);
+
+    pthread_mutex_lock(&lock);
+    size_t dropped = 0;
+    if (spool_append(spool, stream_info->key, data, n))
+        inserts_spooled++;
+    else
+        dropped++;
+    dropped += spool_dropped(spool);
+    __atomic_add_fetch(&inserts_dropped, dropped, __ATOMIC_RELAXED);
+    __atomic_store_n(&spooled_inserts, spool_size(spool), __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lock);
+
+    free(data);
+}
+
+// returns NULL if the record is corrupt or its stream is no longer known
+static zmsg_t* decode_record(zmsg_t *record)
+{
+    char *stream = zmsg_popstr(record);
+    zframe_t *frame = zmsg_first(record);
+    const char *data = (const char*) zframe_data(frame);
+    size_t size = zframe_size(frame);
+    const char *end = data + size;
+
+    const char *db_name = data + 1 + sizeof(sampling_reason_t);
+    const char *db_name_end = size > 1 + sizeof(sampling_reason_t) ? memchr(db_name, 0, end - db_name) : NULL;
+    const char *module = db_name_end ? db_name_end + 1 : NULL;
+    const char *json = module ? memchr(module, 0, end - module) : NULL;
+    if (json == NULL) {
+        fprintf(stderr, "[E] insert spool: dropped corrupt record for stream %s\n", stream);
+        free(stream);
+        return NULL;
+    }
+    json++;
+
+    stream_info_t *stream_info = get_stream_info(stream, NULL);
+    if (stream_info == NULL) {
+        fprintf(stderr, "[W] insert spool: dropped record for unknown stream %s\n", stream);
+        free(stream);
+        return NULL;
+    }
+    free(stream);
+
+    json_tokener *tokener = json_tokener_new();
+    json_object *request = json_tokener_parse_ex(tokener, json, end - json);
+    json_tokener_free(tokener);
+    if (request == NULL) {
+        fprintf(stderr, "[E] insert spool: could not parse spooled request\n");
+        release_stream_info(stream_info);
+        return NULL;
+    }
+
+    char task_type[2] = { data[0], '\0' };
+    zmsg_t *msg = zmsg_new();
+    zmsg_addstr(msg, db_name);
+    zmsg_addstr(msg, task_type);
+    zmsg_addstr(msg, module);
+    zmsg_addptr(msg, request);
+    zmsg_addptr(msg, stream_info);
+    zmsg_addmem(msg, data + 1, sizeof(sampling_reason_t));
+    return msg;
+}
+
+zmsg_t* insert_spool_shift()
+{
+    zmsg_t *msg = NULL;
+    while (msg == NULL && insert_spool_size() > 0) {
+        pthread_mutex_lock(&lock);
+        zmsg_t *record = spool ? spool_shift(spool) : NULL;
+        if (spool)
+            __atomic_add_fetch(&inserts_dropped, spool_dropped(spool), __ATOMIC_RELAXED);
+        __atomic_store_n(&spooled_inserts, spool ? spool_size(spool) : 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&lock);
+        if (record == NULL)
+            break;
+        msg = decode_record(record);
+        zmsg_destroy(&record);
+    }
+    return msg;
+}
+
+void insert_spool_tick()
+{
+    size_t messages = 0, bytes = 0;
+    double age = 0;
+    pthread_mutex_lock(&lock);
+    if (spool) {
+        spool_flush(spool);
+        messages = spool_size(spool);
+        bytes = spool_bytes(spool);
+        age = spool_age(spool) / 1000.0;
+    }
+    size_t spooled = inserts_spooled;
+    inserts_spooled = 0;
+    pthread_mutex_unlock(&lock);
+    size_t dropped = __atomic_exchange_n(&inserts_dropped, 0, __ATOMIC_RELAXED);
+
+    if (spooled || messages)
+        printf("[I] insert spool: %zu inserts spooled, %zu waiting (%.1f MB, oldest %.0f seconds)\n",
+               spooled, messages, bytes / 1048576.0, age);
+    if (dropped)
+        fprintf(stderr, "[W] insert spool: dropped %zu inserts\n", dropped);
+
+    importer_prometheus_client_record_insert_spool(messages, bytes, age);
+    importer_prometheus_client_count_inserts_spooled(spooled);
+    importer_prometheus_client_count_inserts_dropped(dropped);
+}
+
+static void test_append(const char *db_name, char task_type, const char *module, const char *json,
+                        stream_info_t *stream_info, sampling_reason_t sampling_reason)
+{
+    json_object *request = json_tokener_parse(json);
+    assert(request);
+    insert_spool_append(db_name, task_type, module, request, stream_info, sampling_reason);
+    json_object_put(request);
+}
+
+static void test_shift(const char *db_name, const char *task_type, const char *module, const char *json,
+                       stream_info_t *stream_info, sampling_reason_t sampling_reason)
+{
+    zmsg_t *msg = insert_spool_shift();
+    assert(msg);
+    assert(zmsg_size(msg) == 6);
+    char *s = zmsg_popstr(msg);
+    assert(streq(s, db_name));
+    free(s);
+    s = zmsg_popstr(msg);
+    assert(streq(s, task_type));
+    free(s);
+    s = zmsg_popstr(msg);
+    assert(streq(s, module));
+    free(s);
+    json_object *request;
+    zframe_t *frame = zmsg_pop(msg);
+    assert(zframe_size(frame) == sizeof(request));
+    memcpy(&request, zframe_data(frame), sizeof(request));
+    zframe_destroy(&frame);
+    assert(streq(json_object_to_json_string_ext(request, JSON_C_TO_STRING_PLAIN), json));
+    json_object_put(request);
+    frame = zmsg_pop(msg);
+    stream_info_t *info = zframe_getptr(frame);
+    assert(info == stream_info);
+    release_stream_info(info);
+    zframe_destroy(&frame);
+    frame = zmsg_pop(msg);
+    assert(zframe_size(frame) == sizeof(sampling_reason_t));
+    assert(memcmp(zframe_data(frame), &sampling_reason, sizeof(sampling_reason_t)) == 0);
+    zframe_destroy(&frame);
+    zmsg_destroy(&msg);
+}
+
+void insert_spool_test(int verbose)
+{
+    printf(" * insert-spool: ");
+    if (verbose)
+        printf("\n");
+
+    char streams_file_name[] = "/tmp/logjam-insert-spool-test-XXXXXX";
+    int fd = mkstemp(streams_file_name);
+    assert(fd != -1);
+    const char *streams = "{\"e-f\":{}}";
+    ssize_t written = write(fd, streams, strlen(streams));
+    assert(written == (ssize_t)strlen(streams));
+    close(fd);
+    // the url is kept by the stream config
+    char *streams_url;
+    int rc = asprintf(&streams_url, "file://%s", streams_file_name);
+    assert(rc != -1);
+    bool ok = setup_stream_config(streams_url, "");
+    assert(ok);
+    stream_info_t *stream_info = get_stream_info("e-f", NULL);
+    assert(stream_info);
+
+    char directory[] = "/tmp/logjam-insert-spool-test-XXXXXX";
+    assert(mkdtemp(directory));
+    zconfig_t *config = zconfig_new("root", NULL);
+    zconfig_put(config, "frontend/writers/max_queued", "2");
+    zconfig_put(config, "frontend/writers/spool/directory", directory);
+    insert_spool_init(config);
+    assert(max_queued_inserts == 2);
+    assert(insert_spool_size() == 0);
+    assert(insert_spool_shift() == NULL);
+
+    // the spool is used once the limit of queued inserts has been reached ...
+    queued_inserts = 1;
+    assert(!insert_spool_active());
+    queued_inserts = 2;
+    assert(insert_spool_active());
+
+    test_append("logjam-e-f-2026-10-19", 'r', "::Users", "{\"action\":\"Users#show\",\"code\":500}", stream_info, SAMPLE_500 | SAMPLE_SLOW_REQUEST);
+    test_append("logjam-e-f-2026-10-19", 'j', "", "{\"description\":\"TypeError\"}", stream_info, NOT_SAMPLED);
+    test_append("logjam-e-f-2026-10-20", 'e', "", "{\"label\":\"deploy\"}", stream_info, NOT_SAMPLED);
+    assert(insert_spool_size() == 3);
+
+    // ... and stays in use until it has been drained
+    queued_inserts = 0;
+    assert(insert_spool_active());
+    test_shift("logjam-e-f-2026-10-19", "r", "::Users", "{\"action\":\"Users#show\",\"code\":500}", stream_info, SAMPLE_500 | SAMPLE_SLOW_REQUEST);
+    test_shift("logjam-e-f-2026-10-19", "j", "", "{\"description\":\"TypeError\"}", stream_info, NOT_SAMPLED);
+    assert(insert_spool_active());
+    test_shift("logjam-e-f-2026-10-20", "e", "", "{\"label\":\"deploy\"}", stream_info, NOT_SAMPLED);
+    assert(insert_spool_size() == 0);
+    assert(!insert_spool_active());
+    assert(insert_spool_shift() == NULL);
+
+    // corrupt records and records of streams which are no longer known are skipped
+    stream_info_t unknown_stream = { .key = "x-y" };
+    pthread_mutex_lock(&lock);
+    assert(spool_append(spool, "e-f", "r", 1));
+    assert(spool_append(spool, "e-f", "r\0\0\0\0logjam-e-f-2026-10-19", 26));
+    pthread_mutex_unlock(&lock);
+    test_append("logjam-x-y-2026-10-19", 'r', "::Users", "{}", &unknown_stream, NOT_SAMPLED);
+    test_append("logjam-e-f-2026-10-19", 'r', "::Users", "{}", stream_info, SAMPLE_400);
+    assert(insert_spool_size() == 4);
+    test_shift("logjam-e-f-2026-10-19", "r", "::Users", "{}", stream_info, SAMPLE_400);
+    assert(insert_spool_size() == 0);
+
+    // spooled inserts survive a restart
+    test_append("logjam-e-f-2026-10-19", 'j', "", "{}", stream_info, NOT_SAMPLED);
+    insert_spool_tick();
+    insert_spool_destroy();
+    assert(insert_spool_size() == 0);
+    insert_spool_init(config);
+    assert(insert_spool_size() == 1);
+    assert(insert_spool_active());
+    test_shift("logjam-e-f-2026-10-19", "j", "", "{}", stream_info, NOT_SAMPLED);
+    // removes the empty segment
+    pthread_mutex_lock(&lock);
+    assert(spool_shift(spool) == NULL);
+    pthread_mutex_unlock(&lock);
+    insert_spool_destroy();
+    zconfig_destroy(&config);
+
+    // without a spool, inserts beyond the limit are dropped
+    config = zconfig_new("root", NULL);
+    zconfig_put(config, "frontend/writers/max_queued", "2");
+    insert_spool_init(config);
+    queued_inserts = 2;
+    assert(insert_spool_active());
+    test_append("logjam-e-f-2026-10-19", 'j', "", "{}", stream_info, NOT_SAMPLED);
+    assert(insert_spool_size() == 0);
+    assert(insert_spool_shift() == NULL);
+    queued_inserts = 0;
+    assert(!insert_spool_active());
+    insert_spool_tick();
+
+    insert_spool_destroy();
+    max_queued_inserts = 0;
+    zconfig_destroy(&config);
+    release_stream_info(stream_info);
+    zsys_file_delete("%s/cursor", directory);
+    zsys_dir_delete("%s", directory);
+    unlink(streams_file_name);
+
+    printf("OK\n");
+}
@@ -0,0 +1,48 @@
+#ifndef __LOGJAM_IMPORTER_INSERT_SPOOL_H_INCLUDED__
+#define __LOGJAM_IMPORTER_INSERT_SPOOL_H_INCLUDED__
+
+#include "importer-common.h"
+#include "logjam-streaminfo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Parsers hand requests, js exceptions and events to the request writers in memory, as
+// long as fewer than max_queued_inserts of them are waiting to be inserted. Beyond that,
+// they are appended to a spool on disk, which the writers drain whenever they have nothing
+// else to do. Once something has been spooled, everything is spooled until the spool is
+// empty again, so inserts happen in the order in which requests have been parsed. Spooled
+// inserts survive a restart. Without a spool directory, inserts beyond the limit are
+// dropped.
+
+extern size_t max_queued_inserts;   // 0 means unlimited
+
+extern void insert_spool_init(zconfig_t *config);
+extern void insert_spool_destroy();
+// applies a changed max_queued setting after the config file has been reloaded
+extern void insert_spool_update_limit(zconfig_t *config);
+
+// true if parsers should call insert_spool_append instead of sending to the writers
+extern bool insert_spool_active();
+
+extern void insert_spool_append(const char *db_name, char task_type, const char *module, json_object *request,
+                                stream_info_t *stream_info, sampling_reason_t sampling_reason);
+
+// number of inserts waiting in the spool
+extern size_t insert_spool_size();
+
+// removes the oldest insert from the spool and returns it in the format the parsers send
+// to the writers. returns NULL if the spool is empty.
+extern zmsg_t* insert_spool_shift();
+
+// flushes the spool and reports its metrics, called once per tick
+extern void insert_spool_tick();
+
+extern void insert_spool_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,10 +1,20 @@
 #include "importer-common.h"
 #include "importer-livestream.h"
+#include "importer-conflator.h"
+#include "importer-prometheus-client.h"
+
+// Messages from the controller (totals) and the writers (errors) are not forwarded right
+// away, but coalesced by key and published every frontend/livestream/flush_interval
+// milliseconds (default: 250, 0 forwards every message). See importer-conflator.h. This
+// keeps the live stream responsive during incidents, when the writers publish lots of
+// errors, which would otherwise be dropped arbitrarily once the pub socket reaches its HWM.
 
 typedef struct {
     zsock_t* pipe;
     zsock_t* pull_socket;
     zsock_t* pub_socket;
+    live_stream_conflator_t *conflator;
+    size_t flush_interval;
     size_t message_count;
     size_t message_drops;
 } live_stream_state_t;
@@ -40,6 +50,10 @@ live_stream_state_t* live_stream_state_new(zsock_t *pipe, zconfig_t* config)
     state->pipe = pipe;
     state->pub_socket = live_stream_pub_socket_new(config);
     state->pull_socket = live_stream_pull_socket_new(config);
+    state->flush_interval = atol(zconfig_resolve(config, "frontend/livestream/flush_interval", "250"));
+    size_t max_errors = atol(zconfig_resolve(config, "frontend/livestream/max_errors", "10"));
+    if (state->flush_interval > 0)
+        state->conflator = live_stream_conflator_new(max_errors);
     return state;
 }
 
@@ -49,6 +63,7 @@ void live_stream_state_destroy(live_stream_state_t** state_p)
     live_stream_state_t* state = *state_p;
     zsock_destroy(&state->pub_socket);
     zsock_destroy(&state->pull_socket);
+    live_stream_conflator_destroy(&state->conflator);
     free(state);
     *state_p = NULL;
 }
@@ -64,7 +79,7 @@ zsock_t* live_stream_client_socket_new(zconfig_t* config)
 
 void live_stream_publish(zsock_t *live_stream_socket, const char* key, const char* json_str)
 {
-    zstr_sendx(live_stream_socket, key, json_str, NULL);
+    zstr_sendx(live_stream_socket, "totals", key, json_str, NULL);
 }
 
 void publish_error_for_module(stream_info_t *stream_info, const char* module, const char* json_str, zsock_t* live_stream_socket)
@@ -79,7 +94,7 @@ void publish_error_for_module(stream_info_t *stream_info, const char* module, co
     // tolower is unsafe and not really necessary
     for (char *p = key; *p; ++p) *p = tolower(*p);
 
-    live_stream_publish(live_stream_socket, key, json_str);
+    zstr_sendx(live_stream_socket, "errors", key, json_str, NULL);
 }
 
 static
@@ -95,7 +110,20 @@ int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
             rc = -1;
         }
         else if (streq(cmd, "tick")) {
-            printf("[I] live_stream: %5zu messages\n", state->message_count);
+            if (state->conflator) {
+                live_stream_conflation_stats_t stats;
+                live_stream_conflator_take_stats(state->conflator, &stats);
+                printf("[I] live_stream: %5zu messages (received: %zu, conflated: %zu, suppressed: %zu, dropped: %zu)\n",
+                       state->message_count, stats.received, stats.conflated, stats.suppressed, state->message_drops);
+                importer_prometheus_client_count_live_stream_msgs("received", stats.received);
+                importer_prometheus_client_count_live_stream_msgs("conflated", stats.conflated);
+                importer_prometheus_client_count_live_stream_msgs("suppressed", stats.suppressed);
+            } else {
+                printf("[I] live_stream: %5zu messages\n", state->message_count);
+                importer_prometheus_client_count_live_stream_msgs("received", state->message_count);
+            }
+            importer_prometheus_client_count_live_stream_msgs("published", state->message_count - state->message_drops);
+            importer_prometheus_client_count_live_stream_msgs("dropped", state->message_drops);
             state->message_count = 0;
             state->message_drops = 0;
         } else {
@@ -107,19 +135,42 @@ int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
     return rc;
 }
 
+static
+void publish_msg(const char *key, const char *json_str, void *arg)
+{
+    live_stream_state_t *state = arg;
+    state->message_count++;
+    int rc = zstr_sendx(state->pub_socket, key, json_str, NULL);
+    if (rc) {
+        if (!state->message_drops++)
+            fprintf(stderr, "[E] live_stream: dropped message on pub socket (%d: %s)\n", errno, zmq_strerror(errno));
+    }
+}
+
 static
 int read_msg_and_forward(zloop_t *loop, zsock_t *socket, void *callback_data)
 {
     live_stream_state_t *state = callback_data;
-    zmsg_t *msg = zmsg_recv(socket);
-    if (msg) {
-        state->message_count++;
-        int rc = zmsg_send_and_destroy(&msg, state->pub_socket);
-        if (rc) {
-            if (!state->message_drops++)
-                fprintf(stderr, "[E] live_stream: dropped message on pub socket (%d: %s)\n", errno, zmq_strerror(errno));
-        }
-    }
+    char *kind, *key, *json_str;
+    if (zstr_recvx(socket, &kind, &key, &json_str, NULL) == -1)
+        return 0;
+    if (state->conflator == NULL)
+        publish_msg(key, json_str, state);
+    else if (streq(kind, "errors"))
+        live_stream_conflator_add_errors(state->conflator, key, json_str);
+    else
+        live_stream_conflator_add_totals(state->conflator, key, json_str);
+    zstr_free(&kind);
+    zstr_free(&key);
+    zstr_free(&json_str);
+    return 0;
+}
+
+static
+int flush_conflated_msgs(zloop_t *loop, int timer_id, void *arg)
+{
+    live_stream_state_t *state = arg;
+    live_stream_conflator_flush(state->conflator, publish_msg, state);
     return 0;
 }
 
@@ -147,6 +198,12 @@ void live_stream_actor_fn(zsock_t *pipe, void *args)
     rc = zloop_reader(loop, state->pull_socket, read_msg_and_forward, state);
     assert(rc == 0);
 
+    // publish coalesced messages periodically
+    if (state->conflator) {
+        rc = zloop_timer(loop, state->flush_interval, 0, flush_conflated_msgs, state);
+        assert(rc != -1);
+    }
+
     // run the loop
     if (!quiet)
         fprintf(stdout, "[I] live_stream: listening\n");
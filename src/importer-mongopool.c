@@ -0,0 +1,189 @@
+#include "importer-mongopool.h"
+#include "importer-mongoutils.h"
+#include "importer-prometheus-client.h"
+
+typedef struct {
+    mongoc_client_pool_t *client_pool;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    zlist_t *idle;                  // connections not in use
+    size_t max_in_flight;
+    size_t in_flight;
+    size_t waiting;
+    int64_t deferred;               // requests deferred by writers
+    // since last tick
+    size_t ops;
+    double op_seconds;
+    double wait_seconds;
+} mongo_pool_t;
+
+static mongo_pool_t pools[MAX_DATABASES];
+static int num_pools = 0;
+
+void mongo_pools_init(zconfig_t *config)
+{
+    size_t max_in_flight = atol(zconfig_resolve(config, "frontend/mongo/max_in_flight", "8"));
+    if (max_in_flight < 1)
+        max_in_flight = 1;
+    for (int i = 0; i < num_databases; i++) {
+        mongo_pool_t *pool = &pools[i];
+        mongoc_uri_t *uri = mongoc_uri_new(databases[i]);
+        assert(uri);
+        pool->client_pool = mongoc_client_pool_new(uri);
+        assert(pool->client_pool);
+        mongoc_uri_destroy(uri);
+        mongoc_client_pool_max_size(pool->client_pool, max_in_flight);
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->available, NULL);
+        pool->idle = zlist_new();
+        pool->max_in_flight = max_in_flight;
+        printf("[I] database[%d]: at most %zu operations in flight\n", i, max_in_flight);
+    }
+    num_pools = num_databases;
+}
+
+static
+void mongo_connection_destroy(mongo_connection_t **connection_p, mongo_pool_t *pool)
+{
+    mongo_connection_t *connection = *connection_p;
+    zhash_destroy(&connection->collections);
+    mongoc_client_pool_push(pool->client_pool, connection->client);
+    free(connection);
+    *connection_p = NULL;
+}
+
+void mongo_pools_destroy()
+{
+    for (int i = 0; i < num_pools; i++) {
+        mongo_pool_t *pool = &pools[i];
+        if (pool->in_flight > 0)
+            fprintf(stderr, "[W] database[%d]: %zu connections still in use\n", i, pool->in_flight);
+        mongo_connection_t *connection;
+        while ( (connection = zlist_pop(pool->idle)) )
+            mongo_connection_destroy(&connection, pool);
+        zlist_destroy(&pool->idle);
+        mongoc_client_pool_destroy(pool->client_pool);
+        pthread_cond_destroy(&pool->available);
+        pthread_mutex_destroy(&pool->lock);
+    }
+    num_pools = 0;
+}
+
+static
+void refresh_collections(mongo_connection_t *connection)
+{
+    int64_t now = zclock_time();
+    if (connection->collections && now - connection->collections_created < COLLECTION_REFRESH_INTERVAL * 1000)
+        return;
+    zhash_destroy(&connection->collections);
+    connection->collections = zhash_new();
+    connection->collections_created = now;
+}
+
+// must be called with the pool's lock held
+static
+mongo_connection_t* take_connection(mongo_pool_t *pool, int db)
+{
+    pool->in_flight++;
+    mongo_connection_t *connection = zlist_pop(pool->idle);
+    if (connection == NULL) {
+        connection = zmalloc(sizeof(*connection));
+        connection->db = db;
+        // can't block, the client pool holds as many clients as we allow in flight
+        connection->client = mongoc_client_pool_pop(pool->client_pool);
+        assert(connection->client);
+    }
+    return connection;
+}
+
+mongo_connection_t* mongo_connection_acquire(int db)
+{
+    assert(db >= 0 && db < num_pools);
+    mongo_pool_t *pool = &pools[db];
+    int64_t start_us = zclock_usecs();
+    pthread_mutex_lock(&pool->lock);
+    pool->waiting++;
+    while (pool->in_flight >= pool->max_in_flight)
+        pthread_cond_wait(&pool->available, &pool->lock);
+    pool->waiting--;
+    mongo_connection_t *connection = take_connection(pool, db);
+    int64_t now_us = zclock_usecs();
+    pool->wait_seconds += (now_us - start_us) / 1000000.0;
+    pthread_mutex_unlock(&pool->lock);
+    connection->acquired_us = now_us;
+    refresh_collections(connection);
+    return connection;
+}
+
+mongo_connection_t* mongo_connection_try_acquire(int db)
+{
+    assert(db >= 0 && db < num_pools);
+    mongo_pool_t *pool = &pools[db];
+    mongo_connection_t *connection = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->in_flight < pool->max_in_flight)
+        connection = take_connection(pool, db);
+    pthread_mutex_unlock(&pool->lock);
+    if (connection) {
+        connection->acquired_us = zclock_usecs();
+        refresh_collections(connection);
+    }
+    return connection;
+}
+
+void mongo_connection_release(mongo_connection_t **connection_p)
+{
+    mongo_connection_t *connection = *connection_p;
+    if (connection == NULL)
+        return;
+    mongo_pool_t *pool = &pools[connection->db];
+    double seconds = (zclock_usecs() - connection->acquired_us) / 1000000.0;
+    pthread_mutex_lock(&pool->lock);
+    pool->in_flight--;
+    pool->ops++;
+    pool->op_seconds += seconds;
+    zlist_push(pool->idle, connection);
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+    *connection_p = NULL;
+}
+
+mongoc_collection_t* mongo_connection_get_collection(mongo_connection_t *connection, const char *db_name, const char *collection_name)
+{
+    char key[1024];
+    snprintf(key, sizeof(key), "%s.%s", db_name, collection_name);
+    mongoc_collection_t *collection = zhash_lookup(connection->collections, key);
+    if (collection == NULL) {
+        collection = mongoc_client_get_collection(connection->client, db_name, collection_name);
+        zhash_insert(connection->collections, key, collection);
+        zhash_freefn(connection->collections, key, (zhash_free_fn*)mongoc_collection_destroy);
+    }
+    return collection;
+}
+
+void mongo_pool_count_deferred(int db, int delta)
+{
+    __atomic_add_fetch(&pools[db].deferred, delta, __ATOMIC_SEQ_CST);
+}
+
+void mongo_pools_tick()
+{
+    for (int i = 0; i < num_pools; i++) {
+        mongo_pool_t *pool = &pools[i];
+        pthread_mutex_lock(&pool->lock);
+        size_t ops = pool->ops;
+        double op_seconds = pool->op_seconds;
+        double wait_seconds = pool->wait_seconds;
+        size_t in_flight = pool->in_flight;
+        size_t waiting = pool->waiting;
+        int64_t deferred = __atomic_load_n(&pool->deferred, __ATOMIC_SEQ_CST);
+        pool->ops = 0;
+        pool->op_seconds = 0;
+        pool->wait_seconds = 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (verbose && ops > 0)
+            printf("[D] database[%d]: %zu ops, %.3f ms avg, %zu in flight, %zu waiting, %" PRId64 " deferred\n",
+                   i, ops, 1000 * op_seconds / ops, in_flight, waiting, deferred);
+        importer_prometheus_client_record_mongo_pool(i, ops, op_seconds, wait_seconds, in_flight, waiting, deferred);
+    }
+}
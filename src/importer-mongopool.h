@@ -0,0 +1,48 @@
+#ifndef __LOGJAM_IMPORTER_MONGO_POOL_H_INCLUDED__
+#define __LOGJAM_IMPORTER_MONGO_POOL_H_INCLUDED__
+
+#include "importer-common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Request writers, stats updaters and the indexer share one client pool per configured
+// database, instead of each of them holding its own clients. A connection has to be
+// acquired for every operation on a database and released afterwards. At most
+// frontend/mongo/max_in_flight connections per database (default 8) are in use at any time,
+// so a slow database can't be hammered by every thread at once. Collection handles are
+// cached per connection and dropped once an hour.
+
+typedef struct {
+    mongoc_client_t *client;
+    int db;                         // index of the database in the config
+    zhash_t *collections;           // "db_name.collection" -> mongoc_collection_t
+    int64_t collections_created;    // ms
+    int64_t acquired_us;
+} mongo_connection_t;
+
+extern void mongo_pools_init(zconfig_t *config);
+extern void mongo_pools_destroy();
+
+// blocks until fewer than max_in_flight connections to the given database are in use
+extern mongo_connection_t* mongo_connection_acquire(int db);
+
+// returns NULL if max_in_flight connections to the given database are in use
+extern mongo_connection_t* mongo_connection_try_acquire(int db);
+
+extern void mongo_connection_release(mongo_connection_t **connection_p);
+
+extern mongoc_collection_t* mongo_connection_get_collection(mongo_connection_t *connection, const char *db_name, const char *collection_name);
+
+// keeps track of the number of requests writers have deferred because of a busy database
+extern void mongo_pool_count_deferred(int db, int delta);
+
+// reports operation counts, latencies and queue lengths per database, called once per tick
+extern void mongo_pools_tick();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -125,6 +125,75 @@ time_t valid_database_date(const char *date)
         return res;
 }
 
+// Messages for unknown streams and requests without action are only counted. The counts
+// are sent to the unknown streams collector on every tick. Only the first
+// frontend/unknown_streams/samples_per_minute messages (default 10) per unknown stream are
+// forwarded in full, so that the collector can still publish some of them for debugging.
+#define MAX_TRACKED_UNKNOWN_STREAMS 1000
+
+static
+void count_stream(zhash_t *counts, const char *stream)
+{
+    size_t n = (size_t)zhash_lookup(counts, stream);
+    // don't let garbage stream names blow up memory usage
+    if (n == 0 && zhash_size(counts) >= MAX_TRACKED_UNKNOWN_STREAMS)
+        stream = "*other*";
+    n = (size_t)zhash_lookup(counts, stream);
+    zhash_update(counts, stream, (void*)(n + 1));
+}
+
+void parser_count_missing_action(parser_state_t *state, const char *stream)
+{
+    count_stream(state->missing_actions, stream);
+}
+
+static
+void parser_handle_unknown_stream(parser_state_t *state, const char *stream_name, zmsg_t *msg)
+{
+    count_stream(state->unknown_streams, stream_name);
+    size_t forwarded = (size_t)zhash_lookup(state->unknown_stream_samples, stream_name);
+    if (forwarded >= state->unknown_stream_sample_limit)
+        return;
+    if (forwarded == 0 && zhash_size(state->unknown_stream_samples) >= MAX_TRACKED_UNKNOWN_STREAMS)
+        return;
+    zhash_update(state->unknown_stream_samples, stream_name, (void*)(forwarded + 1));
+    zmsg_t *msg_copy = zmsg_dup(msg);
+    zmsg_pushstr(msg_copy, "stream");
+    zmsg_send_and_destroy(&msg_copy, state->unknown_streams_collector_socket);
+}
+
+static
+void send_stream_counts(parser_state_t *state, const char *kind, zhash_t *counts)
+{
+    if (zhash_size(counts) == 0)
+        return;
+    zmsg_t *msg = zmsg_new();
+    zmsg_addstr(msg, "counts");
+    zmsg_addstr(msg, kind);
+    void *value = zhash_first(counts);
+    while (value) {
+        zmsg_addstr(msg, zhash_cursor(counts));
+        zmsg_addstrf(msg, "%zu", (size_t)value);
+        value = zhash_next(counts);
+    }
+    zmsg_send_and_destroy(&msg, state->unknown_streams_collector_socket);
+}
+
+static
+void parser_flush_unknown_streams(parser_state_t *state)
+{
+    send_stream_counts(state, "stream", state->unknown_streams);
+    send_stream_counts(state, "action", state->missing_actions);
+    zhash_destroy(&state->unknown_streams);
+    zhash_destroy(&state->missing_actions);
+    state->unknown_streams = zhash_new();
+    state->missing_actions = zhash_new();
+    if (state->ticks % 60 == 0) {
+        zhash_destroy(&state->unknown_stream_samples);
+        state->unknown_stream_samples = zhash_new();
+    }
+}
+
 static
 processor_state_t* processor_create(zmsg_t** msg, zframe_t* stream_frame, parser_state_t* parser_state, json_object *request, bool *known_stream)
 {
@@ -139,11 +208,8 @@ processor_state_t* processor_create(zmsg_t** msg, zframe_t* stream_frame, parser
     stream_info_t *stream_info = get_stream_info(stream_name, parser_state->stream_info_cache);
     *known_stream = stream_info != NULL;
     if (stream_info == NULL) {
-        if (!is_mobile_app(stream_name)) {
-            zmsg_t *msg_copy = zmsg_dup(*msg);
-            zmsg_pushstr(msg_copy, "stream");
-            zmsg_send_and_destroy(&msg_copy, parser_state->unknown_streams_collector_socket);
-        }
+        if (!is_mobile_app(stream_name))
+            parser_handle_unknown_stream(parser_state, stream_name, *msg);
         return NULL;
     }
     // printf("[D] found stream info for stream %s: %s\n", stream_name, stream_info->key);
@@ -187,6 +253,7 @@ processor_state_t* processor_create(zmsg_t** msg, zframe_t* stream_frame, parser
         int rc = zhash_insert(parser_state->processors, db_name, p);
         assert(rc ==0);
         zhash_freefn(parser_state->processors, db_name, processor_destroy);
+        p->cardinality = cardinality_registry_lookup(db_name, stream_info->key);
         // send msg to indexer to create db indexes and record the database as known
         indexer_ensure_indexes(stream_info, db_name, parser_state->indexer_socket);
     }
@@ -307,6 +374,11 @@ parser_state_t* parser_state_new(zconfig_t* config, size_t id)
     state->pull_socket = parser_pull_socket_new();
     state->push_socket = parser_push_socket_new();
     state->unknown_streams_collector_socket = parser_unknown_stream_collector_socket_new();
+    state->unknown_streams = zhash_new();
+    state->missing_actions = zhash_new();
+    state->unknown_stream_samples = zhash_new();
+    const char *samples = state->config ? zconfig_resolve(state->config, "frontend/unknown_streams/samples_per_minute", "10") : "10";
+    state->unknown_stream_sample_limit = strtoul(samples, NULL, 0);
     state->indexer_socket = parser_indexer_socket_new();
     state->tokener = json_tokener_new();
     assert(state->tokener);
@@ -326,6 +398,9 @@ void parser_state_destroy(parser_state_t **state_p)
     zsock_destroy(&state->push_socket);
     zsock_destroy(&state->indexer_socket);
     zsock_destroy(&state->unknown_streams_collector_socket);
+    zhash_destroy(&state->unknown_streams);
+    zhash_destroy(&state->missing_actions);
+    zhash_destroy(&state->unknown_stream_samples);
     zhash_destroy(&state->processors);
     zhash_destroy(&state->stream_info_cache);
     tracker_destroy(&state->tracker);
@@ -334,6 +409,43 @@ void parser_state_destroy(parser_state_t **state_p)
     *state_p = NULL;
 }
 
+// the controller adds and retires request writers at runtime
+static
+void parser_change_writer(parser_state_t *state, bool add, int writer)
+{
+    int rc;
+    if (add)
+        rc = zsock_connect(state->push_socket, "inproc://request-writer-%d", writer);
+    else
+        rc = zsock_disconnect(state->push_socket, "inproc://request-writer-%d", writer);
+    log_zmq_error(rc, __FILE__, __LINE__);
+}
+
+// The controller pauses the subscribers before retiring a parser. So we can parse
+// everything waiting on the pull socket and disconnect from the subscribers without
+// losing messages. The processors are collected on the next tick, after which the
+// controller destroys the parser.
+static
+void parser_retire(parser_state_t *state)
+{
+    size_t n = 0;
+    while (zsock_events(state->pull_socket) & ZMQ_POLLIN) {
+        zmsg_t *msg = zmsg_recv(state->pull_socket);
+        if (msg == NULL)
+            break;
+        state->parsed_msgs_count++;
+        parse_msg_and_forward_interesting_requests(&msg, state);
+        zmsg_destroy(&msg);
+        n++;
+    }
+    for (int i = 0; i < num_subscribers; i++) {
+        int rc = zsock_disconnect(state->pull_socket, "inproc://subscriber-%d", i);
+        log_zmq_error(rc, __FILE__, __LINE__);
+    }
+    if (!quiet)
+        printf("[I] parser [%zu]: retiring (drained %zu messages)\n", state->id, n);
+}
+
 static
 void parser(zsock_t *pipe, void *args)
 {
@@ -342,8 +454,6 @@ void parser(zsock_t *pipe, void *args)
     set_thread_name(state->me);
     size_t id = state->id;
 
-    static uint64_t ticks = 0;
-
     if (!quiet)
         printf("[I] parser [%zu]: starting\n", id);
 
@@ -361,27 +471,40 @@ void parser(zsock_t *pipe, void *args)
             msg = zmsg_recv(state->pipe);
             if (!msg) continue;
             char *cmd = zmsg_popstr(msg);
-            zmsg_destroy(&msg);
             if (streq(cmd, "tick")) {
                 if (state->parsed_msgs_count && verbose)
                     printf("[I] parser [%zu]: tick (%zu messages, %zu frontend)\n", id, state->parsed_msgs_count, state->fe_stats.received);
                 importer_prometheus_client_count_msgs_parsed(state->parsed_msgs_count);
-                importer_prometheus_client_record_rusage_parser(state->id);
+                double cpu_seconds = importer_prometheus_client_record_rusage_parser(state->id);
                 zmsg_t *answer = zmsg_new();
                 zmsg_addptr(answer, state->processors);
                 zmsg_addmem(answer, &state->parsed_msgs_count, sizeof(state->parsed_msgs_count));
                 zmsg_addmem(answer, &state->fe_stats, sizeof(state->fe_stats));
+                zmsg_addmem(answer, &cpu_seconds, sizeof(cpu_seconds));
                 zmsg_send_with_retry(&answer, state->pipe);
                 state->parsed_msgs_count = 0;
                 memset(&state->fe_stats, 0, sizeof(state->fe_stats));
                 state->processors = processor_hash_new();
-                if (++ticks % 60 == 0) {
+                state->ticks++;
+                parser_flush_unknown_streams(state);
+                if (state->ticks % 60 == 0) {
                     zhash_destroy(&state->stream_info_cache);
                     state->stream_info_cache = zhash_new();
                 }
                 free(cmd);
+            } else if (streq(cmd, "add-writer") || streq(cmd, "remove-writer")) {
+                char *writer = zmsg_popstr(msg);
+                parser_change_writer(state, streq(cmd, "add-writer"), atoi(writer));
+                zsock_signal(state->pipe, 0);
+                free(writer);
+                free(cmd);
+            } else if (streq(cmd, "retire")) {
+                parser_retire(state);
+                zsock_signal(state->pipe, 0);
+                free(cmd);
             } else if (streq(cmd, "$TERM")) {
                 // printf("[D] parser [%zu]: received $TERM command\n", id);
+                zmsg_destroy(&msg);
                 free(cmd);
                 break;
             } else {
@@ -389,6 +512,7 @@ void parser(zsock_t *pipe, void *args)
                 free(cmd);
                 assert(false);
             }
+            zmsg_destroy(&msg);
         } else if (socket == state->pull_socket) {
             msg = zmsg_recv(state->pull_socket);
             if (msg != NULL) {
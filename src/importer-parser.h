@@ -51,10 +51,16 @@ typedef struct {
     uuid_tracker_t *tracker;
     zchunk_t *decompression_buffer;
     zsock_t *unknown_streams_collector_socket;
+    zhash_t *unknown_streams;                 // stream -> messages since the last tick
+    zhash_t *missing_actions;                 // stream -> requests without action since the last tick
+    zhash_t *unknown_stream_samples;          // stream -> messages forwarded during the current minute
+    size_t unknown_stream_sample_limit;       // messages forwarded per unknown stream and minute
+    size_t ticks;                             // ticks received, caches are reset every 60 ticks
 } parser_state_t;
 
 extern zactor_t* parser_new(zconfig_t *config, size_t id);
 extern void parser_destroy(zactor_t **parser_p);
+extern void parser_count_missing_action(parser_state_t *state, const char *stream);
 
 #ifdef __cplusplus
 }
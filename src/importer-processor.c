@@ -6,6 +6,8 @@
 #include "logjam-streaminfo.h"
 #include "importer-resources.h"
 #include "importer-prometheus-client.h"
+#include "importer-quantiles.h"
+#include "importer-insertspool.h"
 
 #define DB_PREFIX "logjam-"
 #define DB_PREFIX_LEN 7
@@ -22,6 +24,8 @@ processor_state_t* processor_new(stream_info_t *stream_info, char *db_name)
     p->quants = zhash_new();
     p->agents = zhash_new();
     p->histograms = zhash_new();
+    p->sketches = zhash_new();
+    p->minute_sketches = zhash_new();
     return p;
 }
 
@@ -29,7 +33,8 @@ void processor_destroy(void* processor)
 {
     processor_state_t* p = processor;
     // printf("[D] destroying processor: %s. requests: %zu\n", p->db_name, p->request_count);
-    release_stream_info(p->stream_info);
+    if (p->stream_info)
+        release_stream_info(p->stream_info);
     free(p->db_name);
     zhash_destroy(&p->modules);
     zhash_destroy(&p->totals);
@@ -37,6 +42,8 @@ void processor_destroy(void* processor)
     zhash_destroy(&p->quants);
     zhash_destroy(&p->agents);
     zhash_destroy(&p->histograms);
+    zhash_destroy(&p->sketches);
+    zhash_destroy(&p->minute_sketches);
     free(p);
 }
 
@@ -103,9 +110,7 @@ const char* processor_setup_page(processor_state_t *self, json_object *request,
     }
 
     if (page_obj == NULL) {
-        zmsg_t *msg_copy = zmsg_dup(msg);
-        zmsg_pushstr(msg_copy, "action");
-        zmsg_send_and_destroy(&msg_copy, pstate->unknown_streams_collector_socket);
+        parser_count_missing_action(pstate, self->stream_info->key);
         // fprintf(stderr, "[E] missing action for request in stream: %s\n", self->stream_info->key);
         // dump_json_object(stderr, "[D] REQUEST", request);
         page_obj = json_object_new_string("Unknown#unknown_method");
@@ -122,7 +127,8 @@ const char* processor_setup_page(processor_state_t *self, json_object *request,
 
     json_object_object_add(request, "page", page_obj);
 
-    return page_str;
+    // stored requests keep their page, statistics of too many distinct pages are folded
+    return stream_cardinality_clamp(self->cardinality, CARDINALITY_PAGES, page_str);
 }
 
 static
@@ -514,6 +520,18 @@ void add_quant(const char* namespace, size_t resource_idx, char kind, size_t qua
     stored[resource_idx]++;
 }
 
+static
+void add_sketch_value(const char* key, double value, zhash_t* sketches)
+{
+    quantile_sketch_t *sketch = zhash_lookup(sketches, key);
+    if (sketch == NULL) {
+        sketch = quantile_sketch_new();
+        zhash_insert(sketches, key, sketch);
+        zhash_freefn(sketches, key, quantile_sketch_destroy);
+    }
+    quantile_sketch_add(sketch, value);
+}
+
 static double buckets[HISTOGRAM_SIZE+1] = {
     1,            //    1   ms               1 object            1   KB
     3,            //    3   ms               3 objects           3   KB
@@ -561,7 +579,6 @@ static inline size_t find_bucket_index(double value)
     return i;
 }
 
-static
 void processor_add_quants(processor_state_t *self, const char* namespace, increments_t *increments)
 {
     for (size_t i=0; i<=last_resource_offset; i++){
@@ -588,6 +605,13 @@ void processor_add_quants(processor_state_t *self, const char* namespace, increm
                 // printf("[D] skipping quant: %s\n", i2r(i));
                 continue;
             }
+            char key[2000];
+            snprintf(key, sizeof(key), "%zu-%s", i, namespace);
+            add_sketch_value(key, val, self->sketches);
+            snprintf(key, sizeof(key), "%zu-all_pages", i);
+            add_sketch_value(key, val, self->sketches);
+            if (!legacy_quants)
+                continue;
             // This is stupid, but historic. We should actually store just the bucket
             // index and let the API in logjam convert bucket indexes to real values.
             if (d != 1)
@@ -639,6 +663,10 @@ void processor_add_histogram(processor_state_t *self, const char* namespace, int
         return;
     }
 
+    add_sketch_value(key, time, self->minute_sketches);
+    if (!legacy_quants)
+        return;
+
     size_t *histogram = zhash_lookup(self->histograms, key);
     if (histogram == NULL) {
         histogram = zmalloc(HISTOGRAM_SIZE * sizeof(size_t));
@@ -772,9 +800,9 @@ throttling_reason_t throttle_request(stream_info_t *stream)
 {
     if (throttle_request_for_stream(stream))
         return THROTTLE_MAX_INSERTS_PER_SECOND;
-    if (stream->storage_size > HARD_LIMIT_STORAGE_SIZE)
+    if (stream->storage_size > __atomic_load_n(&hard_limit_storage_size, __ATOMIC_RELAXED))
         return THROTTLE_HARD_LIMIT_STORAGE_SIZE;
-    if (stream->storage_size > SOFT_LIMIT_STORAGE_SIZE && random() > TEN_PERCENT_OF_MAX_RANDOM)
+    if (stream->storage_size > __atomic_load_n(&soft_limit_storage_size, __ATOMIC_RELAXED) && random() > TEN_PERCENT_OF_MAX_RANDOM)
         return THROTTLE_SOFT_LIMIT_STORAGE_SIZE;
     return NOT_THROTTLED;
 }
@@ -825,9 +853,9 @@ void processor_add_request(processor_state_t *self, parser_state_t *pstate, json
     increments_fill_apdex(increments, request_data.total_time);
     increments_fill_response_code(increments, &request_data);
     increments_fill_severity(increments, &request_data);
-    increments_fill_caller_info(increments, request);
+    increments_fill_caller_info(increments, request, self->cardinality);
     increments_fill_sender_info(increments, request);
-    increments_fill_exceptions(increments, request_data.exceptions);
+    increments_fill_exceptions(increments, request_data.exceptions, self->cardinality);
     increments_fill_soft_exceptions(increments, request_data.soft_exceptions);
 
     processor_add_totals(self, request_data.page, increments);
@@ -880,6 +908,11 @@ void processor_add_request(processor_state_t *self, parser_state_t *pstate, json
         // printf("[D] throttled: %s, reason: %s\n", request_data.page, throttling_reason_str(throttling_reason));
         return;
     }
+    if (insert_spool_active()) {
+        insert_spool_append(self->db_name, 'r', request_data.module, request, self->stream_info, sampling_reason);
+        importer_prometheus_client_count_inserts_for_stream(self->stream_info, 1);
+        return;
+    }
     json_object_get(request);
     zmsg_t *updater_msg = zmsg_new();
     zmsg_addstr(updater_msg, self->db_name);
@@ -956,14 +989,15 @@ void processor_add_js_exception(processor_state_t *self, parser_state_t *pstate,
     const char *module = processor_setup_module(self, page);
 
     increments_t* increments = increments_new();
-    increments_fill_js_exception(increments, js_exception);
+    increments_fill_js_exception(increments, js_exception, self->cardinality);
 
     processor_add_totals(self, "all_pages", increments);
     processor_add_minutes(self, "all_pages", minute, increments);
 
     if (strstr(page, "#unknown_method") == NULL) {
-        processor_add_totals(self, page, increments);
-        processor_add_minutes(self, page, minute, increments);
+        const char *clamped_page = stream_cardinality_clamp(self->cardinality, CARDINALITY_PAGES, page);
+        processor_add_totals(self, clamped_page, increments);
+        processor_add_minutes(self, clamped_page, minute, increments);
     }
 
     if (strcmp(module, "Unknown") != 0) {
@@ -975,6 +1009,10 @@ void processor_add_js_exception(processor_state_t *self, parser_state_t *pstate,
     free(page);
     free(js_exception);
 
+    if (insert_spool_active()) {
+        insert_spool_append(self->db_name, 'j', module, request, self->stream_info, 0);
+        return;
+    }
     json_object_get(request);
     zmsg_t *updater_msg = zmsg_new();
     zmsg_addstr(updater_msg, self->db_name);
@@ -990,6 +1028,10 @@ void processor_add_js_exception(processor_state_t *self, parser_state_t *pstate,
 void processor_add_event(processor_state_t *self, parser_state_t *pstate, json_object *request)
 {
     processor_setup_minute(self, request);
+    if (insert_spool_active()) {
+        insert_spool_append(self->db_name, 'e', "", request, self->stream_info, 0);
+        return;
+    }
     json_object_get(request);
     zmsg_t *msg = zmsg_new();
     zmsg_addstr(msg, self->db_name);
@@ -1411,3 +1453,521 @@ enum fe_msg_drop_reason processor_add_ajax_data(processor_state_t *self, parser_
     return reason;
 }
 
+
+// Serialization of merged processor state for checkpoints (see importer-checkpoint.h).
+// The format is only meant to be read by the same build, so numbers are stored in host
+// byte order. Sizes depending on the configured resources are recorded in the header,
+// a checkpoint written with a different resource configuration is rejected.
+
+#define PROCESSOR_DUMP_VERSION 1
+
+static inline void dump_u32(zchunk_t *buffer, uint32_t n)
+{
+    zchunk_extend(buffer, &n, sizeof(n));
+}
+
+static inline void dump_u64(zchunk_t *buffer, uint64_t n)
+{
+    zchunk_extend(buffer, &n, sizeof(n));
+}
+
+static inline void dump_double(zchunk_t *buffer, double d)
+{
+    zchunk_extend(buffer, &d, sizeof(d));
+}
+
+static inline void dump_str(zchunk_t *buffer, const char *s)
+{
+    uint32_t len = strlen(s);
+    dump_u32(buffer, len);
+    zchunk_extend(buffer, s, len);
+}
+
+static void dump_increments_values(zchunk_t *buffer, increments_t *increments)
+{
+    dump_u64(buffer, increments->backend_request_count);
+    dump_u64(buffer, increments->page_request_count);
+    dump_u64(buffer, increments->ajax_request_count);
+    for (size_t i = 0; i <= last_resource_offset; i++) {
+        metric_pair_t *m = &increments->metrics[i];
+        dump_double(buffer, m->val);
+        dump_double(buffer, m->val_squared);
+        dump_double(buffer, m->val_max);
+    }
+    dump_u32(buffer, json_object_object_length(increments->others));
+    json_object_object_foreach(increments->others, key, value) {
+        dump_str(buffer, key);
+        if (json_object_get_type(value) == json_type_double) {
+            dump_u32(buffer, json_type_double);
+            dump_double(buffer, json_object_get_double(value));
+        } else {
+            dump_u32(buffer, json_type_int);
+            dump_u64(buffer, json_object_get_int64(value));
+        }
+    }
+}
+
+static void dump_sketch(zchunk_t *buffer, quantile_sketch_t *sketch)
+{
+    dump_u32(buffer, sketch->offset);
+    dump_u32(buffer, sketch->size);
+    dump_u64(buffer, sketch->count);
+    zchunk_extend(buffer, sketch->counts, sketch->size * sizeof(uint32_t));
+}
+
+typedef enum { DUMP_MODULE, DUMP_INCREMENTS, DUMP_QUANTS, DUMP_HISTOGRAM, DUMP_SKETCH, DUMP_AGENT } dump_kind_t;
+
+static void dump_hash(zchunk_t *buffer, zhash_t *hash, dump_kind_t kind)
+{
+    if (hash == NULL) {
+        dump_u32(buffer, 0);
+        return;
+    }
+    dump_u32(buffer, zhash_size(hash));
+    void *value = zhash_first(hash);
+    while (value) {
+        dump_str(buffer, zhash_cursor(hash));
+        switch (kind) {
+        case DUMP_MODULE:
+            break;
+        case DUMP_INCREMENTS:
+            dump_increments_values(buffer, value);
+            break;
+        case DUMP_QUANTS:
+            zchunk_extend(buffer, value, QUANTS_ARRAY_SIZE);
+            break;
+        case DUMP_HISTOGRAM:
+            zchunk_extend(buffer, value, HISTOGRAM_SIZE * sizeof(size_t));
+            break;
+        case DUMP_SKETCH:
+            dump_sketch(buffer, value);
+            break;
+        case DUMP_AGENT:
+            zchunk_extend(buffer, value, sizeof(user_agent_stats_t));
+            break;
+        }
+        value = zhash_next(hash);
+    }
+}
+
+void processor_hash_dump(zhash_t *processors, zchunk_t *buffer)
+{
+    dump_u32(buffer, PROCESSOR_DUMP_VERSION);
+    dump_u32(buffer, last_resource_offset + 1);
+    dump_u32(buffer, HISTOGRAM_SIZE);
+    dump_u32(buffer, sizeof(user_agent_stats_t));
+    dump_u32(buffer, processors ? zhash_size(processors) : 0);
+    processor_state_t *p = processors ? zhash_first(processors) : NULL;
+    while (p) {
+        dump_str(buffer, p->db_name);
+        dump_str(buffer, p->stream_info->key);
+        dump_u64(buffer, p->request_count);
+        dump_hash(buffer, p->modules, DUMP_MODULE);
+        dump_hash(buffer, p->totals, DUMP_INCREMENTS);
+        dump_hash(buffer, p->minutes, DUMP_INCREMENTS);
+        dump_hash(buffer, p->quants, DUMP_QUANTS);
+        dump_hash(buffer, p->histograms, DUMP_HISTOGRAM);
+        dump_hash(buffer, p->sketches, DUMP_SKETCH);
+        dump_hash(buffer, p->minute_sketches, DUMP_SKETCH);
+        dump_hash(buffer, p->agents, DUMP_AGENT);
+        p = zhash_next(processors);
+    }
+}
+
+typedef struct {
+    const byte *data;
+    const byte *end;
+    bool ok;
+} load_cursor_t;
+
+static inline bool load_bytes(load_cursor_t *c, void *target, size_t size)
+{
+    if (!c->ok || (size_t)(c->end - c->data) < size) {
+        c->ok = false;
+        return false;
+    }
+    memcpy(target, c->data, size);
+    c->data += size;
+    return true;
+}
+
+static inline uint32_t load_u32(load_cursor_t *c)
+{
+    uint32_t n = 0;
+    load_bytes(c, &n, sizeof(n));
+    return n;
+}
+
+static inline uint64_t load_u64(load_cursor_t *c)
+{
+    uint64_t n = 0;
+    load_bytes(c, &n, sizeof(n));
+    return n;
+}
+
+static inline double load_double(load_cursor_t *c)
+{
+    double d = 0;
+    load_bytes(c, &d, sizeof(d));
+    return d;
+}
+
+// returns a newly allocated string
+static char* load_str(load_cursor_t *c)
+{
+    uint32_t len = load_u32(c);
+    if (!c->ok || (size_t)(c->end - c->data) < len) {
+        c->ok = false;
+        return NULL;
+    }
+    char *s = zmalloc(len + 1);
+    memcpy(s, c->data, len);
+    c->data += len;
+    return s;
+}
+
+static increments_t* load_increments_values(load_cursor_t *c)
+{
+    increments_t *increments = increments_new();
+    increments->backend_request_count = load_u64(c);
+    increments->page_request_count = load_u64(c);
+    increments->ajax_request_count = load_u64(c);
+    for (size_t i = 0; i <= last_resource_offset; i++) {
+        metric_pair_t *m = &increments->metrics[i];
+        m->val = load_double(c);
+        m->val_squared = load_double(c);
+        m->val_max = load_double(c);
+    }
+    uint32_t n = load_u32(c);
+    for (uint32_t i = 0; i < n && c->ok; i++) {
+        char *key = load_str(c);
+        uint32_t type = load_u32(c);
+        if (!c->ok)
+            break;
+        json_object *value;
+        if (type == json_type_double)
+            value = json_object_new_double(load_double(c));
+        else
+            value = json_object_new_int64(load_u64(c));
+        json_object_object_add(increments->others, key, value);
+        free(key);
+    }
+    return increments;
+}
+
+static quantile_sketch_t* load_sketch(load_cursor_t *c)
+{
+    quantile_sketch_t *sketch = quantile_sketch_new();
+    int32_t offset = load_u32(c);
+    uint32_t size = load_u32(c);
+    uint64_t count = load_u64(c);
+    if (!c->ok || (size_t)(c->end - c->data) < size * sizeof(uint32_t)) {
+        c->ok = false;
+        return sketch;
+    }
+    if (size > 0) {
+        // allocate the full range up front
+        quantile_sketch_add_count(sketch, offset, 0);
+        quantile_sketch_add_count(sketch, offset + size - 1, 0);
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t n;
+        load_bytes(c, &n, sizeof(n));
+        if (n)
+            quantile_sketch_add_count(sketch, offset + i, n);
+    }
+    if (sketch->count != count)
+        c->ok = false;
+    return sketch;
+}
+
+static void* load_array(load_cursor_t *c, size_t size)
+{
+    void *array = zmalloc(size);
+    load_bytes(c, array, size);
+    return array;
+}
+
+static void load_hash(load_cursor_t *c, zhash_t *hash, dump_kind_t kind)
+{
+    uint32_t n = load_u32(c);
+    for (uint32_t i = 0; i < n && c->ok; i++) {
+        char *key = load_str(c);
+        if (!c->ok)
+            break;
+        void *value = NULL;
+        zhash_free_fn *free_fn = free;
+        switch (kind) {
+        case DUMP_MODULE:
+            value = strdup(key);
+            break;
+        case DUMP_INCREMENTS:
+            value = load_increments_values(c);
+            free_fn = increments_destroy;
+            break;
+        case DUMP_QUANTS:
+            value = load_array(c, QUANTS_ARRAY_SIZE);
+            break;
+        case DUMP_HISTOGRAM:
+            value = load_array(c, HISTOGRAM_SIZE * sizeof(size_t));
+            break;
+        case DUMP_SKETCH:
+            value = load_sketch(c);
+            free_fn = quantile_sketch_destroy;
+            break;
+        case DUMP_AGENT:
+            value = load_array(c, sizeof(user_agent_stats_t));
+            break;
+        }
+        if (zhash_insert(hash, key, value) == 0)
+            zhash_freefn(hash, key, free_fn);
+        else
+            free_fn(value);
+        free(key);
+    }
+}
+
+zhash_t* processor_hash_load(const byte *data, size_t size)
+{
+    load_cursor_t cursor = { .data = data, .end = data + size, .ok = true };
+    load_cursor_t *c = &cursor;
+
+    if (load_u32(c) != PROCESSOR_DUMP_VERSION
+        || load_u32(c) != last_resource_offset + 1
+        || load_u32(c) != HISTOGRAM_SIZE
+        || load_u32(c) != sizeof(user_agent_stats_t)) {
+        fprintf(stderr, "[W] processor: ignored state dumped with a different configuration\n");
+        return NULL;
+    }
+
+    zhash_t *processors = zhash_new();
+    uint32_t n = load_u32(c);
+    for (uint32_t i = 0; i < n && c->ok; i++) {
+        char *db_name = load_str(c);
+        char *stream = load_str(c);
+        if (!c->ok) {
+            free(db_name);
+            break;
+        }
+        stream_info_t *stream_info = get_stream_info(stream, NULL);
+        if (stream_info == NULL)
+            fprintf(stderr, "[W] processor: dropped saved state for unknown stream: %s\n", stream);
+        // an unknown stream still needs to be read to get to the next one
+        processor_state_t *p = processor_new(stream_info, db_name);
+        p->request_count = load_u64(c);
+        load_hash(c, p->modules, DUMP_MODULE);
+        load_hash(c, p->totals, DUMP_INCREMENTS);
+        load_hash(c, p->minutes, DUMP_INCREMENTS);
+        load_hash(c, p->quants, DUMP_QUANTS);
+        load_hash(c, p->histograms, DUMP_HISTOGRAM);
+        load_hash(c, p->sketches, DUMP_SKETCH);
+        load_hash(c, p->minute_sketches, DUMP_SKETCH);
+        load_hash(c, p->agents, DUMP_AGENT);
+        if (stream_info && c->ok) {
+            zhash_insert(processors, db_name, p);
+            zhash_freefn(processors, db_name, processor_destroy);
+        } else
+            processor_destroy(p);
+        free(db_name);
+        free(stream);
+    }
+
+    if (!c->ok || c->data != c->end) {
+        fprintf(stderr, "[E] processor: saved state is corrupt\n");
+        zhash_destroy(&processors);
+    }
+    return processors;
+}
+
+static void test_add_item(zhash_t *hash, const char *key, void *item, zhash_free_fn *free_fn)
+{
+    int rc = zhash_insert(hash, key, item);
+    assert(rc == 0);
+    zhash_freefn(hash, key, free_fn);
+}
+
+static increments_t* test_increments(size_t n)
+{
+    increments_t *increments = increments_new();
+    increments->backend_request_count = n;
+    increments->page_request_count = n + 1;
+    increments->ajax_request_count = n + 2;
+    increments->metrics[total_time_index] = (metric_pair_t){ .val = 10.5 * n, .val_squared = 110.25 * n, .val_max = 10.5 };
+    increments->metrics[last_resource_offset] = (metric_pair_t){ .val = n, .val_squared = n, .val_max = 1 };
+    json_object_object_add(increments->others, "exceptions.RuntimeError", json_object_new_int64(n));
+    json_object_object_add(increments->others, "apdex.score", json_object_new_double(0.25 * n));
+    return increments;
+}
+
+static void test_check_increments(increments_t *increments, size_t n)
+{
+    assert(increments);
+    assert(increments->backend_request_count == n);
+    assert(increments->page_request_count == n + 1);
+    assert(increments->ajax_request_count == n + 2);
+    assert(increments->metrics[total_time_index].val == 10.5 * n);
+    assert(increments->metrics[total_time_index].val_squared == 110.25 * n);
+    assert(increments->metrics[total_time_index].val_max == 10.5);
+    assert(increments->metrics[last_resource_offset].val == n);
+    assert(json_object_object_length(increments->others) == 2);
+    json_object *value;
+    assert(json_object_object_get_ex(increments->others, "exceptions.RuntimeError", &value));
+    assert(json_object_get_type(value) == json_type_int && json_object_get_int64(value) == (int64_t)n);
+    assert(json_object_object_get_ex(increments->others, "apdex.score", &value));
+    assert(json_object_get_type(value) == json_type_double && json_object_get_double(value) == 0.25 * n);
+}
+
+static void test_check_sketch(quantile_sketch_t *loaded, quantile_sketch_t *saved)
+{
+    assert(loaded);
+    assert(loaded->count == saved->count);
+    for (double q = 0; q <= 1; q += 0.25)
+        assert(quantile_sketch_quantile(loaded, q) == quantile_sketch_quantile(saved, q));
+}
+
+void processor_hash_test(int verbose)
+{
+    printf(" * processor-hash: ");
+    if (verbose)
+        printf("\n");
+
+    // resource names point into the config, so it must not be destroyed
+    zconfig_t *config = zconfig_str_load(
+        "metrics\n"
+        "    time\n        total_time\n        db_time\n"
+        "    call\n        db_calls\n"
+        "    memory\n        allocated_objects\n        allocated_bytes\n"
+        "    heap\n        heap_size\n"
+        "    frontend\n        page_time\n        ajax_time\n"
+        "    dom\n        html_nodes\n");
+    assert(config);
+    setup_resource_maps(config);
+
+    // only processors of known streams are loaded
+    char streams_file_name[] = "/tmp/logjam-processor-test-XXXXXX";
+    int fd = mkstemp(streams_file_name);
+    assert(fd != -1);
+    const char *streams = "{\"a-b\":{}}";
+    ssize_t written = write(fd, streams, strlen(streams));
+    assert(written == (ssize_t)strlen(streams));
+    close(fd);
+    // the url is kept by the stream config
+    char *streams_url;
+    int rc = asprintf(&streams_url, "file://%s", streams_file_name);
+    assert(rc != -1);
+    bool ok = setup_stream_config(streams_url, "");
+    assert(ok);
+
+    stream_info_t *stream_info = get_stream_info("a-b", NULL);
+    assert(stream_info);
+    processor_state_t *p = processor_new(stream_info, "logjam-a-b-2026-10-19");
+    p->request_count = 42;
+    test_add_item(p->modules, "::Users", strdup("::Users"), free);
+    test_add_item(p->totals, "all_pages", test_increments(3), increments_destroy);
+    test_add_item(p->totals, "Users#show", test_increments(1), increments_destroy);
+    test_add_item(p->minutes, "42-all_pages", test_increments(2), increments_destroy);
+
+    size_t *quants = zmalloc(QUANTS_ARRAY_SIZE);
+    quants[total_time_index] = 17;
+    quants[last_resource_offset] = 4;
+    test_add_item(p->quants, "t-all_pages-100", quants, free);
+
+    size_t *histogram = zmalloc(HISTOGRAM_SIZE * sizeof(size_t));
+    histogram[0] = 1;
+    histogram[HISTOGRAM_SIZE - 1] = 9;
+    test_add_item(p->histograms, "all_pages-total_time", histogram, free);
+
+    quantile_sketch_t *sketch = quantile_sketch_new();
+    quantile_sketch_add(sketch, 12.5);
+    quantile_sketch_add(sketch, 80);
+    quantile_sketch_add(sketch, 4711);
+    test_add_item(p->sketches, "all_pages-total_time", sketch, quantile_sketch_destroy);
+    quantile_sketch_t *minute_sketch = quantile_sketch_new();
+    quantile_sketch_add(minute_sketch, 0.5);
+    test_add_item(p->minute_sketches, "42-all_pages-total_time", minute_sketch, quantile_sketch_destroy);
+    test_add_item(p->sketches, "Users#show-total_time", quantile_sketch_new(), quantile_sketch_destroy);
+
+    user_agent_stats_t *agent = zmalloc(sizeof(user_agent_stats_t));
+    agent->received_backend = 5;
+    agent->received_frontend = 3;
+    agent->fe_dropped = 1;
+    agent->fe_drop_reasons[FE_MSG_NUM_REASONS - 1] = 1;
+    test_add_item(p->agents, "Mozilla/5.0", agent, free);
+
+    zhash_t *processors = zhash_new();
+    test_add_item(processors, p->db_name, p, processor_destroy);
+
+    zchunk_t *buffer = zchunk_new(NULL, 1024);
+    processor_hash_dump(processors, buffer);
+    const byte *data = zchunk_data(buffer);
+    size_t size = zchunk_size(buffer);
+
+    zhash_t *loaded = processor_hash_load(data, size);
+    assert(loaded);
+    assert(zhash_size(loaded) == 1);
+    processor_state_t *l = zhash_lookup(loaded, "logjam-a-b-2026-10-19");
+    assert(l);
+    assert(l->stream_info == stream_info);
+    assert(streq(l->db_name, p->db_name));
+    assert(l->request_count == 42);
+
+    assert(zhash_size(l->modules) == 1);
+    assert(streq(zhash_lookup(l->modules, "::Users"), "::Users"));
+
+    assert(zhash_size(l->totals) == 2);
+    test_check_increments(zhash_lookup(l->totals, "all_pages"), 3);
+    test_check_increments(zhash_lookup(l->totals, "Users#show"), 1);
+    assert(zhash_size(l->minutes) == 1);
+    test_check_increments(zhash_lookup(l->minutes, "42-all_pages"), 2);
+
+    assert(zhash_size(l->quants) == 1);
+    size_t *loaded_quants = zhash_lookup(l->quants, "t-all_pages-100");
+    assert(loaded_quants && memcmp(loaded_quants, quants, QUANTS_ARRAY_SIZE) == 0);
+
+    assert(zhash_size(l->histograms) == 1);
+    size_t *loaded_histogram = zhash_lookup(l->histograms, "all_pages-total_time");
+    assert(loaded_histogram && memcmp(loaded_histogram, histogram, HISTOGRAM_SIZE * sizeof(size_t)) == 0);
+
+    assert(zhash_size(l->sketches) == 2);
+    test_check_sketch(zhash_lookup(l->sketches, "all_pages-total_time"), sketch);
+    quantile_sketch_t *empty_sketch = zhash_lookup(l->sketches, "Users#show-total_time");
+    assert(empty_sketch && empty_sketch->count == 0);
+    assert(zhash_size(l->minute_sketches) == 1);
+    test_check_sketch(zhash_lookup(l->minute_sketches, "42-all_pages-total_time"), minute_sketch);
+
+    assert(zhash_size(l->agents) == 1);
+    user_agent_stats_t *loaded_agent = zhash_lookup(l->agents, "Mozilla/5.0");
+    assert(loaded_agent && memcmp(loaded_agent, agent, sizeof(user_agent_stats_t)) == 0);
+    zhash_destroy(&loaded);
+
+    // empty hashes round trip, too
+    zhash_t *empty = zhash_new();
+    zchunk_t *empty_buffer = zchunk_new(NULL, 64);
+    processor_hash_dump(empty, empty_buffer);
+    loaded = processor_hash_load(zchunk_data(empty_buffer), zchunk_size(empty_buffer));
+    assert(loaded && zhash_size(loaded) == 0);
+    zhash_destroy(&loaded);
+    zhash_destroy(&empty);
+    zchunk_destroy(&empty_buffer);
+
+    // truncated or extended data is rejected
+    assert(processor_hash_load(data, size - 1) == NULL);
+    assert(processor_hash_load(data, 3) == NULL);
+    byte *extended = zmalloc(size + 1);
+    memcpy(extended, data, size);
+    assert(processor_hash_load(extended, size + 1) == NULL);
+
+    // so is data written with a different resource configuration
+    uint32_t num_resources;
+    memcpy(&num_resources, extended + sizeof(uint32_t), sizeof(num_resources));
+    num_resources++;
+    memcpy(extended + sizeof(uint32_t), &num_resources, sizeof(num_resources));
+    assert(processor_hash_load(extended, size) == NULL);
+    free(extended);
+
+    zchunk_destroy(&buffer);
+    zhash_destroy(&processors);
+    unlink(streams_file_name);
+
+    printf("OK\n");
+}
@@ -3,6 +3,7 @@
 
 #include "importer-parser.h"
 #include "logjam-streaminfo.h"
+#include "importer-cardinality.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,7 +18,10 @@ typedef struct {
     zhash_t *minutes;
     zhash_t *quants;
     zhash_t *histograms;
+    zhash_t *sketches;
+    zhash_t *minute_sketches;
     zhash_t *agents;
+    stream_cardinality_t *cardinality;    // shared by all parsers, owned by the cardinality registry
 } processor_state_t;
 
 extern processor_state_t* processor_new(stream_info_t *stream_info, char *db_name);
@@ -28,9 +32,17 @@ extern void processor_add_event(processor_state_t *self, parser_state_t *pstate,
 extern enum fe_msg_drop_reason processor_add_frontend_data(processor_state_t *self, parser_state_t *pstate, json_object *request, zmsg_t *msg);
 extern enum fe_msg_drop_reason processor_add_ajax_data(processor_state_t *self, parser_state_t *pstate, json_object *request, zmsg_t *msg);
 extern int processor_set_frontend_apdex_attribute(const char *attr);
+extern void processor_add_quants(processor_state_t *self, const char* namespace, increments_t *increments);
 extern void dump_histogram(const char* key, size_t *h);
 extern void dump_histograms(zhash_t* histograms);
 
+// serialize a hash of processors (db_name -> processor_state_t) for checkpoints. loading
+// returns NULL if the data is corrupt or was written with a different resource configuration.
+extern void processor_hash_dump(zhash_t *processors, zchunk_t *buffer);
+extern zhash_t* processor_hash_load(const byte *data, size_t size);
+
+extern void processor_hash_test(int verbose);
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,6 +47,26 @@ static struct prometheus_client_t {
     prometheus::Family<prometheus::Counter> *cpu_seconds_total_family;
     prometheus::Family<prometheus::Gauge> *sequence_number_family;
     std::unordered_map<uint32_t, prometheus::Gauge*> sequence_numbers;
+    prometheus::Family<prometheus::Counter> *clamped_keys_total_family;
+    prometheus::Family<prometheus::Gauge> *queued_inserts_limit_family;
+    prometheus::Gauge *queued_inserts_limit;
+    prometheus::Family<prometheus::Gauge> *insert_spool_msgs_family;
+    prometheus::Gauge *insert_spool_msgs;
+    prometheus::Family<prometheus::Gauge> *insert_spool_bytes_family;
+    prometheus::Gauge *insert_spool_bytes;
+    prometheus::Family<prometheus::Gauge> *insert_spool_age_family;
+    prometheus::Gauge *insert_spool_age;
+    prometheus::Family<prometheus::Counter> *spooled_inserts_total_family;
+    prometheus::Counter *spooled_inserts_total;
+    prometheus::Family<prometheus::Counter> *dropped_inserts_total_family;
+    prometheus::Counter *dropped_inserts_total;
+    prometheus::Family<prometheus::Counter> *live_stream_msgs_total_family;
+    prometheus::Family<prometheus::Gauge> *index_jobs_family;
+    prometheus::Family<prometheus::Counter> *index_jobs_total_family;
+    prometheus::Family<prometheus::Counter> *mongo_ops_total_family;
+    prometheus::Family<prometheus::Counter> *mongo_op_seconds_total_family;
+    prometheus::Family<prometheus::Counter> *mongo_wait_seconds_total_family;
+    prometheus::Family<prometheus::Gauge> *mongo_connections_family;
 } client;
 
 static std::mutex mutex;
@@ -199,12 +219,98 @@ void importer_prometheus_client_init(const char* address, importer_prometheus_cl
         snprintf(name, sizeof(name), "updater%d", i);
         client.cpu_seconds_total_updaters.push_back(&client.cpu_seconds_total_family->Add({{"thread", name}}));
     }
+    // parsers, writers and updaters added at runtime get their counters on first use
+    client.cpu_seconds_total_parsers.resize(MAX_PARSERS, nullptr);
+    client.cpu_seconds_total_writers.resize(MAX_WRITERS, nullptr);
+    client.cpu_seconds_total_updaters.resize(MAX_UPDATERS, nullptr);
 
     client.sequence_number_family = &prometheus::BuildGauge()
         .Name("logjam:msgbus:sequence")
         .Help("Current sequence number for the given logjam device")
         .Register(*client.registry);
 
+    client.clamped_keys_total_family = &prometheus::BuildCounter()
+        .Name("logjam:importer:keys_clamped_total")
+        .Help("How many pages, exceptions, callers or js exceptions were folded into overflow keys for the given stream")
+        .Register(*client.registry);
+
+    client.queued_inserts_limit_family = &prometheus::BuildGauge()
+        .Name("logjam:importer:inserts_queued_limit")
+        .Help("How many database inserts may wait in memory before they are spooled to disk (0 means unlimited)")
+        .Register(*client.registry);
+
+    client.queued_inserts_limit = &client.queued_inserts_limit_family->Add({});
+
+    client.insert_spool_msgs_family = &prometheus::BuildGauge()
+        .Name("logjam:importer:insert_spool_msgs")
+        .Help("How many database inserts are currently waiting in the spool")
+        .Register(*client.registry);
+
+    client.insert_spool_msgs = &client.insert_spool_msgs_family->Add({});
+
+    client.insert_spool_bytes_family = &prometheus::BuildGauge()
+        .Name("logjam:importer:insert_spool_bytes")
+        .Help("How many bytes of database inserts are currently waiting in the spool")
+        .Register(*client.registry);
+
+    client.insert_spool_bytes = &client.insert_spool_bytes_family->Add({});
+
+    client.insert_spool_age_family = &prometheus::BuildGauge()
+        .Name("logjam:importer:insert_spool_age_seconds")
+        .Help("Age of the oldest database insert waiting in the spool")
+        .Register(*client.registry);
+
+    client.insert_spool_age = &client.insert_spool_age_family->Add({});
+
+    client.spooled_inserts_total_family = &prometheus::BuildCounter()
+        .Name("logjam:importer:inserts_spooled_total")
+        .Help("How many database inserts were spooled to disk because too many were queued")
+        .Register(*client.registry);
+
+    client.spooled_inserts_total = &client.spooled_inserts_total_family->Add({});
+
+    client.dropped_inserts_total_family = &prometheus::BuildCounter()
+        .Name("logjam:importer:inserts_dropped_total")
+        .Help("How many database inserts were dropped because neither the queue nor the spool could take them")
+        .Register(*client.registry);
+
+    client.dropped_inserts_total = &client.dropped_inserts_total_family->Add({});
+
+    client.live_stream_msgs_total_family = &prometheus::BuildCounter()
+        .Name("logjam:importer:live_stream_msgs_total")
+        .Help("How many live stream messages were received, conflated, suppressed, published or dropped")
+        .Register(*client.registry);
+
+    client.index_jobs_family = &prometheus::BuildGauge()
+        .Name("logjam:importer:index_jobs")
+        .Help("How many databases for today or tomorrow are waiting for or undergoing index creation")
+        .Register(*client.registry);
+
+    client.index_jobs_total_family = &prometheus::BuildCounter()
+        .Name("logjam:importer:index_jobs_total")
+        .Help("How many databases were created along with their indexes, by result")
+        .Register(*client.registry);
+
+    client.mongo_ops_total_family = &prometheus::BuildCounter()
+        .Name("logjam:importer:mongo_ops_total")
+        .Help("How many operations were performed on pooled database connections, by database")
+        .Register(*client.registry);
+
+    client.mongo_op_seconds_total_family = &prometheus::BuildCounter()
+        .Name("logjam:importer:mongo_op_seconds_total")
+        .Help("How long pooled database connections were in use, by database")
+        .Register(*client.registry);
+
+    client.mongo_wait_seconds_total_family = &prometheus::BuildCounter()
+        .Name("logjam:importer:mongo_wait_seconds_total")
+        .Help("How long threads waited for a pooled database connection, by database")
+        .Register(*client.registry);
+
+    client.mongo_connections_family = &prometheus::BuildGauge()
+        .Name("logjam:importer:mongo_connections")
+        .Help("How many connections are in use, how many threads wait for one and how many requests were deferred, by database")
+        .Register(*client.registry);
+
     // ask the exposer to scrape the registry on incoming scrapes
     client.exposer->RegisterCollectable(client.registry);
 }
@@ -270,6 +376,60 @@ void importer_prometheus_client_gauge_queued_inserts(double value)
     client.queued_inserts->Set(value);
 }
 
+void importer_prometheus_client_gauge_queued_inserts_limit(double value)
+{
+    client.queued_inserts_limit->Set(value);
+}
+
+void importer_prometheus_client_record_insert_spool(double messages, double bytes, double age)
+{
+    client.insert_spool_msgs->Set(messages);
+    client.insert_spool_bytes->Set(bytes);
+    client.insert_spool_age->Set(age);
+}
+
+void importer_prometheus_client_count_inserts_spooled(double value)
+{
+    client.spooled_inserts_total->Increment(value);
+}
+
+void importer_prometheus_client_count_inserts_dropped(double value)
+{
+    client.dropped_inserts_total->Increment(value);
+}
+
+void importer_prometheus_client_count_live_stream_msgs(const char *kind, double value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // Add returns the existing counter for known label values
+    client.live_stream_msgs_total_family->Add({{"kind", kind}}).Increment(value);
+}
+
+void importer_prometheus_client_record_index_jobs(const char *day, double pending, double running)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    client.index_jobs_family->Add({{"day", day}, {"state", "pending"}}).Set(pending);
+    client.index_jobs_family->Add({{"day", day}, {"state", "running"}}).Set(running);
+}
+
+void importer_prometheus_client_count_index_jobs(const char *result, double value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    client.index_jobs_total_family->Add({{"result", result}}).Increment(value);
+}
+
+void importer_prometheus_client_record_mongo_pool(int db, double ops, double op_seconds, double wait_seconds, double in_flight, double waiting, double deferred)
+{
+    std::string database = std::to_string(db);
+    std::lock_guard<std::mutex> lock(mutex);
+    client.mongo_ops_total_family->Add({{"database", database}}).Increment(ops);
+    client.mongo_op_seconds_total_family->Add({{"database", database}}).Increment(op_seconds);
+    client.mongo_wait_seconds_total_family->Add({{"database", database}}).Increment(wait_seconds);
+    client.mongo_connections_family->Add({{"database", database}, {"state", "in_flight"}}).Set(in_flight);
+    client.mongo_connections_family->Add({{"database", database}, {"state", "waiting"}}).Set(waiting);
+    client.mongo_connections_family->Add({{"database", database}, {"state", "deferred"}}).Set(deferred);
+}
+
 void importer_prometheus_client_time_updates(double value)
 {
     client.updates_seconds->Increment(value);
@@ -302,32 +462,49 @@ double get_combined_cpu_usage()
     return total.tv_sec + (double)total.tv_usec/1000000;
 }
 
-void importer_prometheus_client_record_rusage_subscriber(uint i)
+// cpu seconds used by the calling thread up to its last call of record_cpu_usage
+static thread_local double thread_cpu_seconds = 0;
+
+// actors can be retired and replaced by new threads with the same id, so we
+// increment by the usage of the calling thread instead of setting the total
+static
+double record_cpu_usage(std::vector<prometheus::Counter*> &counters, uint i, const char *kind)
 {
     double value = get_combined_cpu_usage();
-    double oldvalue = client.cpu_seconds_total_subscribers[i]->Value();
-    client.cpu_seconds_total_subscribers[i]->Increment(value - oldvalue);
+    double delta = value - thread_cpu_seconds;
+    thread_cpu_seconds = value;
+    if (i >= counters.size())
+        return delta;
+    prometheus::Counter *counter = counters[i];
+    if (counter == nullptr) {
+        // thread has been added at runtime
+        std::lock_guard<std::mutex> lock(mutex);
+        char name[256];
+        snprintf(name, sizeof(name), "%s%d", kind, i);
+        counter = counters[i] = &client.cpu_seconds_total_family->Add({{"thread", name}});
+    }
+    counter->Increment(delta);
+    return delta;
 }
 
-void importer_prometheus_client_record_rusage_parser(uint i)
+double importer_prometheus_client_record_rusage_subscriber(uint i)
 {
-    double value = get_combined_cpu_usage();
-    double oldvalue = client.cpu_seconds_total_parsers[i]->Value();
-    client.cpu_seconds_total_parsers[i]->Increment(value - oldvalue);
+    return record_cpu_usage(client.cpu_seconds_total_subscribers, i, "subscriber");
 }
 
-void importer_prometheus_client_record_rusage_writer(uint i)
+double importer_prometheus_client_record_rusage_parser(uint i)
 {
-    double value = get_combined_cpu_usage();
-    double oldvalue = client.cpu_seconds_total_writers[i]->Value();
-    client.cpu_seconds_total_writers[i]->Increment(value - oldvalue);
+    return record_cpu_usage(client.cpu_seconds_total_parsers, i, "parser");
 }
 
-void importer_prometheus_client_record_rusage_updater(uint i)
+double importer_prometheus_client_record_rusage_writer(uint i)
 {
-    double value = get_combined_cpu_usage();
-    double oldvalue = client.cpu_seconds_total_updaters[i]->Value();
-    client.cpu_seconds_total_updaters[i]->Increment(value - oldvalue);
+    return record_cpu_usage(client.cpu_seconds_total_writers, i, "writer");
+}
+
+double importer_prometheus_client_record_rusage_updater(uint i)
+{
+    return record_cpu_usage(client.cpu_seconds_total_updaters, i, "updater");
 }
 
 // caller must hold lock on stream
@@ -376,3 +553,10 @@ void importer_prometheus_client_record_device_sequence_number(uint32_t id, const
         sequence_number->Set(n);
     }
 }
+
+void importer_prometheus_client_count_clamped_keys(const char *stream, const char *kind, double value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // Add returns the existing counter for known label values
+    client.clamped_keys_total_family->Add({{"stream", stream}, {"kind", kind}}).Increment(value);
+}
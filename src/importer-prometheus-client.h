@@ -30,18 +30,28 @@ extern void importer_prometheus_client_count_updates_blocked(double value);
 extern void importer_prometheus_client_count_inserts_failed(double value);
 extern void importer_prometheus_client_gauge_queued_inserts(double value);
 extern void importer_prometheus_client_gauge_queued_updates(double value);
+extern void importer_prometheus_client_gauge_queued_inserts_limit(double value);
+extern void importer_prometheus_client_record_insert_spool(double messages, double bytes, double age);
+extern void importer_prometheus_client_count_inserts_spooled(double value);
+extern void importer_prometheus_client_count_inserts_dropped(double value);
+extern void importer_prometheus_client_count_live_stream_msgs(const char *kind, double value);
+extern void importer_prometheus_client_record_index_jobs(const char *day, double pending, double running);
+extern void importer_prometheus_client_count_index_jobs(const char *result, double value);
+extern void importer_prometheus_client_record_mongo_pool(int db, double ops, double op_seconds, double wait_seconds, double in_flight, double waiting, double deferred);
 extern void importer_prometheus_client_time_inserts(double value);
 extern void importer_prometheus_client_time_updates(double value);
-extern void importer_prometheus_client_record_rusage_subscriber(uint i);
-extern void importer_prometheus_client_record_rusage_parser(uint i);
-extern void importer_prometheus_client_record_rusage_writer(uint i);
-extern void importer_prometheus_client_record_rusage_updater(uint i);
+// these return the cpu seconds used by the calling thread since its last call
+extern double importer_prometheus_client_record_rusage_subscriber(uint i);
+extern double importer_prometheus_client_record_rusage_parser(uint i);
+extern double importer_prometheus_client_record_rusage_writer(uint i);
+extern double importer_prometheus_client_record_rusage_updater(uint i);
 
 extern void importer_prometheus_client_create_stream_counters(stream_info_t *stream);
 extern void importer_prometheus_client_destroy_stream_counters(stream_info_t *stream);
 extern void importer_prometheus_client_count_inserts_for_stream(stream_info_t *stream, double value);
 extern void importer_prometheus_client_count_throttled_inserts_for_stream(stream_info_t *stream, double value);
 extern void importer_prometheus_client_record_device_sequence_number(uint32_t id, const char *device, uint64_t n);
+extern void importer_prometheus_client_count_clamped_keys(const char *stream, const char *kind, double value);
 
 #ifdef __cplusplus
 }
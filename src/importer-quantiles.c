@@ -0,0 +1,207 @@
+#include "importer-quantiles.h"
+#include <math.h>
+#include <float.h>
+
+// gamma = (1 + alpha) / (1 - alpha), log_gamma = log(gamma) (checked by the test)
+static const double gamma_value = (1 + QUANTILE_SKETCH_ALPHA) / (1 - QUANTILE_SKETCH_ALPHA);
+static const double log_gamma = 0.020000666706669435;
+
+// additional counters allocated when a sketch grows
+#define QUANTILE_SKETCH_SLACK 16
+
+quantile_sketch_t* quantile_sketch_new()
+{
+    return zmalloc(sizeof(quantile_sketch_t));
+}
+
+void quantile_sketch_destroy(void *sketch)
+{
+    quantile_sketch_t *s = sketch;
+    free(s->counts);
+    free(s);
+}
+
+int32_t quantile_sketch_index(double value)
+{
+    // compare before converting, large doubles don't fit into an int32_t
+    double index = ceil(log(value) / log_gamma);
+    if (!(index > QUANTILE_SKETCH_MIN_INDEX))
+        return QUANTILE_SKETCH_MIN_INDEX;
+    if (index > QUANTILE_SKETCH_MAX_INDEX)
+        return QUANTILE_SKETCH_MAX_INDEX;
+    return (int32_t) index;
+}
+
+double quantile_sketch_value(int32_t index)
+{
+    return 2 * pow(gamma_value, index) / (gamma_value + 1);
+}
+
+// makes sure indexes lo..hi can be counted
+static void ensure_range(quantile_sketch_t *sketch, int32_t lo, int32_t hi)
+{
+    if (sketch->size > 0 && lo >= sketch->offset && hi < sketch->offset + (int32_t)sketch->size)
+        return;
+
+    int32_t new_lo = lo, new_hi = hi;
+    if (sketch->size > 0) {
+        int32_t old_hi = sketch->offset + sketch->size - 1;
+        if (new_lo < sketch->offset)
+            new_lo -= QUANTILE_SKETCH_SLACK;
+        else
+            new_lo = sketch->offset;
+        if (new_hi > old_hi)
+            new_hi += QUANTILE_SKETCH_SLACK;
+        else
+            new_hi = old_hi;
+        if (new_lo < QUANTILE_SKETCH_MIN_INDEX)
+            new_lo = QUANTILE_SKETCH_MIN_INDEX;
+        if (new_hi > QUANTILE_SKETCH_MAX_INDEX)
+            new_hi = QUANTILE_SKETCH_MAX_INDEX;
+    }
+    uint32_t new_size = new_hi - new_lo + 1;
+    uint32_t *counts = zmalloc(new_size * sizeof(uint32_t));
+    if (sketch->size > 0) {
+        memcpy(counts + (sketch->offset - new_lo), sketch->counts, sketch->size * sizeof(uint32_t));
+        free(sketch->counts);
+    }
+    sketch->counts = counts;
+    sketch->offset = new_lo;
+    sketch->size = new_size;
+}
+
+void quantile_sketch_add_count(quantile_sketch_t *sketch, int32_t index, uint32_t count)
+{
+    // indexes come from the database, too
+    if (index < QUANTILE_SKETCH_MIN_INDEX)
+        index = QUANTILE_SKETCH_MIN_INDEX;
+    else if (index > QUANTILE_SKETCH_MAX_INDEX)
+        index = QUANTILE_SKETCH_MAX_INDEX;
+    ensure_range(sketch, index, index);
+    sketch->counts[index - sketch->offset] += count;
+    sketch->count += count;
+}
+
+void quantile_sketch_add(quantile_sketch_t *sketch, double value)
+{
+    if (value > 0 && isfinite(value))
+        quantile_sketch_add_count(sketch, quantile_sketch_index(value), 1);
+}
+
+void quantile_sketch_merge(quantile_sketch_t *target, quantile_sketch_t *source)
+{
+    if (source->size == 0)
+        return;
+    ensure_range(target, source->offset, source->offset + source->size - 1);
+    uint32_t *restrict dst = target->counts + (source->offset - target->offset);
+    const uint32_t *restrict src = source->counts;
+    uint32_t n = source->size;
+    // compiles to vector instructions
+    for (uint32_t i = 0; i < n; i++)
+        dst[i] += src[i];
+    target->count += source->count;
+}
+
+double quantile_sketch_quantile(quantile_sketch_t *sketch, double q)
+{
+    if (sketch->count == 0)
+        return 0;
+    uint64_t rank = q * (sketch->count - 1);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < sketch->size; i++) {
+        seen += sketch->counts[i];
+        if (seen > rank)
+            return quantile_sketch_value(sketch->offset + i);
+    }
+    return quantile_sketch_value(sketch->offset + sketch->size - 1);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+void quantile_sketch_test(int verbose)
+{
+    printf(" * quantile-sketch: ");
+    if (verbose)
+        printf("\n");
+
+    assert(fabs(log_gamma - log(gamma_value)) < 1e-15);
+
+    // bucket boundaries
+    for (int32_t i = -100; i < 1000; i += 7) {
+        double v = quantile_sketch_value(i);
+        assert(quantile_sketch_index(v) == i);
+        assert(quantile_sketch_index(pow(gamma_value, i) * 1.0000001) == i + 1);
+    }
+
+    // log normal distributed response times, split over two sketches
+    const size_t n = 20000;
+    double *values = zmalloc(n * sizeof(double));
+    quantile_sketch_t *a = quantile_sketch_new();
+    quantile_sketch_t *b = quantile_sketch_new();
+    srandom(4711);
+    for (size_t i = 0; i < n; i++) {
+        double u1 = (random() + 1.0) / (RAND_MAX + 2.0);
+        double u2 = (random() + 1.0) / (RAND_MAX + 2.0);
+        double z = sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+        values[i] = 80 * exp(z * 1.2);
+        quantile_sketch_add(i % 2 ? a : b, values[i]);
+    }
+    quantile_sketch_add(a, 0);
+    quantile_sketch_merge(a, b);
+    assert(a->count == n);
+    qsort(values, n, sizeof(double), compare_doubles);
+
+    double qs[] = {0, 0.5, 0.9, 0.99, 0.999, 1};
+    for (size_t i = 0; i < sizeof(qs)/sizeof(qs[0]); i++) {
+        double exact = values[(size_t)(qs[i] * (n - 1))];
+        double estimate = quantile_sketch_quantile(a, qs[i]);
+        double error = fabs(estimate - exact) / exact;
+        if (verbose)
+            printf("[D] q%g: exact %.3f, estimate %.3f, error %.4f\n", qs[i], exact, estimate, error);
+        assert(error <= QUANTILE_SKETCH_ALPHA + 1e-9);
+    }
+
+    // merging into an empty sketch copies the source
+    quantile_sketch_t *c = quantile_sketch_new();
+    quantile_sketch_merge(c, a);
+    assert(c->count == a->count);
+    assert(quantile_sketch_quantile(c, 0.5) == quantile_sketch_quantile(a, 0.5));
+
+    quantile_sketch_t empty = {0};
+    assert(quantile_sketch_quantile(&empty, 0.5) == 0);
+
+    // non finite values are ignored
+    quantile_sketch_t *d = quantile_sketch_new();
+    quantile_sketch_add(d, INFINITY);
+    quantile_sketch_add(d, -INFINITY);
+    quantile_sketch_add(d, NAN);
+    assert(d->count == 0);
+    assert(d->size == 0);
+
+    // extreme values end up in the outermost buckets, the sketch stays small
+    quantile_sketch_add(d, 1e-300);
+    quantile_sketch_add(d, 4.9e-324);
+    quantile_sketch_add(d, 1e300);
+    quantile_sketch_add(d, DBL_MAX);
+    quantile_sketch_add_count(d, INT32_MIN, 1);
+    quantile_sketch_add_count(d, INT32_MAX, 1);
+    assert(d->count == 6);
+    assert(d->offset == QUANTILE_SKETCH_MIN_INDEX);
+    assert(d->size == QUANTILE_SKETCH_MAX_INDEX - QUANTILE_SKETCH_MIN_INDEX + 1);
+    assert(d->counts[0] == 3);
+    assert(d->counts[d->size - 1] == 3);
+    assert(quantile_sketch_quantile(d, 0) == quantile_sketch_value(QUANTILE_SKETCH_MIN_INDEX));
+    assert(quantile_sketch_quantile(d, 1) == quantile_sketch_value(QUANTILE_SKETCH_MAX_INDEX));
+    quantile_sketch_destroy(d);
+
+    free(values);
+    quantile_sketch_destroy(a);
+    quantile_sketch_destroy(b);
+    quantile_sketch_destroy(c);
+
+    printf("OK\n");
+}
@@ -0,0 +1,51 @@
+#ifndef __LOGJAM_IMPORTER_QUANTILES_H_INCLUDED__
+#define __LOGJAM_IMPORTER_QUANTILES_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Mergeable quantile sketch with relative accuracy (see DDSketch, Masson et al. 2019).
+// Positive values are counted in logarithmically sized buckets: bucket i holds values in
+// (gamma^(i-1), gamma^i], where gamma = (1 + alpha) / (1 - alpha). Estimating a value by
+// its bucket's midpoint is off by at most alpha (relative). Bucket counts are kept in a
+// dense array covering the smallest range of indexes seen so far, so sketches can be
+// merged by adding up arrays. The sketch is stored in mongo as bucket index -> count.
+// Indexes are clamped to a fixed range, so values below about 0.001 are counted in the
+// lowest bucket and values above about 10^12 in the highest one. This bounds the size of
+// a sketch to a few KB.
+
+#define QUANTILE_SKETCH_ALPHA 0.01
+#define QUANTILE_SKETCH_MIN_INDEX -350
+#define QUANTILE_SKETCH_MAX_INDEX 1400
+
+typedef struct {
+    int32_t offset;         // bucket index of counts[0]
+    uint32_t size;          // number of counters allocated
+    uint64_t count;         // number of values added
+    uint32_t *counts;
+} quantile_sketch_t;
+
+extern quantile_sketch_t* quantile_sketch_new();
+extern void quantile_sketch_destroy(void *sketch);
+
+// values <= 0, infinity and NaN are ignored
+extern void quantile_sketch_add(quantile_sketch_t *sketch, double value);
+extern void quantile_sketch_add_count(quantile_sketch_t *sketch, int32_t index, uint32_t count);
+extern void quantile_sketch_merge(quantile_sketch_t *target, quantile_sketch_t *source);
+
+// returns 0 for empty sketches
+extern double quantile_sketch_quantile(quantile_sketch_t *sketch, double q);
+
+extern int32_t quantile_sketch_index(double value);
+extern double quantile_sketch_value(int32_t index);
+
+extern void quantile_sketch_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,8 @@
 #include "importer-resources.h"
 #include "importer-mongoutils.h"
 #include "importer-prometheus-client.h"
+#include "importer-insertspool.h"
+#include "importer-mongopool.h"
 
 /*
  * connections: n_w = num_writers, n_p = num_parsers, "o" = bind, "[<>v^]" = connect
@@ -22,18 +24,17 @@ typedef struct {
     zconfig_t* config;
     char me[16];
     size_t id;
-    mongoc_client_t* mongo_clients[MAX_DATABASES];
-    zhash_t *request_collections;
-    zhash_t *metrics_collections;
-    zhash_t *jse_collections;
-    zhash_t *events_collections;
+    mongo_connection_t *connection;    // connection to the database of the request being stored
+    zlist_t *deferred[MAX_DATABASES];  // requests waiting for a connection to their database
+    size_t deferred_count;             // total number of deferred requests
     zsock_t *pipe;                 // actor command pipe
     zsock_t *pull_socket;
     zsock_t *live_stream_socket;
     int updates_count;             // updates performend since last tick
     int update_time;               // processing time since last tick (micro seconds)
     int updates_failed;            // how many updates failed
-    zlist_t *sensitive_cookies;    // list of cookies which must be obfuscated
+    bool retiring;                 // parsers have disconnected, terminate once drained
+    cookie_masker_t *cookie_masker; // obfuscates sensitive cookies
     zchunk_t *obfuscation_buffer;  // buffer for cookie obfuscator
 } request_writer_state_t;
 
@@ -53,60 +54,28 @@ static
 mongoc_collection_t* request_writer_get_request_collection(request_writer_state_t* self, const char* db_name, stream_info_t *stream_info)
 {
     if (dryrun) return NULL;
-    mongoc_collection_t *collection = zhash_lookup(self->request_collections, db_name);
-    if (collection == NULL) {
-        // printf("[D] creating requests collection: %s\n", db_name);
-        mongoc_client_t *mongo_client = self->mongo_clients[stream_info->db];
-        collection = mongoc_client_get_collection(mongo_client, db_name, "requests");
-        zhash_insert(self->request_collections, db_name, collection);
-        zhash_freefn(self->request_collections, db_name, (zhash_free_fn*)mongoc_collection_destroy);
-    }
-    return collection;
+    return mongo_connection_get_collection(self->connection, db_name, "requests");
 }
 
 static
 mongoc_collection_t* request_writer_get_metrics_collection(request_writer_state_t* self, const char* db_name, stream_info_t *stream_info)
 {
     if (dryrun) return NULL;
-    mongoc_collection_t *collection = zhash_lookup(self->metrics_collections, db_name);
-    if (collection == NULL) {
-        // printf("[D] creating metrics collection: %s\n", db_name);
-        mongoc_client_t *mongo_client = self->mongo_clients[stream_info->db];
-        collection = mongoc_client_get_collection(mongo_client, db_name, "metrics");
-        zhash_insert(self->metrics_collections, db_name, collection);
-        zhash_freefn(self->metrics_collections, db_name, (zhash_free_fn*)mongoc_collection_destroy);
-    }
-    return collection;
+    return mongo_connection_get_collection(self->connection, db_name, "metrics");
 }
 
 static
 mongoc_collection_t* request_writer_get_jse_collection(request_writer_state_t* self, const char* db_name, stream_info_t *stream_info)
 {
     if (dryrun) return NULL;
-    mongoc_collection_t *collection = zhash_lookup(self->jse_collections, db_name);
-    if (collection == NULL) {
-        // printf("[D] creating jse collection: %s\n", db_name);
-        mongoc_client_t *mongo_client = self->mongo_clients[stream_info->db];
-        collection = mongoc_client_get_collection(mongo_client, db_name, "js_exceptions");
-        zhash_insert(self->jse_collections, db_name, collection);
-        zhash_freefn(self->jse_collections, db_name, (zhash_free_fn*)mongoc_collection_destroy);
-    }
-    return collection;
+    return mongo_connection_get_collection(self->connection, db_name, "js_exceptions");
 }
 
 static
 mongoc_collection_t* request_writer_get_events_collection(request_writer_state_t* self, const char* db_name, stream_info_t *stream_info)
 {
     if (dryrun) return NULL;
-    mongoc_collection_t *collection = zhash_lookup(self->events_collections, db_name);
-    if (collection == NULL) {
-        // printf("[D] creating events collection: %s\n", db_name);
-        mongoc_client_t *mongo_client = self->mongo_clients[stream_info->db];
-        collection = mongoc_client_get_collection(mongo_client, db_name, "events");
-        zhash_insert(self->events_collections, db_name, collection);
-        zhash_freefn(self->events_collections, db_name, (zhash_free_fn*)mongoc_collection_destroy);
-    }
-    return collection;
+    return mongo_connection_get_collection(self->connection, db_name, "events");
 }
 
 // Find first correct UTF8 character position before buf[n], where n is greater than 3.
@@ -136,6 +105,7 @@ size_t find_utf8_offset(const char *buf, size_t n)
 }
 
 #define MAX_STRING_VALUE_SIZE 10000
+#define MAX_DEFERRED_REQUESTS 1000
 
 // limit string values to MAX_STRING_VALUE_SIZE bytes
 static
@@ -388,7 +358,7 @@ json_object* store_request(const char* db_name, stream_info_t* stream_info, json
         size_t n = 1024;
         char context[n];
         snprintf(context, n, "%s:%s", db_name, request_id);
-        filter_sensitive_cookies(request, state->sensitive_cookies, state->obfuscation_buffer);
+        filter_sensitive_cookies(request, state->cookie_masker, state->obfuscation_buffer);
         json_object_to_bson(context, request, document);
     }
 
@@ -644,6 +614,102 @@ void handle_request_msg(zmsg_t* msg, request_writer_state_t* state)
     release_stream_info(stream_info);
 }
 
+static
+void request_writer_store(request_writer_state_t *state, zmsg_t *msg)
+{
+    int64_t start_time_us = zclock_usecs();
+    handle_request_msg(msg, state);
+    zmsg_destroy(&msg);
+    __atomic_sub_fetch(&queued_inserts, 1, __ATOMIC_SEQ_CST);
+    int64_t end_time_us = zclock_usecs();
+    state->updates_count++;
+    state->update_time += end_time_us - start_time_us;
+}
+
+static
+int request_msg_db(zmsg_t *msg)
+{
+    zframe_t *stream_frame = zmsg_first(msg);
+    for (int i=0; i<4; i++)
+        stream_frame = zmsg_next(msg);
+    stream_info_t *stream_info = zframe_getptr(stream_frame);
+    return stream_info->db;
+}
+
+static
+void request_writer_defer(request_writer_state_t *state, int db, zmsg_t *msg)
+{
+    zlist_append(state->deferred[db], msg);
+    state->deferred_count++;
+    mongo_pool_count_deferred(db, 1);
+}
+
+static
+zmsg_t* request_writer_undefer(request_writer_state_t *state, int db)
+{
+    zmsg_t *msg = zlist_pop(state->deferred[db]);
+    if (msg) {
+        state->deferred_count--;
+        mongo_pool_count_deferred(db, -1);
+    }
+    return msg;
+}
+
+// stores deferred requests for the given database as long as connections are available
+static
+void request_writer_work_off_deferred(request_writer_state_t *state, int db)
+{
+    while (zlist_size(state->deferred[db]) > 0) {
+        state->connection = mongo_connection_try_acquire(db);
+        if (state->connection == NULL)
+            return;
+        request_writer_store(state, request_writer_undefer(state, db));
+        mongo_connection_release(&state->connection);
+    }
+}
+
+// Requests for a database which has all its connections in use are deferred, so that
+// a slow database doesn't hold up the inserts for all other databases. Requests for a
+// database with deferred requests are appended to them, to keep them in order. Once
+// MAX_DEFERRED_REQUESTS are waiting for a database, we wait for a connection instead.
+static
+void request_writer_process(request_writer_state_t *state, zmsg_t *msg)
+{
+    if (dryrun) {
+        request_writer_store(state, msg);
+        return;
+    }
+    int db = request_msg_db(msg);
+    request_writer_work_off_deferred(state, db);
+    if (zlist_size(state->deferred[db]) == 0) {
+        state->connection = mongo_connection_try_acquire(db);
+        if (state->connection) {
+            request_writer_store(state, msg);
+            mongo_connection_release(&state->connection);
+            return;
+        }
+    }
+    if (zlist_size(state->deferred[db]) >= MAX_DEFERRED_REQUESTS) {
+        state->connection = mongo_connection_acquire(db);
+        request_writer_store(state, request_writer_undefer(state, db));
+        mongo_connection_release(&state->connection);
+    }
+    request_writer_defer(state, db, msg);
+}
+
+static
+void request_writer_flush_deferred(request_writer_state_t *state)
+{
+    for (int i=0; i<num_databases; i++) {
+        zmsg_t *msg;
+        while ( (msg = request_writer_undefer(state, i)) ) {
+            state->connection = mongo_connection_acquire(i);
+            request_writer_store(state, msg);
+            mongo_connection_release(&state->connection);
+        }
+    }
+}
+
 static
 request_writer_state_t* request_writer_state_new(zconfig_t *config, size_t id)
 {
@@ -654,15 +720,12 @@ request_writer_state_t* request_writer_state_new(zconfig_t *config, size_t id)
     state->pull_socket = request_writer_pull_socket_new(id);
     state->live_stream_socket = live_stream_client_socket_new(config);
     for (int i=0; i<num_databases; i++) {
-        state->mongo_clients[i] = mongoc_client_new(databases[i]);
-        assert(state->mongo_clients[i]);
+        state->deferred[i] = zlist_new();
     }
-    state->request_collections = zhash_new();
-    state->metrics_collections = zhash_new();
-    state->jse_collections = zhash_new();
-    state->events_collections = zhash_new();
     const char* cookies = zconfig_resolve(config, "/frontend/sensitive_cookies", NULL);
-    state->sensitive_cookies = split_delimited_string(cookies);
+    zlist_t *sensitive_cookies = split_delimited_string(cookies);
+    state->cookie_masker = cookie_masker_new(sensitive_cookies);
+    zlist_destroy(&sensitive_cookies);
     state->obfuscation_buffer = zchunk_new(NULL, 1024);
     return state;
 }
@@ -674,14 +737,11 @@ void request_writer_state_destroy(request_writer_state_t **state_p)
     // must not destroy the pipe, as it's owned by the actor
     zsock_destroy(&state->pull_socket);
     zsock_destroy(&state->live_stream_socket);
-    zhash_destroy(&state->request_collections);
-    zhash_destroy(&state->metrics_collections);
-    zhash_destroy(&state->jse_collections);
-    zhash_destroy(&state->events_collections);
-    zlist_destroy(&state->sensitive_cookies);
+    cookie_masker_destroy(&state->cookie_masker);
     zchunk_destroy(&state->obfuscation_buffer);
     for (int i=0; i<num_databases; i++) {
-        mongoc_client_destroy(state->mongo_clients[i]);
+        assert(zlist_size(state->deferred[i]) == 0);
+        zlist_destroy(&state->deferred[i]);
     }
     free(state);
     *state_p = NULL;
@@ -697,7 +757,6 @@ static void request_writer(zsock_t *pipe, void *args)
     if (!quiet)
         printf("[I] writer [%zu]: starting\n", id);
 
-    size_t ticks = 0;
     // signal readyiness after sockets have been created
     zsock_signal(pipe, 0);
 
@@ -706,8 +765,15 @@ static void request_writer(zsock_t *pipe, void *args)
 
     while (!zsys_interrupted) {
         // printf("[D] writer [%zu]: polling\n", id);
-        // we wait for at most one second
-        void *socket = zpoller_wait(poller, 1000);
+        if (state->deferred_count > 0) {
+            for (int i=0; i<num_databases; i++)
+                request_writer_work_off_deferred(state, i);
+        }
+        // we wait for at most one second, unless inserts are waiting in the spool
+        // or for a database connection
+        bool work_off_spool = insert_spool_size() > 0 && !state->retiring;
+        int timeout = work_off_spool ? 0 : state->deferred_count > 0 ? 10 : 1000;
+        void *socket = zpoller_wait(poller, timeout);
         zmsg_t *msg = NULL;
         if (socket == state->pipe) {
             msg = zmsg_recv(state->pipe);
@@ -721,26 +787,18 @@ static void request_writer(zsock_t *pipe, void *args)
                 importer_prometheus_client_time_inserts(((double)state->update_time)/1000000);
                 importer_prometheus_client_count_inserts_failed(state->updates_failed);
                 importer_prometheus_client_record_rusage_writer(state->id);
-                if (ticks++ % PING_INTERVAL == 0) {
-                    // ping mongodb to reestablish connection if it got lost
-                    for (int i=0; i<num_databases; i++) {
-                        mongo_client_ping(state->mongo_clients[i]);
-                    }
-                }
-                // free collection pointers every hour
-                if (ticks % COLLECTION_REFRESH_INTERVAL == COLLECTION_REFRESH_INTERVAL - id - 1) {
-                    printf("[I] writer [%zu]: freeing request collections\n", id);
-                    zhash_destroy(&state->request_collections);
-                    zhash_destroy(&state->jse_collections);
-                    zhash_destroy(&state->events_collections);
-                    state->request_collections = zhash_new();
-                    state->jse_collections = zhash_new();
-                    state->events_collections = zhash_new();
-                }
+                if (state->deferred_count > 0)
+                    printf("[W] writer [%zu]: %zu requests waiting for a database connection\n", id, state->deferred_count);
                 state->updates_count = 0;
                 state->update_time = 0;
                 state->updates_failed = 0;
                 free(cmd);
+            } else if (streq(cmd, "retire")) {
+                // all parsers have disconnected from us, but some requests might still be queued
+                if (!quiet)
+                    printf("[I] writer [%zu]: retiring\n", id);
+                state->retiring = true;
+                free(cmd);
             } else if (streq(cmd, "$TERM")) {
                 // printf("[D] writer [%zu]: received $TERM command\n", id);
                 free(cmd);
@@ -751,19 +809,25 @@ static void request_writer(zsock_t *pipe, void *args)
             }
         } else if (socket == state->pull_socket) {
             msg = zmsg_recv(state->pull_socket);
-            if (msg != NULL) {
-                int64_t start_time_us = zclock_usecs();
-                handle_request_msg(msg, state);
-                zmsg_destroy(&msg);
-                __atomic_sub_fetch(&queued_inserts, 1, __ATOMIC_SEQ_CST);
-                int64_t end_time_us = zclock_usecs();
-                state->updates_count++;
-                state->update_time += end_time_us - start_time_us;
-            }
+            if (msg != NULL)
+                request_writer_process(state, msg);
         } else if (socket) {
             // if socket is not null, something is horribly broken
             printf("[E] writer [%zu]: broken poller. committing suicide.\n", id);
             assert(false);
+        } else if (zpoller_expired(poller) && state->retiring && state->deferred_count == 0) {
+            // nothing arrived for a second: tell the controller it can destroy us
+            importer_prometheus_client_count_inserts(state->updates_count);
+            importer_prometheus_client_time_inserts(((double)state->update_time)/1000000);
+            importer_prometheus_client_count_inserts_failed(state->updates_failed);
+            state->updates_count = 0;
+            state->update_time = 0;
+            state->updates_failed = 0;
+            zstr_send(state->pipe, "drained");
+        } else if (zpoller_expired(poller) && !state->retiring && (msg = insert_spool_shift())) {
+            // nothing else to do: insert the oldest spooled request
+            __atomic_add_fetch(&queued_inserts, 1, __ATOMIC_SEQ_CST);
+            request_writer_process(state, msg);
         }
         else {
             // probably interrupted by signal handler
@@ -774,6 +838,7 @@ static void request_writer(zsock_t *pipe, void *args)
     if (!quiet)
         printf("[I] writer [%zu]: shutting down\n", id);
 
+    request_writer_flush_deferred(state);
     request_writer_state_destroy(&state);
 
     if (!quiet)
@@ -0,0 +1,124 @@
+#include "importer-scaler.h"
+
+void pool_scaler_init(pool_scaler_t *scaler, size_t min, size_t max, double high, double low, size_t interval, size_t cooldown)
+{
+    scaler->min = min > 0 ? min : 1;
+    scaler->max = max > scaler->min ? max : scaler->min;
+    scaler->high = high;
+    scaler->low = low < high ? low : high;
+    scaler->interval = interval > 0 ? interval : 1;
+    scaler->cooldown = cooldown;
+    scaler->load_sum = 0;
+    scaler->samples = 0;
+    scaler->since_change = 0;
+}
+
+static
+int pool_scaler_change(pool_scaler_t *scaler, int change)
+{
+    // loads measured before the change say nothing about the new pool size
+    scaler->load_sum = 0;
+    scaler->samples = 0;
+    scaler->since_change = 0;
+    return change;
+}
+
+int pool_scaler_update(pool_scaler_t *scaler, size_t current, double load)
+{
+    scaler->since_change++;
+
+    // limits might have been changed by a config reload
+    if (current < scaler->min)
+        return pool_scaler_change(scaler, 1);
+    if (current > scaler->max)
+        return pool_scaler_change(scaler, -1);
+
+    scaler->load_sum += load;
+    if (++scaler->samples < scaler->interval)
+        return 0;
+    double average = scaler->load_sum / scaler->samples;
+    scaler->load_sum = 0;
+    scaler->samples = 0;
+
+    if (average > scaler->high && current < scaler->max)
+        return pool_scaler_change(scaler, 1);
+
+    if (average < scaler->low && current > scaler->min && scaler->since_change >= scaler->cooldown
+        && average * current / (current - 1) < scaler->high)
+        return pool_scaler_change(scaler, -1);
+
+    return 0;
+}
+
+void pool_scaler_test(int verbose)
+{
+    printf(" * pool-scaler: ");
+    if (verbose)
+        printf("\n");
+
+    pool_scaler_t scaler;
+    pool_scaler_init(&scaler, 2, 4, 0.8, 0.3, 5, 20);
+
+    // a fixed size pool never changes
+    pool_scaler_t fixed;
+    pool_scaler_init(&fixed, 3, 3, 0.8, 0.3, 5, 20);
+    for (int i = 0; i < 100; i++) {
+        assert(pool_scaler_update(&fixed, 3, 1.0) == 0);
+        assert(pool_scaler_update(&fixed, 3, 0.0) == 0);
+    }
+
+    // high load averaged over the interval grows the pool
+    size_t n = 2;
+    int changes = 0;
+    for (int i = 0; i < 4; i++)
+        assert(pool_scaler_update(&scaler, n, 0.9) == 0);
+    assert(pool_scaler_update(&scaler, n, 0.9) == 1);
+    n++;
+    // a single spike is averaged away
+    for (int i = 0; i < 4; i++)
+        assert(pool_scaler_update(&scaler, n, 0.5) == 0);
+    assert(pool_scaler_update(&scaler, n, 1.5) == 0);
+
+    // the pool doesn't grow beyond its maximum
+    for (int i = 0; i < 50; i++) {
+        int change = pool_scaler_update(&scaler, n, 2.0);
+        assert(change >= 0);
+        n += change;
+        changes += change;
+    }
+    assert(n == 4);
+    assert(changes == 1);
+
+    // low load shrinks the pool only after the cooldown
+    pool_scaler_init(&scaler, 2, 4, 0.8, 0.3, 5, 20);
+    n = 3;
+    int first_shrink = -1;
+    for (int i = 0; i < 100; i++) {
+        int change = pool_scaler_update(&scaler, n, 0.1);
+        assert(change <= 0);
+        if (change < 0 && first_shrink < 0)
+            first_shrink = i;
+        n += change;
+    }
+    if (verbose)
+        printf("[D] first shrink after %d ticks\n", first_shrink);
+    assert(first_shrink == 19);
+    assert(n == 2);
+
+    // don't shrink if the remaining actors would be overloaded
+    pool_scaler_init(&scaler, 1, 4, 0.8, 0.5, 5, 0);
+    for (int i = 0; i < 50; i++)
+        assert(pool_scaler_update(&scaler, 2, 0.45) == 0);
+    int change = 0;
+    for (int i = 0; i < 5; i++)
+        change += pool_scaler_update(&scaler, 2, 0.35);
+    assert(change == -1);
+
+    // limits lowered by a config reload are enforced right away
+    pool_scaler_init(&scaler, 1, 2, 0.8, 0.3, 5, 60);
+    assert(pool_scaler_update(&scaler, 4, 1.0) == -1);
+    pool_scaler_init(&scaler, 3, 4, 0.8, 0.3, 5, 60);
+    assert(pool_scaler_update(&scaler, 2, 0.0) == 1);
+
+    printf("OK\n");
+}
@@ -0,0 +1,41 @@
+#ifndef __LOGJAM_IMPORTER_SCALER_H_INCLUDED__
+#define __LOGJAM_IMPORTER_SCALER_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decides when the controller should add an actor to a pool or retire one. Once per tick
+// the controller reports the load per actor of the pool (cpu seconds per second for
+// parsers, queued messages for writers and updaters). Loads are averaged over `interval`
+// ticks. A pool grows when the average exceeds `high`. It shrinks when the average is
+// below `low` and would stay below `high` with one actor less, but only `cooldown` ticks
+// after the last change, so that short dips don't make the pool flap. Pools never grow
+// beyond `max` or shrink below `min`.
+
+typedef struct {
+    size_t min;
+    size_t max;
+    double high;
+    double low;
+    size_t interval;
+    size_t cooldown;
+    double load_sum;
+    size_t samples;
+    size_t since_change;
+} pool_scaler_t;
+
+extern void pool_scaler_init(pool_scaler_t *scaler, size_t min, size_t max, double high, double low, size_t interval, size_t cooldown);
+
+// returns 1 if an actor should be added, -1 if one should be retired, 0 otherwise
+extern int pool_scaler_update(pool_scaler_t *scaler, size_t current, double load);
+
+extern void pool_scaler_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,8 @@
 #include "importer-mongoutils.h"
 #include "importer-parser.h"
 #include "importer-prometheus-client.h"
+#include "importer-quantiles.h"
+#include "importer-mongopool.h"
 
 /*
  * connections: n_u = NUM_UPDATERS, "o" = bind, "[<>v^]" = connect
@@ -25,23 +27,13 @@
 typedef struct {
     size_t id;
     char me[16];
-    mongoc_client_t *mongo_clients[MAX_DATABASES];
     mongoc_collection_t *global_collection;
-    zhash_t *stats_collections;
     zsock_t *pipe;
     zsock_t *pull_socket;
     int updates_count;     // updates performend since last tick
     int update_time;       // processing time since last tick (micro seconds)
 } stats_updater_state_t;
 
-typedef struct {
-    mongoc_collection_t *totals;
-    mongoc_collection_t *minutes;
-    mongoc_collection_t *quants;
-    mongoc_collection_t *histograms;
-    mongoc_collection_t *agents;
-} stats_collections_t;
-
 typedef struct {
     const char *db_name;
     mongoc_collection_t *collection;
@@ -49,75 +41,6 @@ typedef struct {
 
 typedef int (updater_foreach_fn) (const char *key, void *item, void *argument);
 
-static
-bson_t* increments_to_bson(const char* namespace, increments_t* increments)
-{
-    // dump_increments(namespace, increments);
-
-    bson_t *incs = bson_new();
-    bson_t *maxs = bson_new();
-
-    if (increments->backend_request_count)
-        bson_append_int32(incs, "count", 5, increments->backend_request_count);
-    size_t frontend_request_count = 0;
-    if (increments->page_request_count) {
-        frontend_request_count += increments->page_request_count;
-        bson_append_int32(incs, "page_count", 10, increments->page_request_count);
-    }
-    if (increments->ajax_request_count) {
-        frontend_request_count += increments->ajax_request_count;
-        bson_append_int32(incs, "ajax_count", 10, increments->ajax_request_count);
-    }
-    // store frontend_count for easier retrieval of frontend totals/minutes
-    if (frontend_request_count) {
-        bson_append_int32(incs, "frontend_count", 14, frontend_request_count);
-    }
-
-    bool have_maxs = false;
-    for (size_t i=0; i<=last_resource_offset; i++) {
-        double val = increments->metrics[i].val;
-        if (val > 0) {
-            const char *name = int_to_resource[i];
-            bson_append_double(incs, name, strlen(name), val);
-            const char *name_sq = int_to_resource_sq[i];
-            bson_append_double(incs, name_sq, strlen(name_sq), increments->metrics[i].val_squared);
-            have_maxs = true;
-            const char *name_max = int_to_resource_max[i];
-            bson_append_double(maxs, name_max, strlen(name_max), increments->metrics[i].val_max);
-        }
-    }
-
-    json_object_object_foreach(increments->others, key, value_obj) {
-        size_t n = strlen(key);
-        enum json_type type = json_object_get_type(value_obj);
-        switch (type) {
-        case json_type_int:
-            bson_append_int32(incs, key, n, json_object_get_int(value_obj));
-            break;
-        case json_type_double:
-            bson_append_double(incs, key, n, json_object_get_double(value_obj));
-            break;
-        default:
-            fprintf(stderr, "[E] unsupported json type in json to bson conversion: %s, key: %s\n", json_type_to_name(type), key);
-        }
-    }
-
-    bson_t *document = bson_new();
-    bson_append_document(document, "$inc", 4, incs);
-    if (have_maxs)
-        bson_append_document(document, "$max", 4, maxs);
-
-    // size_t n;
-    // char* bs = bson_as_json(document, &n);
-    // printf("[D] document. size: %zu; value:%s\n", n, bs);
-    // bson_free(bs);
-
-    bson_destroy(incs);
-    bson_destroy(maxs);
-
-    return document;
-}
-
 static
 int minutes_add_increments(const char* namespace, void* data, void* arg)
 {
@@ -335,6 +258,97 @@ int histograms_add_histograms(const char* namespace, void* data, void* arg)
     return 0;
 }
 
+// sketches are stored sparsely as resource.index -> count, so that concurrent updates
+// can be merged by mongo using $inc
+static
+void update_sketch(mongoc_collection_t *collection, const char *db_name, const char *collection_name,
+                   bson_t *selector, const char *resource, quantile_sketch_t *sketch)
+{
+    bson_t *incs = bson_new();
+    for (uint32_t i=0; i < sketch->size; i++) {
+        if (sketch->counts[i] > 0) {
+            char key[256];
+            int keylen = snprintf(key, sizeof(key), "%s.%d", resource, sketch->offset + (int32_t)i);
+            bson_append_int32(incs, key, keylen, sketch->counts[i]);
+        }
+    }
+    bson_t *document = bson_new();
+    bson_append_document(document, "$inc", 4, incs);
+    bson_t *defaults = bson_new();
+    bson_append_double(defaults, "alpha", 5, QUANTILE_SKETCH_ALPHA);
+    bson_append_document(document, "$setOnInsert", 12, defaults);
+
+    if (!dryrun) {
+        bson_error_t error;
+        if (!mongoc_collection_update(collection, MONGOC_UPDATE_UPSERT, selector, document, wc_no_wait, &error)) {
+            size_t n;
+            char* bjs = bson_as_json(document, &n);
+            fprintf(stderr,
+                    "[E] update failed for %s on %s: (%d) %s\n"
+                    "[E] document size: %zu; value: %s\n",
+                    db_name, collection_name, error.code, error.message, n, bjs);
+            bson_free(bjs);
+        }
+    }
+    bson_destroy(incs);
+    bson_destroy(defaults);
+    bson_destroy(document);
+}
+
+static
+int sketches_add_sketch(const char* namespace, void* data, void* arg)
+{
+    collection_update_callback_t *cb = arg;
+
+    // extract keys from namespace: resource_index-page
+    char* p = (char*) namespace;
+    size_t resource_index = 0;
+    while (isdigit(*p)) {
+        resource_index *= 10;
+        resource_index += *(p++) - '0';
+    }
+    p++; // skip '-'
+
+    bson_t *selector = bson_new();
+    bson_append_utf8(selector, "page", 4, p, strlen(p));
+
+    update_sketch(cb->collection, cb->db_name, "sketches", selector, i2r(resource_index), data);
+
+    bson_destroy(selector);
+    return 0;
+}
+
+static
+int minute_sketches_add_sketch(const char* namespace, void* data, void* arg)
+{
+    collection_update_callback_t *cb = arg;
+
+    // extract details from key: minute-resource-page
+    char* p = (char*) namespace;
+    size_t minute = 0;
+    while (isdigit(*p)) {
+        minute *= 10;
+        minute += *(p++) - '0';
+    }
+    p++; // skip '-'
+    char resource[256];
+    char *r = resource;
+    while (*p != '-') {
+        *(r++) = *(p++);
+    }
+    *r = 0;
+    p++; // skip '-'
+
+    bson_t *selector = bson_new();
+    bson_append_utf8(selector, "page", 4, p, strlen(p));
+    bson_append_int32(selector, "minute", 6, minute);
+
+    update_sketch(cb->collection, cb->db_name, "sketch_minutes", selector, resource, data);
+
+    bson_destroy(selector);
+    return 0;
+}
+
 static
 int agents_add_agent(const char* agent, void* data, void* arg)
 {
@@ -405,52 +419,6 @@ int agents_add_agent(const char* agent, void* data, void* arg)
     return 0;
 }
 
-static
-stats_collections_t *stats_collections_new(mongoc_client_t* client, const char* db_name)
-{
-    stats_collections_t *collections = zmalloc(sizeof(stats_collections_t));
-
-    if (dryrun) return collections;
-
-    collections->totals = mongoc_client_get_collection(client, db_name, "totals");
-    collections->minutes = mongoc_client_get_collection(client, db_name, "minutes");
-    collections->quants = mongoc_client_get_collection(client, db_name, "quants");
-    collections->histograms = mongoc_client_get_collection(client, db_name, "heatmaps");
-    collections->agents = mongoc_client_get_collection(client, db_name, "agents");
-
-    return collections;
-}
-
-static
-void destroy_stats_collections(stats_collections_t* collections)
-{
-    if (collections->totals != NULL)
-        mongoc_collection_destroy(collections->totals);
-    if (collections->minutes != NULL)
-        mongoc_collection_destroy(collections->minutes);
-    if (collections->quants != NULL)
-        mongoc_collection_destroy(collections->quants);
-    if (collections->histograms != NULL)
-        mongoc_collection_destroy(collections->histograms);
-    if (collections->agents != NULL)
-        mongoc_collection_destroy(collections->agents);
-    free(collections);
-}
-
-static
-stats_collections_t *stats_updater_get_collections(stats_updater_state_t *self, const char* db_name, stream_info_t *stream_info)
-{
-    stats_collections_t *collections = zhash_lookup(self->stats_collections, db_name);
-    if (collections == NULL) {
-        mongoc_client_t *mongo_client = self->mongo_clients[stream_info->db];
-        collections = stats_collections_new(mongo_client, db_name);
-        assert(collections);
-        zhash_insert(self->stats_collections, db_name, collections);
-        zhash_freefn(self->stats_collections, db_name, (zhash_free_fn*)destroy_stats_collections);
-    }
-    return collections;
-}
-
 static
 stats_updater_state_t* stats_updater_state_new(zconfig_t *config, size_t id)
 {
@@ -464,11 +432,6 @@ stats_updater_state_t* stats_updater_state_new(zconfig_t *config, size_t id)
     int rc = zsock_connect(state->pull_socket, "inproc://stats-updates");
     assert(rc==0);
 
-    for (int i = 0; i<num_databases; i++) {
-        state->mongo_clients[i] = mongoc_client_new(databases[i]);
-        assert(state->mongo_clients[i]);
-    }
-    state->stats_collections = zhash_new();
     return state;
 }
 
@@ -477,10 +440,6 @@ void stats_updater_state_destroy(stats_updater_state_t **state_p)
 {
     stats_updater_state_t *state = *state_p;
     zsock_destroy(&state->pull_socket);
-    zhash_destroy(&state->stats_collections);
-    for (int i = 0; i<num_databases; i++) {
-        mongoc_client_destroy(state->mongo_clients[i]);
-    }
     free(state);
     *state_p = NULL;
 }
@@ -507,7 +466,6 @@ static void stats_updater(zsock_t *pipe, void *args)
     if (!quiet)
         printf("[I] updater[%zu]: starting\n", id);
 
-    size_t ticks = 0;
     // signal readyiness after sockets have been created
     zsock_signal(pipe, 0);
 
@@ -531,18 +489,6 @@ static void stats_updater(zsock_t *pipe, void *args)
                 importer_prometheus_client_count_updates(state->updates_count);
                 importer_prometheus_client_time_updates(((double)state->update_time)/1000000);
                 importer_prometheus_client_record_rusage_updater(state->id);
-
-                // ping the server
-                if (ticks++ % PING_INTERVAL == 0) {
-                    for (int i=0; i<num_databases; i++) {
-                        mongo_client_ping(state->mongo_clients[i]);
-                    }
-                }
-                // refresh database information
-                if (ticks % COLLECTION_REFRESH_INTERVAL == COLLECTION_REFRESH_INTERVAL - id - 1) {
-                    zhash_destroy(&state->stats_collections);
-                    state->stats_collections = zhash_new();
-                }
                 state->updates_count = 0;
                 state->update_time = 0;
                 free(cmd);
@@ -578,37 +524,53 @@ static void stats_updater(zsock_t *pipe, void *args)
 
             stream_info_t *stream_info = zframe_getptr(stream_frame);
 
-            stats_collections_t *collections = stats_updater_get_collections(state, db_name, stream_info);
-            release_stream_info(stream_info);
-
-            collection_update_callback_t cb;
-            cb.db_name = db_name;
+            const char *collection_name = NULL;
+            updater_foreach_fn *fn = NULL;
 
             switch (task_type) {
             case 't':
-                cb.collection = collections->totals;
-                update_collection(updates, totals_add_increments, &cb);
+                collection_name = "totals";
+                fn = totals_add_increments;
                 break;
             case 'm':
-                cb.collection = collections->minutes;
-                update_collection(updates, minutes_add_increments, &cb);
+                collection_name = "minutes";
+                fn = minutes_add_increments;
                 break;
             case 'q':
-                cb.collection = collections->quants;
-                update_collection(updates, quants_add_quants, &cb);
+                collection_name = "quants";
+                fn = quants_add_quants;
                 break;
             case 'h':
-                cb.collection = collections->histograms;
-                update_collection(updates, histograms_add_histograms, &cb);
+                collection_name = "heatmaps";
+                fn = histograms_add_histograms;
+                break;
+            case 's':
+                collection_name = "sketches";
+                fn = sketches_add_sketch;
+                break;
+            case 'S':
+                collection_name = "sketch_minutes";
+                fn = minute_sketches_add_sketch;
                 break;
             case 'a':
-                cb.collection = collections->agents;
-                update_collection(updates, agents_add_agent, &cb);
+                collection_name = "agents";
+                fn = agents_add_agent;
                 break;
             default:
                 fprintf(stderr, "[E] updater[%zu]: unknown task type: %c\n", id, task_type);
                 assert(false);
             }
+
+            // hold a connection to the stream's database only while updating it
+            mongo_connection_t *connection = dryrun ? NULL : mongo_connection_acquire(stream_info->db);
+            release_stream_info(stream_info);
+
+            collection_update_callback_t cb;
+            cb.db_name = db_name;
+            cb.collection = connection ? mongo_connection_get_collection(connection, db_name, collection_name) : NULL;
+            update_collection(updates, fn, &cb);
+            mongo_connection_release(&connection);
+
             zhash_destroy(&updates);
             __atomic_sub_fetch(&queued_updates, 1, __ATOMIC_SEQ_CST);
 
@@ -0,0 +1,17 @@
+#include "importer-common.h"
+
+// globals normally defined in logjam-importer.c, for programs linking libimporter.a
+// without it (benchmarks and the checker). they never bind tcp ports they don't need,
+// so all ports are ephemeral and all pub sockets use inproc.
+int snd_hwm = -1;
+int rcv_hwm = -1;
+int pull_port = 0;
+int router_port = 0;
+int sub_port = 0;
+int replay_port = 0;
+int run_as_device = 1;
+int replay_router_msgs = 0;
+char* live_stream_connection_spec = "inproc://bench-live-stream";
+char* unknown_streams_collector_connection_spec = "inproc://bench-unknown-streams";
+zlist_t *hosts = NULL;
+FILE* frontend_timings = NULL;
@@ -19,14 +19,12 @@
  *                           parser(n_p)
 */
 
-#define MAX_DEVICES 4096
-
 // actor state
 typedef struct {
     size_t id;                                // subscriber id (value < num_subcribers)
     char me[16];                              // thread name
     zsock_t *pipe;                            // actor commands
-    zlist_t *devices;                         // list of devices to connect to (overrides config)
+    zlist_t *devices;                         // devices this subscriber is connected to
     device_tracker_t *tracker;                // tracks sequence numbers, gaps and heartbeats for devices
     zsock_t *sub_socket;                      // incoming data from logjam devices
     zsock_t *push_socket;                     // outgoing data for parsers
@@ -40,10 +38,27 @@ typedef struct {
     size_t message_gap_size;                  // messages missed due to gaps in the stream (since last tick)
     size_t message_drops;                     // messages dropped because push_socket wasn't ready (since last tick)
     size_t message_blocks;                    // how often the subscriber blocked on the push_socket (since last tick)
+    size_t messages_replayed;                 // messages counted before the last restart (since last tick)
     zlist_t *subscriptions;                   // current subscriptions, NULL if socket has not been subscribed before
 } subscriber_state_t;
 
 
+// returns the subset of devices meant for the given subscriber
+static
+zlist_t* subscriber_assigned_devices(zlist_t* devices, size_t id)
+{
+    zlist_t *assigned = zlist_new();
+    zlist_autofree(assigned);
+    char* spec = zlist_first(devices);
+    size_t pos = 0;
+    while (spec) {
+        if (pos++ % num_subscribers == id)
+            zlist_append(assigned, spec);
+        spec = zlist_next(devices);
+    }
+    return assigned;
+}
+
 static
 zsock_t* subscriber_sub_socket_new(zconfig_t* config, zlist_t* devices, size_t id)
 {
@@ -56,22 +71,49 @@ zsock_t* subscriber_sub_socket_new(zconfig_t* config, zlist_t* devices, size_t i
 
     // connect socket to endpoints
     char* spec = zlist_first(devices);
-    size_t pos = 0;
     while (spec) {
-        // only connect to the subset of devices meant for this subscriber
-        if (pos++ % num_subscribers == id) {
-            if (!quiet)
-                printf("[I] subscriber[%zu]: connecting SUB socket to: %s\n", id, spec);
-            int rc = zsock_connect(socket, "%s", spec);
-            log_zmq_error(rc, __FILE__, __LINE__);
-            assert(rc == 0);
-        }
+        if (!quiet)
+            printf("[I] subscriber[%zu]: connecting SUB socket to: %s\n", id, spec);
+        int rc = zsock_connect(socket, "%s", spec);
+        log_zmq_error(rc, __FILE__, __LINE__);
+        assert(rc == 0);
         spec = zlist_next(devices);
     }
 
     return socket;
 }
 
+// applies a changed list of devices from the config file
+static
+void subscriber_update_devices(subscriber_state_t *state, zlist_t *devices)
+{
+    if (state->sub_socket == NULL)
+        return;
+
+    zlist_t *assigned = subscriber_assigned_devices(devices, state->id);
+    zlist_t *added = zlist_added(state->devices, assigned);
+    char *spec = zlist_first(added);
+    while (spec) {
+        printf("[I] subscriber[%zu]: connecting SUB socket to: %s\n", state->id, spec);
+        int rc = zsock_connect(state->sub_socket, "%s", spec);
+        log_zmq_error(rc, __FILE__, __LINE__);
+        spec = zlist_next(added);
+    }
+    zlist_t *deleted = zlist_deleted(state->devices, assigned);
+    spec = zlist_first(deleted);
+    while (spec) {
+        printf("[I] subscriber[%zu]: disconnecting SUB socket from: %s\n", state->id, spec);
+        int rc = zsock_disconnect(state->sub_socket, "%s", spec);
+        log_zmq_error(rc, __FILE__, __LINE__);
+        spec = zlist_next(deleted);
+    }
+    zlist_destroy(&added);
+    zlist_destroy(&deleted);
+    zlist_destroy(&state->devices);
+    state->devices = assigned;
+    device_tracker_set_known_devices(state->tracker, devices);
+}
+
 static
 zsock_t* subscriber_pull_socket_new(zconfig_t* config, size_t id)
 {
@@ -175,6 +217,11 @@ int process_meta_information_and_handle_heartbeat(subscriber_state_t *state, zms
         zframe_t *spec_frame = zmsg_next(msg);
         pub_spec = zframe_strdup(spec_frame);
     }
+    if (!is_heartbeat && device_tracker_message_already_counted(state->tracker, &meta)) {
+        // included in the checkpoint restored at startup. drop it like a heartbeat.
+        state->messages_replayed++;
+        return 1;
+    }
     state->message_gap_size += device_tracker_calculate_gap(state->tracker, &meta, pub_spec);
     return is_heartbeat;
 }
@@ -328,8 +375,14 @@ int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
             importer_prometheus_client_count_msgs_dropped(state->message_drops);
             importer_prometheus_client_count_msgs_blocked(state->message_blocks);
             importer_prometheus_client_record_rusage_subscriber(state->id);
+            if (state->messages_replayed)
+                printf("[I] subscriber[%zu]: dropped %zu messages counted before restart\n", state->id, state->messages_replayed);
+            // sequence numbers are saved in checkpoints
+            device_sequence_t sequences[MAX_DEVICES];
+            size_t n = device_tracker_get_sequence_numbers(state->tracker, sequences, MAX_DEVICES);
             zmsg_t* response = zmsg_new();
             zmsg_addmem(response, &state->message_count, sizeof(state->message_count));
+            zmsg_addmem(response, sequences, n * sizeof(device_sequence_t));
             zmsg_send(&response, socket);
             state->message_count = 0;
             state->message_bytes = 0;
@@ -338,10 +391,31 @@ int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
             state->messages_dev_zero = 0;
             state->message_drops = 0;
             state->message_blocks = 0;
+            state->messages_replayed = 0;
             device_number_recorder_fn *f = (device_number_recorder_fn*)importer_prometheus_client_record_device_sequence_number;
             device_tracker_record_sequence_numbers(state->tracker, f);
             if (++ticks % HEART_BEAT_INTERVAL == 0)
                 device_tracker_reconnect_stale_devices(state->tracker);
+        } else if (streq(cmd, "pause")) {
+            // the controller is retiring a parser, which needs to drain its queue before it
+            // disconnects. messages arriving in the meantime are buffered by the sockets.
+            zsock_signal(socket, 0);
+            char *next = zstr_recv(socket);
+            if (next == NULL || streq(next, "$TERM"))
+                rc = -1;
+            else if (!streq(next, "continue"))
+                fprintf(stderr, "[E] subscriber[%zu]: received unexpected command while paused: %s\n", state->id, next);
+            free(next);
+        } else if (streq(cmd, "devices")) {
+            zlist_t *devices = zlist_new();
+            zlist_autofree(devices);
+            char *spec;
+            while ((spec = zmsg_popstr(msg))) {
+                zlist_append(devices, spec);
+                free(spec);
+            }
+            subscriber_update_devices(state, devices);
+            zlist_destroy(&devices);
         } else {
             fprintf(stderr, "[E] subscriber[%zu]: received unknown actor command: %s\n", state->id, cmd);
         }
@@ -353,17 +427,19 @@ int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
 
 
 static
-subscriber_state_t* subscriber_state_new(zconfig_t* config, size_t id, zlist_t *devices)
+subscriber_state_t* subscriber_state_new(zconfig_t* config, size_t id, zlist_t *devices, device_sequence_t *resume_sequences, size_t num_resume_sequences)
 {
     //create the state
     subscriber_state_t *state = zmalloc(sizeof(*state));
     state->id = id;
     snprintf(state->me, 16, "subscriber[%zu]", id);
-    state->devices = devices;
+    state->devices = subscriber_assigned_devices(devices, id);
     if (zlist_size(devices) > 0) {
         state->sub_socket = subscriber_sub_socket_new(config, state->devices, state->id);
     }
     state->tracker = device_tracker_new(devices, state->sub_socket);
+    // before the first message has been received
+    device_tracker_resume(state->tracker, resume_sequences, num_resume_sequences);
     if (state->id == 0 && run_as_device) {
         state->pull_socket = subscriber_pull_socket_new(config, id);
         state->router_socket = subscriber_router_socket_new(config, id);
@@ -384,6 +460,7 @@ void subscriber_state_destroy(subscriber_state_t **state_p)
     zsock_destroy(&state->replay_socket);
     zsock_destroy(&state->push_socket);
     device_tracker_destroy(&state->tracker);
+    zlist_destroy(&state->devices);
     *state_p = NULL;
 }
 
@@ -516,9 +593,9 @@ int timer_function(zloop_t *loop, int timer_id, void* arg)
         fprintf(stdout, "[I] subscriber[%zu]: terminated\n", id);
 }
 
-zactor_t* subscriber_new(zconfig_t *config, size_t id)
+zactor_t* subscriber_new(zconfig_t *config, size_t id, device_sequence_t *resume_sequences, size_t num_resume_sequences)
 {
-    subscriber_state_t *state = subscriber_state_new(config, id, hosts);
+    subscriber_state_t *state = subscriber_state_new(config, id, hosts, resume_sequences, num_resume_sequences);
     return zactor_new(subscriber, state);
 }
 
@@ -2,12 +2,15 @@
 #define __LOGJAM_IMPORTER_SUBSCRIBER_H_INCLUDED__
 
 #include "importer-common.h"
+#include "device-tracker.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern zactor_t* subscriber_new(zconfig_t *config, size_t id);
+// messages with sequence numbers up to the given ones are considered to be counted
+// already (see device_tracker_resume)
+extern zactor_t* subscriber_new(zconfig_t *config, size_t id, device_sequence_t *resume_sequences, size_t num_resume_sequences);
 extern void subscriber_destroy(zactor_t **subscriber_p);
 
 #ifdef __cplusplus
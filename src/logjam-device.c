@@ -11,6 +11,8 @@
 #include "message-compressor.h"
 #include "importer-watchdog.h"
 #include "device-prometheus-client.h"
+#include "device-admission.h"
+#include "device-heavy-hitters.h"
 #ifdef HAVE_MALLOC_TRIM
 #include <malloc.h>
 #endif
@@ -36,11 +38,6 @@ static int pub_port = 9606;
 static int stats_port = 9621;
 
 static size_t received_messages_count = 0;
-static size_t received_messages_bytes = 0;
-static size_t received_messages_max_bytes = 0;
-static size_t ping_count_total = 0;
-static size_t invalid_messages_count_total = 0;
-static size_t broken_meta_count_total = 0;
 
 static size_t compressed_messages_count = 0;
 static size_t compressed_messages_bytes = 0;
@@ -49,6 +46,24 @@ static size_t compressed_messages_max_bytes = 0;
 static size_t io_threads = 1;
 static size_t num_compressors = 4;
 
+#define MAX_INTAKE_THREADS 32
+#define DEFAULT_INTAKE_PORT_STEP 100
+static size_t num_intake_threads = 0;
+static int intake_port_step = DEFAULT_INTAKE_PORT_STEP;
+static zactor_t *intake_threads[MAX_INTAKE_THREADS];
+
+// per app-env admission control, disabled if the rate is 0
+static double app_env_rate = 0;
+static double app_env_burst = 0;
+static const char *priority_classes = DEFAULT_PRIORITY_CLASSES;
+
+// streams and producers sending the most messages, per tick
+#define HEAVY_HITTERS_CAPACITY 256
+#define HEAVY_HITTERS_REPORTED 10
+static heavy_hitters_t *top_streams = NULL;
+static heavy_hitters_t *top_producers = NULL;
+static int query_port = 0;
+
 static bool allow_invalid_meta = false;
 
 static msg_meta_t msg_meta = META_INFO_EMPTY;
@@ -71,8 +86,6 @@ typedef struct {
     int64_t last_seen;
 } app_env_record_t;
 
-static zhashx_t *routing_id_to_app_env= NULL;
-
 static void free_app_env_record(void *self)
 {
     app_env_record_t *r = self;
@@ -80,7 +93,7 @@ static void free_app_env_record(void *self)
     free(r);
 }
 
-static void clean_old_routing_id_entries(int64_t max_age)
+static void clean_old_routing_id_entries(zhashx_t *routing_id_to_app_env, int64_t max_age)
 {
     zlist_t *deletions = zlist_new();
     int64_t threshold = zclock_time() - max_age;
@@ -100,10 +113,14 @@ static void clean_old_routing_id_entries(int64_t max_age)
     zlist_destroy(&deletions);
 }
 
+// routing ids and per stream counters are forgotten after an hour (a minute when debugging)
+static int64_t stream_info_max_age()
+{
+    return 1000 * (debug ? 60 : 60 * 60);
+}
+
 typedef struct {
     // raw zmq sockets, to avoid zsock_resolve
-    void *receiver;
-    void *router_receiver;
     void *router_output;
     void *publisher;
     void *stats_socket;
@@ -111,25 +128,170 @@ typedef struct {
     void *compressor_output;
 } publisher_state_t;
 
+// counters of a thread receiving messages from producers, reset on every tick
+typedef struct {
+    size_t received_count;
+    size_t received_bytes;
+    size_t received_max_bytes;
+    size_t ping_count;
+    size_t invalid_count;
+    size_t broken_meta_count;
+    size_t shed_count;
+} intake_counters_t;
+
+// Messages from producers are received by the main thread, or, when running with
+// --intake-threads N, by N intake threads. Each intake thread binds its own ROUTER and
+// PULL socket to sibling ports (the configured ports plus a multiple of the port step),
+// validates messages, answers requests and pings, and keeps its own map of routing ids
+// to streams. Valid messages are handed to the main thread through an inproc socket,
+// which doesn't copy message bodies. The main thread is the only one assigning sequence
+// numbers and publishing, so the numbering of the device's messages has no gaps.
+typedef struct {
+    size_t id;
+    char me[16];
+    int router_port;
+    int pull_port;
+    zsock_t *receiver;                  // PULL socket for producers
+    zsock_t *router_receiver;           // ROUTER socket for producers
+    zsock_t *output;                    // PUSH socket to the main thread (intake threads only)
+    publisher_state_t *publisher;       // publishing state (main thread only)
+    zhashx_t *routing_id_to_app_env;
+    device_admission_t *admission;      // NULL if admission control is disabled
+    heavy_hitters_t *streams;           // message counts by app-env and topic
+    heavy_hitters_t *producers;         // message counts by app-env and routing id
+    intake_counters_t counters;
+    size_t ticks;
+} intake_state_t;
+
+// returns NULL if admission control is disabled or the priority classes are invalid
+static device_admission_t* admission_new()
+{
+    if (app_env_rate <= 0)
+        return NULL;
+    double burst = app_env_burst > 0 ? app_env_burst : app_env_rate;
+    return device_admission_new(app_env_rate, burst, priority_classes, device_prometheus_client_count_shed_msgs_for_stream);
+}
+
+static void flush_admission_state(intake_state_t *state)
+{
+    if (state->admission)
+        state->counters.shed_count = device_admission_flush(state->admission, zclock_mono(), stream_info_max_age());
+}
+
+// adds up and resets the counters of the main thread and all intake threads and merges
+// their heavy hitter sketches into top_streams and top_producers
+static void collect_intake_counters(intake_state_t *state, intake_counters_t *totals)
+{
+    flush_admission_state(state);
+    *totals = state->counters;
+    memset(&state->counters, 0, sizeof(state->counters));
+
+    heavy_hitters_reset(top_streams);
+    heavy_hitters_reset(top_producers);
+    heavy_hitters_merge(top_streams, state->streams);
+    heavy_hitters_merge(top_producers, state->producers);
+    heavy_hitters_reset(state->streams);
+    heavy_hitters_reset(state->producers);
+
+    for (size_t i = 0; i < num_intake_threads; i++)
+        zstr_send(intake_threads[i], "tick");
+
+    for (size_t i = 0; i < num_intake_threads; i++) {
+        zmsg_t *response = zmsg_recv(intake_threads[i]);
+        if (!response)
+            continue;
+        zframe_t *frame = zmsg_first(response);
+        if (frame && zframe_size(frame) == sizeof(intake_counters_t)) {
+            intake_counters_t *c = (intake_counters_t*) zframe_data(frame);
+            totals->received_count += c->received_count;
+            totals->received_bytes += c->received_bytes;
+            if (c->received_max_bytes > totals->received_max_bytes)
+                totals->received_max_bytes = c->received_max_bytes;
+            totals->ping_count += c->ping_count;
+            totals->invalid_count += c->invalid_count;
+            totals->broken_meta_count += c->broken_meta_count;
+            totals->shed_count += c->shed_count;
+        }
+        // intake threads hand over their sketches and start new ones
+        for (int j = 0; j < 2; j++) {
+            frame = zmsg_next(response);
+            if (frame && zframe_size(frame) == sizeof(heavy_hitters_t*)) {
+                heavy_hitters_t *hh;
+                memcpy(&hh, zframe_data(frame), sizeof(hh));
+                heavy_hitters_merge(j == 0 ? top_streams : top_producers, hh);
+                heavy_hitters_destroy(&hh);
+            }
+        }
+        zmsg_destroy(&response);
+    }
+}
+
+// keys are "app-env topic" or "app-env routing-id"
+static json_object* heavy_hitters_to_json(heavy_hitters_t *hh, const char *key_name, size_t n)
+{
+    heavy_hitter_t top[n];
+    n = heavy_hitters_top(hh, top, n);
+    json_object *entries = json_object_new_array();
+    for (size_t i = 0; i < n; i++) {
+        json_object *entry = json_object_new_object();
+        const char *space = strchr(top[i].key, ' ');
+        int stream_len = space ? space - top[i].key : (int)strlen(top[i].key);
+        json_object_object_add(entry, "stream", json_object_new_string_len(top[i].key, stream_len));
+        json_object_object_add(entry, key_name, json_object_new_string(space ? space + 1 : ""));
+        json_object_object_add(entry, "count", json_object_new_int64(top[i].count));
+        json_object_object_add(entry, "error", json_object_new_int64(top[i].error));
+        json_object_object_add(entry, "bytes", json_object_new_int64(top[i].bytes));
+        json_object_array_add(entries, entry);
+    }
+    return entries;
+}
+
+// returns a JSON report on the top n streams and producers of the last tick. caller must free.
+static char* heavy_hitters_report(size_t n)
+{
+    json_object *report = json_object_new_object();
+    json_object_object_add(report, "device", json_object_new_int(msg_meta.device_number));
+    json_object_object_add(report, "count", json_object_new_int64(heavy_hitters_total_count(top_streams)));
+    json_object_object_add(report, "bytes", json_object_new_int64(heavy_hitters_total_bytes(top_streams)));
+    json_object_object_add(report, "streams", heavy_hitters_to_json(top_streams, "topic", n));
+    json_object_object_add(report, "producers", heavy_hitters_to_json(top_producers, "routing_id", n));
+    char *result = strdup(json_object_to_json_string_ext(report, JSON_C_TO_STRING_PLAIN));
+    json_object_put(report);
+    return result;
+}
+
+static void export_heavy_hitters()
+{
+    heavy_hitter_t top[HEAVY_HITTERS_REPORTED];
+    size_t n = heavy_hitters_top(top_streams, top, HEAVY_HITTERS_REPORTED);
+    device_prometheus_client_set_top_streams(top, n);
+    if (verbose && n > 0)
+        printf("[I] top stream: %s (%zu messages, %zu KB)\n", top[0].key, top[0].count, top[0].bytes/1024);
+    n = heavy_hitters_top(top_producers, top, HEAVY_HITTERS_REPORTED);
+    device_prometheus_client_set_top_producers(top, n);
+}
+
 static int timer_event(zloop_t *loop, int timer_id, void *arg)
 {
-    publisher_state_t* state = arg;
+    intake_state_t *intake = arg;
+    publisher_state_t* state = intake->publisher;
 
-    static size_t last_received_count   = 0;
-    static size_t last_received_bytes   = 0;
     static size_t last_compressed_count = 0;
     static size_t last_compressed_bytes = 0;
-    static size_t last_ping_count = 0;
-    static size_t last_invalid_count = 0;
-    static size_t last_broken_meta_count = 0;
 
-    size_t message_count     = received_messages_count - last_received_count;
-    size_t message_bytes     = received_messages_bytes - last_received_bytes;
+    intake_counters_t counters;
+    collect_intake_counters(intake, &counters);
+    received_messages_count += counters.received_count;
+    export_heavy_hitters();
+
+    size_t message_count     = counters.received_count;
+    size_t message_bytes     = counters.received_bytes;
     size_t compressed_count  = compressed_messages_count - last_compressed_count;
     size_t compressed_bytes  = compressed_messages_bytes - last_compressed_bytes;
-    size_t ping_count        = ping_count_total - last_ping_count;
-    size_t invalid_count     = invalid_messages_count_total - last_invalid_count;
-    size_t broken_meta_count = broken_meta_count_total - last_broken_meta_count;
+    size_t ping_count        = counters.ping_count;
+    size_t invalid_count     = counters.invalid_count;
+    size_t broken_meta_count = counters.broken_meta_count;
+    size_t shed_count        = counters.shed_count;
 
     device_prometheus_client_count_msgs_received(message_count);
     device_prometheus_client_count_bytes_received(message_bytes);
@@ -138,12 +300,13 @@ static int timer_event(zloop_t *loop, int timer_id, void *arg)
     device_prometheus_client_count_pings(ping_count);
     device_prometheus_client_count_invalid_messages(invalid_count);
     device_prometheus_client_count_broken_metas(broken_meta_count);
+    device_prometheus_client_count_shed_msgs(shed_count);
     device_prometheus_client_record_rusage();
     device_prometheus_client_set_sequence_number(msg_meta.sequence_number);
-    device_prometheus_client_set_msg_max_bytes(received_messages_max_bytes);
+    device_prometheus_client_set_msg_max_bytes(counters.received_max_bytes);
 
     double avg_msg_size        = message_count ? (message_bytes / 1024.0) / message_count : 0;
-    double max_msg_size        = received_messages_max_bytes / 1024.0;
+    double max_msg_size        = counters.received_max_bytes / 1024.0;
     double avg_compressed_size = compressed_count ? (compressed_bytes / 1024.0) / compressed_count : 0;
     double max_compressed_size = compressed_messages_max_bytes / 1024.0;
 
@@ -154,19 +317,13 @@ static int timer_event(zloop_t *loop, int timer_id, void *arg)
         printf("[I] compressd %zu messages (%.2f KB), avg: %.2f KB, max: %.2f KB\n",
                compressed_count, compressed_bytes/1024.0, avg_compressed_size, max_compressed_size);
 
-        printf("[I] pings: %zu, invalid msgs: %zu, broken metas: %zu\n",
-               ping_count, invalid_count, broken_meta_count);
+        printf("[I] pings: %zu, invalid msgs: %zu, broken metas: %zu, shed msgs: %zu\n",
+               ping_count, invalid_count, broken_meta_count, shed_count);
     }
 
-    last_received_count = received_messages_count;
-    last_ping_count = ping_count_total;
-    last_received_bytes = received_messages_bytes;
-    received_messages_max_bytes = 0;
     last_compressed_count = compressed_messages_count;
     last_compressed_bytes = compressed_messages_bytes;
     compressed_messages_max_bytes = 0;
-    last_invalid_count = invalid_messages_count_total;
-    last_broken_meta_count = broken_meta_count_total;
 
     // update timestamp
     global_time = zclock_time();
@@ -190,6 +347,14 @@ static int timer_event(zloop_t *loop, int timer_id, void *arg)
         zmsg_addstr(msg, device_number_s);
         zmsg_addstrf(msg, "%" PRIu64,  msg_meta.sequence_number);
         zmsg_send_with_retry(&msg, state->stats_socket);
+
+        char *report = heavy_hitters_report(HEAVY_HITTERS_REPORTED);
+        msg = zmsg_new();
+        zmsg_addstr(msg, "heavy-hitters");
+        zmsg_addstr(msg, device_number_s);
+        zmsg_addstr(msg, report);
+        zmsg_send_with_retry(&msg, state->stats_socket);
+        free(report);
     }
 
     // tick compressors
@@ -201,11 +366,12 @@ static int timer_event(zloop_t *loop, int timer_id, void *arg)
 
     // delete old ping counters and broken meta counters, once per minute.
     if (ticks % 60 == 0) {
-        int64_t max_age = 1000 * (debug ? 60 : 60 * 60);
         // max age is given in milliseconds.
-        clean_old_routing_id_entries(max_age);
+        int64_t max_age = stream_info_max_age();
+        clean_old_routing_id_entries(intake->routing_id_to_app_env, max_age);
         device_prometheus_client_delete_old_ping_counters(max_age);
         device_prometheus_client_delete_old_broken_meta_counters(max_age);
+        device_prometheus_client_delete_old_shed_counters(max_age);
     }
 
 #ifdef HAVE_MALLOC_TRIM
@@ -273,19 +439,26 @@ static bool warn_msg_size(zmq_msg_t *parts, int n, int min, int max)
     return false;
 }
 
-static void update_message_stats(void* socket, publisher_state_t *state, zmq_msg_t* body)
+// the main thread reads compressed messages with the same handler as producer messages
+static inline bool from_compressor(intake_state_t *state, void *socket)
+{
+    return state->publisher && socket == state->publisher->compressor_output;
+}
+
+static void update_message_stats(void* socket, intake_state_t *state, zmq_msg_t* body)
 {
     size_t msg_bytes = zmq_msg_size(body);
-    if (socket == state->compressor_output) {
+    if (from_compressor(state, socket)) {
         compressed_messages_count++;
         compressed_messages_bytes += msg_bytes;
         if (msg_bytes > compressed_messages_max_bytes)
             compressed_messages_max_bytes = msg_bytes;
     } else {
-        received_messages_count++;
-        received_messages_bytes += msg_bytes;
-        if (msg_bytes > received_messages_max_bytes)
-            received_messages_max_bytes = msg_bytes;
+        intake_counters_t *counters = &state->counters;
+        counters->received_count++;
+        counters->received_bytes += msg_bytes;
+        if (msg_bytes > counters->received_max_bytes)
+            counters->received_max_bytes = msg_bytes;
     }
 }
 
@@ -307,6 +480,56 @@ static void compress_or_forward(zmq_msg_t* parts,  msg_meta_t *meta, publisher_s
     }
 }
 
+static void forward_message(zmq_msg_t* parts, msg_meta_t *meta, intake_state_t *state)
+{
+    if (state->output)
+        // sequence numbers are assigned by the main thread
+        publish_on_zmq_transport(&parts[0], zsock_resolve(state->output), meta, 0);
+    else
+        compress_or_forward(parts, meta, state->publisher);
+}
+
+static bool admit_message(intake_state_t *state, void *socket, zmq_msg_t *app_env, zmq_msg_t *topic)
+{
+    if (state->admission == NULL)
+        return true;
+    // messages coming back from the compressors have been admitted already
+    if (from_compressor(state, socket))
+        return true;
+    return device_admission_check(state->admission, zmq_msg_data(app_env), zmq_msg_size(app_env),
+                                  zmq_msg_data(topic), zmq_msg_size(topic), zclock_mono());
+}
+
+// counts a received message by "app-env topic" and, if it was sent to the router socket,
+// by "app-env routing-id"
+static void record_heavy_hitters(intake_state_t *state, zmq_msg_t *app_env, zmq_msg_t *topic, zmq_msg_t *routing_id, size_t bytes)
+{
+    char key[HEAVY_HITTER_KEY_SIZE];
+    size_t app_env_len = zmq_msg_size(app_env);
+    if (app_env_len > HEAVY_HITTER_KEY_SIZE / 2)
+        app_env_len = HEAVY_HITTER_KEY_SIZE / 2;
+    memcpy(key, zmq_msg_data(app_env), app_env_len);
+    key[app_env_len] = ' ';
+    size_t prefix_len = app_env_len + 1;
+    size_t available = HEAVY_HITTER_KEY_SIZE - 1 - prefix_len;
+
+    size_t topic_len = zmq_msg_size(topic);
+    if (topic_len > available)
+        topic_len = available;
+    memcpy(key + prefix_len, zmq_msg_data(topic), topic_len);
+    heavy_hitters_add(state->streams, key, prefix_len + topic_len, bytes);
+
+    if (routing_id) {
+        size_t id_len = zmq_msg_size(routing_id);
+        if (2 * id_len > available)
+            id_len = available / 2;
+        unsigned char* data = zmq_msg_data(routing_id);
+        for (size_t i = 0; i < id_len; i++)
+            sprintf(&key[prefix_len + 2*i], "%02X", data[i]);
+        heavy_hitters_add(state->producers, key, prefix_len + 2 * id_len, bytes);
+    }
+}
+
 static void record_broken_meta(zmq_msg_t *stream_part)
 {
     int n = zmq_msg_size(stream_part);
@@ -320,7 +543,7 @@ static void record_broken_meta(zmq_msg_t *stream_part)
 static int read_zmq_message_and_forward(zloop_t *loop, zsock_t *sock, void *callback_data)
 {
     zmq_msg_t message_parts[10];
-    publisher_state_t *state = (publisher_state_t*)callback_data;
+    intake_state_t *state = (intake_state_t*)callback_data;
     void *socket = zsock_resolve(sock);
 
     int n;
@@ -333,15 +556,15 @@ static int read_zmq_message_and_forward(zloop_t *loop, zsock_t *sock, void *call
     // The old pull socket interface did not require meta information to be sent and there
     // might be some old clients left. Otherwise we'd demand 4 parts here.
     if (warn_msg_size(message_parts, n, 3, 4)) {
-        invalid_messages_count_total++;
+        state->counters.invalid_count++;
         goto cleanup;
     }
 
     msg_meta_t meta = META_INFO_EMPTY;
     if (n==4) {
         if (!zmq_msg_extract_meta_info(&message_parts[3], &meta)) {
-            invalid_messages_count_total++;
-            broken_meta_count_total++;
+            state->counters.invalid_count++;
+            state->counters.broken_meta_count++;
             record_broken_meta(&message_parts[0]);
             if (verbose) {
                 fprintf(stderr, "[W] meta info could not be decoded: %d\n", n);
@@ -354,7 +577,7 @@ static int read_zmq_message_and_forward(zloop_t *loop, zsock_t *sock, void *call
 
     zmq_msg_t *app_env = &message_parts[0];
     if (!well_formed_stream_name(zmq_msg_data(app_env), zmq_msg_size(app_env))) {
-        invalid_messages_count_total++;
+        state->counters.invalid_count++;
         fprintf(stderr, "[E] malformed stream name\n");
         my_zmq_msg_fprint(message_parts, n, "[E] MSG", stderr);
         goto cleanup;
@@ -362,14 +585,17 @@ static int read_zmq_message_and_forward(zloop_t *loop, zsock_t *sock, void *call
 
     zmq_msg_t *topic = &message_parts[1];
     if (!well_formed_topic(zmq_msg_data(topic), zmq_msg_size(topic))) {
-        invalid_messages_count_total++;
+        state->counters.invalid_count++;
         fprintf(stderr, "[E] malformed routing key\n");
         my_zmq_msg_fprint(message_parts, n, "[E] MSG", stderr);
         goto cleanup;
     }
 
     update_message_stats(socket, state, &message_parts[2]);
-    compress_or_forward(message_parts, &meta, state);
+    if (!from_compressor(state, socket))
+        record_heavy_hitters(state, app_env, topic, NULL, zmq_msg_size(&message_parts[2]));
+    if (admit_message(state, socket, app_env, topic))
+        forward_message(message_parts, &meta, state);
 
  cleanup:
     for (int i=n-1; i>=0; i--)
@@ -378,8 +604,9 @@ static int read_zmq_message_and_forward(zloop_t *loop, zsock_t *sock, void *call
     return 0;
 }
 
-static void record_routing_id_and_app_env(zmq_msg_t *sender_id, const char *stream, int m)
+static void record_routing_id_and_app_env(intake_state_t *state, zmq_msg_t *sender_id, const char *stream, int m)
 {
+    zhashx_t *routing_id_to_app_env = state->routing_id_to_app_env;
     int n = zmq_msg_size(sender_id);
     char routing_id[2*n+1];
     unsigned char* data = zmq_msg_data(sender_id);
@@ -402,7 +629,7 @@ static void record_routing_id_and_app_env(zmq_msg_t *sender_id, const char *stre
     }
 }
 
-static void record_ping(zmq_msg_t *sender_id, const char *routing_key, int routing_key_len)
+static void record_ping(intake_state_t *state, zmq_msg_t *sender_id, const char *routing_key, int routing_key_len)
 {
     if (routing_key_len > 0) {
         // application sent app-env as the routing key
@@ -417,7 +644,7 @@ static void record_ping(zmq_msg_t *sender_id, const char *routing_key, int routi
         for (int i=0; i<sender_id_len; i++)
             sprintf(&routing_id[2*i], "%02X", data[i]);
         const char* app_env = "unknown-unknown";
-        app_env_record_t *r = zhashx_lookup(routing_id_to_app_env, routing_id);
+        app_env_record_t *r = zhashx_lookup(state->routing_id_to_app_env, routing_id);
         if (r) {
             r->last_seen = zclock_time();
             app_env = r->app_env;
@@ -429,7 +656,7 @@ static void record_ping(zmq_msg_t *sender_id, const char *routing_key, int routi
 static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *callback_data)
 {
     zmq_msg_t message_parts[12];
-    publisher_state_t *state = (publisher_state_t*)callback_data;
+    intake_state_t *state = (intake_state_t*)callback_data;
     void *socket = zsock_resolve(sock);
 
     int n;
@@ -455,7 +682,7 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
     if (n == expected_parts) {
         decoded = zmq_msg_extract_meta_info(&message_parts[app_env_index+3], &meta);
         if (!decoded) {
-            broken_meta_count_total++;
+            state->counters.broken_meta_count++;
             record_broken_meta(&message_parts[app_env_index]);
         }
     }
@@ -475,8 +702,13 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
     zmq_msg_t *topic = &message_parts[app_env_index+1];
     bool valid_topic = is_ping || (app_env_index+1 < n && well_formed_topic(zmq_msg_data(topic), zmq_msg_size(topic)));
 
+    // decide whether to accept the message before replying
+    bool admitted = true;
+    if (!is_ping && valid_stream && valid_topic && n == expected_parts && (decoded || allow_invalid_meta))
+        admitted = admit_message(state, socket, &message_parts[app_env_index], topic);
+
     if (!send_reply) {
-        record_routing_id_and_app_env(routing_id, app_env, app_env_len);
+        record_routing_id_and_app_env(state, routing_id, app_env, app_env_len);
     } else {
         zmsg_t *reply = zmsg_new();
         zmsg_addmem(reply, zmq_msg_data(routing_id), zmq_msg_size(routing_id));
@@ -486,7 +718,7 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
         // decoded or stream name is not well formed
         if (is_ping) {
             valid_stream = true;
-            ping_count_total++;
+            state->counters.ping_count++;
             if (decoded) {
                 zmsg_addstr(reply, "200 OK");
                 zmsg_addstr(reply, my_fqdn());
@@ -494,13 +726,16 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
                 zmsg_addstr(reply, "400 Bad Request");
             }
             if (valid_stream && (app_env_index+1 < n)) {
-                record_ping(routing_id, zmq_msg_data(topic), zmq_msg_size(topic));
+                record_ping(state, routing_id, zmq_msg_data(topic), zmq_msg_size(topic));
             }
         } else {
             // a normal message, but asking for a reply
             if (valid_stream) {
-                zmsg_addstr(reply, decoded ? "202 Accepted" : "400 Bad Request");
-                record_routing_id_and_app_env(routing_id, app_env, app_env_len);
+                if (!decoded)
+                    zmsg_addstr(reply, "400 Bad Request");
+                else
+                    zmsg_addstr(reply, admitted ? "202 Accepted" : "429 Too Many Requests");
+                record_routing_id_and_app_env(state, routing_id, app_env, app_env_len);
             } else
                 zmsg_addstr(reply, "400 Bad Request");
         }
@@ -511,12 +746,12 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
     }
 
     if (warn_msg_size(message_parts, n, expected_parts, expected_parts)) {
-        invalid_messages_count_total++;
+        state->counters.invalid_count++;
         goto cleanup;
     }
 
     if (!decoded) {
-        invalid_messages_count_total++;
+        state->counters.invalid_count++;
         if (verbose) {
             fprintf(stderr, "[E] meta info could not be decoded: %d\n", n);
             my_zmq_msg_fprint(message_parts, n, "[E] MSG", stderr);
@@ -526,7 +761,7 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
     }
 
     if (!valid_stream) {
-        invalid_messages_count_total++;
+        state->counters.invalid_count++;
         fprintf(stderr, "[E] malformed stream name\n");
         my_zmq_msg_fprint(message_parts, n, "[E] MSG", stderr);
         goto cleanup;
@@ -534,7 +769,7 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
 
     if (!is_ping) {
         if (!valid_topic) {
-            invalid_messages_count_total++;
+            state->counters.invalid_count++;
             fprintf(stderr, "[E] malformed routing key\n");
             my_zmq_msg_fprint(message_parts, n, "[E] MSG", stderr);
             goto cleanup;
@@ -542,7 +777,9 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
 
         zmq_msg_t *body = &message_parts[app_env_index+2];
         update_message_stats(socket, state, body);
-        compress_or_forward(message_parts+app_env_index, &meta, state);
+        record_heavy_hitters(state, &message_parts[app_env_index], topic, routing_id, zmq_msg_size(body));
+        if (admitted)
+            forward_message(message_parts+app_env_index, &meta, state);
     }
 
  cleanup:
@@ -552,6 +789,184 @@ static int read_router_message_and_forward(zloop_t *loop, zsock_t *sock, void *c
     return 0;
 }
 
+// receives messages validated by intake threads and publishes them
+static int read_intake_message_and_publish(zloop_t *loop, zsock_t *sock, void *callback_data)
+{
+    zmq_msg_t message_parts[4];
+    intake_state_t *state = (intake_state_t*)callback_data;
+    void *socket = zsock_resolve(sock);
+
+    int n;
+    int rc = read_multipart_msg(socket, message_parts, 4, &n);
+    if (rc) {
+        fprintf(stderr, "[E] unexpected error on recv: %d (%s)\n", errno, zmq_strerror(errno));
+        goto cleanup;
+    }
+    assert(n == 4);
+
+    // meta information could be invalid if allow_invalid_meta is set
+    msg_meta_t meta = META_INFO_EMPTY;
+    if (!zmq_msg_extract_meta_info(&message_parts[3], &meta))
+        meta = (msg_meta_t) META_INFO_EMPTY;
+
+    compress_or_forward(message_parts, &meta, state->publisher);
+
+ cleanup:
+    for (int i=n-1; i>=0; i--)
+        zmq_msg_close(&message_parts[i]);
+
+    return 0;
+}
+
+// answers "heavy-hitters [N]" with a JSON report on the top N streams and producers
+static int read_query_and_reply(zloop_t *loop, zsock_t *socket, void *callback_data)
+{
+    zmsg_t *request = zmsg_recv(socket);
+    if (!request)
+        return 0;
+    char *cmd = zmsg_popstr(request);
+    char *count = zmsg_popstr(request);
+    zmsg_destroy(&request);
+
+    if (cmd && streq(cmd, "heavy-hitters")) {
+        size_t n = count ? strtoul(count, NULL, 10) : HEAVY_HITTERS_REPORTED;
+        if (n == 0 || n > HEAVY_HITTERS_CAPACITY)
+            n = HEAVY_HITTERS_CAPACITY;
+        char *report = heavy_hitters_report(n);
+        zstr_send(socket, report);
+        free(report);
+    } else {
+        zstr_send(socket, "400 Bad Request");
+    }
+
+    free(cmd);
+    free(count);
+    return 0;
+}
+
+static zsock_t* producer_pull_socket_new(int port)
+{
+    zsock_t *receiver = zsock_new(ZMQ_PULL);
+    assert_x(receiver != NULL, "zmq socket creation failed", __FILE__, __LINE__);
+
+    //  configure the socket
+    zsock_set_rcvhwm(receiver, rcv_hwm);
+
+    // bind externally
+    int rc = zsock_bind(receiver, "tcp://%s:%d", "*", port);
+    assert_x(rc == port, "receiver socket: external bind failed", __FILE__, __LINE__);
+
+    return receiver;
+}
+
+static zsock_t* producer_router_socket_new(int port)
+{
+    zsock_t *router_receiver = zsock_new(ZMQ_ROUTER);
+    assert_x(router_receiver != NULL, "zmq socket creation failed", __FILE__, __LINE__);
+    int rc = zsock_bind(router_receiver, "tcp://%s:%d", "*", port);
+    assert_x(rc == port, "receiver socket: external bind failed", __FILE__, __LINE__);
+    return router_receiver;
+}
+
+static int intake_command(zloop_t *loop, zsock_t *socket, void *arg)
+{
+    int rc = 0;
+    intake_state_t *state = arg;
+    zmsg_t *msg = zmsg_recv(socket);
+    if (msg) {
+        char *cmd = zmsg_popstr(msg);
+        zmsg_destroy(&msg);
+        if (streq(cmd, "$TERM")) {
+            if (verbose)
+                printf("[D] %s: received $TERM command\n", state->me);
+            rc = -1;
+        } else if (streq(cmd, "tick")) {
+            flush_admission_state(state);
+            zmsg_t *response = zmsg_new();
+            zmsg_addmem(response, &state->counters, sizeof(state->counters));
+            // the main thread takes over the sketches
+            zmsg_addmem(response, &state->streams, sizeof(state->streams));
+            zmsg_addmem(response, &state->producers, sizeof(state->producers));
+            zmsg_send(&response, socket);
+            state->streams = heavy_hitters_new(HEAVY_HITTERS_CAPACITY);
+            state->producers = heavy_hitters_new(HEAVY_HITTERS_CAPACITY);
+            memset(&state->counters, 0, sizeof(state->counters));
+            device_prometheus_client_record_rusage_intake(state->id);
+            if (++state->ticks % 60 == 0)
+                clean_old_routing_id_entries(state->routing_id_to_app_env, stream_info_max_age());
+        } else {
+            fprintf(stderr, "[E] %s: received unknown actor command: %s\n", state->me, cmd);
+        }
+        free(cmd);
+    }
+    return rc;
+}
+
+static void intake_thread(zsock_t *pipe, void *args)
+{
+    intake_state_t *state = args;
+    set_thread_name(state->me);
+
+    state->receiver = producer_pull_socket_new(state->pull_port);
+    state->router_receiver = producer_router_socket_new(state->router_port);
+    state->output = zsock_new(ZMQ_PUSH);
+    assert_x(state->output != NULL, "intake output socket creation failed", __FILE__, __LINE__);
+    zsock_set_sndhwm(state->output, rcv_hwm);
+    int rc = zsock_connect(state->output, "inproc://intake-output");
+    assert_x(rc == 0, "intake output socket connect failed", __FILE__, __LINE__);
+
+    if (!quiet)
+        printf("[I] %s: receiving on router-port %d, pull-port %d\n", state->me, state->router_port, state->pull_port);
+
+    // signal readyiness
+    zsock_signal(pipe, 0);
+
+    zloop_t *loop = zloop_new();
+    assert(loop);
+    zloop_set_verbose(loop, 0);
+    // we rely on the main thread shutting us down
+    zloop_ignore_interrupts(loop);
+
+    rc = zloop_reader(loop, pipe, intake_command, state);
+    assert(rc == 0);
+    rc = zloop_reader(loop, state->receiver, read_zmq_message_and_forward, state);
+    assert(rc == 0);
+    zloop_reader_set_tolerant(loop, state->receiver);
+    rc = zloop_reader(loop, state->router_receiver, read_router_message_and_forward, state);
+    assert(rc == 0);
+    zloop_reader_set_tolerant(loop, state->router_receiver);
+
+    rc = zloop_start(loop);
+    if (verbose)
+        printf("[I] %s: event loop terminated with return code %d\n", state->me, rc);
+    zloop_destroy(&loop);
+
+    zsock_destroy(&state->receiver);
+    zsock_destroy(&state->router_receiver);
+    zsock_destroy(&state->output);
+    zhashx_destroy(&state->routing_id_to_app_env);
+    device_admission_destroy(&state->admission);
+    heavy_hitters_destroy(&state->streams);
+    heavy_hitters_destroy(&state->producers);
+    if (!quiet)
+        printf("[I] %s: terminated\n", state->me);
+    free(state);
+}
+
+static zactor_t* intake_thread_new(size_t id)
+{
+    intake_state_t *state = zmalloc(sizeof(*state));
+    state->id = id;
+    snprintf(state->me, sizeof(state->me), "intake[%zu]", id);
+    state->router_port = router_port + id * intake_port_step;
+    state->pull_port = pull_port + id * intake_port_step;
+    state->routing_id_to_app_env = zhashx_new();
+    state->admission = admission_new();
+    state->streams = heavy_hitters_new(HEAVY_HITTERS_CAPACITY);
+    state->producers = heavy_hitters_new(HEAVY_HITTERS_CAPACITY);
+    return zactor_new(intake_thread, state);
+}
+
 static void print_usage(char * const *argv)
 {
     fprintf(stderr,
@@ -562,6 +977,12 @@ static void print_usage(char * const *argv)
             "  -p, --input-port N         port number of zeromq input socket\n"
             "  -q, --quiet                supress most output\n"
             "  -C, --compressors N        number of compressor threads\n"
+            "  -n, --intake-threads N     receive producer messages on N threads\n"
+            "  -N, --intake-port-step N   port distance between intake threads\n"
+            "  -r, --app-env-rate N       accept at most N messages per second per app-env\n"
+            "  -b, --app-env-burst N      accept bursts of N messages per app-env (default: rate)\n"
+            "  -k, --priorities L         topic prefixes, from most to least important, shed last to first\n"
+            "  -Q, --query-port N         port number of zeromq socket for heavy hitter queries\n"
             "  -t, --router-port N        port number of zeromq router socket\n"
             "  -v, --verbose              log more (use -vv for debug output)\n"
             "  -x, --compress M           compress logjam traffic using (snappy|zlib)\n"
@@ -599,6 +1020,12 @@ static void process_arguments(int argc, char * const *argv)
         { "rcv-hwm",            required_argument, 0, 'R' },
         { "snd-hwm",            required_argument, 0, 'S' },
         { "compressors",        required_argument, 0, 'C' },
+        { "intake-threads",     required_argument, 0, 'n' },
+        { "intake-port-step",   required_argument, 0, 'N' },
+        { "app-env-rate",       required_argument, 0, 'r' },
+        { "app-env-burst",      required_argument, 0, 'b' },
+        { "priorities",         required_argument, 0, 'k' },
+        { "query-port",         required_argument, 0, 'Q' },
         { "verbose",            no_argument,       0, 'v' },
         { "metrics-port",       required_argument, 0, 'm' },
         { "metrics-ip",         required_argument, 0, 'M' },
@@ -607,7 +1034,7 @@ static void process_arguments(int argc, char * const *argv)
         { 0,                    0,                 0,  0  }
     };
 
-    while ((c = getopt_long(argc, argv, "vqd:p:c:i:x:C:P:S:s:R:t:m:M:T:A", long_options, &longindex)) != -1) {
+    while ((c = getopt_long(argc, argv, "vqd:p:c:i:x:C:n:N:r:b:k:Q:P:S:s:R:t:m:M:T:A", long_options, &longindex)) != -1) {
         switch (c) {
         case 'v':
             if (verbose)
@@ -648,6 +1075,28 @@ static void process_arguments(int argc, char * const *argv)
                 printf("[I] number of compressors reduced to %d\n", MAX_COMPRESSORS);
             }
             break;
+        case 'n':
+            num_intake_threads = atoi(optarg);
+            if (num_intake_threads > MAX_INTAKE_THREADS) {
+                num_intake_threads = MAX_INTAKE_THREADS;
+                printf("[I] number of intake threads reduced to %d\n", MAX_INTAKE_THREADS);
+            }
+            break;
+        case 'N':
+            intake_port_step = atoi(optarg);
+            break;
+        case 'r':
+            app_env_rate = atof(optarg);
+            break;
+        case 'b':
+            app_env_burst = atof(optarg);
+            break;
+        case 'k':
+            priority_classes = optarg;
+            break;
+        case 'Q':
+            query_port = atoi(optarg);
+            break;
         case 't':
             router_port = atoi(optarg);
             break;
@@ -673,7 +1122,7 @@ static void process_arguments(int argc, char * const *argv)
             exit(0);
             break;
         case '?':
-            if (strchr("dpcixsPSRt", optopt))
+            if (strchr("dpcixnNrbkQsPSRt", optopt))
                 fprintf(stderr, "option -%c requires an argument.\n", optopt);
             else if (isprint (optopt))
                 fprintf(stderr, "unknown option `-%c'.\n", optopt);
@@ -720,7 +1169,16 @@ int main(int argc, char * const *argv)
                "[I] io-threads:   %lu\n"
                "[I] rcv-hwm:      %d\n"
                "[I] snd-hwm:      %d\n"
-               , argv[0], pull_port, pub_port, router_port, metrics_port, stats_port, io_threads, rcv_hwm, snd_hwm);
+               "[I] intake-threads: %zu\n"
+               , argv[0], pull_port, pub_port, router_port, metrics_port, stats_port, io_threads, rcv_hwm, snd_hwm,
+               num_intake_threads);
+        if (num_intake_threads > 0)
+            printf("[I] intake-port-step: %d\n", intake_port_step);
+        if (query_port > 0)
+            printf("[I] query-port: %d\n", query_port);
+        if (app_env_rate > 0)
+            printf("[I] app-env-rate: %.0f, burst: %.0f, priorities: %s\n",
+                   app_env_rate, app_env_burst > 0 ? app_env_burst : app_env_rate, priority_classes);
     }
 
     // set global config
@@ -732,40 +1190,50 @@ int main(int argc, char * const *argv)
     zsys_set_io_threads(io_threads);
 
     compression_buffer = zchunk_new(NULL, INITIAL_COMPRESSION_BUFFER_SIZE);
-    routing_id_to_app_env = zhashx_new();
+
+    // intake threads create their admission state the same way
+    device_admission_t *admission = admission_new();
+    if (app_env_rate > 0 && admission == NULL) {
+        fprintf(stderr, "[E] invalid priority classes: %s\n", priority_classes);
+        exit(1);
+    }
 
     // initalize prometheus client
     snprintf(metrics_address, sizeof(metrics_address), "%s:%d", metrics_ip, metrics_port);
-    device_prometheus_client_init(metrics_address, device_number_s, num_compressors);
+    device_prometheus_client_init(metrics_address, device_number_s, num_compressors, num_intake_threads);
 
     device_prometheus_client_set_start_time();
 
-    // create socket to receive messages on
-    zsock_t *receiver = zsock_new(ZMQ_PULL);
-    assert_x(receiver != NULL, "zmq socket creation failed", __FILE__, __LINE__);
-
-    //  configure the socket
-    zsock_set_rcvhwm(receiver, rcv_hwm);
+    zsock_t *receiver = NULL;
+    zsock_t *router_receiver = NULL;
+    zsock_t *router_output = NULL;
+    zsock_t *intake_output = NULL;
 
-    // bind externally
-    rc = zsock_bind(receiver, "tcp://%s:%d", "*", pull_port);
-    assert_x(rc == pull_port, "receiver socket: external bind failed", __FILE__, __LINE__);
+    if (num_intake_threads == 0) {
+        // create socket to receive messages on
+        receiver = producer_pull_socket_new(pull_port);
 
-    // bind internally
-    rc = zsock_bind(receiver, "inproc://receiver");
-    assert_x(rc != -1, "receiver socket: internal bind failed", __FILE__, __LINE__);
+        // bind internally
+        rc = zsock_bind(receiver, "inproc://receiver");
+        assert_x(rc != -1, "receiver socket: internal bind failed", __FILE__, __LINE__);
 
-    // create and bind socket for receiving logjam messages
-    zsock_t *router_receiver = zsock_new(ZMQ_ROUTER);
-    assert_x(router_receiver != NULL, "zmq socket creation failed", __FILE__, __LINE__);
-    rc = zsock_bind(router_receiver, "tcp://%s:%d", "*", router_port);
-    assert_x(rc == router_port, "receiver socket: external bind failed", __FILE__, __LINE__);
+        // create and bind socket for receiving logjam messages
+        router_receiver = producer_router_socket_new(router_port);
 
-    // create router output socket and connect to the inproc receiver
-    zsock_t *router_output = zsock_new(ZMQ_PUSH);
-    assert_x(router_output != NULL, "zmq socket creation failed", __FILE__, __LINE__);
-    rc = zsock_connect(router_output, "inproc://receiver");
-    assert(rc == 0);
+        // create router output socket and connect to the inproc receiver
+        router_output = zsock_new(ZMQ_PUSH);
+        assert_x(router_output != NULL, "zmq socket creation failed", __FILE__, __LINE__);
+        rc = zsock_connect(router_output, "inproc://receiver");
+        assert(rc == 0);
+    } else {
+        // create socket for messages validated by intake threads. must be bound before
+        // the intake threads connect to it.
+        intake_output = zsock_new(ZMQ_PULL);
+        assert_x(intake_output != NULL, "zmq socket creation failed", __FILE__, __LINE__);
+        zsock_set_rcvhwm(intake_output, rcv_hwm);
+        rc = zsock_bind(intake_output, "inproc://intake-output");
+        assert_x(rc == 0, "intake output socket bind failed", __FILE__, __LINE__);
+    }
 
     // create socket for publishing
     zsock_t *publisher = zsock_new(ZMQ_PUB);
@@ -783,6 +1251,15 @@ int main(int argc, char * const *argv)
     rc = zsock_bind(stats_socket, "tcp://%s:%d", "*", stats_port);
     assert_x(rc == stats_port, "stats socket bind failed", __FILE__, __LINE__);
 
+    // create socket for heavy hitter queries
+    zsock_t *query_socket = NULL;
+    if (query_port > 0) {
+        query_socket = zsock_new(ZMQ_REP);
+        assert_x(query_socket != NULL, "query socket creation failed", __FILE__, __LINE__);
+        rc = zsock_bind(query_socket, "tcp://%s:%d", "*", query_port);
+        assert_x(rc == query_port, "query socket bind failed", __FILE__, __LINE__);
+    }
+
     // create compressor sockets
     zsock_t *compressor_input = zsock_new(ZMQ_PUSH);
     assert_x(compressor_input != NULL, "compressor input socket creation failed", __FILE__, __LINE__);
@@ -798,6 +1275,10 @@ int main(int argc, char * const *argv)
     for (size_t i = 0; i < num_compressors; i++)
         compressors[i] = message_compressor_new(i, compression_method, device_prometheus_client_record_rusage_compressor);
 
+    // create intake threads
+    for (size_t i = 0; i < num_intake_threads; i++)
+        intake_threads[i] = intake_thread_new(i);
+
     // create watchdog
     device_watchdog = watchdog_new(10, 1, 0);
 
@@ -808,33 +1289,60 @@ int main(int argc, char * const *argv)
 
     // setup publisher state
     publisher_state_t publisher_state = {
-        .receiver = zsock_resolve(receiver),
-        .router_receiver = zsock_resolve(router_receiver),
-        .router_output = zsock_resolve(router_output),
+        .router_output = router_output ? zsock_resolve(router_output) : NULL,
         .publisher = zsock_resolve(publisher),
         .stats_socket = stats_socket,
         .compressor_input = zsock_resolve(compressor_input),
         .compressor_output = zsock_resolve(compressor_output),
     };
 
+    // setup intake state of the main thread
+    intake_state_t main_intake = {
+        .me = "main",
+        .router_port = router_port,
+        .pull_port = pull_port,
+        .receiver = receiver,
+        .router_receiver = router_receiver,
+        .publisher = &publisher_state,
+        .routing_id_to_app_env = zhashx_new(),
+        .admission = admission,
+        .streams = heavy_hitters_new(HEAVY_HITTERS_CAPACITY),
+        .producers = heavy_hitters_new(HEAVY_HITTERS_CAPACITY),
+    };
+    top_streams = heavy_hitters_new(HEAVY_HITTERS_CAPACITY);
+    top_producers = heavy_hitters_new(HEAVY_HITTERS_CAPACITY);
+
     // calculate statistics every 1000 ms
-    int timer_id = zloop_timer(loop, 1000, 0, timer_event, &publisher_state);
+    int timer_id = zloop_timer(loop, 1000, 0, timer_event, &main_intake);
     assert(timer_id != -1);
 
     // setup handler for compression results
-    rc = zloop_reader(loop, compressor_output, read_zmq_message_and_forward, &publisher_state);
+    rc = zloop_reader(loop, compressor_output, read_zmq_message_and_forward, &main_intake);
     assert(rc == 0);
     zloop_reader_set_tolerant(loop, compressor_output);
 
-    // setup handler for incoming messages (all from the outside)
-    rc = zloop_reader(loop, receiver, read_zmq_message_and_forward, &publisher_state);
-    assert(rc == 0);
-    zloop_reader_set_tolerant(loop, receiver);
+    if (query_socket) {
+        rc = zloop_reader(loop, query_socket, read_query_and_reply, NULL);
+        assert(rc == 0);
+        zloop_reader_set_tolerant(loop, query_socket);
+    }
 
-    // setup handler for event messages (all from the outside)
-    rc = zloop_reader(loop, router_receiver, read_router_message_and_forward, &publisher_state);
-    assert(rc == 0);
-    zloop_reader_set_tolerant(loop, router_receiver);
+    if (num_intake_threads == 0) {
+        // setup handler for incoming messages (all from the outside)
+        rc = zloop_reader(loop, receiver, read_zmq_message_and_forward, &main_intake);
+        assert(rc == 0);
+        zloop_reader_set_tolerant(loop, receiver);
+
+        // setup handler for event messages (all from the outside)
+        rc = zloop_reader(loop, router_receiver, read_router_message_and_forward, &main_intake);
+        assert(rc == 0);
+        zloop_reader_set_tolerant(loop, router_receiver);
+    } else {
+        // setup handler for messages validated by intake threads
+        rc = zloop_reader(loop, intake_output, read_intake_message_and_publish, &main_intake);
+        assert(rc == 0);
+        zloop_reader_set_tolerant(loop, intake_output);
+    }
 
     // initialize clock
     global_time = zclock_time();
@@ -862,6 +1370,16 @@ int main(int argc, char * const *argv)
     }
 
     watchdog_destroy(&device_watchdog);
+    for (size_t i = 0; i < num_intake_threads; i++)
+        zactor_destroy(&intake_threads[i]);
+    zsock_destroy(&intake_output);
+    zhashx_destroy(&main_intake.routing_id_to_app_env);
+    device_admission_destroy(&main_intake.admission);
+    heavy_hitters_destroy(&main_intake.streams);
+    heavy_hitters_destroy(&main_intake.producers);
+    heavy_hitters_destroy(&top_streams);
+    heavy_hitters_destroy(&top_producers);
+    zsock_destroy(&query_socket);
     zsock_destroy(&receiver);
     zsock_destroy(&router_receiver);
     zsock_destroy(&router_output);
@@ -0,0 +1,1011 @@
+#include "logjam-traffic.h"
+#include <getopt.h>
+#include <math.h>
+#include <json-c/json.h>
+
+/*
+ * connections: "o" = bind, "[<>v^]" = connect
+ *
+ *                 --- PIPE ---  generator[0]    PUB/PUSH/DEALER  o---------->  device/importer
+ *  main loop:     --- PIPE ---  ...
+ *                 --- PIPE ---  generator[n-1]  PUB/PUSH/DEALER  o---------->  device/importer
+ *
+ */
+
+// Synthesizes logjam traffic from a declarative profile (ZPL format, see README.md).
+// Each generator thread owns its own socket, random number generator and buffers, and
+// produces complete backend requests, optionally followed by a frontend.page or
+// frontend.ajax message carrying the same request id, so that the importer's uuid
+// tracker sees matching pairs. Device numbers are partitioned among the generators as
+// described in logjam-traffic.h.
+
+bool dryrun = false;
+bool verbose = false;
+bool debug = false;
+bool quiet = false;
+
+static char *profile_file_name = NULL;
+static char *seed_corpus_file_name = NULL;
+static zconfig_t *profile = NULL;
+
+static traffic_options_t options;
+static int compression_method = NO_COMPRESSION;
+static bool compression_set = false;
+static uint64_t random_seed = 0;
+
+static int messages_per_second = 1000;
+static size_t message_limit = 0;
+
+static zsock_t *stats_socket = NULL;
+
+// used when no profile file is given on the command line
+static const char *default_profile =
+    "generator\n"
+    "    compression = snappy\n"
+    "streams\n"
+    "    logjam-generator\n"
+    "        weight = 1\n"
+    "defaults\n"
+    "    pages = 500\n"
+    "    zipf = 1.0\n"
+    "    modules = 20\n"
+    "    hosts = 10\n"
+    "    error_rate = 0.01\n"
+    "    exception_rate = 0.02\n"
+    "    exceptions = 10\n"
+    "    frontend_ratio = 0.2\n"
+    "    ajax_ratio = 0.2\n"
+    "    lines = 10\n"
+    "    line_size = 100\n"
+    "metrics\n"
+    "    time\n"
+    "        total_time\n"
+    "            median = 80\n"
+    "            sigma = 0.8\n"
+    "        db_time\n"
+    "            median = 15\n"
+    "            sigma = 1.0\n"
+    "        view_time\n"
+    "            median = 20\n"
+    "            sigma = 0.6\n"
+    "    call\n"
+    "        db_calls\n"
+    "            median = 5\n"
+    "            sigma = 0.8\n"
+    "    memory\n"
+    "        allocated_objects\n"
+    "            median = 20000\n"
+    "            sigma = 1.0\n"
+    "        allocated_bytes\n"
+    "            median = 2000000\n"
+    "            sigma = 1.0\n"
+    "    heap\n"
+    "        heap_size\n"
+    "            median = 500000\n"
+    "            sigma = 0.2\n"
+    "    frontend\n"
+    "        page_time\n"
+    "            median = 1500\n"
+    "            sigma = 0.6\n"
+    "        ajax_time\n"
+    "            median = 150\n"
+    "            sigma = 0.7\n";
+
+// metric types, named after the sections of the importer's metrics configuration
+enum metric_type { METRIC_TIME, METRIC_CALL, METRIC_MEMORY, METRIC_HEAP, METRIC_FRONTEND, METRIC_TYPES };
+static const char *metric_type_names[METRIC_TYPES] = { "time", "call", "memory", "heap", "frontend" };
+
+// values are drawn from a log-normal distribution with the given median
+typedef struct {
+    char *name;
+    enum metric_type type;
+    double median;
+    double sigma;
+} metric_profile_t;
+
+#define MAX_METRICS 100
+static metric_profile_t metrics[MAX_METRICS];
+static size_t metric_count = 0;
+static int total_time_metric = -1;
+static int page_time_metric = -1;
+static int ajax_time_metric = -1;
+
+typedef struct {
+    char *app_env;
+    size_t app_env_len;
+    char *topic;
+    size_t topic_len;
+    double weight;
+    size_t num_pages;
+    char **pages;
+    double *page_cdf;
+    size_t num_exceptions;
+    char **exceptions;
+    int hosts;
+    double error_rate;
+    double exception_rate;
+    double frontend_ratio;
+    double ajax_ratio;
+    int lines;
+    int line_size;
+} stream_profile_t;
+
+static stream_profile_t *streams = NULL;
+static size_t stream_count = 0;
+static double *stream_cdf = NULL;
+
+// seed corpus: serialized fields of sample requests, appended verbatim to generated requests
+static char **seed_fields = NULL;
+static size_t seed_count = 0;
+
+typedef struct {
+    traffic_thread_t thread;
+    zsock_t *socket;
+    char *connection_spec;
+    uint64_t rng;
+    zchunk_t *body;
+    zchunk_t *compression_buffer;
+    size_t request_limit;
+    traffic_pacer_t pacer;
+    // statistics, written by the generator, read by the main thread
+    size_t messages_sent;
+    size_t bytes_sent;
+    size_t raw_bytes;
+    size_t requests_sent;
+    size_t frontend_sent;
+    size_t ajax_sent;
+    size_t errors_sent;
+} generator_state_t;
+
+static int64_t start_time = 0;
+
+static generator_state_t *generators[MAX_TRAFFIC_THREADS];
+static zactor_t *generator_actors[MAX_TRAFFIC_THREADS];
+static size_t finished_generators = 0;
+
+// xorshift64*: fast, good enough for load generation and reproducible per thread
+static inline uint64_t rng_next(uint64_t *s)
+{
+    uint64_t x = *s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline double rng_uniform(uint64_t *s)
+{
+    return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_gaussian(uint64_t *s)
+{
+    double u1 = rng_uniform(s);
+    double u2 = rng_uniform(s);
+    if (u1 < 1e-300)
+        u1 = 1e-300;
+    return sqrt(-2.0 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static double rng_metric(uint64_t *s, metric_profile_t *m)
+{
+    return m->median * exp(m->sigma * rng_gaussian(s));
+}
+
+// returns the first index whose cumulative probability exceeds a uniform sample
+static size_t rng_pick(uint64_t *s, double *cdf, size_t n)
+{
+    double u = rng_uniform(s);
+    size_t lo = 0, hi = n - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void normalize_cdf(double *cdf, size_t n)
+{
+    for (size_t i = 1; i < n; i++)
+        cdf[i] += cdf[i-1];
+    for (size_t i = 0; i < n; i++)
+        cdf[i] /= cdf[n-1];
+}
+
+// looks up a stream attribute, falling back to the defaults section of the profile
+static const char* stream_attribute(zconfig_t *stream, const char *attr, const char *default_value)
+{
+    char *value = zconfig_get(stream, attr, NULL);
+    if (value)
+        return value;
+    char path[256];
+    snprintf(path, sizeof(path), "defaults/%s", attr);
+    return zconfig_resolve(profile, path, default_value);
+}
+
+static void setup_stream(stream_profile_t *s, zconfig_t *config)
+{
+    const char *name = zconfig_name(config);
+    const char *dash = strrchr(name, '-');
+    if (dash == NULL || dash == name || dash[1] == 0) {
+        fprintf(stderr, "[E] stream name must have the form app-env: %s\n", name);
+        exit(1);
+    }
+    s->app_env = strdup(name);
+    s->app_env_len = strlen(name);
+    int rc = asprintf(&s->topic, "logs.%.*s.%s", (int)(dash - name), name, dash + 1);
+    assert(rc != -1);
+    s->topic_len = strlen(s->topic);
+
+    s->weight = atof(stream_attribute(config, "weight", "1"));
+    s->num_pages = atoi(stream_attribute(config, "pages", "100"));
+    if (s->num_pages == 0)
+        s->num_pages = 1;
+    double zipf = atof(stream_attribute(config, "zipf", "1.0"));
+    int modules = atoi(stream_attribute(config, "modules", "10"));
+    if (modules <= 0)
+        modules = 1;
+    s->num_exceptions = atoi(stream_attribute(config, "exceptions", "10"));
+    s->hosts = atoi(stream_attribute(config, "hosts", "10"));
+    if (s->hosts <= 0)
+        s->hosts = 1;
+    s->error_rate = atof(stream_attribute(config, "error_rate", "0.01"));
+    s->exception_rate = atof(stream_attribute(config, "exception_rate", "0.01"));
+    s->frontend_ratio = atof(stream_attribute(config, "frontend_ratio", "0"));
+    s->ajax_ratio = atof(stream_attribute(config, "ajax_ratio", "0"));
+    s->lines = atoi(stream_attribute(config, "lines", "5"));
+    s->line_size = atoi(stream_attribute(config, "line_size", "80"));
+    if (s->line_size < 32)
+        s->line_size = 32;
+    if (s->frontend_ratio + s->ajax_ratio > 1) {
+        fprintf(stderr, "[E] frontend_ratio + ajax_ratio must not exceed 1 for stream %s\n", name);
+        exit(1);
+    }
+
+    // page k is requested with a probability proportional to 1/k^zipf
+    s->pages = zmalloc(s->num_pages * sizeof(char*));
+    s->page_cdf = zmalloc(s->num_pages * sizeof(double));
+    for (size_t k = 0; k < s->num_pages; k++) {
+        rc = asprintf(&s->pages[k], "Module%zu::Page%zuController#action%zu", k % modules, k, k % 7);
+        assert(rc != -1);
+        s->page_cdf[k] = 1.0 / pow(k + 1, zipf);
+    }
+    normalize_cdf(s->page_cdf, s->num_pages);
+
+    if (s->num_exceptions > 0) {
+        s->exceptions = zmalloc(s->num_exceptions * sizeof(char*));
+        for (size_t k = 0; k < s->num_exceptions; k++) {
+            rc = asprintf(&s->exceptions[k], "Generated::Error%zu", k);
+            assert(rc != -1);
+        }
+    }
+}
+
+static void setup_metrics()
+{
+    for (int t = 0; t < METRIC_TYPES; t++) {
+        char path[64];
+        snprintf(path, sizeof(path), "metrics/%s", metric_type_names[t]);
+        zconfig_t *section = zconfig_locate(profile, path);
+        if (section == NULL)
+            continue;
+        for (zconfig_t *metric = zconfig_child(section); metric; metric = zconfig_next(metric)) {
+            // metrics copied from the importer config without a distribution are not generated
+            char *median = zconfig_get(metric, "median", NULL);
+            if (median == NULL)
+                continue;
+            if (metric_count == MAX_METRICS) {
+                fprintf(stderr, "[E] too many metrics in profile\n");
+                exit(1);
+            }
+            metric_profile_t *m = &metrics[metric_count];
+            m->name = zconfig_name(metric);
+            m->type = t;
+            m->median = atof(median);
+            m->sigma = atof(zconfig_get(metric, "sigma", "0.5"));
+            if (streq(m->name, "total_time"))
+                total_time_metric = metric_count;
+            else if (streq(m->name, "page_time"))
+                page_time_metric = metric_count;
+            else if (streq(m->name, "ajax_time"))
+                ajax_time_metric = metric_count;
+            metric_count++;
+        }
+    }
+    if (total_time_metric == -1) {
+        fprintf(stderr, "[E] profile must specify a distribution for metrics/time/total_time\n");
+        exit(1);
+    }
+}
+
+static void load_profile()
+{
+    if (profile_file_name) {
+        profile = zconfig_load(profile_file_name);
+        if (profile == NULL) {
+            fprintf(stderr, "[E] could not load profile: %s\n", profile_file_name);
+            exit(1);
+        }
+    } else {
+        profile = zconfig_str_load(default_profile);
+        assert(profile);
+    }
+
+    if (!compression_set) {
+        char *method = zconfig_resolve(profile, "generator/compression", NULL);
+        if (method && !streq(method, "none"))
+            compression_method = string_to_compression_method(method);
+    }
+    if (random_seed == 0)
+        random_seed = atoll(zconfig_resolve(profile, "generator/seed", "0"));
+    if (random_seed == 0)
+        random_seed = zclock_usecs();
+
+    setup_metrics();
+
+    zconfig_t *section = zconfig_locate(profile, "streams");
+    for (zconfig_t *s = section ? zconfig_child(section) : NULL; s; s = zconfig_next(s))
+        stream_count++;
+    if (stream_count == 0) {
+        fprintf(stderr, "[E] profile contains no streams\n");
+        exit(1);
+    }
+    streams = zmalloc(stream_count * sizeof(stream_profile_t));
+    stream_cdf = zmalloc(stream_count * sizeof(double));
+    size_t i = 0;
+    for (zconfig_t *s = zconfig_child(section); s; s = zconfig_next(s), i++) {
+        setup_stream(&streams[i], s);
+        stream_cdf[i] = streams[i].weight;
+        if (verbose)
+            printf("[I] stream %s: weight %.2f, %zu pages, frontend %.2f, ajax %.2f\n",
+                   streams[i].app_env, streams[i].weight, streams[i].num_pages,
+                   streams[i].frontend_ratio, streams[i].ajax_ratio);
+    }
+    normalize_cdf(stream_cdf, stream_count);
+}
+
+// fields which are always generated and thus never copied from the seed corpus
+static bool generated_field(const char *key)
+{
+    static const char *keys[] = {
+        "action", "logjam_action", "request_id", "logjam_request_id", "started_at", "started_ms",
+        "code", "severity", "lines", "exceptions", "host", "process_id", "rts", "user_agent", NULL
+    };
+    for (int i = 0; keys[i]; i++)
+        if (streq(key, keys[i]))
+            return true;
+    for (size_t i = 0; i < metric_count; i++)
+        if (streq(key, metrics[i].name))
+            return true;
+    return false;
+}
+
+static void load_seed_corpus()
+{
+    FILE *file = fopen(seed_corpus_file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "[E] could not open seed corpus: %s\n", strerror(errno));
+        exit(1);
+    }
+    size_t capacity = 1024;
+    seed_fields = zmalloc(capacity * sizeof(char*));
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t skipped = 0;
+    zchunk_t *buffer = zchunk_new(NULL, 4096);
+    while (getline(&line, &line_size, file) != -1) {
+        json_object *obj = json_tokener_parse(line);
+        if (obj == NULL || !json_object_is_type(obj, json_type_object)) {
+            skipped++;
+            if (obj)
+                json_object_put(obj);
+            continue;
+        }
+        zchunk_set(buffer, "", 0);
+        json_object_object_foreach(obj, key, val) {
+            if (generated_field(key))
+                continue;
+            json_object *name = json_object_new_string(key);
+            const char *name_str = json_object_to_json_string_ext(name, JSON_C_TO_STRING_PLAIN);
+            const char *val_str = json_object_to_json_string_ext(val, JSON_C_TO_STRING_PLAIN);
+            size_t name_len = strlen(name_str), val_len = strlen(val_str);
+            ensure_chunk_can_take(buffer, name_len + val_len + 2);
+            zchunk_append(buffer, ",", 1);
+            zchunk_append(buffer, name_str, name_len);
+            zchunk_append(buffer, ":", 1);
+            zchunk_append(buffer, val_str, val_len);
+            json_object_put(name);
+        }
+        if (seed_count == capacity) {
+            capacity *= 2;
+            seed_fields = realloc(seed_fields, capacity * sizeof(char*));
+            assert(seed_fields);
+        }
+        seed_fields[seed_count++] = strndup((char*) zchunk_data(buffer), zchunk_size(buffer));
+        json_object_put(obj);
+    }
+    free(line);
+    fclose(file);
+    zchunk_destroy(&buffer);
+    if (skipped)
+        fprintf(stderr, "[W] skipped %zu seed corpus lines which are not JSON objects\n", skipped);
+    if (seed_count == 0) {
+        fprintf(stderr, "[E] seed corpus contains no requests\n");
+        exit(1);
+    }
+    if (verbose)
+        printf("[I] loaded %zu seed requests from %s\n", seed_count, seed_corpus_file_name);
+}
+
+static void format_started_at(char *buffer, size_t size, uint64_t ms)
+{
+    time_t secs = ms / 1000;
+    struct tm tm;
+    localtime_r(&secs, &tm);
+    long offset = tm.tm_gmtoff / 60;
+    char sign = offset < 0 ? '-' : '+';
+    if (offset < 0)
+        offset = -offset;
+    size_t n = strftime(buffer, size, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buffer + n, size - n, "%c%02ld:%02ld", sign, offset / 60, offset % 60);
+}
+
+static void format_line_time(char *buffer, size_t size, uint64_t usecs)
+{
+    time_t secs = usecs / 1000000;
+    struct tm tm;
+    localtime_r(&secs, &tm);
+    size_t n = strftime(buffer, size, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buffer + n, size - n, ".%06" PRIu64, usecs % 1000000);
+}
+
+static void append_log_line(zchunk_t *body, uint64_t *rng, int severity, uint64_t usecs, int size, const char *text, bool first)
+{
+    static const char filler[] = "lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor ";
+    char timestamp[32];
+    format_line_time(timestamp, sizeof(timestamp), usecs);
+    int text_len = strlen(text);
+    int pad = size > text_len ? size - text_len : 0;
+    if (pad > 2000)
+        pad = 2000;
+    size_t offset = rng_next(rng) % (sizeof(filler) - 1);
+    append_line(body, "%s[%d,\"%s\",\"%s", first ? "" : ",", severity, timestamp, text);
+    while (pad > 0) {
+        int n = sizeof(filler) - 1 - offset;
+        if (n > pad)
+            n = pad;
+        ensure_chunk_can_take(body, n);
+        zchunk_append(body, filler + offset, n);
+        pad -= n;
+        offset = 0;
+    }
+    append_line(body, "\"]");
+}
+
+// generates the JSON body of a backend request into the body buffer
+static void generate_request(generator_state_t *state, stream_profile_t *s, const char *page, const char *uuid,
+                             uint64_t now_ms, bool error, int *total_time_ms)
+{
+    uint64_t *rng = &state->rng;
+    zchunk_t *body = state->body;
+    double values[MAX_METRICS];
+    double other_time = 0;
+    for (size_t i = 0; i < metric_count; i++) {
+        metric_profile_t *m = &metrics[i];
+        if (m->type == METRIC_FRONTEND)
+            continue;
+        double v = rng_metric(rng, m);
+        if (m->type != METRIC_TIME)
+            v = round(v);
+        else if (i != total_time_metric)
+            other_time += v;
+        values[i] = v;
+    }
+    // the importer derives other_time from total_time, so the parts must not exceed the whole
+    double total_time = values[total_time_metric];
+    if (other_time > total_time * 0.95) {
+        double scale = total_time * 0.95 / other_time;
+        for (size_t i = 0; i < metric_count; i++)
+            if (metrics[i].type == METRIC_TIME && i != total_time_metric)
+                values[i] *= scale;
+    }
+    *total_time_ms = total_time;
+
+    uint64_t started_ms = now_ms - (uint64_t)total_time;
+    char started_at[32];
+    format_started_at(started_at, sizeof(started_at), started_ms);
+    int code = error ? 500 : 200;
+    int severity = error ? 3 : 1;
+
+    zchunk_set(body, "", 0);
+    append_line(body, "{\"action\":\"%s\",\"request_id\":\"%s\",\"started_at\":\"%s\",\"started_ms\":%" PRIu64
+                ",\"code\":%d,\"severity\":%d,\"host\":\"host-%d.%s\",\"process_id\":%d",
+                page, uuid, started_at, started_ms, code, severity,
+                (int)(rng_next(rng) % s->hosts), s->app_env, 1000 + (int)(rng_next(rng) % 30000));
+    for (size_t i = 0; i < metric_count; i++) {
+        metric_profile_t *m = &metrics[i];
+        if (m->type == METRIC_FRONTEND)
+            continue;
+        if (m->type == METRIC_TIME)
+            append_line(body, ",\"%s\":%.3f", m->name, values[i]);
+        else
+            append_line(body, ",\"%s\":%.0f", m->name, values[i]);
+    }
+
+    if (s->num_exceptions > 0 && rng_uniform(rng) < s->exception_rate)
+        append_line(body, ",\"exceptions\":[\"%s\"]", s->exceptions[rng_next(rng) % s->num_exceptions]);
+
+    // the number of log lines is uniformly distributed around the configured mean
+    int lines = s->lines > 0 ? rng_next(rng) % (2 * s->lines + 1) : 0;
+    if (lines > 0 || error) {
+        uint64_t usecs = started_ms * 1000;
+        uint64_t step = total_time * 1000 / (lines + 1);
+        append_line(body, ",\"lines\":[");
+        append_log_line(body, rng, 1, usecs, s->line_size, "Processing by generated action", true);
+        for (int i = 1; i < lines; i++) {
+            usecs += step;
+            append_log_line(body, rng, rng_uniform(rng) < 0.1 ? 0 : 1, usecs, s->line_size, "Generated log line", false);
+        }
+        if (error)
+            append_log_line(body, rng, 3, started_ms * 1000 + total_time * 1000, s->line_size,
+                            "Completed 500 Internal Server Error", false);
+        append_line(body, "]");
+    }
+
+    if (seed_count > 0) {
+        const char *fields = seed_fields[rng_next(rng) % seed_count];
+        size_t n = strlen(fields);
+        ensure_chunk_can_take(body, n);
+        zchunk_append(body, fields, n);
+    } else {
+        append_line(body, ",\"request_info\":{\"method\":\"GET\",\"url\":\"/%s/%zu\"}",
+                    s->app_env, (size_t)(rng_next(rng) % 1000));
+    }
+    append_line(body, "}");
+}
+
+// generates a frontend.page or frontend.ajax message referring to the given backend request
+static void generate_frontend_request(generator_state_t *state, stream_profile_t *s, const char *page, const char *uuid,
+                                      uint64_t now_ms, int backend_time, bool ajax)
+{
+    uint64_t *rng = &state->rng;
+    zchunk_t *body = state->body;
+
+    int metric = ajax ? ajax_time_metric : page_time_metric;
+    int64_t t = metric >= 0 ? rng_metric(rng, &metrics[metric]) : (ajax ? 150 : 1500);
+    // frontend times include the backend time, the importer drops non ascending timings
+    if (t < backend_time + 20)
+        t = backend_time + 20;
+    uint64_t started_ms = now_ms - backend_time - 10;
+    char started_at[32];
+    format_started_at(started_at, sizeof(started_at), started_ms);
+
+    zchunk_set(body, "", 0);
+    append_line(body, "{\"action\":\"%s\",\"logjam_request_id\":\"%s-%s\",\"started_at\":\"%s\",\"started_ms\":%" PRIu64
+                ",\"user_agent\":\"Mozilla/5.0 (logjam-generator)\"",
+                page, s->app_env, uuid, started_at, started_ms);
+    if (ajax) {
+        append_line(body, ",\"rts\":\"%" PRIu64 ",%" PRIu64 "\"}", started_ms, started_ms + t);
+    } else {
+        // navigation timing api attributes, in the order expected by the importer
+        uint64_t b = started_ms;
+        uint64_t request_start = b + t / 20, response_start = b + t / 20 + backend_time;
+        uint64_t response_end = response_start + t / 20, dom_interactive = response_end + t / 5;
+        uint64_t dom_complete = b + t * 9 / 10, load_end = b + t;
+        append_line(body, ",\"rts\":\"%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                    ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                    ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\"}",
+                    b, b + 1, b + 1, b + 1, b + 1, b + 1, request_start, response_start, response_end,
+                    response_end, dom_interactive, dom_interactive, dom_interactive, dom_complete,
+                    dom_complete, load_end);
+    }
+}
+
+// sends the contents of the body buffer on the given topic
+static int send_generated_message(generator_state_t *state, stream_profile_t *s, const char *topic, size_t topic_len,
+                                  uint32_t device, uint64_t sequence)
+{
+    const char *data = (const char*) zchunk_data(state->body);
+    size_t data_len = zchunk_size(state->body);
+
+    if (debug)
+        printf("[D] generator[%zu]: %s %.*s\n", state->thread.id, topic, (int)data_len, data);
+
+    zmq_msg_t parts[3];
+    zmq_msg_init_size(&parts[0], s->app_env_len);
+    memcpy(zmq_msg_data(&parts[0]), s->app_env, s->app_env_len);
+    zmq_msg_init_size(&parts[1], topic_len);
+    memcpy(zmq_msg_data(&parts[1]), topic, topic_len);
+    if (compression_method) {
+        zmq_msg_init(&parts[2]);
+        compress_message_data(compression_method, state->compression_buffer, &parts[2], data, data_len);
+    } else {
+        zmq_msg_init_size(&parts[2], data_len);
+        memcpy(zmq_msg_data(&parts[2]), data, data_len);
+    }
+    size_t msg_bytes = s->app_env_len + topic_len + zmq_msg_size(&parts[2]) + sizeof(msg_meta_t);
+
+    msg_meta_t meta = META_INFO_EMPTY;
+    meta.compression_method = compression_method;
+    meta.device_number = device;
+    meta.sequence_number = sequence;
+    meta.created_ms = zclock_time();
+
+    // only the first frame can block, so sends can be retried safely on timeouts
+    int rc;
+    do {
+        rc = publish_on_zmq_transport(parts, zsock_resolve(state->socket), &meta, 0);
+    } while (rc == -1 && errno == EAGAIN && traffic_thread_check_pipe(&state->thread, 0));
+
+    // send a ping once in a while if socket is a dealer
+    if (rc != -1 && options.socket_type == ZMQ_DEALER && (sequence % 20 == 0))
+        traffic_send_ping(state->socket, &meta, s->app_env, s->app_env_len);
+
+    for (int i = 0; i < 3; i++)
+        zmq_msg_close(&parts[i]);
+
+    if (rc == -1)
+        return rc;
+
+    __atomic_add_fetch(&state->messages_sent, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&state->bytes_sent, msg_bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&state->raw_bytes, data_len, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+static
+generator_state_t* generator_state_new(size_t id)
+{
+    generator_state_t *state = zmalloc(sizeof(*state));
+    state->thread.kind = "generator";
+    state->thread.id = id;
+    state->connection_spec = traffic_thread_connection_spec(&options, id);
+    // distinct, non zero seeds for all threads
+    state->rng = (random_seed + id * 0x9E3779B97F4A7C15ULL) | 1;
+    state->body = zchunk_new(NULL, 16 * 1024);
+    state->compression_buffer = zchunk_new(NULL, 16 * 1024);
+    // the share of a generator can be 0 if fewer requests than threads are requested
+    if (message_limit)
+        state->request_limit = message_limit / options.num_threads + (id < message_limit % options.num_threads ? 1 : 0);
+    return state;
+}
+
+static
+void generator_state_destroy(generator_state_t **state_p)
+{
+    generator_state_t *state = *state_p;
+    zchunk_destroy(&state->body);
+    zchunk_destroy(&state->compression_buffer);
+    free(state->connection_spec);
+    free(state);
+    *state_p = NULL;
+}
+
+static
+void generator(zsock_t *pipe, void *args)
+{
+    generator_state_t *state = args;
+    state->thread.pipe = pipe;
+    size_t id = state->thread.id;
+
+    char thread_name[16];
+    memset(thread_name, 0, 16);
+    snprintf(thread_name, 16, "generator[%zu]", id);
+    set_thread_name(thread_name);
+
+    state->socket = traffic_thread_socket_new(&options, id, state->connection_spec, 100000);
+    state->thread.poller = zpoller_new(pipe, NULL);
+    assert(state->thread.poller);
+
+    // signal readiness
+    zsock_signal(pipe, 0);
+
+    int my_devices = traffic_thread_device_count(&options, id);
+
+    traffic_pacer_reset(&state->pacer, messages_per_second, options.num_threads);
+    size_t sent = 0;
+    uint64_t request_counter = 0;
+    bool running = true;
+
+    while (running) {
+        if (message_limit && state->requests_sent >= state->request_limit)
+            break;
+
+        stream_profile_t *s = &streams[rng_pick(&state->rng, stream_cdf, stream_count)];
+        const char *page = s->pages[rng_pick(&state->rng, s->page_cdf, s->num_pages)];
+        bool error = rng_uniform(&state->rng) < s->error_rate;
+        double kind = rng_uniform(&state->rng);
+        bool frontend = kind < s->frontend_ratio;
+        bool ajax = !frontend && kind < s->frontend_ratio + s->ajax_ratio;
+
+        // 32 hex characters, unique across generators
+        char uuid[33];
+        snprintf(uuid, sizeof(uuid), "%016" PRIx64 "%04zx%012" PRIx64,
+                 rng_next(&state->rng), id, ++request_counter & (uint64_t)0xffffffffffff);
+
+        uint64_t now_ms = zclock_time();
+        int backend_time;
+        generate_request(state, s, page, uuid, now_ms, error, &backend_time);
+
+        int messages = frontend || ajax ? 2 : 1;
+        for (int i = 0; i < messages && running; i++) {
+            if (i == 1)
+                generate_frontend_request(state, s, page, uuid, now_ms, backend_time, ajax);
+
+            traffic_pacer_wait(&state->pacer);
+            if (state->thread.terminated || zsys_interrupted) {
+                running = false;
+                break;
+            }
+
+            int device = traffic_thread_device(&options, id, my_devices, sent);
+            uint64_t n = traffic_next_sequence_number(&options, device);
+
+            const char *topic = i == 0 ? s->topic : (ajax ? "frontend.ajax" : "frontend.page");
+            size_t topic_len = i == 0 ? s->topic_len : 13;
+            if (send_generated_message(state, s, topic, topic_len, device, n) == -1) {
+                if (!zsys_interrupted)
+                    fprintf(stderr, "[E] generator[%zu]: send failed: %s\n", id, zmq_strerror(errno));
+            } else if (i == 0) {
+                __atomic_add_fetch(&state->requests_sent, 1, __ATOMIC_RELAXED);
+                if (error)
+                    __atomic_add_fetch(&state->errors_sent, 1, __ATOMIC_RELAXED);
+            } else if (ajax)
+                __atomic_add_fetch(&state->ajax_sent, 1, __ATOMIC_RELAXED);
+            else
+                __atomic_add_fetch(&state->frontend_sent, 1, __ATOMIC_RELAXED);
+
+            if (++sent % 256 == 0)
+                running = traffic_thread_check_pipe(&state->thread, 0);
+        }
+    }
+
+    if (running) {
+        // tell main loop we're done and wait for termination
+        zstr_send(pipe, "finished");
+        while (traffic_thread_check_pipe(&state->thread, 1000)) ;
+    }
+
+    if (verbose)
+        printf("[I] generator[%zu]: shutting down\n", id);
+
+    zpoller_destroy(&state->thread.poller);
+    zsock_destroy(&state->socket);
+}
+
+static size_t total_messages_sent = 0;
+
+static int timer_event(zloop_t *loop, int timer_id, void *arg)
+{
+    static size_t last_sent_count = 0;
+    static size_t last_sent_bytes = 0;
+    static size_t last_raw_bytes = 0;
+    static size_t last_requests = 0, last_frontend = 0, last_ajax = 0, last_errors = 0;
+    static int64_t last_time = 0;
+
+    size_t sent_count = 0, sent_bytes = 0, raw_bytes = 0;
+    size_t requests = 0, frontend = 0, ajax = 0, errors = 0;
+
+    for (size_t i = 0; i < options.num_threads; i++) {
+        generator_state_t *g = generators[i];
+        sent_count += __atomic_load_n(&g->messages_sent, __ATOMIC_RELAXED);
+        sent_bytes += __atomic_load_n(&g->bytes_sent, __ATOMIC_RELAXED);
+        raw_bytes += __atomic_load_n(&g->raw_bytes, __ATOMIC_RELAXED);
+        requests += __atomic_load_n(&g->requests_sent, __ATOMIC_RELAXED);
+        frontend += __atomic_load_n(&g->frontend_sent, __ATOMIC_RELAXED);
+        ajax += __atomic_load_n(&g->ajax_sent, __ATOMIC_RELAXED);
+        errors += __atomic_load_n(&g->errors_sent, __ATOMIC_RELAXED);
+    }
+
+    int64_t now = zclock_usecs();
+    double elapsed = last_time ? (now - last_time) / 1000000.0 : 1;
+    size_t tick_count = sent_count - last_sent_count;
+    size_t tick_bytes = sent_bytes - last_sent_bytes;
+    size_t tick_raw_bytes = raw_bytes - last_raw_bytes;
+    double avg_msg_size = tick_count ? (tick_bytes / 1024.0) / tick_count : 0;
+    double ratio = tick_bytes ? (double)tick_raw_bytes / tick_bytes : 0;
+
+    printf("[I] generated %zu messages (%.2f KB), avg: %.2f KB, compression ratio: %.2f\n",
+           tick_count, tick_bytes/1024.0, avg_msg_size, ratio);
+    printf("[I] rate: %.0f msgs/s (%.2f MB/s), requests: %zu, errors: %zu, frontend: %zu, ajax: %zu\n",
+           tick_count / elapsed, tick_bytes / elapsed / (1024.0 * 1024.0),
+           requests - last_requests, errors - last_errors, frontend - last_frontend, ajax - last_ajax);
+
+    last_sent_count = sent_count;
+    last_sent_bytes = sent_bytes;
+    last_raw_bytes = raw_bytes;
+    last_requests = requests;
+    last_frontend = frontend;
+    last_ajax = ajax;
+    last_errors = errors;
+    last_time = now;
+    total_messages_sent = sent_count;
+
+    traffic_publish_device_stats(&options, stats_socket);
+
+    return 0;
+}
+
+static int generator_finished(zloop_t *loop, zsock_t *reader, void *arg)
+{
+    char *msg = zstr_recv(reader);
+    if (msg) {
+        if (streq(msg, "finished"))
+            finished_generators++;
+        free(msg);
+    }
+    // terminate the main loop once all generators have produced their share
+    return finished_generators == options.num_threads ? -1 : 0;
+}
+
+void print_usage(char * const *argv)
+{
+    fprintf(stderr,
+            "usage: %s [options] [profile]\n"
+            "\nOptions:\n"
+            "  -c, --corpus F             copy additional request fields from JSON lines in file F\n"
+            "  -i, --io-threads N         zeromq io threads (defaults to number of generators)\n"
+            "  -n, --requests N           stop after generating N backend requests\n"
+            "  -r, --msg-rate N           output message rate (per second, 0 means unlimited)\n"
+            "  -t, --generators N         number of generator threads/sockets\n"
+            "  -v, --verbose              log more (use -vv for debug output)\n"
+            "  -d, --dealer               use zqm DEALER socket for publishing\n"
+            "  -P, --push                 use zmq PUSH socket for sending messages (overrides --dealer option)\n"
+            "  -p, --pub S                zmq specification for publishing socket\n"
+            "  -s, --devices N            simulate N devices\n"
+            "  -x, --compress M           compress messages using (snappy|zlib|lz4|none)\n"
+            "  -S, --seed N               random seed (defaults to generator/seed from profile)\n"
+            "      --help                 display this message\n"
+            "\nWithout a profile, a built-in profile with a single stream is used.\n"
+            "With N generators in PUB mode, generator i binds to the given port + i.\n"
+            , argv[0]);
+}
+
+void process_arguments(int argc, char * const *argv)
+{
+    char c;
+    int longindex = 0;
+    opterr = 0;
+    traffic_options_init(&options, "generator");
+
+    static struct option long_options[] = {
+        { "help",          no_argument,       0,  0  },
+        { "corpus",        required_argument, 0, 'c' },
+        { "requests",      required_argument, 0, 'n' },
+        { "msg-rate",      required_argument, 0, 'r' },
+        { "io-threads",    required_argument, 0, 'i' },
+        { "pub",           required_argument, 0, 'p' },
+        { "devices",       required_argument, 0, 's' },
+        { "generators",    required_argument, 0, 't' },
+        { "verbose",       no_argument,       0, 'v' },
+        { "dealer",        no_argument,       0, 'd' },
+        { "push",          no_argument,       0, 'P' },
+        { "compress",      required_argument, 0, 'x' },
+        { "seed",          required_argument, 0, 'S' },
+        { 0,               0,                 0,  0  }
+    };
+
+    while ((c = getopt_long(argc, argv, "Pvdc:n:r:i:p:s:t:x:S:", long_options, &longindex)) != -1) {
+        switch (c) {
+        case 'v':
+            if (verbose)
+                debug = true;
+            else
+                verbose = true;
+            break;
+        case 'c':
+            seed_corpus_file_name = optarg;
+            break;
+        case 'n':
+            message_limit = atoll(optarg);
+            break;
+        case 'r':
+            messages_per_second = atoi(optarg);
+            break;
+        case 'x':
+            compression_set = true;
+            compression_method = streq(optarg, "none") ? NO_COMPRESSION : string_to_compression_method(optarg);
+            break;
+        case 'S':
+            random_seed = strtoull(optarg, NULL, 10);
+            break;
+        case 0:
+            print_usage(argv);
+            exit(0);
+            break;
+        case '?':
+            if (strchr("cnripstxS", optopt))
+                fprintf(stderr, "[E] option -%c requires an argument.\n", optopt);
+            else if (isprint (optopt))
+                fprintf(stderr, "[E] unknown option `-%c'.\n", optopt);
+            else
+                fprintf(stderr, "[E] unknown option character `\\x%x'.\n", optopt);
+            print_usage(argv);
+            exit(1);
+        default:
+            if (!traffic_options_parse(&options, c, optarg)) {
+                fprintf(stderr, "BUG: can't process option -%c\n", optopt);
+                exit(1);
+            }
+        }
+    }
+
+    if (optind + 1 < argc) {
+        fprintf(stderr, "[E] too many arguments\n");
+        print_usage(argv);
+        exit(1);
+    } else if (optind +1 == argc) {
+        profile_file_name = argv[argc-1];
+    }
+
+    traffic_options_finalize(&options);
+}
+
+int main(int argc, char * const *argv)
+{
+    // don't buffer stdout and stderr
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    setvbuf(stderr, NULL, _IOLBF, 0);
+
+    process_arguments(argc, argv);
+
+    load_profile();
+    if (seed_corpus_file_name)
+        load_seed_corpus();
+    printf("[I] generating traffic for %zu streams, compression: %s, seed: %" PRIu64 "\n",
+           stream_count, compression_method_to_string(compression_method), random_seed);
+
+    // set global config
+    traffic_zsys_init(&options);
+    stats_socket = traffic_stats_socket_new(&options);
+
+    // set up event loop
+    zloop_t *loop = zloop_new();
+    assert(loop);
+    zloop_set_verbose(loop, 0);
+
+    // create generators
+    start_time = zclock_usecs();
+    for (size_t i = 0; i < options.num_threads; i++) {
+        generators[i] = generator_state_new(i);
+        generator_actors[i] = zactor_new(generator, generators[i]);
+        int rc = zloop_reader(loop, zactor_sock(generator_actors[i]), generator_finished, NULL);
+        assert(rc == 0);
+    }
+
+    // calculate statistics every 1000 ms
+    int timer_id = 1;
+    int rc = zloop_timer(loop, 1000, 0, timer_event, &timer_id);
+    assert(rc != -1);
+
+    traffic_run_main_loop(loop);
+
+    // final statistics
+    timer_event(loop, timer_id, NULL);
+    double runtime = (zclock_usecs() - start_time) / 1000000.0;
+    printf("[I] generated %zu messages in %.2f seconds (%.0f msgs/s)\n",
+           total_messages_sent, runtime, runtime > 0 ? total_messages_sent / runtime : 0);
+
+    // clean up
+    if (verbose) printf("[I] shutting down\n");
+
+    zloop_destroy(&loop);
+    assert(loop == NULL);
+    for (size_t i = 0; i < options.num_threads; i++) {
+        zactor_destroy(&generator_actors[i]);
+        generator_state_destroy(&generators[i]);
+    }
+    if (stats_socket)
+        zsock_destroy(&stats_socket);
+    zconfig_destroy(&profile);
+    zsys_shutdown();
+
+    if (verbose) printf("[I] terminated\n");
+
+    return 0;
+}
@@ -45,9 +45,12 @@ static void print_usage(char * const *argv)
             "  -e, --subscribe S,T        subscription patterns\n"
             "  -h, --hosts H,I            specs of devices to connect to\n"
             "  -i, --interface I          zmq spec of interface on which to listen\n"
+            "  -G, --gelf-endpoints E,F   send to graylog GELF inputs (udp://host:port or tcp://host:port)\n"
             "  -n, --dryrun               don't send data to graylog\n"
             "  -p, --parsers N            use N threads for parsing log messages\n"
+            "  -b, --subscribers N        use N threads for subscribing to devices\n"
             "  -z, --compress             compress data sent to graylog\n"
+            "  -Z, --compression-level N  zlib compression level (1-9), implies -z\n"
             "  -v, --verbose              verbose output (specify twice for debug mode)\n"
             "  -R, --rcv-hwm N            high watermark for input socket\n"
             "  -S, --snd-hwm N            high watermark for output socket\n"
@@ -58,6 +61,9 @@ static void print_usage(char * const *argv)
             "  -M, --metrics-ip N         ip for binding metrics endpoint\n"
             "  -T, --trim-frequency N     malloc trim freqency in seconds, 0 means no trimming\n"
             "  -H, --headers H            name of the whitelisted HTTP headers file\n"
+            "  -D, --spool-dir D          spool messages in directory D while graylog is unavailable\n"
+            "  -B, --spool-size N         maximum size of the spool in MB (default: %d)\n"
+            "  -r, --drain-rate N         send at most N spooled messages per second (default: %d)\n"
             "      --help                 display this message\n"
             "\nEnvironment: (parameters take precedence)\n"
             "  LOGJAM_DEVICES             specs of devices to connect to\n"
@@ -66,7 +72,7 @@ static void print_usage(char * const *argv)
             "  LOGJAM_SND_HWM             high watermark for output socket\n"
             "  LOGJAM_INTERFACE           zmq spec of interface on which to liste\n"
             "  LOGJAM_ABORT_AFTER         abort after missing heartbeats for this many seconds\n"
-            , argv[0]);
+            , argv[0], DEFAULT_SPOOL_MAX_SIZE, DEFAULT_SPOOL_DRAIN_RATE);
 }
 
 static void process_arguments(int argc, char * const *argv)
@@ -78,12 +84,15 @@ static void process_arguments(int argc, char * const *argv)
 
     static struct option long_options[] = {
         { "compress",       no_argument,       0, 'z' },
+        { "compression-level", required_argument, 0, 'Z' },
         { "config",         required_argument, 0, 'c' },
         { "dryrun",         no_argument,       0, 'n' },
         { "help",           no_argument,       0,  0  },
         { "hosts",          required_argument, 0, 'h' },
         { "interface",      required_argument, 0, 'i' },
+        { "gelf-endpoints", required_argument, 0, 'G' },
         { "parsers",        required_argument, 0, 'p' },
+        { "subscribers",    required_argument, 0, 'b' },
         { "quiet",          no_argument,       0, 'q' },
         { "rcv-hwm",        required_argument, 0, 'R' },
         { "snd-hwm",        required_argument, 0, 'S' },
@@ -96,10 +105,13 @@ static void process_arguments(int argc, char * const *argv)
         { "metrics-ip",     required_argument, 0, 'M' },
         { "trim-frequency", required_argument, 0, 'T' },
         { "headers",        required_argument, 0, 'H' },
+        { "spool-dir",      required_argument, 0, 'D' },
+        { "spool-size",     required_argument, 0, 'B' },
+        { "drain-rate",     required_argument, 0, 'r' },
         { 0,                0,                 0,  0  }
     };
 
-    while ((c = getopt_long(argc, argv, "vqc:np:zh:S:R:e:L:A:d:m:M:T:H:", long_options, &longindex)) != -1) {
+    while ((c = getopt_long(argc, argv, "vqc:np:b:zZ:h:i:G:S:R:e:L:A:d:m:M:T:H:D:B:r:", long_options, &longindex)) != -1) {
         switch (c) {
         case 'v':
             if (verbose)
@@ -129,6 +141,16 @@ static void process_arguments(int argc, char * const *argv)
         case 'z':
             compress_gelf = true;
             break;
+        case 'Z': {
+            int level = atoi(optarg);
+            if (level < 1 || level > 9) {
+                fprintf(stderr, "compression level must be between 1 and 9\n");
+                exit(1);
+            }
+            gelf_compression_level = level;
+            compress_gelf = true;
+            break;
+        }
         case 'p': {
             unsigned int n = strtoul(optarg, NULL, 0);
             if (n <= MAX_PARSERS)
@@ -139,6 +161,16 @@ static void process_arguments(int argc, char * const *argv)
             }
             break;
         }
+        case 'b': {
+            unsigned int n = strtoul(optarg, NULL, 0);
+            if (n > 0 && n <= MAX_SUBSCRIBERS)
+                num_subscribers = n;
+            else {
+                fprintf(stderr, "parameter value 'b' must be between 1 and %d\n", MAX_SUBSCRIBERS);
+                exit(1);
+            }
+            break;
+        }
         case 'h':
             hosts = split_delimited_string(optarg);
             if (hosts == NULL || zlist_size(hosts) == 0) {
@@ -149,6 +181,9 @@ static void process_arguments(int argc, char * const *argv)
         case 'i':
             interface = optarg;
             break;
+        case 'G':
+            gelf_endpoints = split_delimited_string(optarg);
+            break;
         case 'e':
             subscription_pattern = optarg;
             break;
@@ -171,6 +206,15 @@ static void process_arguments(int argc, char * const *argv)
             headers_file_name = optarg;
             break;
         }
+        case 'D':
+            spool_directory = optarg;
+            break;
+        case 'B':
+            spool_max_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            spool_drain_rate = strtoul(optarg, NULL, 0);
+            break;
         case 0:
             print_usage(argv);
             exit(0);
@@ -248,10 +292,6 @@ int main(int argc, char * const *argv)
         config = zconfig_load((char*)config_file_name);
     }
 
-    // initalize prometheus client
-    snprintf(metrics_address, sizeof(metrics_address), "%s:%d", metrics_ip, metrics_port);
-    graylog_forwarder_prometheus_client_init(metrics_address, num_parsers);
-
     // convert config file to list of devices if none where specified as a parameter or env variable
     if (hosts == NULL || zlist_size(hosts) == 0) {
         if (hosts == NULL)
@@ -270,10 +310,42 @@ int main(int argc, char * const *argv)
         }
     }
 
+    // more subscribers than devices would be idle
+    if (num_subscribers > zlist_size(hosts))
+        num_subscribers = zlist_size(hosts);
+
+    // initalize prometheus client
+    snprintf(metrics_address, sizeof(metrics_address), "%s:%d", metrics_ip, metrics_port);
+    graylog_forwarder_prometheus_client_init(metrics_address, num_subscribers, num_parsers);
+
     // configure graylog endpoint
     if (interface == NULL)
         interface = zconfig_resolve(config, "/graylog/endpoint", DEFAULT_INTERFACE);
 
+    // GELF UDP/TCP endpoints replace the zmq PUSH socket
+    if (gelf_endpoints == NULL) {
+        zconfig_t *endpoints = zconfig_locate(config, "/graylog/gelf_endpoints");
+        if (endpoints) {
+            gelf_endpoints = zlist_new();
+            for (zconfig_t *endpoint = zconfig_child(endpoints); endpoint; endpoint = zconfig_next(endpoint))
+                zlist_append(gelf_endpoints, zconfig_value(endpoint));
+        }
+    }
+    if (gelf_endpoints && zlist_size(gelf_endpoints) == 0)
+        zlist_destroy(&gelf_endpoints);
+    if (gelf_endpoints) {
+        for (char *spec = zlist_first(gelf_endpoints); spec; spec = zlist_next(gelf_endpoints)) {
+            if (compress_gelf && !strncmp(spec, "tcp://", 6)) {
+                fprintf(stderr, "[E] GELF TCP inputs don't accept compressed messages: %s\n", spec);
+                exit(1);
+            }
+            if (strncmp(spec, "tcp://", 6) && strncmp(spec, "udp://", 6)) {
+                fprintf(stderr, "[E] invalid GELF endpoint: %s\n", spec);
+                exit(1);
+            }
+        }
+    }
+
     // set inbound high-water-mark
     if (rcv_hwm == -1)
         rcv_hwm = atoi(zconfig_resolve(config, "/logjam/high_water_mark", DEFAULT_RCV_HWM_STR));
@@ -282,6 +354,18 @@ int main(int argc, char * const *argv)
     if (snd_hwm == -1)
         snd_hwm = atoi(zconfig_resolve(config, "/graylog/high_water_mark", DEFAULT_SND_HWM_STR));
 
+    // configure spooling
+    if (spool_directory == NULL)
+        spool_directory = zconfig_resolve(config, "/graylog/spool/directory", NULL);
+    if (spool_max_size == 0)
+        spool_max_size = atoi(zconfig_resolve(config, "/graylog/spool/max_size", "0"));
+    if (spool_max_size == 0)
+        spool_max_size = DEFAULT_SPOOL_MAX_SIZE;
+    if (spool_drain_rate == 0)
+        spool_drain_rate = atoi(zconfig_resolve(config, "/graylog/spool/drain_rate", "0"));
+    if (spool_drain_rate == 0)
+        spool_drain_rate = DEFAULT_SPOOL_DRAIN_RATE;
+
     if (!quiet)
         printf("[I] started %s\n"
                "[I] interface %s\n"
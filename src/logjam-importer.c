@@ -341,26 +341,6 @@ void process_arguments(int argc, char * const *argv)
         indexer_opts = 0;
 }
 
-static
-zlist_t* extract_devices_from_config(zconfig_t* config)
-{
-    zlist_t *devices = zlist_new();
-    zconfig_t *bindings = zconfig_locate(config, "frontend/endpoints/bindings");
-    assert(bindings);
-    zconfig_t *binding = zconfig_child(bindings);
-    while (binding) {
-        char *spec = zconfig_value(binding);
-        if (streq(spec, "")) {
-            if (verbose)
-                printf("[I] ignoring empty SUB socket binding in config\n");
-        } else {
-            zlist_append(devices, spec);
-        }
-        binding = zconfig_next(binding);
-    }
-    return devices;
-}
-
 int main(int argc, char * const *argv)
 {
     // don't buffer stdout and stderr
@@ -411,6 +391,9 @@ int main(int argc, char * const *argv)
     if (unknown_streams_collector_connection_spec == NULL)
         unknown_streams_collector_connection_spec = zconfig_resolve(config, "frontend/endpoints/unknown_streams_collector/pub", DEFAULT_UNKNOWN_STREAMS_COLLECTOR_CONNECTION);
 
+    legacy_quants = strcmp(zconfig_resolve(config, "frontend/quants/legacy", "true"), "false");
+    config_update_storage_limits(config);
+
     setup_thread_counts(config);
 
     if (!quiet)
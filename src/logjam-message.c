@@ -25,21 +25,6 @@ const int SYSLOG_MAPPING[6] = {
     1 /* Alert */
 };
 
-static inline void str_underscore(char *str)
-{
-    for (char *p = str; *p; ++p) {
-        if (*p == '-')
-            *p = '_';
-    }
-}
-
-static inline void str_lower(char *str)
-{
-    for (char *p = str; *p; ++p) {
-        *p = tolower(*p);
-    }
-}
-
 logjam_message* logjam_message_read(zsock_t *receiver)
 {
     int i = 0, end_of_message = 0;
@@ -112,299 +97,765 @@ char* extract_module(const char *action)
    return strdup(module_str);
 }
 
-static int stringcmp(const void *a, const void *b)
+
+// The GELF message is produced in a single pass over the request JSON, without building
+// json-c objects for either side: values which are copied unchanged are taken verbatim
+// from the input (string literals keep their escape sequences) and only the few values
+// which need inspection (action, caller info, headers, log levels) are looked at. The
+// scanner validates the structure of the input, but not the syntax of numbers and
+// literals, which are only copied.
+
+typedef enum {
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_LITERAL,
+    JSON_NULL,
+    JSON_OBJECT,
+    JSON_ARRAY,
+} json_token_type_t;
+
+typedef struct {
+    json_token_type_t type;
+    const char *start;          // raw JSON text of the value
+    size_t len;
+    const char *str;            // contents of string literals, still escaped
+    size_t str_len;
+} json_token_t;
+
+typedef struct {
+    const char *p;
+    const char *end;
+    int depth;
+} json_scanner_t;
+
+#define MAX_JSON_DEPTH 64
+
+static inline void js_skip_ws(json_scanner_t *s)
 {
-    const char **ia = (const char **)a;
-    const char **ib = (const char **)b;
-    return strcmp(*ia, *ib);
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t'))
+        s->p++;
 }
 
-zchunk_t* sort_headers(zhash_t *headers) {
-    size_t n = zhash_size(headers);
-    const char **keys = malloc(n * sizeof(char*));
-    char* value = zhash_first(headers);
-    int i = 0;
-    size_t bufsize = 1; // terminating null byte
-    while (value) {
-        if (i>0) bufsize++; // newline if not first header
-        const char *key = zhash_cursor(headers);
-        keys[i++] = key;
-        bufsize += strlen(key) + 2 + strlen(value); // 2 = strlen(": ")
-        value = zhash_next(headers);
-    }
-    qsort(keys, n, sizeof(char*), stringcmp);
-    zchunk_t *extra_headers_chunk = zchunk_new(NULL, bufsize*2);
-    for (i = 0; i < n; i++) {
-        if (i > 0) {
-            zchunk_append(extra_headers_chunk, "\n", 1);
+static inline char js_peek(json_scanner_t *s)
+{
+    js_skip_ws(s);
+    return s->p < s->end ? *s->p : '\0';
+}
+
+static inline bool js_expect(json_scanner_t *s, char c)
+{
+    if (js_peek(s) != c)
+        return false;
+    s->p++;
+    return true;
+}
+
+static bool js_scan_string(json_scanner_t *s, const char **str, size_t *len)
+{
+    if (!js_expect(s, '"'))
+        return false;
+    const char *start = s->p;
+    while (s->p < s->end) {
+        char c = *s->p;
+        if (c == '"') {
+            *str = start;
+            *len = s->p++ - start;
+            return true;
         }
-        const char *key = keys[i];
-        char *val = zhash_lookup(headers, key);
-        zchunk_append(extra_headers_chunk, key, strlen(key));
-        zchunk_append(extra_headers_chunk, ": ", 2);
-        zchunk_append(extra_headers_chunk, val, strlen(val));
+        s->p += (c == '\\') ? 2 : 1;
     }
-    free(keys);
-    zchunk_append(extra_headers_chunk, "", 1);
-    return extra_headers_chunk;
+    return false;
 }
 
-
-gelf_message* logjam_message_to_gelf(logjam_message *logjam_msg, json_tokener *tokener, zhash_t *stream_info_cache, zchunk_t *decompression_buffer, zchunk_t *buffer, zhash_t *header_fields, zlist_t *sensitive_cookies, zchunk_t *obfuscation_buffer)
+// returns 1 if positioned at the value of the next member, 0 at the end of the object, -1 on errors
+static int js_next_member(json_scanner_t *s, bool *first, const char **key, size_t *key_len)
 {
-    json_object *obj = NULL, *http_request = NULL, *lines = NULL;
-    const char *host = "Not found", *action = "";
-    char *str = NULL;
+    if (js_expect(s, '}'))
+        return 0;
+    if (!*first && !js_expect(s, ','))
+        return -1;
+    *first = false;
+    if (!js_scan_string(s, key, key_len) || !js_expect(s, ':'))
+        return -1;
+    return 1;
+}
 
-    // extract meta information
-    msg_meta_t meta;
-    frame_extract_meta_info(logjam_msg->frames[3], &meta);
+// returns 1 if positioned at the next array element, 0 at the end of the array, -1 on errors
+static int js_next_element(json_scanner_t *s, bool *first)
+{
+    if (js_expect(s, ']'))
+        return 0;
+    if (!*first && !js_expect(s, ','))
+        return -1;
+    *first = false;
+    return 1;
+}
 
-    char *app_env = zframe_strdup (logjam_msg->frames[0]);
-    stream_info_t *stream_info = get_stream_info(app_env, stream_info_cache);
-    if (stream_info == NULL) {
-        if (verbose)
-            fprintf(stderr, "[W] dropped request from unknown stream: %s\n", app_env);
-        free(app_env);
-        return NULL;
+static bool js_scan_value(json_scanner_t *s, json_token_t *t)
+{
+    char c = js_peek(s);
+    t->start = s->p;
+    t->str = NULL;
+    t->str_len = 0;
+    switch (c) {
+    case '\0':
+        return false;
+    case '"':
+        t->type = JSON_STRING;
+        if (!js_scan_string(s, &t->str, &t->str_len))
+            return false;
+        break;
+    case '{':
+    case '[': {
+        if (++s->depth > MAX_JSON_DEPTH)
+            return false;
+        s->p++;
+        bool first = true;
+        int rc;
+        json_token_t member;
+        if (c == '{') {
+            t->type = JSON_OBJECT;
+            const char *key;
+            size_t key_len;
+            while ((rc = js_next_member(s, &first, &key, &key_len)) == 1)
+                if (!js_scan_value(s, &member))
+                    return false;
+        } else {
+            t->type = JSON_ARRAY;
+            while ((rc = js_next_element(s, &first)) == 1)
+                if (!js_scan_value(s, &member))
+                    return false;
+        }
+        s->depth--;
+        if (rc < 0)
+            return false;
+        break;
     }
-
-    // decompress if necessary
-    char *json_data;
-    size_t json_data_len;
-    if (meta.compression_method) {
-        decompress_frame(logjam_msg->frames[2], meta.compression_method, decompression_buffer, &json_data, &json_data_len);
-    } else {
-        json_data = (char*)zframe_data(logjam_msg->frames[2]);
-        json_data_len = zframe_size(logjam_msg->frames[2]);
+    default:
+        while (s->p < s->end && !strchr(",}] \t\r\n", *s->p))
+            s->p++;
+        if (s->p == t->start || c == '}' || c == ']' || c == ',' || c == ':')
+            return false;
+        if (c == '-' || isdigit(c))
+            t->type = JSON_NUMBER;
+        else if (s->p - t->start == 4 && !strncmp(t->start, "null", 4))
+            t->type = JSON_NULL;
+        else
+            t->type = JSON_LITERAL;
     }
+    t->len = s->p - t->start;
+    return true;
+}
+
+static inline bool js_token_is_nonempty_string(json_token_t *t)
+{
+    return t->type == JSON_STRING && t->str_len > 0;
+}
 
-    // now see whether we can parse it
-    json_object *request = parse_json_data(json_data, json_data_len, tokener);
+// parses the integer part of a number token. the input isn't zero terminated, so the
+// number is copied first.
+static bool js_token_int64(json_token_t *t, int64_t *value)
+{
+    char buffer[32];
+    if (t->type != JSON_NUMBER || t->len >= sizeof(buffer))
+        return false;
+    memcpy(buffer, t->start, t->len);
+    buffer[t->len] = '\0';
+    *value = strtoll(buffer, NULL, 10);
+    return true;
+}
 
-    if (!request) {
-        if (verbose)
-            printf("[D] could not parse JSON data: %*.s\n", (int)json_data_len, json_data);
-        free(app_env);
-        return NULL;
+// log levels outside of the known range are Unknown
+static int js_token_log_level(json_token_t *t, int missing)
+{
+    int64_t level;
+    if (!js_token_int64(t, &level))
+        return missing;
+    return level < 0 || level > 5 ? 5 : level;
+}
+
+static bool js_read_hex4(const char *p, const char *end, uint32_t *value)
+{
+    if (end - p < 4)
+        return false;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            return false;
     }
+    *value = v;
+    return true;
+}
 
-    if (debug)
-        dump_json_object(stdout, "[D]", request);
+static size_t utf8_encode(uint32_t cp, char *out)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xc0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xe0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3f);
+    out[2] = 0x80 | ((cp >> 6) & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
 
-    if (json_object_object_get_ex (request, "host", &obj)) {
-        host = json_object_get_string (obj);
+// copies the string contents of a token to a zero terminated buffer, resolving escape
+// sequences and truncating if necessary
+static void js_token_copy_string(json_token_t *t, char *buffer, size_t size)
+{
+    if (t->type != JSON_STRING) {
+        size_t len = t->type == JSON_NULL ? 0 : t->len;
+        if (len >= size)
+            len = size - 1;
+        memcpy(buffer, t->start, len);
+        buffer[len] = '\0';
+        return;
     }
-    if (json_object_object_get_ex (request, "action", &obj)) {
-        action = json_object_get_string (obj);
-        if (action == NULL)
-            action = "";
+    const char *p = t->str;
+    const char *end = t->str + t->str_len;
+    size_t n = 0;
+    // leave room for the longest utf-8 sequence and the terminating zero
+    while (p < end && n + 4 < size) {
+        char c = *p++;
+        if (c != '\\' || p == end) {
+            buffer[n++] = c;
+            continue;
+        }
+        c = *p++;
+        switch (c) {
+        case 'b': buffer[n++] = '\b'; break;
+        case 'f': buffer[n++] = '\f'; break;
+        case 'n': buffer[n++] = '\n'; break;
+        case 'r': buffer[n++] = '\r'; break;
+        case 't': buffer[n++] = '\t'; break;
+        case 'u': {
+            uint32_t cp;
+            if (!js_read_hex4(p, end, &cp)) {
+                // invalid escape sequences are kept as text
+                buffer[n++] = '\\';
+                buffer[n++] = c;
+                break;
+            }
+            p += 4;
+            uint32_t low;
+            if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u'
+                && js_read_hex4(p + 2, end, &low) && low >= 0xdc00 && low < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                p += 6;
+            } else if (cp >= 0xd800 && cp < 0xe000) {
+                // unpaired surrogate
+                cp = '?';
+            }
+            n += utf8_encode(cp, buffer + n);
+            break;
+        }
+        case '"':
+        case '\\':
+        case '/':
+            buffer[n++] = c;
+            break;
+        default:
+            buffer[n++] = '\\';
+            buffer[n++] = c;
+        }
     }
+    buffer[n] = '\0';
+}
 
-    int action_len = strlen (action);
-    zchunk_ensure_size (buffer, action_len + 100);
-    char *buf = (char*) zchunk_data (buffer);
-    *buf = '\0';
-    strcat(buf, action);
-    char *pos = buf + action_len;
+#define KEY_IS(k) (key_len == sizeof(k) - 1 && !memcmp(key, k, sizeof(k) - 1))
 
-    if (action_len == 0)
-        strcat (pos, "Unknown#unknown_method");
-    else if (!strchr(action, '#'))
-        strcat (pos, "#unknown_method");
-    else if (action[action_len-1] == '#')
-        strcat (pos, "unknown_method");
-    action = buf;
+// returns the severity of a request by only scanning its top level members. the severity
+// set by the logjam agents is the maximum severity of the logged lines, so the lines don't
+// need to be inspected. requests with a missing or non numeric severity are sampled like
+// info requests, so they are not thrown away as debug noise. returns -1 for invalid JSON.
+static int request_severity(const char *json_data, size_t json_data_len)
+{
+    json_scanner_t s = { json_data, json_data + json_data_len, 0 };
+    const char *key;
+    size_t key_len;
+    bool first = true;
+    int severity = LOG_SEVERITY_INFO;
+    int rc;
+
+    if (js_peek(&s) != '{')
+        return -1;
+    s.p++;
+    while ((rc = js_next_member(&s, &first, &key, &key_len)) == 1) {
+        json_token_t value;
+        if (!js_scan_value(&s, &value))
+            return -1;
+        if (KEY_IS("severity")) {
+            severity = js_token_log_level(&value, severity);
+            break;
+        }
+    }
+    return rc < 0 ? -1 : severity;
+}
+
+// state of a single conversion
+typedef struct {
+    gelf_message *gelf;
+    header_matcher_t *headers;
+    zchunk_t *obfuscation_buffer;
+    const char *app_env;
+    int lines_level;
+    bool have_url;
+} gelf_encoder_t;
 
-    gelf_message *gelf_msg = gelf_message_new (host, action);
+// the value of a header which hasn't been extracted into a separate field
+typedef struct {
+    const char *key;
+    size_t key_len;
+    json_token_t value;
+} header_t;
 
-    gelf_message_add_string (gelf_msg, "_app", app_env);
+#define MAX_NOT_EXTRACTED_HEADERS 256
 
-    double timestamp;
+// adds a field with the string value of the given token (as json_object_get_string would return it)
+static void add_token_as_string_contents(gelf_message *gelf, json_token_t *t)
+{
+    if (t->type == JSON_STRING)
+        gelf_message_append_json_string(gelf, t->str, t->str_len);
+    else if (t->type != JSON_NULL)
+        gelf_message_append_string(gelf, t->start, t->len);
+}
 
-    // use logjam_agent's started_ms if available, current time as fallback
-    if (json_object_object_get_ex (request, "started_ms", &obj)) {
-        int64_t started_ms = json_object_get_int64(obj);
-        timestamp = started_ms / 1000.0;
+static void add_token(gelf_message *gelf, const char *key, json_token_t *t)
+{
+    if (t->type == JSON_STRING) {
+        gelf_message_start_string(gelf, key);
+        gelf_message_append_json_string(gelf, t->str, t->str_len);
+        gelf_message_finish_string(gelf);
     } else {
-        timestamp = zclock_time() / 1000.0;
+        gelf_message_add_json(gelf, key, t->start, t->len);
     }
+}
 
-    gelf_message_add_double(gelf_msg, "timestamp", timestamp);
+// appends the value of a cookie header with sensitive cookie values replaced
+static void append_filtered_cookies(gelf_encoder_t *enc, json_token_t *t)
+{
+    cookie_masker_t *masker = header_matcher_cookie_masker(enc->headers);
+    size_t filtered_len;
+    char *filtered = cookie_masker_apply(masker, t->str, t->str_len, enc->obfuscation_buffer, &filtered_len);
+    if (filtered)
+        gelf_message_append_json_string(enc->gelf, filtered, filtered_len);
+    else
+        gelf_message_append_json_string(enc->gelf, t->str, t->str_len);
+}
 
-    if (json_object_object_get_ex (request, "code", &obj)) {
-        gelf_message_add_json_object (gelf_msg, "_code", obj);
-    }
+static inline bool is_cookie_header(const char *key, size_t key_len)
+{
+    return key_len == 6 && !strncasecmp(key, "cookie", 6);
+}
 
-    if (json_object_object_get_ex (request, "request_id", &obj)) {
-        gelf_message_add_json_object (gelf_msg, "_request_id", obj);
+static int compare_headers(const void *a, const void *b)
+{
+    const header_t *ha = a, *hb = b;
+    size_t n = ha->key_len < hb->key_len ? ha->key_len : hb->key_len;
+    for (size_t i = 0; i < n; i++) {
+        int d = tolower(ha->key[i]) - tolower(hb->key[i]);
+        if (d)
+            return d;
     }
+    return (ha->key_len > hb->key_len) - (ha->key_len < hb->key_len);
+}
 
-    if (json_object_object_get_ex (request, "ip", &obj)) {
-        gelf_message_add_json_object (gelf_msg, "_ip", obj);
+static void add_not_extracted_headers(gelf_encoder_t *enc, header_t *headers, size_t n)
+{
+    qsort(headers, n, sizeof(header_t), compare_headers);
+    gelf_message_start_string(enc->gelf, "_http_headers_not_extracted");
+    for (size_t i = 0; i < n; i++) {
+        header_t *h = &headers[i];
+        if (i > 0)
+            gelf_message_append_string(enc->gelf, "\n", 1);
+        // keys are lower cased in chunks. escape sequences, valid or not, are copied
+        // unchanged and never split between two chunks.
+        const char *p = h->key, *end = h->key + h->key_len;
+        while (p < end) {
+            char key[256];
+            size_t key_len = 0;
+            while (p < end && key_len + 6 <= sizeof(key)) {
+                size_t n = gelf_message_json_escape_length(p, end);
+                if (n == 0 && *p == '\\')
+                    n = end - p < 2 ? 1 : 2;
+                if (n == 0) {
+                    key[key_len++] = tolower(*p++);
+                } else {
+                    memcpy(key + key_len, p, n);
+                    key_len += n;
+                    p += n;
+                }
+            }
+            gelf_message_append_json_string(enc->gelf, key, key_len);
+        }
+        gelf_message_append_string(enc->gelf, ": ", 2);
+        if (h->value.type == JSON_STRING && is_cookie_header(h->key, h->key_len))
+            append_filtered_cookies(enc, &h->value);
+        else
+            add_token_as_string_contents(enc->gelf, &h->value);
     }
+    gelf_message_finish_string(enc->gelf);
+}
 
-    if (json_object_object_get_ex (request, "process_id", &obj)) {
-        gelf_message_add_json_object (gelf_msg, "_process_id", obj);
-    }
+static bool encode_headers(gelf_encoder_t *enc, json_scanner_t *s)
+{
+    header_t headers[MAX_NOT_EXTRACTED_HEADERS];
+    size_t num_headers = 0;
+    const char *key;
+    size_t key_len;
+    bool first = true;
+    int rc;
 
-    if (json_object_object_get_ex (request, "datacenter", &obj)) {
-        gelf_message_add_json_object (gelf_msg, "_datacenter", obj);
-    } else {
-        gelf_message_add_string (gelf_msg, "_datacenter", default_datacenter);
-    }
+    s->p++;
+    while ((rc = js_next_member(s, &first, &key, &key_len)) == 1) {
+        json_token_t value;
+        if (!js_scan_value(s, &value))
+            return false;
 
-    if (json_object_object_get_ex (request, "namespace", &obj)) {
-        gelf_message_add_json_object (gelf_msg, "_namespace", obj);
+        // whitelisted headers become fields of their own, named after the lower cased header
+        const char *field = header_matcher_field(enc->headers, key, key_len);
+        if (field) {
+            if (value.type == JSON_STRING && is_cookie_header(key, key_len)) {
+                gelf_message_start_string(enc->gelf, field);
+                append_filtered_cookies(enc, &value);
+                gelf_message_finish_string(enc->gelf);
+            } else {
+                add_token(enc->gelf, field, &value);
+            }
+        } else if (num_headers < MAX_NOT_EXTRACTED_HEADERS) {
+            header_t *h = &headers[num_headers++];
+            h->key = key;
+            h->key_len = key_len;
+            h->value = value;
+        }
     }
+    if (rc < 0)
+        return false;
 
-    if (json_object_object_get_ex (request, "user_id", &obj)
-            && json_object_get_type (obj) != json_type_null) {
-        gelf_message_add_json_object (gelf_msg, "_user_id", obj);
-    }
+    if (num_headers > 0)
+        add_not_extracted_headers(enc, headers, num_headers);
 
-    if (json_object_object_get_ex (request, "total_time", &obj)) {
-        gelf_message_add_json_object (gelf_msg, "_total_time", obj);
-    }
+    return true;
+}
 
-    filter_sensitive_cookies(request, sensitive_cookies, obfuscation_buffer);
+static bool encode_request_info(gelf_encoder_t *enc, json_scanner_t *s)
+{
+    const char *key;
+    size_t key_len;
+    bool first = true;
+    int rc;
 
-    if (json_object_object_get_ex (request, "request_info", &http_request)) {
-        if (json_object_object_get_ex (http_request, "method", &obj)) {
-            gelf_message_add_json_object (gelf_msg, "_http_method", obj);
+    s->p++;
+    while ((rc = js_next_member(s, &first, &key, &key_len)) == 1) {
+        if (KEY_IS("headers") && js_peek(s) == '{') {
+            if (!encode_headers(enc, s))
+                return false;
+            continue;
         }
-
-        if (json_object_object_get_ex (http_request, "url", &obj)) {
-            gelf_message_add_json_object (gelf_msg, "_http_url", obj);
-            const char *path = json_object_get_string(obj);
-            char* module = extract_module(action);
-            adjust_caller_info(path, module, request, stream_info);
-            free(module);
+        json_token_t value;
+        if (!js_scan_value(s, &value))
+            return false;
+        if (KEY_IS("method")) {
+            add_token(enc->gelf, "_http_method", &value);
+        } else if (KEY_IS("url")) {
+            add_token(enc->gelf, "_http_url", &value);
+            enc->have_url = value.type != JSON_NULL;
+        } else if (KEY_IS("headers")) {
+            fprintf(stderr, "[W] unexpected json data type for headers: %.*s; app: %s\n",
+                    (int)(value.len > 20 ? 20 : value.len), value.start, enc->app_env);
         }
+    }
+    return rc == 0;
+}
 
-        if (json_object_object_get_ex (http_request, "headers", &obj)) {
-            json_type jtype = json_object_get_type (obj);
-            if (jtype != json_type_object) {
-                fprintf(stderr, "[W] unexpected json data type for headers: %s; app: %s, action: %s\n",
-                        json_type_to_name(jtype),
-                        app_env,
-                        action
-                        );
-                // dump_json_object(stderr, "[W]", request);
-            } else {
-                char header[1024] = "_http_header_";
-                // clear buffer data
-                zhash_t *headers = zhash_new();
-                json_object_object_foreach (obj, key, value) {
-                    str_lower(key);
-                    if (zhash_lookup(header_fields, key)) {
-                        snprintf (header, 1024, "_http_header_%s", key);
-                        str_underscore(header + 13);
-                        gelf_message_add_json_object (gelf_msg, header, value);
-                    } else {
-                        const char *val = json_object_get_string(value);
-                        zhash_insert(headers, key, strdup(val));
-                        zhash_freefn(headers, key, free);
-                    }
-                }
-                if (zhash_size(headers) > 0) {
-                    zchunk_t *extra_headers_chunk = sort_headers(headers);
-                    const char *data = (const char*) zchunk_data(extra_headers_chunk);
-                    gelf_message_add_string(gelf_msg, "_http_headers_not_extracted", data);
-                    zchunk_destroy(&extra_headers_chunk);
-                }
-                zhash_destroy(&headers);
-            }
+// lines are arrays of severity, timestamp and logged text. full_message contains one line
+// of text for each of them: "severity-as-word timestamp logged-text"
+static bool encode_lines(gelf_encoder_t *enc, json_scanner_t *s)
+{
+    bool first = true;
+    int rc;
+
+    s->p++;
+    gelf_message_start_string(enc->gelf, "full_message");
+    while ((rc = js_next_element(s, &first)) == 1) {
+        if (js_peek(s) != '[') {
+            json_token_t ignored;
+            if (!js_scan_value(s, &ignored))
+                return false;
+            continue;
+        }
+        s->p++;
+        json_token_t parts[3];
+        int num_parts = 0;
+        bool first_part = true;
+        while ((rc = js_next_element(s, &first_part)) == 1) {
+            json_token_t part;
+            if (!js_scan_value(s, &part))
+                return false;
+            if (num_parts < 3)
+                parts[num_parts++] = part;
         }
+        if (rc < 0)
+            return false;
+
+        int level = num_parts > 0 ? js_token_log_level(&parts[0], 0) : 0;
+        if (level > enc->lines_level)
+            enc->lines_level = level;
+        const char *level_name = LOG_LEVELS_NAMES[level];
+        gelf_message_append_string(enc->gelf, level_name, strlen(level_name));
+        gelf_message_append_string(enc->gelf, " ", 1);
+        if (num_parts > 1)
+            add_token_as_string_contents(enc->gelf, &parts[1]);
+        gelf_message_append_string(enc->gelf, " ", 1);
+        if (num_parts > 2)
+            add_token_as_string_contents(enc->gelf, &parts[2]);
+        gelf_message_append_string(enc->gelf, "\n", 1);
     }
+    gelf_message_finish_string(enc->gelf);
+    return rc == 0;
+}
 
-    // needs to happen after the call to adjust_caller_info
-    if (json_object_object_get_ex (request, "caller_id", &obj) && json_object_get_type(obj) == json_type_string) {
-        const char *caller_id = json_object_get_string(obj);
-        if (caller_id && *caller_id) {
-            gelf_message_add_json_object (gelf_msg, "_caller_id", obj);
-            char app[256], env[256], rid[256];
-            if (extract_app_env_rid (caller_id, 256, app, env, rid)) {
-                json_object *app_obj = json_object_new_string(app);
-                gelf_message_add_json_object (gelf_msg, "_caller_app", app_obj);
-                json_object_put(app_obj);
-            }
-        }
+static void add_caller_app(gelf_message *gelf, const char *caller_id)
+{
+    char app[256], env[256], rid[256];
+    if (extract_app_env_rid(caller_id, 256, app, env, rid))
+        gelf_message_add_string(gelf, "_caller_app", app);
+}
+
+static void add_caller_id(gelf_message *gelf, const char *caller_id)
+{
+    gelf_message_add_string(gelf, "_caller_id", caller_id);
+    add_caller_app(gelf, caller_id);
+}
+
+// state of caller_id and caller_action fields
+enum caller_info_state { CALLER_INFO_MISSING, CALLER_INFO_PRESENT, CALLER_INFO_OTHER };
+
+static enum caller_info_state caller_info_state(json_token_t *t)
+{
+    if (js_token_is_nonempty_string(t))
+        return CALLER_INFO_PRESENT;
+    if (t->type == JSON_NULL || t->type == JSON_STRING)
+        return CALLER_INFO_MISSING;
+    return CALLER_INFO_OTHER;
+}
+
+bool logjam_message_to_gelf(logjam_message *logjam_msg, gelf_message *gelf_msg, zhash_t *stream_info_cache, zchunk_t *decompression_buffer, zchunk_t *buffer, header_matcher_t *headers, zchunk_t *obfuscation_buffer, gelf_sampler_t *sampler)
+{
+    // extract meta information
+    msg_meta_t meta;
+    frame_extract_meta_info(logjam_msg->frames[3], &meta);
+
+    char *app_env = zframe_strdup (logjam_msg->frames[0]);
+    stream_info_t *stream_info = get_stream_info(app_env, stream_info_cache);
+    if (stream_info == NULL) {
+        if (verbose)
+            fprintf(stderr, "[W] dropped request from unknown stream: %s\n", app_env);
+        free(app_env);
+        return false;
     }
 
-    // needs to happen after the call to adjust_caller_info
-    if (json_object_object_get_ex (request, "caller_action", &obj) && json_object_get_type(obj) == json_type_string) {
-        const char *caller_action = json_object_get_string(obj);
-        if (caller_action && *caller_action)
-            gelf_message_add_json_object (gelf_msg, "_caller_action", obj);
+    // decompress if necessary
+    char *json_data;
+    size_t json_data_len;
+    if (meta.compression_method) {
+        decompress_frame(logjam_msg->frames[2], meta.compression_method, decompression_buffer, &json_data, &json_data_len);
+    } else {
+        json_data = (char*)zframe_data(logjam_msg->frames[2]);
+        json_data_len = zframe_size(logjam_msg->frames[2]);
     }
 
-    // forward trace_id field
-    if (json_object_object_get_ex (request, "trace_id", &obj) && json_object_get_type(obj) == json_type_string) {
-        const char *trace_id = json_object_get_string(obj);
-        if (trace_id && *trace_id) {
-            gelf_message_add_json_object (gelf_msg, "_trace_id", obj);
+    if (debug)
+        printf("[D] %.*s\n", (int)json_data_len, json_data);
+
+    // drop sampled and rate limited requests before doing the expensive conversion
+    if (sampler && gelf_sampler_applies_to(stream_info)) {
+        int severity = stream_info->gelf_sampling ? request_severity(json_data, json_data_len) : LOG_SEVERITY_DEBUG;
+        if (gelf_sampler_check(sampler, stream_info, severity, zclock_time()) != GELF_FORWARD) {
+            free(app_env);
+            release_stream_info(stream_info);
+            return false;
         }
     }
 
-    // forward sender_id field
-    if (json_object_object_get_ex (request, "sender_id", &obj) && json_object_get_type(obj) == json_type_string) {
-        const char *sender_id = json_object_get_string(obj);
-        if (sender_id && *sender_id) {
-            gelf_message_add_json_object (gelf_msg, "_sender_id", obj);
+    gelf_encoder_t enc = {
+        .gelf = gelf_msg,
+        .headers = headers,
+        .obfuscation_buffer = obfuscation_buffer,
+        .app_env = app_env,
+        .lines_level = 0,
+        .have_url = false,
+    };
+    json_scanner_t s = { json_data, json_data + json_data_len, 0 };
+    json_token_t host = { .type = JSON_NULL }, action = { .type = JSON_NULL };
+    int64_t started_ms = -1;
+    int severity = 0; // Debug
+    bool have_datacenter = false;
+    enum caller_info_state caller_id = CALLER_INFO_MISSING, caller_action = CALLER_INFO_MISSING;
+
+    gelf_message_begin(gelf_msg);
+    gelf_message_add_string(gelf_msg, "_app", app_env);
+
+    const char *key;
+    size_t key_len;
+    bool first = true;
+    int rc = -1;
+
+    if (js_peek(&s) != '{')
+        goto invalid;
+    s.p++;
+    while ((rc = js_next_member(&s, &first, &key, &key_len)) == 1) {
+        if (KEY_IS("request_info") && js_peek(&s) == '{') {
+            if (!encode_request_info(&enc, &s))
+                goto invalid;
+            continue;
         }
-    }
+        if (KEY_IS("lines") && js_peek(&s) == '[') {
+            if (!encode_lines(&enc, &s))
+                goto invalid;
+            continue;
+        }
+        json_token_t value;
+        if (!js_scan_value(&s, &value))
+            goto invalid;
 
-    // forward sender_action field
-    if (json_object_object_get_ex (request, "sender_action", &obj) && json_object_get_type(obj) == json_type_string) {
-        const char *sender_action = json_object_get_string(obj);
-        if (sender_action && *sender_action)
-            gelf_message_add_json_object (gelf_msg, "_sender_action", obj);
+        if (KEY_IS("host")) {
+            host = value;
+        } else if (KEY_IS("action")) {
+            action = value;
+        } else if (KEY_IS("started_ms")) {
+            // use logjam_agent's started_ms if available
+            js_token_int64(&value, &started_ms);
+        } else if (KEY_IS("severity")) {
+            severity = js_token_log_level(&value, severity);
+        } else if (KEY_IS("code")) {
+            add_token(gelf_msg, "_code", &value);
+        } else if (KEY_IS("request_id")) {
+            add_token(gelf_msg, "_request_id", &value);
+        } else if (KEY_IS("ip")) {
+            add_token(gelf_msg, "_ip", &value);
+        } else if (KEY_IS("process_id")) {
+            add_token(gelf_msg, "_process_id", &value);
+        } else if (KEY_IS("datacenter")) {
+            add_token(gelf_msg, "_datacenter", &value);
+            have_datacenter = true;
+        } else if (KEY_IS("namespace")) {
+            add_token(gelf_msg, "_namespace", &value);
+        } else if (KEY_IS("user_id")) {
+            if (value.type != JSON_NULL)
+                add_token(gelf_msg, "_user_id", &value);
+        } else if (KEY_IS("total_time")) {
+            add_token(gelf_msg, "_total_time", &value);
+        } else if (KEY_IS("caller_id")) {
+            caller_id = caller_info_state(&value);
+            if (caller_id == CALLER_INFO_PRESENT) {
+                // the token is still escaped, so it can be added as is
+                add_token(gelf_msg, "_caller_id", &value);
+                char caller_id_str[1024];
+                js_token_copy_string(&value, caller_id_str, sizeof(caller_id_str));
+                add_caller_app(gelf_msg, caller_id_str);
+            }
+        } else if (KEY_IS("caller_action")) {
+            caller_action = caller_info_state(&value);
+            if (caller_action == CALLER_INFO_PRESENT)
+                add_token(gelf_msg, "_caller_action", &value);
+        } else if (KEY_IS("trace_id")) {
+            if (js_token_is_nonempty_string(&value))
+                add_token(gelf_msg, "_trace_id", &value);
+        } else if (KEY_IS("sender_id")) {
+            if (js_token_is_nonempty_string(&value))
+                add_token(gelf_msg, "_sender_id", &value);
+        } else if (KEY_IS("sender_action")) {
+            if (js_token_is_nonempty_string(&value))
+                add_token(gelf_msg, "_sender_action", &value);
+        }
     }
+    if (rc < 0)
+        goto invalid;
 
-    int level = 0; // Debug
-    if (json_object_object_get_ex (request, "severity", &obj)) {
-        level = json_object_get_int (obj);
-    }
+    if (host.type == JSON_NULL)
+        gelf_message_add_string(gelf_msg, "host", "Not found");
+    else
+        add_token(gelf_msg, "host", &host);
+
+    // short_message is the action, completed to the form Module#method
+    const char *action_str = action.type == JSON_STRING ? action.str : action.start;
+    size_t action_len = action.type == JSON_STRING ? action.str_len : action.type == JSON_NULL ? 0 : action.len;
+    const char *suffix = "";
+    if (action_len == 0)
+        suffix = "Unknown#unknown_method";
+    else if (!memchr(action_str, '#', action_len))
+        suffix = "#unknown_method";
+    else if (action_str[action_len-1] == '#')
+        suffix = "unknown_method";
+    gelf_message_start_string(gelf_msg, "short_message");
+    if (action.type == JSON_STRING)
+        gelf_message_append_json_string(gelf_msg, action_str, action_len);
+    else
+        gelf_message_append_string(gelf_msg, action_str, action_len);
+    gelf_message_append_string(gelf_msg, suffix, strlen(suffix));
+    gelf_message_finish_string(gelf_msg);
 
-    if (json_object_object_get_ex (request, "lines", &lines) && json_object_get_type(lines) == json_type_array) {
-        int n_lines = json_object_array_length (lines);
-
-        str_builder *sb = sb_new (1024*10);
-        for (int i = 0; i < n_lines; i++) {
-            json_object *line = json_object_array_get_idx (lines, i);
-            if (line && json_object_get_type (line) == json_type_array) {
-                obj = json_object_array_get_idx (line, 0);
-                int l = json_object_get_int (obj);
-                if (l > level)
-                    level = l;
-                sb_append(sb, LOG_LEVELS_NAMES[l], strlen (LOG_LEVELS_NAMES[l]));
-                sb_append(sb, " ", 1);
-
-                obj = json_object_array_get_idx (line, 1);
-                str = (char *) json_object_get_string(obj);
-                sb_append (sb, str, strlen (str));
-                sb_append (sb, " ", 1);
-
-                obj = json_object_array_get_idx (line, 2);
-                str = (char *) json_object_get_string (obj);
-                sb_append (sb, str, strlen (str));
-                sb_append (sb, "\n", 1);
+    gelf_message_add_timestamp(gelf_msg, started_ms >= 0 ? started_ms : zclock_time());
+
+    if (!have_datacenter)
+        gelf_message_add_string(gelf_msg, "_datacenter", default_datacenter);
+
+    // api requests without caller information get placeholders
+    if (enc.have_url && (caller_id == CALLER_INFO_MISSING || caller_action == CALLER_INFO_MISSING)) {
+        zchunk_ensure_size(buffer, action_len + strlen(suffix) + 1);
+        char *full_action = (char*) zchunk_data(buffer);
+        memcpy(full_action, action_str, action_len);
+        strcpy(full_action + action_len, suffix);
+        char* module = extract_module(full_action);
+        if (is_api_request(module, stream_info)) {
+            if (caller_id == CALLER_INFO_MISSING) {
+                char rid[256] = {'\0'};
+                snprintf(rid, sizeof(rid), "unknown-%s-unknown", stream_info->env);
+                add_caller_id(gelf_msg, rid);
             }
+            if (caller_action == CALLER_INFO_MISSING)
+                gelf_message_add_string(gelf_msg, "_caller_action", "Unknown#unknown");
         }
-        gelf_message_add_full_message (gelf_msg, sb_string(sb));
-        sb_destroy (&sb);
+        free(module);
     }
 
-    gelf_message_add_int (gelf_msg, "level", SYSLOG_MAPPING[level]);
+    int level = severity > enc.lines_level ? severity : enc.lines_level;
+    if (level < 0 || level > 5)
+        level = 5;
+    gelf_message_add_int(gelf_msg, "level", SYSLOG_MAPPING[level]);
 
-    gelf_message_add_int (gelf_msg, "_logjam_message_size", json_data_len);
+    gelf_message_add_int(gelf_msg, "_logjam_message_size", json_data_len);
+    gelf_message_end(gelf_msg);
 
-    free (app_env);
+    free(app_env);
     release_stream_info(stream_info);
-    json_object_put (request);
+    return true;
 
-    return gelf_msg;
+ invalid:
+    if (verbose)
+        printf("[D] could not parse JSON data (offset %zu): %.*s\n", (size_t)(s.p - json_data), (int)json_data_len, json_data);
+    free(app_env);
+    release_stream_info(stream_info);
+    return false;
 }
 
 void logjam_message_destroy(logjam_message **msg)
@@ -419,3 +870,199 @@ void logjam_message_destroy(logjam_message **msg)
     free (*msg);
     *msg = NULL;
 }
+
+static logjam_message* test_message_new(const char *stream, const char *json)
+{
+    logjam_message *msg = zmalloc(sizeof(*msg));
+    msg->frames[0] = zframe_new(stream, strlen(stream));
+    msg->frames[1] = zframe_new("logs", 4);
+    msg->frames[2] = zframe_new(json, strlen(json));
+    msg_meta_t meta = META_INFO_EMPTY;
+    meta_info_encode(&meta);
+    msg->frames[3] = zframe_new(&meta, sizeof(meta));
+    msg->stream = strdup(stream);
+    return msg;
+}
+
+// returns the GELF message, or NULL if the message was dropped
+static const char* test_convert(const char *stream, const char *json, header_matcher_t *headers, gelf_message *gelf)
+{
+    zchunk_t *decompression_buffer = zchunk_new(NULL, 1024);
+    zchunk_t *scratch_buffer = zchunk_new(NULL, 1024);
+    zchunk_t *obfuscation_buffer = zchunk_new(NULL, 1024);
+    logjam_message *msg = test_message_new(stream, json);
+    bool ok = logjam_message_to_gelf(msg, gelf, NULL, decompression_buffer, scratch_buffer, headers, obfuscation_buffer, NULL);
+    logjam_message_destroy(&msg);
+    zchunk_destroy(&decompression_buffer);
+    zchunk_destroy(&scratch_buffer);
+    zchunk_destroy(&obfuscation_buffer);
+    const char *result = ok ? gelf_message_to_string(gelf) : NULL;
+    if (verbose)
+        printf("[D] %s\n", result ? result : "dropped");
+    return result;
+}
+
+// the expected message is given without the trailing size field
+static void test_expect(const char *json, header_matcher_t *headers, gelf_message *gelf, const char *expected)
+{
+    const char *gelf_str = test_convert("c-d", json, headers, gelf);
+    assert(gelf_str);
+    char message[2048];
+    snprintf(message, sizeof(message), "%s,\"_logjam_message_size\":%zu}", expected, strlen(json));
+    assert(streq(gelf_str, message));
+}
+
+static void test_copy_string(const char *json, const char *expected)
+{
+    json_token_t t = { .type = JSON_STRING, .start = json, .len = strlen(json), .str = json, .str_len = strlen(json) };
+    char buffer[64];
+    js_token_copy_string(&t, buffer, sizeof(buffer));
+    assert(streq(buffer, expected));
+}
+
+static void test_append_json_string(gelf_message *gelf, const char *json, const char *expected)
+{
+    gelf_message_begin(gelf);
+    gelf_message_start_string(gelf, "f");
+    gelf_message_append_json_string(gelf, json, strlen(json));
+    gelf_message_finish_string(gelf);
+    gelf_message_end(gelf);
+    char message[256];
+    snprintf(message, sizeof(message), "{\"version\":\"1.1\",\"f\":\"%s\"}", expected);
+    assert(streq(gelf_message_to_string(gelf), message));
+}
+
+void logjam_message_test(int verbose)
+{
+    printf(" * logjam-message: ");
+    if (verbose)
+        printf("\n");
+
+    char streams_file_name[] = "/tmp/logjam-message-test-XXXXXX";
+    int fd = mkstemp(streams_file_name);
+    assert(fd != -1);
+    const char *streams = "{\"c-d\":{\"api_requests\":[\"Api\"]}}";
+    ssize_t written = write(fd, streams, strlen(streams));
+    assert(written == (ssize_t)strlen(streams));
+    close(fd);
+    // the url is kept by the stream config
+    char *streams_url;
+    int rc = asprintf(&streams_url, "file://%s", streams_file_name);
+    assert(rc != -1);
+    bool ok = setup_stream_config(streams_url, "");
+    assert(ok);
+
+    zlist_t *names = zlist_new();
+    zlist_append(names, "user-agent");
+    zlist_t *cookies = zlist_new();
+    zlist_append(cookies, "_session");
+    header_matcher_t *matcher = header_matcher_new(names, cookies);
+    zlist_append(names, "cookie");
+    header_matcher_t *cookie_matcher = header_matcher_new(names, cookies);
+    gelf_message *gelf = gelf_message_new();
+
+    // field mapping
+    test_expect(
+        "{\"action\":\"Users#show\",\"host\":\"web1\",\"started_ms\":1760000000123,\"severity\":1,"
+        "\"code\":200,\"request_id\":\"abc\",\"ip\":\"1.2.3.4\",\"process_id\":42,\"user_id\":null,"
+        "\"total_time\":12.5,\"datacenter\":\"dc1\",\"namespace\":\"ns\",\"trace_id\":\"\","
+        "\"sender_id\":\"s-e-1\",\"caller_id\":\"app-env-rid\",\"caller_action\":\"A#b\","
+        "\"lines\":[[2,\"10:00:00\",\"hello\"],[1,\"10:00:01\",\"world\"]],\"other\":[1,{}]}",
+        matcher, gelf,
+        "{\"version\":\"1.1\",\"_app\":\"c-d\",\"_code\":200,\"_request_id\":\"abc\",\"_ip\":\"1.2.3.4\","
+        "\"_process_id\":42,\"_total_time\":12.5,\"_datacenter\":\"dc1\",\"_namespace\":\"ns\","
+        "\"_sender_id\":\"s-e-1\",\"_caller_id\":\"app-env-rid\",\"_caller_app\":\"app\","
+        "\"_caller_action\":\"A#b\",\"full_message\":\"Warn 10:00:00 hello\\nInfo 10:00:01 world\\n\","
+        "\"host\":\"web1\",\"short_message\":\"Users#show\",\"timestamp\":1760000000.123,\"level\":5");
+
+    // defaults, and placeholders for api requests without caller information
+    test_expect(
+        "{\"action\":\"Api::Users\",\"severity\":9,\"started_ms\":5,"
+        "\"request_info\":{\"method\":\"GET\",\"url\":\"/api\"}}",
+        matcher, gelf,
+        "{\"version\":\"1.1\",\"_app\":\"c-d\",\"_http_method\":\"GET\",\"_http_url\":\"/api\","
+        "\"host\":\"Not found\",\"short_message\":\"Api::Users#unknown_method\",\"timestamp\":0.005,"
+        "\"_datacenter\":\"unknown\",\"_caller_id\":\"unknown-d-unknown\",\"_caller_app\":\"unknown\","
+        "\"_caller_action\":\"Unknown#unknown\",\"level\":1");
+
+    // whitelisted headers become fields, all others are collected in a sorted list.
+    // sensitive cookies are obfuscated in both cases.
+    const char *request_with_headers =
+        "{\"action\":\"Users#\",\"started_ms\":0,\"request_info\":{\"headers\":{"
+        "\"X-Foo\":\"bar\",\"User-Agent\":\"curl\",\"Cookie\":\"_session=secret; a=b\",\"ACCEPT\":\"*/*\"}}}";
+    test_expect(request_with_headers, matcher, gelf,
+        "{\"version\":\"1.1\",\"_app\":\"c-d\",\"_http_header_user_agent\":\"curl\","
+        "\"_http_headers_not_extracted\":\"accept: */*\\ncookie: _session=[FILTERED]; a=b\\nx-foo: bar\","
+        "\"host\":\"Not found\",\"short_message\":\"Users#unknown_method\",\"timestamp\":0.000,"
+        "\"_datacenter\":\"unknown\",\"level\":7");
+    test_expect(request_with_headers, cookie_matcher, gelf,
+        "{\"version\":\"1.1\",\"_app\":\"c-d\",\"_http_header_user_agent\":\"curl\","
+        "\"_http_header_cookie\":\"_session=[FILTERED]; a=b\","
+        "\"_http_headers_not_extracted\":\"accept: */*\\nx-foo: bar\","
+        "\"host\":\"Not found\",\"short_message\":\"Users#unknown_method\",\"timestamp\":0.000,"
+        "\"_datacenter\":\"unknown\",\"level\":7");
+
+    // escape sequences are copied, but not escaped again. invalid ones are kept as text.
+    test_expect(
+        "{\"action\":\"Users#sh\\u00f6w\",\"started_ms\":0,\"request_id\":\"a\\qb\\u12\","
+        "\"caller_id\":\"app\\/x-env-r\\\"id\",\"caller_action\":\"A\\tb\","
+        "\"request_info\":{\"headers\":{\"X-\\u0041\\Q\":\"v\\\\\",\"Ab\":\"raw\ttab\"}}}",
+        matcher, gelf,
+        "{\"version\":\"1.1\",\"_app\":\"c-d\",\"_request_id\":\"a\\\\qb\\\\u12\","
+        "\"_caller_id\":\"app\\/x-env-r\\\"id\",\"_caller_app\":\"app/x\",\"_caller_action\":\"A\\tb\","
+        "\"_http_headers_not_extracted\":\"ab: raw\\u0009tab\\nx-\\u0041\\\\Q: v\\\\\","
+        "\"host\":\"Not found\",\"short_message\":\"Users#sh\\u00f6w\",\"timestamp\":0.000,"
+        "\"_datacenter\":\"unknown\",\"level\":7");
+    test_copy_string("a\\\"b\\\\c\\/d", "a\"b\\c/d");
+    test_copy_string("\\u00f6\\ud83d\\ude00", "\xc3\xb6\xf0\x9f\x98\x80");
+    test_copy_string("\\q\\u12x\\ud83d", "\\q\\u12x?");
+    test_append_json_string(gelf, "\\n\\u00F6\\\"", "\\n\\u00F6\\\"");
+    test_append_json_string(gelf, "\\x\\u12g\\", "\\\\x\\\\u12g\\\\");
+    test_append_json_string(gelf, "\x01", "\\u0001");
+
+    // long header keys are lower cased in chunks, without splitting escape sequences
+    char long_request[1024];
+    char long_key[600];
+    memset(long_key, 'K', 253);
+    strcpy(long_key + 253, "\\u0041\\Kk");
+    memset(long_key + 262, 'K', 300);
+    long_key[562] = '\0';
+    snprintf(long_request, sizeof(long_request),
+             "{\"started_ms\":0,\"request_info\":{\"headers\":{\"%s\":\"v\"}}}", long_key);
+    const char *gelf_str = test_convert("c-d", long_request, matcher, gelf);
+    assert(gelf_str);
+    char expected_key[600];
+    memset(expected_key, 'k', 253);
+    strcpy(expected_key + 253, "\\u0041\\\\Kk");
+    memset(expected_key + 263, 'k', 300);
+    strcpy(expected_key + 563, ": v\"");
+    assert(strstr(gelf_str, expected_key));
+
+    // numbers are only parsed within their token
+    const char *number = "12345";
+    json_token_t t = { .type = JSON_NUMBER, .start = number, .len = 3 };
+    int64_t value;
+    assert(js_token_int64(&t, &value) && value == 123);
+    assert(request_severity("{\"severity\":2999", 13) == 2);
+    assert(request_severity("{\"a\":1,\"severity\":3,\"b\":{}}", 27) == 3);
+    assert(request_severity("{\"a\":1}", 7) == LOG_SEVERITY_INFO);
+    assert(request_severity("{\"severity\":\"debug\"}", 20) == LOG_SEVERITY_INFO);
+    assert(request_severity("{\"severity\":0}", 14) == LOG_SEVERITY_DEBUG);
+    assert(request_severity("[1]", 3) == -1);
+    assert(request_severity("{\"a\":}", 6) == -1);
+
+    // dropped messages
+    assert(test_convert("x-y", "{}", matcher, gelf) == NULL);
+    assert(test_convert("c-d", "{\"a\":1,}", matcher, gelf) == NULL);
+    assert(test_convert("c-d", "[]", matcher, gelf) == NULL);
+    assert(test_convert("c-d", "{\"lines\":[[1,\"a\"]", matcher, gelf) == NULL);
+
+    gelf_message_destroy(&gelf);
+    header_matcher_destroy(&matcher);
+    header_matcher_destroy(&cookie_matcher);
+    zlist_destroy(&names);
+    zlist_destroy(&cookies);
+    unlink(streams_file_name);
+
+    printf("OK\n");
+}
@@ -2,8 +2,10 @@
 #define __LOGJAM_MESSAGE_H_INCLUDED__
 
 #include <czmq.h>
-#include <json_tokener.h>
+#include <stdbool.h>
 #include "gelf-message.h"
+#include "header-matcher.h"
+#include "graylog-forwarder-sampler.h"
 
 typedef struct {
     zframe_t *frames[4];
@@ -13,8 +15,12 @@ typedef struct {
 
 logjam_message* logjam_message_read(zsock_t *receiver);
 
-gelf_message* logjam_message_to_gelf(logjam_message *logjam_msg, json_tokener *tokener, zhash_t* stream_info_cache, zchunk_t *decompression_buffer, zchunk_t *scratch_buffer, zhash_t *header_fields, zlist_t *sensitive_cookies, zchunk_t *buffer);
+// writes the GELF representation of the given message into gelf_msg. returns false if the
+// message should be dropped (unknown stream, invalid JSON, or dropped by the sampler).
+bool logjam_message_to_gelf(logjam_message *logjam_msg, gelf_message *gelf_msg, zhash_t* stream_info_cache, zchunk_t *decompression_buffer, zchunk_t *scratch_buffer, header_matcher_t *headers, zchunk_t *obfuscation_buffer, gelf_sampler_t *sampler);
 
 void logjam_message_destroy(logjam_message **msg);
 
+void logjam_message_test(int verbose);
+
 #endif
@@ -1,162 +1,484 @@
-#include "logjam-util.h"
+#include "logjam-traffic.h"
 #include <getopt.h>
+#include <sys/mman.h>
+
+/*
+ * connections: "o" = bind, "[<>v^]" = connect
+ *
+ *                 --- PIPE ---  sender[0]    PUB/PUSH/DEALER  o---------->  device/importer
+ *  main loop:     --- PIPE ---  ...
+ *                 --- PIPE ---  sender[n-1]  PUB/PUSH/DEALER  o---------->  device/importer
+ *
+ */
+
+// The dump file is memory mapped and indexed once at startup. Each sender thread owns its
+// own socket and sends every n-th message of the dump file, pointing the zmq message
+// frames directly into the mapping. Device numbers are partitioned among the senders (see
+// logjam-traffic.h). The main thread only collects and reports statistics.
 
 bool dryrun = false;
 bool verbose = false;
 bool debug = false;
 bool quiet = false;
 
-FILE* dump_file = NULL;
 static char *dump_file_name = "logjam-stream.dump";
 static size_t dump_file_size = 0;
-static size_t bytes_read_from_file = 0;
+static char *dump_data = NULL;
 
-static size_t io_threads = 1;
-static char *connection_spec = NULL;
-static int socket_type = ZMQ_PUB;
+// start offsets of all messages contained in the dump file
+static size_t *message_offsets = NULL;
+static size_t message_count = 0;
 
-#define DEFAULT_CONNECTION_PORT_PUB 9606
-#define DEFAULT_CONNECTION_SPEC_PUB "tcp://*:9606"
-#define DEFAULT_CONNECTION_PORT_DEALER 9604
-#define DEFAULT_CONNECTION_SPEC_DEALER "tcp://localhost:9604"
-#define DEFAULT_CONNECTION_PORT_PUSH 9605
-#define DEFAULT_CONNECTION_SPEC_PUSH "tcp://localhost:9605"
+// time faithful replay: send times relative to replay start, derived from msg_meta_t.created_ms
+static bool time_faithful = false;
+static double time_scale = 1.0;
+static int64_t max_gap_ms = 0;
+static uint64_t *message_due_usecs = NULL;
+static uint64_t replay_period_usecs = 0;
+#define MIN_REPLAY_GAP_USECS 1000
 
-static int stats_port = 9621;
+static traffic_options_t options;
 
 static bool endless_loop = false;
 static int messages_per_second = 100000;
-static int message_credit = 1000000;
-static char* *device_number_s = NULL;
-static uint64_t *sequence_number = NULL;
-static int device_count = 1;
 
 static zsock_t *stats_socket = NULL;
 
-static size_t replayed_messages_count = 0;
-static size_t replayed_messages_bytes = 0;
-static size_t replayed_messages_max_bytes = 0;
+// latencies are recorded in power of two buckets of microseconds
+// bucket 0 holds sends which took less than 1us, bucket i those in [2^(i-1), 2^i)
+#define LATENCY_BUCKETS 24
+
+typedef struct {
+    traffic_thread_t thread;
+    zsock_t *socket;
+    char *connection_spec;
+    traffic_pacer_t pacer;
+    // time faithful replay: start of the current pass over the dump file
+    int64_t schedule_start;
+    // statistics, written by the sender, read by the main thread
+    size_t messages_sent;
+    size_t bytes_sent;
+    size_t max_bytes;
+    uint64_t send_usecs;
+    uint64_t pacing_usecs;
+    uint64_t max_lag_usecs;
+    size_t latency_histogram[LATENCY_BUCKETS];
+} sender_state_t;
+
+static int64_t replay_start_time = 0;
+
+static sender_state_t *senders[MAX_TRAFFIC_THREADS];
+static zactor_t *sender_actors[MAX_TRAFFIC_THREADS];
+static size_t finished_senders = 0;
+
+// Computes the send time of a message relative to the replay start from the creation time
+// of the message. Creation times are made monotonic, as messages from different producers
+// can arrive at a device slightly out of order. Gaps longer than max_gap_ms are shortened
+// to max_gap_ms, which compresses idle periods of long captures but keeps bursts intact.
+static uint64_t captured_ms = 0;
+
+static uint64_t schedule_message(const char *meta_data, bool first)
+{
+    static uint64_t last_created_ms = 0;
+    static uint64_t virtual_ms = 0;
+
+    msg_meta_t meta;
+    memcpy(&meta, meta_data, sizeof(meta));
+    meta_info_decode(&meta);
+
+    if (first || last_created_ms == 0)
+        last_created_ms = meta.created_ms;
+
+    if (meta.created_ms > last_created_ms) {
+        uint64_t delta = meta.created_ms - last_created_ms;
+        captured_ms += delta;
+        if (max_gap_ms > 0 && delta > max_gap_ms)
+            delta = max_gap_ms;
+        virtual_ms += delta;
+        last_created_ms = meta.created_ms;
+    }
+
+    return virtual_ms * 1000 / time_scale;
+}
 
-static int timer_event( zloop_t *loop, int timer_id, void *arg)
+static bool index_dump_file()
 {
-    static size_t last_replayed_count = 0;
-    static size_t last_replayed_bytes = 0;
-    size_t message_count = replayed_messages_count - last_replayed_count;
-    size_t message_bytes = replayed_messages_bytes - last_replayed_bytes;
-    double avg_msg_size = message_count ? (message_bytes / 1024.0) / message_count : 0;
-    double max_msg_size = replayed_messages_max_bytes / 1024.0;
-    printf("[I] processed %zu messages (%.2f KB), avg: %.2f KB, max: %.2f KB\n",
-           message_count, message_bytes/1024.0, avg_msg_size, max_msg_size);
-    last_replayed_count = replayed_messages_count;
-    last_replayed_bytes = replayed_messages_bytes;
-    replayed_messages_max_bytes = 0;
-    message_credit = messages_per_second;
-
-    if (stats_socket) {
-        for (int i = 0; i < device_count; i++) {
-            zmsg_t *msg = zmsg_new();
-            zmsg_addstr(msg, "stats");
-            zmsg_addstr(msg, device_number_s[i]);
-            zmsg_addstrf(msg, "%" PRIu64, sequence_number[i]);
-            zmsg_send_with_retry(&msg, stats_socket);
+    size_t capacity = 64 * 1024;
+    size_t skipped = 0;
+    message_offsets = zmalloc(capacity * sizeof(size_t));
+    if (time_faithful)
+        message_due_usecs = zmalloc(capacity * sizeof(uint64_t));
+    size_t pos = 0;
+    while (pos + sizeof(size_t) <= dump_file_size) {
+        size_t frame_count;
+        memcpy(&frame_count, dump_data + pos, sizeof(size_t));
+        size_t next = pos + sizeof(size_t);
+        bool complete = true;
+        size_t meta_size = 0;
+        size_t meta_pos = 0;
+        for (size_t i = 0; i < frame_count && complete; i++) {
+            size_t frame_size;
+            if (next + sizeof(size_t) > dump_file_size) {
+                complete = false;
+                break;
+            }
+            memcpy(&frame_size, dump_data + next, sizeof(size_t));
+            next += sizeof(size_t);
+            if (frame_size > dump_file_size - next) {
+                complete = false;
+                break;
+            }
+            meta_pos = next;
+            next += frame_size;
+            meta_size = frame_size;
+        }
+        if (!complete) {
+            fprintf(stderr, "[W] dump file truncated at offset %zu\n", pos);
+            break;
         }
+        if (frame_count == 4 && meta_size == sizeof(msg_meta_t)) {
+            if (message_count == capacity) {
+                capacity *= 2;
+                message_offsets = realloc(message_offsets, capacity * sizeof(size_t));
+                assert(message_offsets);
+                if (time_faithful) {
+                    message_due_usecs = realloc(message_due_usecs, capacity * sizeof(uint64_t));
+                    assert(message_due_usecs);
+                }
+            }
+            if (time_faithful)
+                message_due_usecs[message_count] = schedule_message(dump_data + meta_pos, message_count == 0);
+            message_offsets[message_count++] = pos;
+        } else
+            skipped++;
+        pos = next;
+    }
+    if (skipped)
+        fprintf(stderr, "[W] skipped %zu messages without valid meta frame\n", skipped);
+    if (verbose)
+        printf("[I] indexed %zu messages\n", message_count);
+    if (time_faithful && message_count > 0) {
+        // when looping, start the next pass one average inter-arrival time after the last message,
+        // but at least one millisecond later, in case all messages were captured at the same time
+        uint64_t last = message_due_usecs[message_count-1];
+        uint64_t gap = message_count > 1 ? last / (message_count - 1) : 0;
+        replay_period_usecs = last + (gap < MIN_REPLAY_GAP_USECS ? MIN_REPLAY_GAP_USECS : gap);
+        printf("[I] replaying %.1f seconds of captured traffic in %.1f seconds\n",
+               captured_ms / 1000.0, last / 1000000.0);
     }
+    return message_count > 0;
+}
 
-    return 0;
+// blocks until the token bucket permits sending the next message
+static void sender_pacing_wait(sender_state_t *state)
+{
+    int64_t waited = traffic_pacer_wait(&state->pacer);
+    if (waited)
+        __atomic_add_fetch(&state->pacing_usecs, waited, __ATOMIC_RELAXED);
 }
 
-static void send_ping(zsock_t *socket, msg_meta_t *meta, const char* app_env)
+static void sender_record_latency(sender_state_t *state, uint64_t usecs)
 {
-    zmsg_t *msg = zmsg_new();
-    zmsg_addstr(msg, "");
-    zmsg_addstr(msg, "ping");
-    if (random()&01)
-        zmsg_addstr(msg, "");
-    else
-        zmsg_addstr(msg, app_env);
-    zmsg_addstr(msg, "{}");
-    zmsg_add_meta_info(msg, meta);
-    zmsg_send_and_destroy(&msg, socket);
-    zmsg_t *reply = zmsg_recv(socket);
-    if (!zsys_interrupted)
-        assert(reply);
-    zmsg_destroy(&reply);
+    int bucket = usecs ? 64 - __builtin_clzll(usecs) : 0;
+    if (bucket >= LATENCY_BUCKETS)
+        bucket = LATENCY_BUCKETS - 1;
+    __atomic_add_fetch(&state->latency_histogram[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&state->send_usecs, usecs, __ATOMIC_RELAXED);
 }
 
-static int file_consume_message_and_forward(zloop_t *loop, zmq_pollitem_t *item, void* arg)
+// blocks until the scheduled send time of the given message has been reached
+static void sender_schedule_wait(sender_state_t *state, size_t index)
 {
-    zsock_t *socket = arg;
+    int64_t due = state->schedule_start + message_due_usecs[index];
+    int64_t now = zclock_usecs();
+    if (now >= due) {
+        uint64_t lag = now - due;
+        if (lag > __atomic_load_n(&state->max_lag_usecs, __ATOMIC_RELAXED))
+            __atomic_store_n(&state->max_lag_usecs, lag, __ATOMIC_RELAXED);
+        return;
+    }
+    int64_t start = now;
+    while (now < due && !zsys_interrupted) {
+        int64_t wait = due - now;
+        // spin for very short waits, the scheduler can't deliver this precision
+        if (wait > 50)
+            usleep(wait > 100000 ? 100000 : wait - 20);
+        // don't delay shutdown when replaying long idle periods
+        if (wait > 100000 && !traffic_thread_check_pipe(&state->thread, 0))
+            return;
+        now = zclock_usecs();
+    }
+    __atomic_add_fetch(&state->pacing_usecs, now - start, __ATOMIC_RELAXED);
+}
 
-    if (message_credit-- <= 0) {
-        zclock_sleep(1);
-        return 0;
+static int send_dump_message(sender_state_t *state, size_t index, uint32_t device, uint64_t sequence)
+{
+    char *p = dump_data + message_offsets[index] + sizeof(size_t);
+    zmq_msg_t parts[3];
+    size_t msg_bytes = 0;
+    for (int i = 0; i < 3; i++) {
+        size_t frame_size;
+        memcpy(&frame_size, p, sizeof(size_t));
+        p += sizeof(size_t);
+        // the mapping outlives all sockets, so zmq doesn't need to free anything
+        zmq_msg_init_data(&parts[i], p, frame_size, NULL, NULL);
+        p += frame_size;
+        msg_bytes += frame_size;
     }
+    // the meta frame has to be copied, as we change device and sequence numbers
+    msg_meta_t meta;
+    memcpy(&meta, p + sizeof(size_t), sizeof(msg_meta_t));
+    meta_info_decode(&meta);
+    meta.device_number = device;
+    meta.sequence_number = sequence;
+    msg_bytes += sizeof(msg_meta_t);
 
-    static int next_device_minus_1 = 0;
+    if (debug) {
+        my_zmq_msg_fprint(parts, 3, "[D]", stdout);
+        dump_meta_info("[D]", &meta);
+    }
 
-    zmsg_t *msg = zmsg_loadx(NULL, dump_file);
-    if (!msg) return 1;
+    // only the first frame can block, so sends can be retried safely on timeouts
+    int rc;
+    int64_t start = zclock_usecs();
+    do {
+        rc = publish_on_zmq_transport(parts, zsock_resolve(state->socket), &meta, 0);
+    } while (rc == -1 && errno == EAGAIN && traffic_thread_check_pipe(&state->thread, 0));
+    sender_record_latency(state, zclock_usecs() - start);
 
-    // update device and sequence number
-    int d = 1;
-    if (socket_type == ZMQ_PUB) {
-        d = 1 + (++next_device_minus_1 % device_count);
+    // send a ping once in a while if socket is a dealer
+    if (rc != -1 && options.socket_type == ZMQ_DEALER && (sequence % 20 == 0)) {
+        size_t app_env_len;
+        memcpy(&app_env_len, dump_data + message_offsets[index] + sizeof(size_t), sizeof(size_t));
+        const char *app_env = dump_data + message_offsets[index] + 2 * sizeof(size_t);
+        traffic_send_ping(state->socket, &meta, app_env, app_env_len);
     }
-    uint64_t n = ++sequence_number[d-1];
-    zmsg_set_device_and_sequence_number(msg, d, n);
 
-    // calculate stats
-    size_t msg_bytes = zmsg_content_size(msg);
-    bytes_read_from_file  += sizeof(size_t) * 5 + msg_bytes;
-    replayed_messages_count++;
-    replayed_messages_bytes += msg_bytes;
-    if (msg_bytes > replayed_messages_max_bytes)
-        replayed_messages_max_bytes = msg_bytes;
+    for (int i = 0; i < 3; i++)
+        zmq_msg_close(&parts[i]);
 
-    msg_meta_t meta;
-    msg_extract_meta_info(msg, &meta);
+    if (rc == -1)
+        return rc;
 
-    if (debug) {
-        my_zmsg_fprint(msg, "[D]", stdout);
-        dump_meta_info("[D]", &meta);
+    __atomic_add_fetch(&state->messages_sent, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&state->bytes_sent, msg_bytes, __ATOMIC_RELAXED);
+    if (msg_bytes > __atomic_load_n(&state->max_bytes, __ATOMIC_RELAXED))
+        __atomic_store_n(&state->max_bytes, msg_bytes, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+static
+sender_state_t* sender_state_new(size_t id)
+{
+    sender_state_t *state = zmalloc(sizeof(*state));
+    state->thread.kind = "sender";
+    state->thread.id = id;
+    state->connection_spec = traffic_thread_connection_spec(&options, id);
+    return state;
+}
+
+static
+void sender_state_destroy(sender_state_t **state_p)
+{
+    sender_state_t *state = *state_p;
+    free(state->connection_spec);
+    free(state);
+    *state_p = NULL;
+}
+
+static
+void sender(zsock_t *pipe, void *args)
+{
+    sender_state_t *state = args;
+    state->thread.pipe = pipe;
+    size_t id = state->thread.id;
+
+    char thread_name[16];
+    memset(thread_name, 0, 16);
+    snprintf(thread_name, 16, "sender[%zu]", id);
+    set_thread_name(thread_name);
+
+    state->socket = traffic_thread_socket_new(&options, id, state->connection_spec, 1000000);
+    state->thread.poller = zpoller_new(pipe, NULL);
+    assert(state->thread.poller);
+
+    // signal readiness
+    zsock_signal(pipe, 0);
+
+    int my_devices = traffic_thread_device_count(&options, id);
+
+    traffic_pacer_reset(&state->pacer, messages_per_second, options.num_threads);
+    state->schedule_start = replay_start_time;
+    size_t sent = 0;
+    size_t index = id;
+    bool running = true;
+
+    while (running) {
+        if (index >= message_count) {
+            if (!endless_loop)
+                break;
+            if (verbose) printf("[I] sender[%zu]: end of dump file reached. rewinding.\n", id);
+            index = id;
+            state->schedule_start += replay_period_usecs;
+            continue;
+        }
+
+        if (time_faithful)
+            sender_schedule_wait(state, index);
+        else
+            sender_pacing_wait(state);
+        if (state->thread.terminated)
+            break;
+
+        int device = traffic_thread_device(&options, id, my_devices, sent);
+        uint64_t n = traffic_next_sequence_number(&options, device);
+
+        if (send_dump_message(state, index, device, n) == -1 && !zsys_interrupted)
+            fprintf(stderr, "[E] sender[%zu]: send failed: %s\n", id, zmq_strerror(errno));
+
+        index += options.num_threads;
+        if (++sent % 256 == 0)
+            running = traffic_thread_check_pipe(&state->thread, 0);
+    }
+
+    if (running) {
+        // tell main loop we're done and wait for termination
+        zstr_send(pipe, "finished");
+        while (traffic_thread_check_pipe(&state->thread, 1000)) ;
     }
 
-    char *app_env = zframe_strdup(zmsg_first(msg));
+    if (verbose)
+        printf("[I] sender[%zu]: shutting down\n", id);
 
-    // send message and destroy it
-    zmsg_send(&msg, socket);
+    zpoller_destroy(&state->thread.poller);
+    zsock_destroy(&state->socket);
+}
 
-    // send a ping once in a while if socket is a dealer
-    if (socket_type == ZMQ_DEALER && (n % 20 == 0))
-        send_ping(socket, &meta, app_env);
+static int percentile_upper_bound(size_t *histogram, size_t total, double percentile)
+{
+    size_t threshold = total * percentile;
+    size_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > threshold)
+            return 1 << i;
+    }
+    return 1 << (LATENCY_BUCKETS - 1);
+}
 
-    free(app_env);
+static void print_latency_histogram(size_t *histogram)
+{
+    printf("[I] send latency histogram:\n");
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        if (histogram[i])
+            printf("[I]   < %8dus: %zu\n", 1 << i, histogram[i]);
+    }
+}
 
-    if (bytes_read_from_file == dump_file_size) {
-        if (endless_loop) {
-            if (verbose) printf("[I] end of dump file reached. rewinding.\n");
-            bytes_read_from_file = 0;
-            rewind(dump_file);
-        } else
-            zsys_interrupted = 1;
+static size_t total_latency_histogram[LATENCY_BUCKETS];
+static size_t total_messages_sent = 0;
+
+static int timer_event(zloop_t *loop, int timer_id, void *arg)
+{
+    static size_t last_sent_count = 0;
+    static size_t last_sent_bytes = 0;
+    static uint64_t last_send_usecs = 0;
+    static uint64_t last_pacing_usecs = 0;
+    static size_t last_histogram[LATENCY_BUCKETS];
+    static int64_t last_time = 0;
+
+    size_t sent_count = 0, sent_bytes = 0, max_bytes = 0;
+    uint64_t max_lag = 0;
+    uint64_t send_usecs = 0, pacing_usecs = 0;
+    size_t histogram[LATENCY_BUCKETS];
+    memset(histogram, 0, sizeof(histogram));
+
+    for (size_t i = 0; i < options.num_threads; i++) {
+        sender_state_t *s = senders[i];
+        sent_count += __atomic_load_n(&s->messages_sent, __ATOMIC_RELAXED);
+        sent_bytes += __atomic_load_n(&s->bytes_sent, __ATOMIC_RELAXED);
+        send_usecs += __atomic_load_n(&s->send_usecs, __ATOMIC_RELAXED);
+        pacing_usecs += __atomic_load_n(&s->pacing_usecs, __ATOMIC_RELAXED);
+        size_t m = __atomic_exchange_n(&s->max_bytes, 0, __ATOMIC_RELAXED);
+        if (m > max_bytes)
+            max_bytes = m;
+        uint64_t lag = __atomic_exchange_n(&s->max_lag_usecs, 0, __ATOMIC_RELAXED);
+        if (lag > max_lag)
+            max_lag = lag;
+        for (int j = 0; j < LATENCY_BUCKETS; j++)
+            histogram[j] += __atomic_load_n(&s->latency_histogram[j], __ATOMIC_RELAXED);
     }
+
+    int64_t now = zclock_usecs();
+    double elapsed = last_time ? (now - last_time) / 1000000.0 : 1;
+    size_t tick_count = sent_count - last_sent_count;
+    size_t tick_bytes = sent_bytes - last_sent_bytes;
+    double avg_msg_size = tick_count ? (tick_bytes / 1024.0) / tick_count : 0;
+    double max_msg_size = max_bytes / 1024.0;
+    // fraction of available sender time spent inside zmq send calls and waiting for tokens
+    double blocked_percent = 100.0 * (send_usecs - last_send_usecs) / (elapsed * 1000000.0 * options.num_threads);
+    double pacing_percent = 100.0 * (pacing_usecs - last_pacing_usecs) / (elapsed * 1000000.0 * options.num_threads);
+
+    size_t tick_histogram[LATENCY_BUCKETS];
+    for (int j = 0; j < LATENCY_BUCKETS; j++)
+        tick_histogram[j] = histogram[j] - last_histogram[j];
+
+    printf("[I] processed %zu messages (%.2f KB), avg: %.2f KB, max: %.2f KB\n",
+           tick_count, tick_bytes/1024.0, avg_msg_size, max_msg_size);
+    printf("[I] rate: %.0f msgs/s (%.2f MB/s), send: %.1f%%, pacing: %.1f%%, latency p50/p99/p999: %d/%d/%dus\n",
+           tick_count / elapsed, tick_bytes / elapsed / (1024.0 * 1024.0), blocked_percent, pacing_percent,
+           percentile_upper_bound(tick_histogram, tick_count, 0.5),
+           percentile_upper_bound(tick_histogram, tick_count, 0.99),
+           percentile_upper_bound(tick_histogram, tick_count, 0.999));
+    if (time_faithful)
+        printf("[I] max schedule lag: %.3f ms\n", max_lag / 1000.0);
+
+    last_sent_count = sent_count;
+    last_sent_bytes = sent_bytes;
+    last_send_usecs = send_usecs;
+    last_pacing_usecs = pacing_usecs;
+    last_time = now;
+    memcpy(last_histogram, histogram, sizeof(histogram));
+    memcpy(total_latency_histogram, histogram, sizeof(histogram));
+    total_messages_sent = sent_count;
+
+    traffic_publish_device_stats(&options, stats_socket);
+
     return 0;
 }
 
+static int sender_finished(zloop_t *loop, zsock_t *reader, void *arg)
+{
+    char *msg = zstr_recv(reader);
+    if (msg) {
+        if (streq(msg, "finished"))
+            finished_senders++;
+        free(msg);
+    }
+    // terminate the main loop once all senders have replayed their share
+    return finished_senders == options.num_threads ? -1 : 0;
+}
+
 void print_usage(char * const *argv)
 {
     fprintf(stderr,
             "usage: %s [options] [dump-file-name]\n"
             "\nOptions:\n"
-            "  -i, --io-threads N         zeromq io threads\n"
+            "  -i, --io-threads N         zeromq io threads (defaults to number of senders)\n"
             "  -l, --loop                 loop the dump file\n"
-            "  -r, --msg-rate N           output message rate (per second)\n"
+            "  -r, --msg-rate N           output message rate (per second, 0 means unlimited)\n"
+            "  -t, --senders N            number of sender threads/sockets\n"
             "  -v, --verbose              log more (use -vv for debug output)\n"
             "  -d, --dealer               use zqm DEALER socket for publishing\n"
             "  -P, --push                 use zmq PUSH socket for sending messages (overrides --dealer option)\n"
             "  -p, --pub S                zmq specification for publishing socket\n"
             "  -s, --devices N            simulate N devices\n"
+            "  -T, --timed                replay using the original inter-arrival times (ignores --msg-rate)\n"
+            "  -x, --time-scale F         speed up timed replay by factor F (e.g. 2, 10, 0.5)\n"
+            "  -g, --max-gap N            shorten pauses longer than N ms during timed replay\n"
             "      --help                 display this message\n"
+            "\nWith N senders in PUB mode, sender i binds to the given port + i.\n"
             , argv[0]);
 }
 
@@ -165,6 +487,7 @@ void process_arguments(int argc, char * const *argv)
     char c;
     int longindex = 0;
     opterr = 0;
+    traffic_options_init(&options, "sender");
 
     static struct option long_options[] = {
         { "help",          no_argument,       0,  0  },
@@ -173,13 +496,17 @@ void process_arguments(int argc, char * const *argv)
         { "io-threads",    required_argument, 0, 'i' },
         { "pub",           required_argument, 0, 'p' },
         { "devices",       required_argument, 0, 's' },
+        { "senders",       required_argument, 0, 't' },
         { "verbose",       no_argument,       0, 'v' },
         { "dealer",        no_argument,       0, 'd' },
         { "push",          no_argument,       0, 'P' },
+        { "timed",         no_argument,       0, 'T' },
+        { "time-scale",    required_argument, 0, 'x' },
+        { "max-gap",       required_argument, 0, 'g' },
         { 0,               0,                 0,  0  }
     };
 
-    while ((c = getopt_long(argc, argv, "Pvdlr:i:p:s:", long_options, &longindex)) != -1) {
+    while ((c = getopt_long(argc, argv, "PTvdlr:i:p:s:t:x:g:", long_options, &longindex)) != -1) {
         switch (c) {
         case 'v':
             if (verbose)
@@ -193,27 +520,25 @@ void process_arguments(int argc, char * const *argv)
         case 'r':
             messages_per_second = atoi(optarg);
             break;
-        case 'P':
-            socket_type = ZMQ_PUSH;
-            break;
-        case 'd':
-            socket_type = ZMQ_DEALER;
-            break;
-        case 'i':
-            io_threads = atoi(optarg);
+        case 'T':
+            time_faithful = true;
             break;
-        case 'p':
-            connection_spec = optarg;
+        case 'x':
+            time_scale = atof(optarg);
+            if (time_scale <= 0) {
+                fprintf(stderr, "[E] time scale must be positive\n");
+                exit(1);
+            }
             break;
-        case 's':
-            device_count = atoi(optarg);
+        case 'g':
+            max_gap_ms = atoll(optarg);
             break;
         case 0:
             print_usage(argv);
             exit(0);
             break;
         case '?':
-            if (strchr("rips", optopt))
+            if (strchr("ripstxg", optopt))
                 fprintf(stderr, "[E] option -%c requires an argument.\n", optopt);
             else if (isprint (optopt))
                 fprintf(stderr, "[E] unknown option `-%c'.\n", optopt);
@@ -222,8 +547,10 @@ void process_arguments(int argc, char * const *argv)
             print_usage(argv);
             exit(1);
         default:
-            fprintf(stderr, "BUG: can't process option -%c\n", optopt);
-            exit(1);
+            if (!traffic_options_parse(&options, c, optarg)) {
+                fprintf(stderr, "BUG: can't process option -%c\n", optopt);
+                exit(1);
+            }
         }
     }
 
@@ -235,29 +562,7 @@ void process_arguments(int argc, char * const *argv)
         dump_file_name = argv[argc-1];
     }
 
-    sequence_number = zmalloc(device_count*sizeof(uint64_t));
-    device_number_s = zmalloc(device_count*sizeof(char*));
-    for (int i = 0; i < device_count; i++) {
-        int rc = asprintf(&device_number_s[i], "%d", i+1);
-        assert(rc != -1);
-    }
-
-    if (socket_type == ZMQ_PUB) {
-        if (connection_spec == NULL)
-            connection_spec = DEFAULT_CONNECTION_SPEC_PUB;
-        else
-            connection_spec = augment_zmq_connection_spec(connection_spec, DEFAULT_CONNECTION_PORT_PUB);
-    } else if (socket_type == ZMQ_PUSH) {
-        if (connection_spec == NULL)
-            connection_spec = DEFAULT_CONNECTION_SPEC_PUSH;
-        else
-            connection_spec = augment_zmq_connection_spec(connection_spec, DEFAULT_CONNECTION_PORT_PUSH);
-    } else {
-        if (connection_spec == NULL)
-            connection_spec = DEFAULT_CONNECTION_SPEC_DEALER;
-        else
-            connection_spec = augment_zmq_connection_spec(connection_spec, DEFAULT_CONNECTION_PORT_DEALER);
-    }
+    traffic_options_finalize(&options);
 }
 
 int main(int argc, char * const *argv)
@@ -268,101 +573,81 @@ int main(int argc, char * const *argv)
 
     process_arguments(argc, argv);
 
-    // open dump file
-    dump_file = fopen(dump_file_name, "r");
-    if (!dump_file) {
+    // map dump file
+    int fd = open(dump_file_name, O_RDONLY);
+    if (fd == -1) {
         fprintf(stderr, "[E] could not open dump file: %s\n", strerror(errno));
         exit(1);
     }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        fprintf(stderr, "[E] could not determine size of dump file or file is empty\n");
+        exit(1);
+    }
+    dump_file_size = st.st_size;
+    dump_data = mmap(NULL, dump_file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (dump_data == MAP_FAILED) {
+        fprintf(stderr, "[E] could not map dump file: %s\n", strerror(errno));
+        exit(1);
+    }
+    close(fd);
+    madvise(dump_data, dump_file_size, MADV_SEQUENTIAL);
+
     if (verbose) printf("[I] replaying stream from %s\n", dump_file_name);
-    dump_file_size = zsys_file_size (dump_file_name);
+    if (!index_dump_file()) {
+        fprintf(stderr, "[E] dump file contains no messages\n");
+        exit(1);
+    }
 
     // set global config
-    zsys_init();
-    zsys_set_rcvhwm(10000);
-    zsys_set_sndhwm(100000);
-    zsys_set_pipehwm(1000);
-    zsys_set_linger(100);
-    zsys_set_io_threads(io_threads);
-
-    // create socket to push messages to
-    zsock_t* publisher = zsock_new(socket_type);
-    assert_x(publisher != NULL, "[E] zmq socket creation failed", __FILE__, __LINE__);
-
-    // configure the push socket
-    zsock_set_sndhwm(publisher, 1000000);
-
-    if (socket_type == ZMQ_PUB) {
-        // bind pub socket
-        printf("[I] binding PUB socket to %s\n", connection_spec);
-        int rc = zsock_bind(publisher, "%s", connection_spec);
-        assert_x(rc > 0, "pub socket bind failed", __FILE__, __LINE__);
-
-        stats_socket = zsock_new(ZMQ_PUB);
-        assert_x(stats_socket != NULL, "stats socket creation failed", __FILE__, __LINE__);
-        zsock_set_sndhwm(stats_socket, 1000);
-
-        rc = zsock_bind(stats_socket, "tcp://%s:%d", "*", stats_port);
-        assert_x(rc == stats_port, "stats socket bind failed", __FILE__, __LINE__);
-    } else if (socket_type == ZMQ_PUSH) {
-        // bind push socket
-        printf("[I] binding PUSH socket to %s\n", connection_spec);
-        int rc = zsock_connect(publisher, "%s", connection_spec);
-        log_zmq_error(rc, __FILE__, __LINE__);
-        assert(rc != -1);
-    } else {
-        // connect dealer socket
-        printf("[I] connecting DEALER socket to %s\n", connection_spec);
-        int rc = zsock_connect(publisher, "%s", connection_spec);
-        log_zmq_error(rc, __FILE__, __LINE__);
-        assert(rc == 0);
-    }
+    traffic_zsys_init(&options);
+    stats_socket = traffic_stats_socket_new(&options);
 
     // set up event loop
     zloop_t *loop = zloop_new();
     assert(loop);
     zloop_set_verbose(loop, 0);
 
-    // register FILE descriptor for pollin events
-    zmq_pollitem_t dump_file_item = {
-        .fd = fileno(dump_file),
-        .events = ZMQ_POLLIN
-    };
-    int rc = zloop_poller(loop, &dump_file_item, file_consume_message_and_forward, publisher);
-    assert(rc==0);
+    // create senders
+    replay_start_time = zclock_usecs();
+    for (size_t i = 0; i < options.num_threads; i++) {
+        senders[i] = sender_state_new(i);
+        sender_actors[i] = zactor_new(sender, senders[i]);
+        int rc = zloop_reader(loop, zactor_sock(sender_actors[i]), sender_finished, NULL);
+        assert(rc == 0);
+    }
 
     // calculate statistics every 1000 ms
     int timer_id = 1;
-    rc = zloop_timer(loop, 1000, 0, timer_event, &timer_id);
+    int rc = zloop_timer(loop, 1000, 0, timer_event, &timer_id);
     assert(rc != -1);
 
-    // set publishing rate
-    message_credit = messages_per_second;
-
-    if (!zsys_interrupted) {
-        if (verbose) printf("[I] starting main event loop\n");
-        bool should_continue_to_run = getenv("CPUPROFILE") != NULL;
-        do {
-            rc = zloop_start(loop);
-            should_continue_to_run &= errno == EINTR && !zsys_interrupted;
-            log_zmq_error(rc, __FILE__, __LINE__);
-        } while (should_continue_to_run);
-        if (verbose) printf("[I] main event loop terminated with return code %d\n", rc);
-    }
+    traffic_run_main_loop(loop);
 
-    printf("[I] replayed %zu messages\n", replayed_messages_count);
+    // final statistics
+    timer_event(loop, timer_id, NULL);
+    double runtime = (zclock_usecs() - replay_start_time) / 1000000.0;
+    printf("[I] replayed %zu messages in %.2f seconds (%.0f msgs/s)\n",
+           total_messages_sent, runtime, runtime > 0 ? total_messages_sent / runtime : 0);
+    print_latency_histogram(total_latency_histogram);
 
     // clean up
     if (verbose) printf("[I] shutting down\n");
 
-    fclose(dump_file);
     zloop_destroy(&loop);
     assert(loop == NULL);
-    zsock_destroy(&publisher);
+    for (size_t i = 0; i < options.num_threads; i++) {
+        zactor_destroy(&sender_actors[i]);
+        sender_state_destroy(&senders[i]);
+    }
     if (stats_socket)
         zsock_destroy(&stats_socket);
     zsys_shutdown();
 
+    // zmq may reference the mapping until all sockets have been closed
+    munmap(dump_data, dump_file_size);
+    free(message_offsets);
+
     if (verbose) printf("[I] terminated\n");
 
     return 0;
@@ -0,0 +1,567 @@
+#include <dirent.h>
+#include "logjam-spool.h"
+
+// Segment files contain a sequence of records: a header, followed by the stream name and
+// the data. Records are only ever read by the process which wrote them (or a
+// restarted one on the same host), so the header is written in native byte order. The
+// read position in the oldest segment is saved in a cursor file when the spool is flushed
+// or destroyed, so after a crash at most the messages read since the last flush are sent
+// again.
+
+typedef struct {
+    uint32_t stream_len;
+    uint32_t data_len;
+    int64_t created_ms;
+} spool_record_header_t;
+
+typedef struct {
+    uint64_t id;
+    size_t size;                        // number of bytes written to the segment
+    size_t read_offset;                 // position of the next record to read
+    size_t messages;                    // number of records not read yet
+} spool_segment_t;
+
+struct _spool_t {
+    char *directory;
+    size_t segment_size;
+    size_t max_bytes;
+    zlist_t *segments;                  // oldest segment first
+    spool_segment_t *write_segment;     // NULL if the next append starts a new segment
+    FILE *writer;
+    spool_segment_t *read_segment;      // segment for which reader is open
+    FILE *reader;
+    spool_record_header_t head;         // header of the next record to read
+    bool have_head;
+    uint64_t next_id;
+    uint64_t cursor_id;                 // last read position written to the cursor file
+    size_t cursor_offset;
+    size_t messages;
+    size_t bytes;
+    size_t dropped;
+};
+
+static const char *segment_prefix = "segment-";
+static const char *segment_suffix = ".spool";
+static const char *cursor_file_name = "cursor";
+
+static void segment_path(spool_t *spool, uint64_t id, char *path, size_t n)
+{
+    snprintf(path, n, "%s/%s%016" PRIx64 "%s", spool->directory, segment_prefix, id, segment_suffix);
+}
+
+static bool parse_segment_name(const char *name, uint64_t *id)
+{
+    size_t prefix_len = strlen(segment_prefix);
+    size_t suffix_len = strlen(segment_suffix);
+    size_t len = strlen(name);
+    if (len != prefix_len + 16 + suffix_len
+        || strncmp(name, segment_prefix, prefix_len)
+        || strcmp(name + len - suffix_len, segment_suffix))
+        return false;
+    char *end;
+    *id = strtoull(name + prefix_len, &end, 16);
+    return end == name + len - suffix_len;
+}
+
+static int compare_segments(void *a, void *b)
+{
+    spool_segment_t *sa = a, *sb = b;
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+static void remove_segment(spool_t *spool, spool_segment_t *segment)
+{
+    if (segment == spool->read_segment) {
+        fclose(spool->reader);
+        spool->reader = NULL;
+        spool->read_segment = NULL;
+        spool->have_head = false;
+    }
+    if (segment == spool->write_segment) {
+        fclose(spool->writer);
+        spool->writer = NULL;
+        spool->write_segment = NULL;
+    }
+    char path[1024];
+    segment_path(spool, segment->id, path, sizeof(path));
+    if (unlink(path))
+        fprintf(stderr, "[E] spool: could not remove segment %s: %s\n", path, strerror(errno));
+
+    spool->messages -= segment->messages;
+    spool->bytes -= segment->size - segment->read_offset;
+    zlist_remove(spool->segments, segment);
+    free(segment);
+}
+
+static void drop_segment(spool_t *spool, spool_segment_t *segment)
+{
+    spool->dropped += segment->messages;
+    remove_segment(spool, segment);
+}
+
+// counts the unread complete records of a segment left over by a previous run and
+// truncates an incomplete last record
+static bool recover_segment(spool_t *spool, spool_segment_t *segment, size_t read_offset)
+{
+    char path[1024];
+    segment_path(spool, segment->id, path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "[E] spool: could not open segment %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    size_t file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    spool_record_header_t header;
+    size_t offset = read_offset;
+    if (offset > file_size || fseek(file, offset, SEEK_SET))
+        offset = file_size;
+    segment->read_offset = offset;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        size_t record_size = sizeof(header) + header.stream_len + header.data_len;
+        if (offset + record_size > file_size)
+            break;
+        offset += record_size;
+        segment->messages++;
+        if (fseek(file, offset, SEEK_SET))
+            break;
+    }
+    fclose(file);
+
+    if (offset < file_size) {
+        fprintf(stderr, "[W] spool: truncating incomplete record in segment %s\n", path);
+        if (truncate(path, offset))
+            fprintf(stderr, "[E] spool: could not truncate segment %s: %s\n", path, strerror(errno));
+    }
+    segment->size = offset;
+    if (segment->messages == 0)
+        unlink(path);
+    return segment->messages > 0;
+}
+
+static void read_cursor(spool_t *spool)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", spool->directory, cursor_file_name);
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return;
+    if (fscanf(file, "%" SCNx64 " %zu", &spool->cursor_id, &spool->cursor_offset) != 2) {
+        fprintf(stderr, "[W] spool: ignoring invalid cursor file %s\n", path);
+        spool->cursor_id = 0;
+        spool->cursor_offset = 0;
+    }
+    fclose(file);
+}
+
+static void write_cursor(spool_t *spool)
+{
+    spool_segment_t *oldest = zlist_first(spool->segments);
+    uint64_t id = oldest ? oldest->id : 0;
+    size_t offset = oldest ? oldest->read_offset : 0;
+    if (id == spool->cursor_id && offset == spool->cursor_offset)
+        return;
+
+    char path[1024], tmp_path[1024];
+    snprintf(path, sizeof(path), "%s/%s", spool->directory, cursor_file_name);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        fprintf(stderr, "[E] spool: could not write cursor file %s: %s\n", tmp_path, strerror(errno));
+        return;
+    }
+    fprintf(file, "%016" PRIx64 " %zu\n", id, offset);
+    if (fclose(file) == 0 && rename(tmp_path, path) == 0) {
+        spool->cursor_id = id;
+        spool->cursor_offset = offset;
+    }
+}
+
+static void recover_segments(spool_t *spool)
+{
+    read_cursor(spool);
+
+    DIR *dir = opendir(spool->directory);
+    if (!dir) {
+        fprintf(stderr, "[E] spool: could not open directory %s: %s\n", spool->directory, strerror(errno));
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        uint64_t id;
+        if (!parse_segment_name(entry->d_name, &id))
+            continue;
+        spool_segment_t *segment = zmalloc(sizeof(*segment));
+        segment->id = id;
+        zlist_append(spool->segments, segment);
+        if (id >= spool->next_id)
+            spool->next_id = id + 1;
+    }
+    closedir(dir);
+    zlist_sort(spool->segments, compare_segments);
+
+    zlist_t *recovered = zlist_new();
+    spool_segment_t *segment;
+    while ((segment = zlist_pop(spool->segments))) {
+        size_t read_offset = segment->id == spool->cursor_id ? spool->cursor_offset : 0;
+        if (segment->id < spool->cursor_id) {
+            // completely read before the cursor was written
+            char path[1024];
+            segment_path(spool, segment->id, path, sizeof(path));
+            unlink(path);
+            free(segment);
+        } else if (recover_segment(spool, segment, read_offset)) {
+            zlist_append(recovered, segment);
+            spool->messages += segment->messages;
+            spool->bytes += segment->size - segment->read_offset;
+        } else {
+            free(segment);
+        }
+    }
+    zlist_destroy(&spool->segments);
+    spool->segments = recovered;
+
+    if (spool->messages > 0)
+        printf("[I] spool: recovered %zu messages (%zu bytes) in %zu segments from %s\n",
+               spool->messages, spool->bytes, zlist_size(spool->segments), spool->directory);
+}
+
+spool_t* spool_new(const char *directory, size_t segment_size, size_t max_bytes)
+{
+    if (!zsys_file_exists(directory) && zsys_dir_create("%s", directory)) {
+        fprintf(stderr, "[E] spool: could not create directory %s: %s\n", directory, strerror(errno));
+        return NULL;
+    }
+    spool_t *spool = zmalloc(sizeof(*spool));
+    spool->directory = strdup(directory);
+    spool->segment_size = segment_size;
+    spool->max_bytes = max_bytes;
+    spool->segments = zlist_new();
+    spool->next_id = 1;
+    recover_segments(spool);
+    return spool;
+}
+
+void spool_destroy(spool_t **spool_p)
+{
+    spool_t *spool = *spool_p;
+    if (spool == NULL)
+        return;
+    // segments which still contain messages are kept for the next run
+    write_cursor(spool);
+    if (spool->writer)
+        fclose(spool->writer);
+    if (spool->reader)
+        fclose(spool->reader);
+    spool_segment_t *segment;
+    while ((segment = zlist_pop(spool->segments)))
+        free(segment);
+    zlist_destroy(&spool->segments);
+    free(spool->directory);
+    free(spool);
+    *spool_p = NULL;
+}
+
+static bool open_write_segment(spool_t *spool)
+{
+    spool_segment_t *segment = zmalloc(sizeof(*segment));
+    segment->id = spool->next_id++;
+    char path[1024];
+    segment_path(spool, segment->id, path, sizeof(path));
+    spool->writer = fopen(path, "w");
+    if (!spool->writer) {
+        fprintf(stderr, "[E] spool: could not create segment %s: %s\n", path, strerror(errno));
+        free(segment);
+        return false;
+    }
+    zlist_append(spool->segments, segment);
+    spool->write_segment = segment;
+    return true;
+}
+
+bool spool_append(spool_t *spool, const char *stream, const void *data, size_t len)
+{
+    spool_record_header_t header = {
+        .stream_len = strlen(stream),
+        .data_len = len,
+        .created_ms = zclock_time(),
+    };
+    size_t record_size = sizeof(header) + header.stream_len + header.data_len;
+
+    if (spool->write_segment && spool->write_segment->size >= spool->segment_size) {
+        fclose(spool->writer);
+        spool->writer = NULL;
+        spool->write_segment = NULL;
+    }
+
+    // make room by dropping the oldest segments, but never the one being written
+    spool_segment_t *oldest;
+    while (spool->bytes + record_size > spool->max_bytes
+           && (oldest = zlist_first(spool->segments))
+           && oldest != spool->write_segment) {
+        fprintf(stderr, "[W] spool: size limit reached, dropping %zu messages\n", oldest->messages);
+        drop_segment(spool, oldest);
+    }
+    if (spool->bytes + record_size > spool->max_bytes)
+        return false;
+
+    if (!spool->write_segment && !open_write_segment(spool))
+        return false;
+
+    if (fwrite(&header, sizeof(header), 1, spool->writer) != 1
+        || fwrite(stream, header.stream_len, 1, spool->writer) != 1
+        || (len > 0 && fwrite(data, len, 1, spool->writer) != 1)) {
+        fprintf(stderr, "[E] spool: write failed: %s\n", strerror(errno));
+        // the segment might contain an incomplete record now, so don't append to it
+        fclose(spool->writer);
+        spool->writer = NULL;
+        spool->write_segment = NULL;
+        return false;
+    }
+
+    spool->write_segment->size += record_size;
+    spool->write_segment->messages++;
+    spool->messages++;
+    spool->bytes += record_size;
+    return true;
+}
+
+// positions the reader at the oldest record and reads its header
+static bool load_head(spool_t *spool)
+{
+    while (!spool->have_head) {
+        spool_segment_t *segment = zlist_first(spool->segments);
+        if (segment == NULL)
+            return false;
+        if (segment->messages == 0) {
+            remove_segment(spool, segment);
+            continue;
+        }
+        if (segment != spool->read_segment) {
+            if (spool->reader)
+                fclose(spool->reader);
+            char path[1024];
+            segment_path(spool, segment->id, path, sizeof(path));
+            spool->reader = fopen(path, "r");
+            spool->read_segment = segment;
+            if (!spool->reader || fseek(spool->reader, segment->read_offset, SEEK_SET)) {
+                fprintf(stderr, "[E] spool: could not read segment %s: %s\n", path, strerror(errno));
+                drop_segment(spool, segment);
+                continue;
+            }
+        }
+        if (segment == spool->write_segment)
+            fflush(spool->writer);
+        clearerr(spool->reader);
+        if (fread(&spool->head, sizeof(spool->head), 1, spool->reader) != 1) {
+            fprintf(stderr, "[E] spool: could not read record header from segment %016" PRIx64 "\n", segment->id);
+            drop_segment(spool, segment);
+            continue;
+        }
+        spool->have_head = true;
+    }
+    return true;
+}
+
+zmsg_t* spool_shift(spool_t *spool)
+{
+    if (!load_head(spool))
+        return NULL;
+
+    spool_segment_t *segment = spool->read_segment;
+    zframe_t *stream = zframe_new(NULL, spool->head.stream_len);
+    zframe_t *data = zframe_new(NULL, spool->head.data_len);
+    if ((spool->head.stream_len > 0 && fread(zframe_data(stream), spool->head.stream_len, 1, spool->reader) != 1)
+        || (spool->head.data_len > 0 && fread(zframe_data(data), spool->head.data_len, 1, spool->reader) != 1)) {
+        fprintf(stderr, "[E] spool: could not read record from segment %016" PRIx64 "\n", segment->id);
+        zframe_destroy(&stream);
+        zframe_destroy(&data);
+        drop_segment(spool, segment);
+        return NULL;
+    }
+
+    size_t record_size = sizeof(spool->head) + spool->head.stream_len + spool->head.data_len;
+    segment->read_offset += record_size;
+    segment->messages--;
+    spool->messages--;
+    spool->bytes -= record_size;
+    spool->have_head = false;
+
+    zmsg_t *msg = zmsg_new();
+    zmsg_append(msg, &stream);
+    zmsg_append(msg, &data);
+    return msg;
+}
+
+void spool_flush(spool_t *spool)
+{
+    if (spool->writer)
+        fflush(spool->writer);
+    write_cursor(spool);
+}
+
+size_t spool_size(spool_t *spool)
+{
+    return spool->messages;
+}
+
+size_t spool_bytes(spool_t *spool)
+{
+    return spool->bytes;
+}
+
+int64_t spool_age(spool_t *spool)
+{
+    if (spool->messages == 0 || !load_head(spool))
+        return 0;
+    return zclock_time() - spool->head.created_ms;
+}
+
+size_t spool_dropped(spool_t *spool)
+{
+    size_t dropped = spool->dropped;
+    spool->dropped = 0;
+    return dropped;
+}
+
+void spool_drain_init(spool_drain_t *drain, unsigned int rate, int64_t now)
+{
+    drain->rate = rate;
+    drain->tokens = 0;
+    drain->updated = now;
+}
+
+size_t spool_drain_available(spool_drain_t *drain, int64_t now)
+{
+    // allow bursts of 100ms worth of messages
+    double max_tokens = drain->rate / 10.0 + 1;
+    drain->tokens += (now - drain->updated) * drain->rate / 1000.0;
+    if (drain->tokens > max_tokens)
+        drain->tokens = max_tokens;
+    drain->updated = now;
+    return drain->tokens;
+}
+
+static void spool_drain_test()
+{
+    char directory[] = "/tmp/logjam-spool-test-XXXXXX";
+    assert(mkdtemp(directory));
+    spool_t *spool = spool_new(directory, 4096, 1024 * 1024);
+    assert(spool);
+
+    // graylog accepts 50 messages per 10ms tick, live traffic uses 30 of them and the
+    // drain may replay 10 per tick: the backlog must disappear while live traffic flows.
+    for (int i = 0; i < 200; i++)
+        assert(spool_append(spool, "app-env", "backlog", 7));
+
+    spool_drain_t drain;
+    int64_t now = 0;
+    spool_drain_init(&drain, 1000, now);
+    size_t live_sent = 0;
+    int tick;
+    for (tick = 0; tick < 100 && spool_size(spool) > 0; tick++) {
+        now += 10;
+        size_t capacity = 50;
+        for (int i = 0; i < 30; i++) {
+            if (capacity > 0) {
+                capacity--;
+                live_sent++;
+            } else {
+                assert(spool_append(spool, "app-env", "live", 4));
+            }
+        }
+        size_t available = spool_drain_available(&drain, now);
+        zmsg_t *msg;
+        while (available > 0 && capacity > 0 && (msg = spool_shift(spool))) {
+            zmsg_destroy(&msg);
+            available--;
+            capacity--;
+            drain.tokens -= 1;
+        }
+    }
+    assert(spool_size(spool) == 0);
+    assert(live_sent == tick * 30);
+    // 10 spooled messages per tick
+    assert(tick == 20);
+
+    spool_destroy(&spool);
+    zsys_file_delete("%s/%s", directory, cursor_file_name);
+    zsys_dir_delete("%s", directory);
+}
+
+void spool_test(int verbose)
+{
+    printf(" * spool: ");
+    if (verbose)
+        printf("\n");
+
+    char directory[] = "/tmp/logjam-spool-test-XXXXXX";
+    assert(mkdtemp(directory));
+
+    // small segments, room for about three of them
+    spool_t *spool = spool_new(directory, 100, 350);
+    assert(spool);
+    assert(spool_size(spool) == 0);
+    assert(spool_shift(spool) == NULL);
+
+    char data[64];
+    for (int i = 0; i < 5; i++) {
+        int n = snprintf(data, sizeof(data), "message %d", i);
+        assert(spool_append(spool, "app-env", data, n));
+    }
+    assert(spool_size(spool) == 5);
+    assert(spool_bytes(spool) == 5 * (sizeof(spool_record_header_t) + 7 + 9));
+    assert(spool_age(spool) >= 0);
+
+    zmsg_t *msg = spool_shift(spool);
+    assert(msg);
+    char *stream = zmsg_popstr(msg);
+    char *gelf = zmsg_popstr(msg);
+    assert(streq(stream, "app-env"));
+    assert(streq(gelf, "message 0"));
+    free(stream);
+    free(gelf);
+    zmsg_destroy(&msg);
+    assert(spool_size(spool) == 4);
+
+    // messages survive restarts
+    spool_destroy(&spool);
+    spool = spool_new(directory, 100, 350);
+    assert(spool_size(spool) == 4);
+
+    // interleaved reads and writes keep the order
+    assert(spool_append(spool, "app-env", "message 5", 9));
+    for (int i = 1; i <= 5; i++) {
+        msg = spool_shift(spool);
+        assert(msg);
+        zframe_t *frame = zmsg_last(msg);
+        snprintf(data, sizeof(data), "message %d", i);
+        assert(zframe_streq(frame, data));
+        zmsg_destroy(&msg);
+    }
+    assert(spool_size(spool) == 0);
+    assert(spool_bytes(spool) == 0);
+    assert(spool_shift(spool) == NULL);
+
+    // the oldest segments are dropped when the spool is full
+    for (int i = 0; i < 20; i++)
+        assert(spool_append(spool, "app-env", "0123456789", 10));
+    assert(spool_bytes(spool) <= 350);
+    size_t dropped = spool_dropped(spool);
+    assert(dropped > 0);
+    assert(spool_size(spool) + dropped == 20);
+    assert(spool_dropped(spool) == 0);
+    while ((msg = spool_shift(spool)))
+        zmsg_destroy(&msg);
+    assert(spool_size(spool) == 0);
+
+    spool_destroy(&spool);
+    zsys_file_delete("%s/%s", directory, cursor_file_name);
+    zsys_dir_delete("%s", directory);
+
+    spool_drain_test();
+
+    printf("OK\n");
+}
@@ -0,0 +1,65 @@
+#ifndef __LOGJAM_SPOOL_H_INCLUDED__
+#define __LOGJAM_SPOOL_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A FIFO of messages (a stream name and some data) on disk. The graylog forwarder spools
+// GELF messages while graylog doesn't accept them, the importer spools requests while the
+// database can't keep up with inserting them. Messages are appended to segment files of
+// a given size. Segments are deleted once all their messages have been read, or, if the
+// spool grows beyond its maximum size, dropped starting with the oldest one. Segments
+// left over by a previous run are picked up again when the spool is created.
+
+typedef struct _spool_t spool_t;
+
+extern spool_t* spool_new(const char *directory, size_t segment_size, size_t max_bytes);
+extern void spool_destroy(spool_t **spool_p);
+
+// returns false if the message could not be written
+extern bool spool_append(spool_t *spool, const char *stream, const void *data, size_t len);
+
+// removes the oldest message from the spool and returns it as a two part message
+// (stream name, data). returns NULL if the spool is empty.
+extern zmsg_t* spool_shift(spool_t *spool);
+
+// writes buffered data to the current segment file
+extern void spool_flush(spool_t *spool);
+
+// number of messages in the spool
+extern size_t spool_size(spool_t *spool);
+
+// number of bytes of all messages in the spool
+extern size_t spool_bytes(spool_t *spool);
+
+// age of the oldest message in milliseconds (0 if the spool is empty)
+extern int64_t spool_age(spool_t *spool);
+
+// number of messages dropped since the last call
+extern size_t spool_dropped(spool_t *spool);
+
+// token bucket limiting the rate at which spooled messages are replayed. messages which
+// can be sent right away should bypass the spool, so that the drain only has to work
+// off the backlog.
+typedef struct {
+    unsigned int rate;      // messages per second
+    double tokens;
+    int64_t updated;        // milliseconds
+} spool_drain_t;
+
+extern void spool_drain_init(spool_drain_t *drain, unsigned int rate, int64_t now);
+
+// number of spooled messages which may be sent at the given time (in milliseconds).
+// callers subtract the number of messages actually sent from drain->tokens.
+extern size_t spool_drain_available(spool_drain_t *drain, int64_t now);
+
+extern void spool_test(int verbose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
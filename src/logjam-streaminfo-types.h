@@ -14,6 +14,9 @@ typedef struct {
 
 #define DEFAULT_MAX_INSERTS_PER_SECOND 100
 
+// number of log severities (Debug .. Unknown)
+#define NUM_LOG_SEVERITIES 6
+
 typedef struct {
     int64_t cap;                       // number of insertions allowed during one tick
     int64_t current;                   // number of requests inserted since the last tick
@@ -21,10 +24,19 @@ typedef struct {
 
 typedef void (stream_fn) (void *stream);
 
+// modules which received requests during the last day. only used by the controller.
+typedef struct {
+    uint64_t last_seen;
+    char *live_stream_key;             // [app-env,module].join(',').downcase
+    const char *live_stream_module;    // module part of live_stream_key
+    bool active;                       // had requests when it was last published
+} known_module_t;
+
 typedef struct {
     int32_t ref_count;
     char *key;      // [app,env].join('-')
     char *yek;      // [env,app].join('.')
+    char *live_stream_key;  // key.downcase
     char *app;
     char *env;
     size_t key_len;
@@ -46,12 +58,15 @@ typedef struct {
     char **api_requests;
     int api_requests_size;
     int all_requests_are_api_requests;
-    zhash_t *known_modules;
+    zhash_t *known_modules;                                 // module => known_module_t
     void *inserts_total;
     void *inserts_throttled_total;
     stream_fn *free_callback;
     requests_inserted_t *requests_inserted;
     bool free_requests_inserted;
+    int64_t max_gelf_messages_per_second;                   // 0: not limited
+    bool gelf_sampling;                                     // some severities are sampled
+    long gelf_sampling_thresholds[NUM_LOG_SEVERITIES];      // per request severity
 } stream_info_t;
 
 
@@ -168,6 +168,31 @@ void add_api_requests_settings(stream_info_t* info, json_object* obj)
     }
 }
 
+static
+void add_gelf_sampling_settings(stream_info_t* info, json_object* obj)
+{
+    static const char *severities[NUM_LOG_SEVERITIES] = {"debug", "info", "warn", "error", "fatal", "unknown"};
+    if (json_object_get_type(obj) != json_type_object)
+        return;
+    json_object_object_foreach(obj, key, value) {
+        int i;
+        for (i = 0; i < NUM_LOG_SEVERITIES; i++)
+            if (strcasecmp(key, severities[i]) == 0)
+                break;
+        if (i == NUM_LOG_SEVERITIES) {
+            fprintf(stderr, "[W] ignored gelf sampling rate for unknown severity: %s (stream %s)\n", key, info->key);
+            continue;
+        }
+        double rate = json_object_get_double(value);
+        if (rate < 0)
+            rate = 0;
+        if (rate < 1) {
+            info->gelf_sampling_thresholds[i] = MAX_RANDOM_VALUE * rate;
+            info->gelf_sampling = true;
+        }
+    }
+}
+
 static
 void add_stream_settings(stream_info_t *info, json_object *stream_obj)
 {
@@ -205,6 +230,14 @@ void add_stream_settings(stream_info_t *info, json_object *stream_obj)
     } else {
         info->requests_inserted->cap = DEFAULT_MAX_INSERTS_PER_SECOND;
     }
+    if (json_object_object_get_ex(stream_obj, "max_gelf_messages_per_second", &obj)) {
+        info->max_gelf_messages_per_second = json_object_get_int64(obj);
+    }
+    for (int i = 0; i < NUM_LOG_SEVERITIES; i++)
+        info->gelf_sampling_thresholds[i] = MAX_RANDOM_VALUE;
+    if (json_object_object_get_ex(stream_obj, "gelf_sampling_rates", &obj)) {
+        add_gelf_sampling_settings(info, obj);
+    }
 }
 
 static
@@ -241,6 +274,9 @@ stream_info_t* stream_info_new(const char* key, json_object *stream_obj)
     snprintf(yek, info->key_len+1, "%s.%s", env, app);
     info->yek = strdup(yek);
 
+    info->live_stream_key = strdup(info->key);
+    for (char *p = info->live_stream_key; *p; ++p) *p = tolower(*p);
+
     info->requests_inserted = zmalloc(sizeof(requests_inserted_t));
     info->free_requests_inserted = true;
     add_stream_settings(info, stream_obj);
@@ -261,6 +297,7 @@ void release_stream_info(stream_info_t *info)
     // printf("[D] stream-op: freeing stream %s\n", info->key);
     free(info->key);
     free(info->yek);
+    free(info->live_stream_key);
     free(info->app);
     free(info->env);
     if (info->module_thresholds) {
@@ -318,6 +355,11 @@ void dump_stream_info(stream_info_t *stream)
             printf(",%s", stream->backend_only_requests[i]);
         printf("\n");
     }
+    printf("[D] max gelf messages per second: %" PRIi64 "\n", stream->max_gelf_messages_per_second);
+    for (int i = 0; i<NUM_LOG_SEVERITIES; i++) {
+        if (stream->gelf_sampling_thresholds[i] < MAX_RANDOM_VALUE)
+            printf("[D] gelf sampling rate for severity %d: %.3f\n", i, (double)stream->gelf_sampling_thresholds[i] / MAX_RANDOM_VALUE);
+    }
     n = stream->api_requests_size;
     printf("[D] api requests size: %d\n", n);
     if (n > 0) {
@@ -329,11 +371,43 @@ void dump_stream_info(stream_info_t *stream)
     }
 }
 
+static
+zhash_t* streams_from_json(json_object *streams_obj)
+{
+    zhash_t *streams = zhash_new();
+    json_object_object_foreach(streams_obj, key, val) {
+        stream_info_t *stream = stream_info_new(key, val);
+        if (stream) {
+            if (0) dump_stream_info(stream);
+            zhash_insert(streams, key, stream);
+            zhash_freefn(streams, key, (zhash_free_fn*)release_stream_info);
+        }
+    }
+    return streams;
+}
+
+// file urls are used by benchmarks and tests, which run without a logjam instance
+static
+zhash_t* get_streams_from_file(const char *file_name)
+{
+    json_object *streams_obj = json_object_from_file(file_name);
+    if (streams_obj == NULL) {
+        fprintf(stderr, "[E] stream-updater: could not read stream config from %s\n", file_name);
+        return NULL;
+    }
+    zhash_t *streams = streams_from_json(streams_obj);
+    json_object_put(streams_obj);
+    return streams;
+}
+
 static
 zhash_t* get_streams()
 {
     zhash_t *streams = NULL;
 
+    if (!strncmp(streams_url, "file://", 7))
+        return get_streams_from_file(streams_url + 7);
+
     zhttp_request_t *request = zhttp_request_new();
     zhttp_response_t *response = NULL;
     zhttp_request_set_url(request, streams_url);
@@ -357,15 +431,7 @@ zhash_t* get_streams()
     json_tokener_free(tokener);
     if (streams_obj == NULL) goto cleanup;
 
-    streams = zhash_new();
-    json_object_object_foreach(streams_obj, key, val) {
-        stream_info_t *stream = stream_info_new(key, val);
-        if (stream) {
-            if (0) dump_stream_info(stream);
-            zhash_insert(streams, key, stream);
-            zhash_freefn(streams, key, (zhash_free_fn*)release_stream_info);
-        }
-    }
+    streams = streams_from_json(streams_obj);
     json_object_put(streams_obj);
 
  cleanup:
@@ -447,11 +513,13 @@ bool setup_stream_config(const char* logjam_url, const char *pattern)
     if (have_subscription_pattern)
         log_gaps = false;
 
-    int rc = pthread_mutex_init(&lock, NULL);
-    assert(rc == 0);
-
-    client = zhttp_client_new(debug);
-    assert(client);
+    // the config can be set up again (the checker does this for several tests)
+    if (client == NULL) {
+        int rc = pthread_mutex_init(&lock, NULL);
+        assert(rc == 0);
+        client = zhttp_client_new(debug);
+        assert(client);
+    }
     if (update_stream_config()) {
         return true;
     }
@@ -461,6 +529,34 @@ bool setup_stream_config(const char* logjam_url, const char *pattern)
 
 #define ONE_DAY_MS (1000 * 60 * 60 * 24)
 
+static
+void known_module_destroy(void *item)
+{
+    known_module_t *known = item;
+    free(known->live_stream_key);
+    free(known);
+}
+
+// live stream keys are computed once, when a module is seen for the first time
+static
+void touch_known_module(stream_info_t *stream_info, const char *module, uint64_t now)
+{
+    known_module_t *known = zhash_lookup(stream_info->known_modules, module);
+    if (known == NULL) {
+        known = zmalloc(sizeof(*known));
+        // skip :: at the beginning of module
+        const char *name = module;
+        while (*name == ':') name++;
+        int n = asprintf(&known->live_stream_key, "%s,%s", stream_info->key, name);
+        assert(n > 0);
+        for (char *p = known->live_stream_key; *p; ++p) *p = tolower(*p);
+        known->live_stream_module = known->live_stream_key + stream_info->key_len + 1;
+        zhash_insert(stream_info->known_modules, module, known);
+        zhash_freefn(stream_info->known_modules, module, known_module_destroy);
+    }
+    known->last_seen = now;
+}
+
 void update_known_modules(stream_info_t *stream_info, zhash_t* module_hash)
 {
     uint64_t now = zclock_time();
@@ -471,7 +567,7 @@ void update_known_modules(stream_info_t *stream_info, zhash_t* module_hash)
     void *elem = zhash_first(module_hash);
     while (elem) {
         const char *module = zhash_cursor(module_hash);
-        zhash_update(known_modules, module, (void*)now);
+        touch_known_module(stream_info, module, now);
         elem = zhash_next(module_hash);
     }
 
@@ -479,8 +575,8 @@ void update_known_modules(stream_info_t *stream_info, zhash_t* module_hash)
     zlist_t* modules = zhash_keys(known_modules);
     const char* module = zlist_first(modules);
     while (module) {
-        uint64_t last_seen = (uint64_t)zhash_lookup(known_modules, module);
-        if (last_seen < age_threshold) {
+        known_module_t *known = zhash_lookup(known_modules, module);
+        if (known->last_seen < age_threshold) {
             zhash_delete(known_modules, module);
         }
         module = zlist_next(modules);
@@ -488,7 +584,7 @@ void update_known_modules(stream_info_t *stream_info, zhash_t* module_hash)
 
     // update all_pages, unless no module is left
     if (zhash_size(known_modules) > 0)
-        zhash_update(known_modules, "all_pages", (void*)now);
+        touch_known_module(stream_info, "all_pages", now);
 
     zlist_destroy(&modules);
 }
@@ -632,27 +728,29 @@ static void stream_config_updater(zsock_t *pipe, void *args)
         printf("[I] stream-updater: terminated\n");
 }
 
+bool is_api_request(const char* module, stream_info_t *stream_info)
+{
+    if (stream_info->all_requests_are_api_requests)
+        return true;
+    // check whether app has no api requests at all
+    if (stream_info->api_requests_size == 0)
+        return false;
+    while (*module == ':') module++;
+    for (int i = 0; i < stream_info->api_requests_size; i++) {
+        if (streq(module, stream_info->api_requests[i]))
+            return true;
+    }
+    return false;
+}
+
 void adjust_caller_info(const char* path, const char* module, json_object *request, stream_info_t *stream_info)
 {
     // check whether we have a HTTP request
     if (path == NULL)
         return;
-    // check whether app has no api requests at all
-    if (!stream_info->all_requests_are_api_requests && stream_info->api_requests_size == 0)
-        return;
     // check whether we have an api request
-    while (*module == ':') module++;
-    bool api_request = stream_info->all_requests_are_api_requests;
-    if (!api_request) {
-        for (int i = 0; i < stream_info->api_requests_size; i++) {
-            if (streq(module, stream_info->api_requests[i])) {
-                api_request = true;
-                break;
-            }
-        }
-        if (!api_request)
-            return;
-    }
+    if (!is_api_request(module, stream_info))
+        return;
     // set caller_id if not present
     bool dump = false;
     json_object *caller_id_obj;
@@ -25,12 +25,9 @@ extern void stream_config_updater_destroy(zactor_t **updater);
 #define MAX_RANDOM_VALUE ((1L<<31) - 1)
 #define TEN_PERCENT_OF_MAX_RANDOM 214748364
 
-// request storage size soft limit is 15 GB, hard limit 30 GB, per app
-#define SOFT_LIMIT_STORAGE_SIZE 16106127360
-#define HARD_LIMIT_STORAGE_SIZE 32212254720
-
 extern bool setup_stream_config(const char* logjam_url, const char* pattern);
 extern void update_known_modules(stream_info_t *stream_info, zhash_t* module_hash);
+extern bool is_api_request(const char* module, stream_info_t *stream_info);
 extern void adjust_caller_info(const char* path, const char* module, json_object *request, stream_info_t *stream_info);
 extern bool throttle_request_for_stream(stream_info_t *stream_info);
 extern void indexer_ensure_indexes(stream_info_t *stream_info, const char* db_name, zsock_t* indexer_socket);
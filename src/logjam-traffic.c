@@ -0,0 +1,270 @@
+#include "logjam-traffic.h"
+
+void traffic_options_init(traffic_options_t *options, const char *thread_kind)
+{
+    memset(options, 0, sizeof(*options));
+    options->thread_kind = thread_kind;
+    options->socket_type = ZMQ_PUB;
+    options->num_threads = 1;
+    options->device_count = 1;
+}
+
+bool traffic_options_parse(traffic_options_t *options, int c, char *arg)
+{
+    switch (c) {
+    case 'P':
+        options->socket_type = ZMQ_PUSH;
+        break;
+    case 'd':
+        options->socket_type = ZMQ_DEALER;
+        break;
+    case 'i':
+        options->io_threads = atoi(arg);
+        break;
+    case 'p':
+        options->connection_spec = arg;
+        break;
+    case 's':
+        options->device_count = atoi(arg);
+        break;
+    case 't':
+        options->num_threads = atoi(arg);
+        if (options->num_threads > MAX_TRAFFIC_THREADS) {
+            options->num_threads = MAX_TRAFFIC_THREADS;
+            printf("[I] number of %ss reduced to %d\n", options->thread_kind, MAX_TRAFFIC_THREADS);
+        }
+        if (options->num_threads == 0)
+            options->num_threads = 1;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+void traffic_options_finalize(traffic_options_t *options)
+{
+    // every thread needs at least one device of its own
+    if (options->socket_type == ZMQ_PUB && options->device_count < options->num_threads) {
+        printf("[I] number of devices increased to %zu\n", options->num_threads);
+        options->device_count = options->num_threads;
+    }
+
+    if (options->io_threads == 0)
+        options->io_threads = options->num_threads;
+
+    options->sequence_numbers = zmalloc(options->device_count*sizeof(uint64_t));
+    options->device_numbers = zmalloc(options->device_count*sizeof(char*));
+    for (int i = 0; i < options->device_count; i++) {
+        int rc = asprintf(&options->device_numbers[i], "%d", i+1);
+        assert(rc != -1);
+    }
+
+    char *spec = options->connection_spec;
+    if (options->socket_type == ZMQ_PUB) {
+        if (spec == NULL)
+            spec = DEFAULT_CONNECTION_SPEC_PUB;
+        else
+            spec = augment_zmq_connection_spec(spec, DEFAULT_CONNECTION_PORT_PUB);
+    } else if (options->socket_type == ZMQ_PUSH) {
+        if (spec == NULL)
+            spec = DEFAULT_CONNECTION_SPEC_PUSH;
+        else
+            spec = augment_zmq_connection_spec(spec, DEFAULT_CONNECTION_PORT_PUSH);
+    } else {
+        if (spec == NULL)
+            spec = DEFAULT_CONNECTION_SPEC_DEALER;
+        else
+            spec = augment_zmq_connection_spec(spec, DEFAULT_CONNECTION_PORT_DEALER);
+    }
+    options->connection_spec = spec;
+}
+
+int traffic_thread_device_count(traffic_options_t *options, size_t id)
+{
+    if (options->socket_type != ZMQ_PUB)
+        return 1;
+    int owned = 0;
+    for (int d = id; d < options->device_count; d += options->num_threads)
+        owned++;
+    return owned;
+}
+
+int traffic_thread_device(traffic_options_t *options, size_t id, int owned_devices, size_t n)
+{
+    // only PUB sockets simulate devices, DEALER and PUSH sockets talk to a device
+    if (options->socket_type != ZMQ_PUB)
+        return 1;
+    return 1 + id + (n % owned_devices) * options->num_threads;
+}
+
+char* traffic_thread_connection_spec(traffic_options_t *options, size_t id)
+{
+    // PUB sockets can't share a port: additional threads bind to the following ports
+    const char *connection_spec = options->connection_spec;
+    if (options->socket_type != ZMQ_PUB || id == 0)
+        return strdup(connection_spec);
+    char *spec = NULL;
+    char *colon = strrchr(connection_spec, ':');
+    int rc;
+    if (colon && isdigit(colon[1]))
+        rc = asprintf(&spec, "%.*s:%d", (int)(colon - connection_spec), connection_spec, atoi(colon+1) + (int)id);
+    else
+        rc = asprintf(&spec, "%s-%zu", connection_spec, id);
+    assert(rc != -1);
+    return spec;
+}
+
+zsock_t* traffic_thread_socket_new(traffic_options_t *options, size_t id, const char *connection_spec, int sndhwm)
+{
+    const char *kind = options->thread_kind;
+    zsock_t *socket = zsock_new(options->socket_type);
+    assert_x(socket != NULL, "[E] zmq socket creation failed", __FILE__, __LINE__);
+    zsock_set_sndhwm(socket, sndhwm);
+    zsock_set_sndtimeo(socket, 100);
+
+    int rc;
+    if (options->socket_type == ZMQ_PUB) {
+        printf("[I] %s[%zu]: binding PUB socket to %s\n", kind, id, connection_spec);
+        rc = zsock_bind(socket, "%s", connection_spec);
+        assert_x(rc > 0, "pub socket bind failed", __FILE__, __LINE__);
+    } else if (options->socket_type == ZMQ_PUSH) {
+        printf("[I] %s[%zu]: connecting PUSH socket to %s\n", kind, id, connection_spec);
+        rc = zsock_connect(socket, "%s", connection_spec);
+        log_zmq_error(rc, __FILE__, __LINE__);
+        assert(rc != -1);
+    } else {
+        printf("[I] %s[%zu]: connecting DEALER socket to %s\n", kind, id, connection_spec);
+        rc = zsock_connect(socket, "%s", connection_spec);
+        log_zmq_error(rc, __FILE__, __LINE__);
+        assert(rc == 0);
+    }
+    return socket;
+}
+
+void traffic_pacer_reset(traffic_pacer_t *pacer, int messages_per_second, size_t num_threads)
+{
+    pacer->rate = messages_per_second > 0 ? (double)messages_per_second / num_threads / 1000000.0 : 0;
+    // allow bursts of one millisecond worth of messages, but at least one message
+    pacer->capacity = pacer->rate * 1000;
+    if (pacer->capacity < 1)
+        pacer->capacity = 1;
+    pacer->tokens = 0;
+    pacer->updated = zclock_usecs();
+}
+
+int64_t traffic_pacer_wait(traffic_pacer_t *pacer)
+{
+    if (pacer->rate == 0)
+        return 0;
+    int64_t start = 0;
+    while (!zsys_interrupted) {
+        int64_t now = zclock_usecs();
+        pacer->tokens += (now - pacer->updated) * pacer->rate;
+        pacer->updated = now;
+        if (pacer->tokens > pacer->capacity)
+            pacer->tokens = pacer->capacity;
+        if (pacer->tokens >= 1) {
+            pacer->tokens -= 1;
+            return start ? now - start : 0;
+        }
+        if (!start)
+            start = now;
+        int64_t wait = (1 - pacer->tokens) / pacer->rate;
+        // spin for very short waits, the scheduler can't deliver this precision
+        if (wait > 50)
+            usleep(wait - 20);
+    }
+    return 0;
+}
+
+bool traffic_thread_check_pipe(traffic_thread_t *thread, int timeout)
+{
+    if (thread->terminated)
+        return false;
+    if (zpoller_wait(thread->poller, timeout) == thread->pipe) {
+        char *cmd = zstr_recv(thread->pipe);
+        if (cmd) {
+            if (streq(cmd, "$TERM")) {
+                if (verbose)
+                    printf("[D] %s[%zu]: received $TERM command\n", thread->kind, thread->id);
+                thread->terminated = true;
+            } else {
+                printf("[E] %s[%zu]: received unknown command: %s\n", thread->kind, thread->id, cmd);
+                assert(false);
+            }
+            free(cmd);
+        }
+    }
+    return !thread->terminated && !zsys_interrupted;
+}
+
+void traffic_send_ping(zsock_t *socket, msg_meta_t *meta, const char* app_env, size_t app_env_len)
+{
+    zmsg_t *msg = zmsg_new();
+    zmsg_addstr(msg, "");
+    zmsg_addstr(msg, "ping");
+    if (random()&01)
+        zmsg_addstr(msg, "");
+    else
+        zmsg_addmem(msg, app_env, app_env_len);
+    zmsg_addstr(msg, "{}");
+    zmsg_add_meta_info(msg, meta);
+    zmsg_send_and_destroy(&msg, socket);
+    zmsg_t *reply = zmsg_recv(socket);
+    if (!zsys_interrupted)
+        assert(reply);
+    zmsg_destroy(&reply);
+}
+
+void traffic_zsys_init(traffic_options_t *options)
+{
+    zsys_init();
+    zsys_set_rcvhwm(10000);
+    zsys_set_sndhwm(100000);
+    zsys_set_pipehwm(1000);
+    zsys_set_linger(100);
+    zsys_set_io_threads(options->io_threads);
+}
+
+zsock_t* traffic_stats_socket_new(traffic_options_t *options)
+{
+    if (options->socket_type != ZMQ_PUB)
+        return NULL;
+
+    zsock_t *stats_socket = zsock_new(ZMQ_PUB);
+    assert_x(stats_socket != NULL, "stats socket creation failed", __FILE__, __LINE__);
+    zsock_set_sndhwm(stats_socket, 1000);
+
+    int rc = zsock_bind(stats_socket, "tcp://%s:%d", "*", TRAFFIC_STATS_PORT);
+    assert_x(rc == TRAFFIC_STATS_PORT, "stats socket bind failed", __FILE__, __LINE__);
+    return stats_socket;
+}
+
+void traffic_publish_device_stats(traffic_options_t *options, zsock_t *stats_socket)
+{
+    if (stats_socket == NULL)
+        return;
+    for (int i = 0; i < options->device_count; i++) {
+        zmsg_t *msg = zmsg_new();
+        zmsg_addstr(msg, "stats");
+        zmsg_addstr(msg, options->device_numbers[i]);
+        zmsg_addstrf(msg, "%" PRIu64, __atomic_load_n(&options->sequence_numbers[i], __ATOMIC_RELAXED));
+        zmsg_send_with_retry(&msg, stats_socket);
+    }
+}
+
+void traffic_run_main_loop(zloop_t *loop)
+{
+    if (zsys_interrupted)
+        return;
+    if (verbose) printf("[I] starting main event loop\n");
+    bool should_continue_to_run = getenv("CPUPROFILE") != NULL;
+    int rc;
+    do {
+        rc = zloop_start(loop);
+        should_continue_to_run &= errno == EINTR && !zsys_interrupted;
+        log_zmq_error(rc, __FILE__, __LINE__);
+    } while (should_continue_to_run);
+    if (verbose) printf("[I] main event loop terminated with return code %d\n", rc);
+}
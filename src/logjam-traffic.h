@@ -0,0 +1,104 @@
+#ifndef __LOGJAM_TRAFFIC_H_INCLUDED__
+#define __LOGJAM_TRAFFIC_H_INCLUDED__
+
+#include "logjam-util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Code shared by logjam-replay and logjam-generator. Both send logjam messages from several
+// threads, each owning its own socket and pacing itself with its own token bucket. Device
+// numbers are partitioned among the threads, so sequence numbers never need to be shared
+// between threads. In PUB mode, thread i binds to the given port + i.
+
+#define DEFAULT_CONNECTION_PORT_PUB 9606
+#define DEFAULT_CONNECTION_SPEC_PUB "tcp://*:9606"
+#define DEFAULT_CONNECTION_PORT_DEALER 9604
+#define DEFAULT_CONNECTION_SPEC_DEALER "tcp://localhost:9604"
+#define DEFAULT_CONNECTION_PORT_PUSH 9605
+#define DEFAULT_CONNECTION_SPEC_PUSH "tcp://localhost:9605"
+
+#define TRAFFIC_STATS_PORT 9621
+#define MAX_TRAFFIC_THREADS 64
+
+typedef struct {
+    const char *thread_kind;        // "sender" or "generator", used in log messages
+    int socket_type;                // ZMQ_PUB, ZMQ_PUSH or ZMQ_DEALER
+    char *connection_spec;
+    size_t io_threads;              // defaults to the number of threads
+    size_t num_threads;
+    int device_count;
+    char **device_numbers;          // device numbers as strings, for the stats socket
+    uint64_t *sequence_numbers;     // last sequence number sent, per device
+} traffic_options_t;
+
+extern void traffic_options_init(traffic_options_t *options, const char *thread_kind);
+
+// handles the command line options common to both tools (-P, -d, -i, -p, -s, -t).
+// returns false if the option is not one of them.
+extern bool traffic_options_parse(traffic_options_t *options, int c, char *arg);
+
+// called once all options have been parsed: applies defaults and allocates device state
+extern void traffic_options_finalize(traffic_options_t *options);
+
+// number of devices owned by the given thread: id+1, id+1+num_threads, ...
+extern int traffic_thread_device_count(traffic_options_t *options, size_t id);
+
+// the device for the n-th message sent by the given thread
+extern int traffic_thread_device(traffic_options_t *options, size_t id, int owned_devices, size_t n);
+
+static inline uint64_t traffic_next_sequence_number(traffic_options_t *options, int device)
+{
+    return __atomic_add_fetch(&options->sequence_numbers[device-1], 1, __ATOMIC_RELAXED);
+}
+
+// connection spec of the given thread, must be freed by the caller
+extern char* traffic_thread_connection_spec(traffic_options_t *options, size_t id);
+
+extern zsock_t* traffic_thread_socket_new(traffic_options_t *options, size_t id, const char *connection_spec, int sndhwm);
+
+// token bucket: tokens are measured in messages, time in microseconds
+typedef struct {
+    double rate;
+    double capacity;
+    double tokens;
+    int64_t updated;
+} traffic_pacer_t;
+
+extern void traffic_pacer_reset(traffic_pacer_t *pacer, int messages_per_second, size_t num_threads);
+
+// blocks until the token bucket permits sending the next message.
+// returns the number of microseconds spent waiting.
+extern int64_t traffic_pacer_wait(traffic_pacer_t *pacer);
+
+typedef struct {
+    const char *kind;
+    size_t id;
+    zsock_t *pipe;
+    zpoller_t *poller;
+    bool terminated;
+} traffic_thread_t;
+
+// returns false if the thread has been asked to terminate
+extern bool traffic_thread_check_pipe(traffic_thread_t *thread, int timeout);
+
+// DEALER sockets need to send a ping once in a while
+extern void traffic_send_ping(zsock_t *socket, msg_meta_t *meta, const char* app_env, size_t app_env_len);
+
+extern void traffic_zsys_init(traffic_options_t *options);
+
+// returns NULL unless sending on PUB sockets
+extern zsock_t* traffic_stats_socket_new(traffic_options_t *options);
+
+// publishes the last sequence number of every device on the stats socket
+extern void traffic_publish_device_stats(traffic_options_t *options, zsock_t *stats_socket);
+
+// runs the main loop until a handler terminates it
+extern void traffic_run_main_loop(zloop_t *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
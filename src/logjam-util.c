@@ -1056,7 +1056,167 @@ char* replace_keywords(const char *str, zlist_t *keywords, zchunk_t *buffer) {
     return output;
 }
 
-void filter_sensitive_cookies(json_object *request, zlist_t *keywords, zchunk_t *buffer) {
+// Aho-Corasick automaton over the patterns "<cookie>=". All patterns end with '=' and
+// cookie names don't contain '=', so all matches overlapping a given position end at the
+// same '='. Taking the longest match at each '=' therefore yields the leftmost match,
+// which is what replace_keywords produces, without comparing every keyword at every
+// position of the cookie header.
+struct _cookie_masker_t {
+    int num_states;
+    int num_classes;
+    uint8_t classes[256];   // maps bytes to character classes. 0: byte not used by any pattern
+    int *transitions;       // num_states * num_classes entries
+    size_t *match_len;      // length of the longest pattern ending in a state, 0 if none
+};
+
+cookie_masker_t* cookie_masker_new(zlist_t *cookie_names)
+{
+    cookie_masker_t *masker = zmalloc(sizeof(*masker));
+
+    size_t max_states = 1;
+    masker->num_classes = 1;
+    const char *name = cookie_names ? zlist_first(cookie_names) : NULL;
+    while (name) {
+        size_t n = strlen(name);
+        max_states += n + 1;
+        for (size_t i = 0; i <= n; i++) {
+            uint8_t c = i < n ? name[i] : '=';
+            if (masker->classes[c] == 0)
+                masker->classes[c] = masker->num_classes++;
+        }
+        name = zlist_next(cookie_names);
+    }
+
+    const int k = masker->num_classes;
+    masker->transitions = zmalloc(max_states * k * sizeof(int));
+    masker->match_len = zmalloc(max_states * sizeof(size_t));
+    for (size_t i = 0; i < max_states * k; i++)
+        masker->transitions[i] = -1;
+    masker->num_states = 1;
+
+    // build the trie
+    name = cookie_names ? zlist_first(cookie_names) : NULL;
+    while (name) {
+        size_t n = strlen(name);
+        if (n > 0) {
+            int state = 0;
+            for (size_t i = 0; i <= n; i++) {
+                int c = masker->classes[(uint8_t)(i < n ? name[i] : '=')];
+                int *next = &masker->transitions[state * k + c];
+                if (*next < 0)
+                    *next = masker->num_states++;
+                state = *next;
+            }
+            masker->match_len[state] = n + 1;
+        }
+        name = zlist_next(cookie_names);
+    }
+
+    // turn it into a DFA: compute failure links breadth first and replace missing
+    // transitions by the transitions of the failure state
+    int *fail = zmalloc(masker->num_states * sizeof(int));
+    int *queue = zmalloc(masker->num_states * sizeof(int));
+    int head = 0, tail = 0;
+    for (int c = 0; c < k; c++) {
+        int *next = &masker->transitions[c];
+        if (*next < 0) {
+            *next = 0;
+        } else {
+            fail[*next] = 0;
+            queue[tail++] = *next;
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        if (masker->match_len[state] == 0)
+            masker->match_len[state] = masker->match_len[fail[state]];
+        for (int c = 0; c < k; c++) {
+            int *next = &masker->transitions[state * k + c];
+            int fallback = masker->transitions[fail[state] * k + c];
+            if (*next < 0) {
+                *next = fallback;
+            } else {
+                fail[*next] = fallback;
+                queue[tail++] = *next;
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+
+    return masker;
+}
+
+void cookie_masker_destroy(cookie_masker_t **masker_p)
+{
+    cookie_masker_t *masker = *masker_p;
+    if (masker == NULL)
+        return;
+    free(masker->transitions);
+    free(masker->match_len);
+    free(masker);
+    *masker_p = NULL;
+}
+
+bool cookie_masker_empty(cookie_masker_t *masker)
+{
+    return masker->num_states == 1;
+}
+
+static inline bool cookie_value_end(char c)
+{
+    return c == '\0' || c == ';' || isspace((unsigned char)c);
+}
+
+char* cookie_masker_apply(cookie_masker_t *masker, const char *str, size_t len, zchunk_t *buffer, size_t *result_len)
+{
+    static const char filtered[] = "[FILTERED]";
+    const int k = masker->num_classes;
+    const int *transitions = masker->transitions;
+    const uint8_t *classes = masker->classes;
+    char *output = NULL;
+    char *out_ptr = NULL;
+    size_t copied = 0;
+    int state = 0;
+
+    if (masker->num_states == 1)
+        return NULL;
+
+    for (size_t i = 0; i < len && str[i] != '\0'; i++) {
+        state = transitions[state * k + classes[(uint8_t)str[i]]];
+        size_t match_len = masker->match_len[state];
+        if (match_len == 0)
+            continue;
+        if (output == NULL) {
+            // every match consists of at least two bytes, so the output can't grow
+            // by more than five times the input length
+            zchunk_ensure_size(buffer, 6 * len + 1);
+            out_ptr = output = (char*)zchunk_data(buffer);
+        }
+        // copy everything up to and including the '='
+        memcpy(out_ptr, str + copied, i + 1 - copied);
+        out_ptr += i + 1 - copied;
+        memcpy(out_ptr, filtered, sizeof(filtered) - 1);
+        out_ptr += sizeof(filtered) - 1;
+        // skip the value
+        while (i + 1 < len && !cookie_value_end(str[i + 1]))
+            i++;
+        copied = i + 1;
+        state = 0;
+    }
+    if (output == NULL)
+        return NULL;
+
+    size_t rest = strnlen(str + copied, len - copied);
+    memcpy(out_ptr, str + copied, rest);
+    out_ptr += rest;
+    *out_ptr = '\0';
+    if (result_len)
+        *result_len = out_ptr - output;
+    return output;
+}
+
+void filter_sensitive_cookies(json_object *request, cookie_masker_t *masker, zchunk_t *buffer) {
     json_object *request_info;
     if (!json_object_object_get_ex(request, "request_info", &request_info))
         return;
@@ -1080,10 +1240,11 @@ void filter_sensitive_cookies(json_object *request, zlist_t *keywords, zchunk_t
         return;
 
     const char* cookie_str = json_object_get_string(value);
-    char *new_str = replace_keywords(cookie_str, keywords, buffer);
+    size_t new_len;
+    char *new_str = cookie_masker_apply(masker, cookie_str, json_object_get_string_len(value), buffer, &new_len);
 
     if (new_str) {
-        json_object_object_add(headers, key, json_object_new_string(new_str));
+        json_object_object_add(headers, key, json_object_new_string_len(new_str, new_len));
     }
 }
 
@@ -1294,6 +1455,69 @@ void test_keyword_replacement (int verbose) {
     zchunk_destroy(&buffer);
 }
 
+void test_cookie_masker (int verbose) {
+    zlist_t *keywords = zlist_new();
+    zchunk_t *buffer = zchunk_new(NULL, 1024);
+    zchunk_t *reference_buffer = zchunk_new(NULL, 1024);
+
+    cookie_masker_t *masker = cookie_masker_new(keywords);
+    assert(cookie_masker_empty(masker));
+    assert(cookie_masker_apply(masker, "foo=bar", 7, buffer, NULL) == NULL);
+    cookie_masker_destroy(&masker);
+
+    zlist_append(keywords, "foo");
+    zlist_append(keywords, "baz");
+    zlist_append(keywords, "_session");
+    zlist_append(keywords, "_shop_session");
+    masker = cookie_masker_new(keywords);
+    assert(!cookie_masker_empty(masker));
+
+    // the masker must produce the same results as replace_keywords
+    const char *data[] = {
+        "foo=bar",
+        "foo=123456789123456789",
+        "foo=123; ",
+        "foo=123; fum=larifari",
+        "fum=larifari; foo=123",
+        "foo=123; baz=456",
+        "fo=1; fooo=2; bazfoo=3",
+        "a=foo=1;baz=2 foo=3\tbar=4",
+        "_shop_session=abc; _session=def; shop_session=ghi",
+        "fum=larifari",
+        "foo",
+        "foo=",
+        "",
+        NULL
+    };
+    for (const char **p = data; *p; p++) {
+        size_t len = strlen(*p);
+        size_t result_len = 0;
+        char *result = cookie_masker_apply(masker, *p, len, buffer, &result_len);
+        char *expected = replace_keywords(*p, keywords, reference_buffer);
+        if (verbose)
+            printf("%s --> %s\n", *p, result ? result : "(unchanged)");
+        if (expected == NULL) {
+            assert(result == NULL);
+        } else {
+            assert(result != NULL);
+            assert(streq(result, expected));
+            assert(result_len == strlen(expected));
+        }
+    }
+
+    // input doesn't need to be null terminated
+    size_t result_len = 0;
+    char *result = cookie_masker_apply(masker, "baz=1; foo=2", 5, buffer, &result_len);
+    assert(streq(result, "baz=[FILTERED]"));
+    assert(result_len == 14);
+
+    cookie_masker_destroy(&masker);
+    assert(masker == NULL);
+    zlist_destroy(&keywords);
+    zchunk_destroy(&buffer);
+    zchunk_destroy(&reference_buffer);
+}
+
 void logjam_util_test (int verbose)
 {
     printf (" * logjam-utils: ");
@@ -1311,6 +1535,7 @@ void logjam_util_test (int verbose)
     test_extract_app_env_rid (verbose);
     test_compression_decompression (verbose);
     test_keyword_replacement (verbose);
+    test_cookie_masker (verbose);
 
     printf ("OK\n");
 }
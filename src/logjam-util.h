@@ -249,7 +249,19 @@ extern void ensure_chunk_can_take(zchunk_t* buffer, size_t data_size);
 extern void append_line(zchunk_t* buffer, const char* format, ...);
 extern void append_null_byte(zchunk_t* buffer);
 
-extern void filter_sensitive_cookies(json_object *request, zlist_t *keywords, zchunk_t *buffer);
+// replaces the values of sensitive cookies in cookie headers by [FILTERED], matching all
+// cookie names in a single pass over the header.
+typedef struct _cookie_masker_t cookie_masker_t;
+
+extern cookie_masker_t* cookie_masker_new(zlist_t *cookie_names);
+extern void cookie_masker_destroy(cookie_masker_t **masker_p);
+// true if there are no cookies to mask
+extern bool cookie_masker_empty(cookie_masker_t *masker);
+// returns NULL if no cookie was masked. otherwise returns the masked header, which is
+// stored in the given buffer, and its length in result_len (if not NULL).
+extern char* cookie_masker_apply(cookie_masker_t *masker, const char *str, size_t len, zchunk_t *buffer, size_t *result_len);
+
+extern void filter_sensitive_cookies(json_object *request, cookie_masker_t *masker, zchunk_t *buffer);
 extern char* replace_keywords(const char *str, zlist_t *keywords, zchunk_t *buffer);
 
 #ifdef __cplusplus
@@ -42,9 +42,21 @@ void sb_append(str_builder *sb, const char* str, size_t length)
     }
     assert (new_pos < sb->size);
     memcpy (sb->str + sb->pos, str, length);
+    sb->str[new_pos] = '\0';
     sb->pos = new_pos;
 }
 
+size_t sb_length(str_builder *sb)
+{
+    return sb->pos;
+}
+
+void sb_reset(str_builder *sb)
+{
+    sb->pos = 0;
+    sb->str[0] = '\0';
+}
+
 void sb_destroy(str_builder **sb)
 {
     free ((*sb)->str);
@@ -9,6 +9,10 @@ char *sb_string(str_builder *sb);
 
 void sb_append(str_builder *sb, const char* str, size_t length);
 
+size_t sb_length(str_builder *sb);
+
+void sb_reset(str_builder *sb);
+
 void sb_destroy(str_builder **sb);
 
 #endif
@@ -5,9 +5,10 @@ typedef struct {
     zsock_t* pipe;
     zsock_t* pull_socket;
     zsock_t* pub_socket;
-    zhashx_t *unknown_streams;
-    zhashx_t *missing_actions;
+    zhashx_t *unknown_streams;          // stream -> messages counted by the parsers
+    zhashx_t *missing_actions;          // stream -> requests without action counted by the parsers
     size_t message_count;
+    size_t forwarded_count;
     size_t message_drops;
     zchunk_t *decompression_buffer;
 } unknown_streams_collector_state_t;
@@ -71,44 +72,41 @@ zsock_t* unknown_streams_collector_client_socket_new(zconfig_t* config)
     return socket;
 }
 
+// formats "stream(count),..." into the given buffer, truncating the list if necessary
+static
+void format_stream_counts(zhashx_t *counts, char *buffer, size_t size)
+{
+    size_t len = 0;
+    buffer[0] = '\0';
+    void* elem = zhashx_first(counts);
+    while (elem && len < size) {
+        const char *stream = zhashx_cursor(counts);
+        int n = snprintf(buffer + len, size - len, "%s%s(%zu)", len > 0 ? "," : "", stream, (size_t)elem);
+        if (n < 0)
+            break;
+        len += n;
+        elem = zhashx_next(counts);
+    }
+}
+
 static
 void log_unknown_streams(unknown_streams_collector_state_t* state) {
-    void* elem = zhashx_first(state->unknown_streams);
-    if (elem == NULL)
+    if (zhashx_size(state->unknown_streams) == 0)
         return;
-    int size = 0;
-    char streams[1024] = {'\0'};
-    while (elem) {
-        const char *stream = zhashx_cursor(state->unknown_streams);
-        if (size > 0) {
-            strcat(streams, ",");
-        }
-        size += strlen(stream);
-        strcat(streams, stream);
-        elem = zhashx_next(state->unknown_streams);
-    }
+    char streams[1024];
+    format_stream_counts(state->unknown_streams, streams, sizeof(streams));
     fprintf(stderr,
             "[W] unknown_streams_collector: unknown streams: %s\n"
-            "[W] unknown_streams_collector: %5zu messages\n",
-            streams, state->message_count);
+            "[W] unknown_streams_collector: %5zu messages (%zu published)\n",
+            streams, state->message_count, state->forwarded_count);
 }
 
 static
 void log_streams_with_missing_actions(unknown_streams_collector_state_t* state) {
-    void* elem = zhashx_first(state->missing_actions);
-    if (elem == NULL)
+    if (zhashx_size(state->missing_actions) == 0)
         return;
-    int size = 0;
-    char streams[1024] = {'\0'};
-    while (elem) {
-        const char *stream = zhashx_cursor(state->missing_actions);
-        if (size > 0) {
-            strcat(streams, ",");
-        }
-        size += strlen(stream);
-        strcat(streams, stream);
-        elem = zhashx_next(state->missing_actions);
-    }
+    char streams[1024];
+    format_stream_counts(state->missing_actions, streams, sizeof(streams));
     fprintf(stderr, "[W] unknown_streams_collector: streams with missing actions: %s\n", streams);
 }
 
@@ -124,6 +122,7 @@ static int timer_event(zloop_t *loop, int timer_id, void *arg)
     assert(state->unknown_streams);
     assert(state->missing_actions);
     state->message_count = 0;
+    state->forwarded_count = 0;
     state->message_drops = 0;
     return 0;
 }
@@ -150,6 +149,27 @@ int actor_command(zloop_t *loop, zsock_t *socket, void *callback_data)
     return rc;
 }
 
+// parsers send counts of messages for unknown streams and requests without actions on
+// every tick: "counts", "stream"|"action", followed by stream name and count pairs
+static
+void add_stream_counts(unknown_streams_collector_state_t *state, zmsg_t *msg)
+{
+    char *kind = zmsg_popstr(msg);
+    zhashx_t *counts = streq(kind, "stream") ? state->unknown_streams : state->missing_actions;
+    char *stream;
+    while ( (stream = zmsg_popstr(msg)) ) {
+        char *count_str = zmsg_popstr(msg);
+        size_t count = count_str ? strtoul(count_str, NULL, 10) : 0;
+        size_t n = (size_t)zhashx_lookup(counts, stream);
+        zhashx_update(counts, stream, (void*)(n + count));
+        if (counts == state->unknown_streams)
+            state->message_count += count;
+        free(stream);
+        free(count_str);
+    }
+    free(kind);
+}
+
 static
 int read_msg_and_forward(zloop_t *loop, zsock_t *socket, void *callback_data)
 {
@@ -158,20 +178,23 @@ int read_msg_and_forward(zloop_t *loop, zsock_t *socket, void *callback_data)
     if (msg) {
         char *reason = zmsg_popstr(msg);
 
+        if (streq(reason, "counts")) {
+            add_stream_counts(state, msg);
+            free(reason);
+            zmsg_destroy(&msg);
+            return 0;
+        }
+
         zframe_t *stream_frame = zmsg_first(msg);
         char* stream_name = zframe_strdup(stream_frame);
 
         switch (*reason) {
-        case 'a':
-            zhashx_insert(state->missing_actions, stream_name, (void*)1);
-            break;
         case 's':
-            zhashx_insert(state->unknown_streams, stream_name, (void*)1);
-
+            // a sample of the messages counted by the parsers
             // fprintf(stderr, "[E] unknown_streams_collector: received message for unknown stream: %s\n", stream_name);
             // dump_message_payload(msg, stderr, state->decompression_buffer);
 
-            state->message_count++;
+            state->forwarded_count++;
             zmsg_set_device_and_sequence_number(msg, 0, 0);
 
             int rc = zmsg_send_and_destroy(&msg, state->pub_socket);